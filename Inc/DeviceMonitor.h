@@ -0,0 +1,60 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DEVICEMONITOR_H
+#define DEVICEMONITOR_H
+
+#include <iostream>
+#include <mutex>
+#include <condition_variable>
+#include "DisplayManager.h"
+#include "Error.h"
+
+/* Period of the device list refresh when hotplug events are not available */
+constexpr int STATION_POLL_INTERVAL_MS = 500 ;
+
+/* Size of the netlink receive buffer, uevents are a few hundred bytes */
+constexpr size_t UEVENT_BUFFER_SZ = 8 * 1024 ;
+
+/**
+ * Wait for USB devices to be plugged or unplugged.
+ * Linux listens to the udev (or kernel) uevents over netlink, other platforms fall back to a periodic wake up.
+ */
+class DeviceMonitor
+{
+public:
+    DeviceMonitor();
+    ~DeviceMonitor();
+    int open() ;
+    void close() ;
+    bool isEventDriven() const { return socketFd >= 0; }
+    void waitForEvent() ;
+    void wakeUp() ;
+
+private:
+    bool isUsbEvent(const char *message, size_t length) ;
+
+    DisplayManager displayManager = DisplayManager::getInstance() ;
+    int socketFd = -1 ;
+    int wakeUpPipe[2] = {-1, -1} ;
+    std::mutex wakeUpMutex ;
+    std::condition_variable wakeUpCondition ;
+    bool wakeUpPending = false ;
+};
+
+#endif // DEVICEMONITOR_H
@@ -21,6 +21,8 @@
 
 #include <stdarg.h>
 #include <iostream>
+#include <cstddef>
+#include "Error.h"
 
 /* Colors macros for console*/
 #define BLACK 0
@@ -41,6 +43,12 @@
 #define WHITE 15
 #define BLINK 128
 
+/* Messages waiting for the writer thread (power of two), a thread printing waits while the queue is full */
+constexpr size_t DISPLAY_QUEUE_SZ = 4096 ;
+
+/* Longest formatted message, in characters */
+constexpr size_t DISPLAY_MESSAGE_MAX_SZ = 30 * 1024 ;
+
 enum messageType
 {
     MSG_NORMAL,
@@ -49,15 +57,23 @@ enum messageType
     MSG_ERROR,
 };
 
+/**
+ * Console output of the toolbox.
+ * Messages are formatted by the calling thread into a reusable buffer and queued without lock; a writer thread
+ * prints them in batches, so that the flashing sessions never wait for the console. The queue keeps the order
+ * of the print() calls. The messages can also be appended to a JSON Lines log, whatever the console level.
+ */
 class DisplayManager
 {
 public:
     static DisplayManager& getInstance() ;
     void print(messageType messageType, const wchar_t* message, ...);
+    static void setDeviceTag(const std::string &tag) ;
+    static void setLevel(messageType minimumType) ;
+    static int setJsonLog(const std::string &logPath) ;
 
 private:
     DisplayManager();
-    void displayMessage(messageType type, const wchar_t* str) ;
 };
 
 #endif // DISPLAYMANAGER_H
@@ -56,6 +56,9 @@ enum ToolboxError {
     /** File format not supported for this kind of device */
     TOOLBOX_FASTBOOT_ERROR_UNSUPPORTED_FILE_FORMAT = -11,
 
+    /** Device or fastboot tool not answering in time */
+    TOOLBOX_FASTBOOT_ERROR_TIMEOUT = -12,
+
     /** Other error */
     TOOLBOX_FASTBOOT_ERROR_OTHER = -99,
 };
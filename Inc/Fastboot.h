@@ -20,27 +20,119 @@
 #define FASTBOOT_H
 
 #include <iostream>
+#include <vector>
+#include <functional>
+#include <map>
 #include "DisplayManager.h"
 #include "Error.h"
+#include "FastbootTransport.h"
+#include "FastbootProtocol.h"
+#include "FastbootOutputParser.h"
+#include "SparseImage.h"
+#include "FlashPipeline.h"
+#include "TraceRecorder.h"
 #include <cstdint>
 
+/* Size of the file reads feeding a native download */
+constexpr size_t NATIVE_DOWNLOAD_CHUNK_SZ = 1024 * 1024 ;
+
+enum stepType
+{
+    STEP_FLASH,
+    STEP_ERASE,
+    STEP_OEM_BOOTBUS,
+    STEP_OEM_PARTCONF,
+};
+
+/* Measured execution of one step of a flashing sequence */
+struct stepTimings
+{
+    uint64_t sentBytes = 0; // Bytes downloaded to the device, after the sparse conversion
+    double transferSeconds = 0; // Downloads
+    double writeSeconds = 0; // Device commands: flash, erase or OEM
+    double totalSeconds = 0;
+};
+
+/* One device operation of a flashing sequence */
+struct fastbootStep
+{
+    stepType type;
+    std::string partName;
+    std::string binary;
+    uint16_t values[3];
+    int result;
+};
+
+/* Bootloader variables of the device, read once per session and served to every later query */
+struct deviceInfo
+{
+    std::map<std::string, std::string> variablesList;
+    bool loaded = false;
+    bool complete = false; // Read with "getvar all": a variable not listed does not exist
+};
+
 class Fastboot
 {
 public:
     Fastboot();
+    ~Fastboot();
     int flashPartition(const std::string partitionName, const std::string partitionFirmwarePath) ;
     int erasePartition(const std::string partitionName);
     int oemFormatMemory() ;
+    int getPartitionSizes(const std::vector<std::string> &partNames, std::map<std::string, uint64_t> &sizesList) ;
+    int getVariable(const std::string &name, std::string &value) ;
     bool isUbootFastbootRunning() ;
     int displayDevicesList() ;
+    int listDevices(std::vector<std::string> &serialNumbers) ;
     int oemBootbus(uint16_t width, uint16_t reset, uint16_t mode);
     int oemPartconf(uint16_t bootAck, uint16_t activeEmmcBootPartition);
+    int executeSteps(std::vector<fastbootStep> &stepsList) ;
+    const std::vector<stepTimings>& getStepsTimings() const { return stepsTimingsList; }
+    uint32_t getMaxDownloadSize() const { return maxDownloadSize; }
+    std::string getBootloaderVersion() const { return bootloaderVersion; }
     std::string toolboxFolder = "" ;
     std::string fastbootSerialNumber = "" ;
+    std::string transportSpec = "" ;
+    sparseMode sparse = SPARSE_OFF ;
+    uint64_t pipelineMemory = static_cast<uint64_t>(PIPELINE_DEFAULT_MEMORY_MB) * 1024 * 1024 ; // Buffers filled ahead of the transfer
+    commandTimeouts timeouts ; // Set before the session is opened
+    std::function<void(size_t stepIndex)> onStepCompleted ; // Called by executeSteps() as soon as a step succeeds
 
 private:
     DisplayManager displayManager = DisplayManager::getInstance() ;
-    std::string getFastbootProgramPath() ;
+    const std::string& getFastbootProgramPath() ;
+    int openSession() ;
+    void closeSession() ;
+    void readDeviceInfo() ;
+    int flashPartition(const std::string &partitionName, const std::string &partitionFirmwarePath, FlashPipeline *pipeline, size_t stepIndex, pipelineTimings &timings) ;
+    int planFlash(const std::string &partitionName, const std::string &partitionFirmwarePath, uint32_t downloadLimit, preparedFlash &prepared) ;
+    int nativeFlashPartition(const std::string &partitionName, FlashPipeline &pipeline, size_t stepIndex, pipelineTimings &timings) ;
+    int nativeDownloadAndFlash(const std::string &partitionName, const std::string &sendingLabel, uint64_t downloadSize, const std::function<int(bool &readFailed)> &sendPayload, pipelineTimings &timings) ;
+    void printPipelineTimings(const FlashPipeline &pipeline, const std::vector<pipelineTimings> &timingsList) ;
+    int nativeCommand(const std::string &cmd, const std::string &label) ;
+    void printStatus(const std::string &label, int ret, double seconds) ;
+    int executeStep(fastbootStep &step) ;
+    int executeBatch(std::vector<fastbootStep> &stepsList, size_t first, size_t last) ;
+    void attributeBatchEvent(const outputEvent &event, std::vector<fastbootStep> &stepsList, size_t last, size_t &cursor) ;
+    int runFastbootTool(const std::vector<std::string> &arguments, FastbootOutputParser &parser, bool selectDevice = true) ;
+    uint32_t getToolTimeout(const std::vector<std::string> &arguments) ;
+    int abandonSession(int ret) ;
+    void printOutputEvent(const outputEvent &event) ;
+    void reportStep(const fastbootStep &step) ;
+    bool convertToSparse(const std::string &partitionName, SparseImage &image, std::string &report) ;
+    std::string prepareToolImage(const std::string &partitionName, const std::string &binary) ;
+    void removeTemporaryFiles() ;
+
+    FastbootTransport *transport = nullptr ;
+    FastbootProtocol *protocol = nullptr ;
+    bool useTool = false ; /* The native session could not be opened, the bundled fastboot tool runs every command */
+    uint32_t maxDownloadSize = 0 ;
+    std::string bootloaderVersion = "" ;
+    deviceInfo deviceVariables ; /* Cleared when "oem format" changes the partitions */
+    std::vector<stepTimings> stepsTimingsList ; /* Steps of the last sequence, in the same order */
+    std::string fastbootProgramPath = "" ;
+    bool fastbootProgramResolved = false ;
+    std::vector<std::string> temporaryFiles ;
 };
 
 #endif // FASTBOOT_H
@@ -0,0 +1,117 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FASTBOOTEMULATOR_H
+#define FASTBOOTEMULATOR_H
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <map>
+#include <chrono>
+#include <cstdint>
+#include "DisplayManager.h"
+#include "Error.h"
+
+/* Default emulated device: STM32MP U-Boot with a 128 MB download buffer */
+constexpr uint32_t EMULATOR_MAX_DOWNLOAD_SIZE = 0x08000000 ;
+constexpr uint64_t EMULATOR_BOOT_PARTITION_SIZE = 4 * 1024 * 1024 ;
+
+struct emulatedPartition
+{
+    std::string name = "";
+    uint64_t size = 0;
+    std::string type = "raw";
+    uint64_t written = 0;
+    uint32_t flashCount = 0;
+};
+
+/* Android sparse image parsed on the fly while the download payload is received */
+struct sparseStreamState
+{
+    std::string pending = ""; // Header bytes received so far
+    bool headerParsed = false;
+    bool isSparse = false;
+    bool invalid = false;
+    uint32_t blockSize = 0;
+    uint32_t chunkHeaderSize = 0;
+    uint32_t totalBlocks = 0;
+    uint32_t blocksSeen = 0;
+    uint64_t payloadRemaining = 0; // Bytes to skip before the next chunk header
+    uint64_t writtenSize = 0; // Bytes the RAW and FILL chunks write into the memory
+};
+
+struct emulatorConfig
+{
+    std::string serialNumber = "EMULATOR";
+    std::string product = "STM32MP";
+    std::string version = "0.4";
+    uint32_t maxDownloadSize = EMULATOR_MAX_DOWNLOAD_SIZE;
+    std::vector<emulatedPartition> partitionsList; // GPT created by "oem format", empty to accept any name
+    std::map<std::string, std::string> variablesList; // Extra getvar variables
+    std::vector<std::string> failList; // Command prefixes answered with FAIL
+    std::vector<std::string> hangList; // Command prefixes never answered, as a wedged board
+    bool formatted = false; // GPT already present at power-on
+    double linkSpeed = 0; // MB/s, 0 for an instant link
+    double writeSpeed = 0; // MB/s, 0 for an instant memory
+    double eraseSpeed = 0; // MB/s, 0 for an instant erase
+    uint32_t commandLatency = 0; // ms added to every command
+    uint32_t formatTime = 0; // ms spent by "oem format"
+};
+
+/**
+ * Simulated STM32MP U-Boot fastboot device.
+ * The host packets are given to receive(), the device packets are collected with nextResponse().
+ * Images are not stored: only their size is checked against the partition table and accounted.
+ */
+class FastbootEmulator
+{
+public:
+    FastbootEmulator();
+    int loadConfig(const std::string &configPath) ;
+    void reset() ;
+    int receive(const uint8_t* data, size_t length) ;
+    bool nextResponse(std::string &packet) ;
+    std::string getSerialNumber() const { return config.serialNumber; }
+    int serveTcp(uint16_t port, uint32_t sessionsNbr) ;
+
+private:
+    void handleCommand(const std::string &cmd) ;
+    void handleGetVar(const std::string &name) ;
+    void handleFlash(const std::string &partitionName) ;
+    void handleErase(const std::string &partitionName) ;
+    void handleOem(const std::string &oemCommand, const std::string &parameters) ;
+    void createPartitionTable(bool withGpt) ;
+    emulatedPartition* findPartition(const std::string &partitionName) ;
+    void parseSparseData(const uint8_t* data, size_t length) ;
+    void simulateDuration(uint64_t bytes, double speed, uint32_t extraMs) ;
+    int serveSession(intptr_t clientFd) ;
+
+    DisplayManager displayManager = DisplayManager::getInstance() ;
+    emulatorConfig config ;
+    std::vector<emulatedPartition> partitionsList ;
+    std::deque<std::string> responsesList ;
+    uint32_t downloadSize = 0 ;
+    uint32_t downloadRemaining = 0 ;
+    std::chrono::steady_clock::time_point downloadStart ;
+    sparseStreamState sparseStream ;
+    uint16_t bootBus[3] = {0, 0, 0} ;
+    uint16_t partConf[2] = {0, 0} ;
+};
+
+#endif // FASTBOOTEMULATOR_H
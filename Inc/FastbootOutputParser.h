@@ -0,0 +1,94 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FASTBOOTOUTPUTPARSER_H
+#define FASTBOOTOUTPUTPARSER_H
+
+#include <iostream>
+#include <functional>
+#include <cstddef>
+
+/* Longest output line kept by the parser, the rest of a longer line is dropped */
+constexpr size_t FB_OUTPUT_LINE_MAX = 4096 ;
+
+/* Number of output streams parsed separately (stdout, stderr) */
+constexpr int FB_OUTPUT_STREAMS = 2 ;
+
+enum outputEventType
+{
+    EVENT_STEP_START,   /* "Sending/Writing/Erasing '<name>'" printed, the operation is running */
+    EVENT_STEP_OKAY,    /* Status line ending with "OKAY [x.xxxs]" */
+    EVENT_STEP_FAILED,  /* Status line ending with "FAILED (reason)" */
+    EVENT_INFO,         /* "(bootloader) ..." message from the device */
+    EVENT_ERROR,        /* "fastboot: error: ..." from the tool */
+    EVENT_FINISHED,     /* "Finished. Total time: x.xxxs" */
+    EVENT_TEXT,         /* Any other line */
+};
+
+enum outputPhase
+{
+    PHASE_NONE,
+    PHASE_SENDING,
+    PHASE_WRITING,
+    PHASE_ERASING,
+    PHASE_COMMAND,      /* Unnamed status line, e.g. OEM commands */
+};
+
+struct outputEvent
+{
+    outputEventType type;
+    outputPhase phase;
+    std::string partName;
+    double seconds;
+    std::string reason;
+    std::string line;
+    size_t partIndex; /* "Sending sparse '<name>' 2/3": image piece being sent or written, 1 for a single download */
+    size_t partsNbr;
+};
+
+/**
+ * Incremental parser of the fastboot tool output.
+ * Data is fed as it is read from the child process, events are emitted line by line without keeping the whole output.
+ * Each output stream has its own line buffer so that stdout and stderr lines never interleave.
+ */
+class FastbootOutputParser
+{
+public:
+    explicit FastbootOutputParser(std::function<void(const outputEvent&)> eventHandler);
+    void feed(const char *data, size_t length, int stream = 0) ;
+    void finish() ;
+    bool hasFailed() const { return failed; }
+    bool hasFinished() const { return finished; }
+
+private:
+    void parseLine(const std::string &line, bool startEmitted) ;
+    bool parseLabel(const std::string &text, outputPhase &phase, std::string &partName) ;
+    void parseCounter(const std::string &text, size_t nameEnd, outputPhase phase, const std::string &partName) ;
+    void emit(outputEventType type, outputPhase phase, const std::string &partName, double seconds, const std::string &reason, const std::string &line) ;
+
+    std::function<void(const outputEvent&)> eventHandler ;
+    std::string pendingLine[FB_OUTPUT_STREAMS] ;
+    bool startEmitted[FB_OUTPUT_STREAMS] = {false, false} ;
+    std::string counterPartName = "" ;
+    size_t counterIndex = 1 ;
+    size_t counterTotal = 1 ;
+    bool failed = false ;
+    bool finished = false ;
+};
+
+#endif // FASTBOOTOUTPUTPARSER_H
@@ -0,0 +1,84 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FASTBOOTPROTOCOL_H
+#define FASTBOOTPROTOCOL_H
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <cstdint>
+#include "DisplayManager.h"
+#include "FastbootTransport.h"
+#include "TraceRecorder.h"
+#include "Error.h"
+
+/* Largest command accepted by the upstream fastboot protocol */
+constexpr size_t FB_COMMAND_SZ = 4096 ;
+
+/* Longest silence of the device before an operation is abandoned (ms), 0 to wait forever */
+struct commandTimeouts
+{
+    uint32_t command = 5000; // getvar, download request, oem bootbus/partconf, fastboot tool start
+    uint32_t transfer = 10000; // Each write of a download payload, and its final status
+    uint32_t flash = 10000; // flash, plus flashPerMB for each MB of the written image
+    uint32_t flashPerMB = 500; // 2 MB/s, slower than any STM32MP memory
+    uint32_t erase = 60000;
+    uint32_t format = 30000; // oem format
+};
+
+/**
+ * In-process fastboot client: command/response state machine on top of a FastbootTransport.
+ * The transport is owned by the caller and must stay open while the protocol is used.
+ */
+class FastbootProtocol
+{
+public:
+    explicit FastbootProtocol(FastbootTransport *transport);
+    int command(const std::string &cmd, std::string *response = nullptr) ;
+    int getVar(const std::string &name, std::string &value) ;
+    int getVarAll(std::map<std::string, std::string> &variablesList) ;
+    int downloadCommand(uint32_t size) ;
+    int sendData(const uint8_t *data, size_t length) ;
+    int readResponse(std::string *response = nullptr) ;
+    int download(const uint8_t *data, uint32_t size) ;
+    int flash(const std::string &partitionName) ;
+    int erase(const std::string &partitionName) ;
+    int oem(const std::string &arguments) ;
+    void setTimeouts(const commandTimeouts &timeouts) { this->timeouts = timeouts; }
+    std::string getLastError() const { return lastError; }
+
+    static uint32_t getFlashTimeout(const commandTimeouts &timeouts, uint64_t imageSize) ;
+    static bool parseTimeouts(const std::string &timeoutsSpec, commandTimeouts &timeouts) ;
+
+private:
+    int sendCommand(const std::string &cmd) ;
+    uint32_t getTimeout(const std::string &cmd) const ;
+    void setTransportTimeout(uint32_t timeoutMs) ;
+
+    DisplayManager displayManager = DisplayManager::getInstance() ;
+    FastbootTransport *transport ;
+    std::string lastError = "" ;
+    uint32_t dataRemaining = 0 ;
+    uint32_t downloadedSize = 0 ; // Size of the last download, written by the next flash command
+    commandTimeouts timeouts ;
+    uint32_t transportTimeout = 0 ; // Timeout of the operation in progress
+    std::vector<std::string> *infoList = nullptr ; // INFO payloads kept instead of printed, during getVarAll()
+};
+
+#endif // FASTBOOTPROTOCOL_H
@@ -0,0 +1,60 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FASTBOOTTRANSPORT_H
+#define FASTBOOTTRANSPORT_H
+
+#include <iostream>
+#include <cstdint>
+#include <cstddef>
+#include "Error.h"
+
+/* Transport names accepted by the -t/--transport option */
+#define TRANSPORT_USB       "usb"
+#define TRANSPORT_EXEC      "exec"
+#define TRANSPORT_LOOPBACK  "loopback"
+#define TRANSPORT_TCP       "tcp:"
+
+/* Largest fastboot response packet (protocol v0.4 uses 64 bytes, upstream fastboot accepts up to 256) */
+constexpr size_t FB_RESPONSE_SZ = 256 ;
+
+/**
+ * Link between the host and a device in fastboot mode.
+ * A response packet is always returned by a single read() call, whatever the underlying framing.
+ * read() and write() return TOOLBOX_FASTBOOT_ERROR_TIMEOUT when the device does not move for the timeout set.
+ */
+class FastbootTransport
+{
+public:
+    virtual ~FastbootTransport() {}
+
+    virtual int open() = 0 ;
+    virtual void close() = 0 ;
+    virtual int read(uint8_t* data, size_t length, size_t* transferred) = 0 ;
+    virtual int write(const uint8_t* data, size_t length) = 0 ;
+    virtual std::string getName() = 0 ;
+    void setTimeout(uint32_t timeoutMs) { this->timeoutMs = timeoutMs; }
+
+    static FastbootTransport* create(const std::string &transportSpec, const std::string &serialNumber) ;
+    static bool isValidSpec(const std::string &transportSpec) ;
+
+protected:
+    uint32_t timeoutMs = 0 ; // Longest wait of a single read or write, 0 to wait forever
+};
+
+#endif // FASTBOOTTRANSPORT_H
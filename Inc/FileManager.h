@@ -22,15 +22,19 @@
 #include <iostream>
 #include <cstring>
 #include <vector>
-#include <regex>
 #include <fstream>
+#include <functional>
 #include <cstdint>
 
 #include"DisplayManager.h"
+#include "TraceRecorder.h"
 #include "Error.h"
 
 constexpr uint8_t TSV_NB_COLUMNS = 7;
 
+/* Files kept between the runs (manifest, journals, cost model), in the user home folder */
+#define TOOLBOX_DATA_FOLDER ".prg-toolbox-fb"
+
 struct partitionInfo
 {
     std::string opt;
@@ -40,6 +44,15 @@ struct partitionInfo
     std::string partIp;
     std::string offset;
     std::string binary;
+    uint64_t binarySize; // Size of the binary file, 0 for "none"
+    int64_t binaryModified; // Last modification of the binary file in seconds since the epoch, 0 for "none"
+};
+
+/* Field of a TSV line, pointing into the file buffer */
+struct tsvField
+{
+    const char *data;
+    size_t length;
 };
 
 struct fileTSV
@@ -52,11 +65,15 @@ class FileManager
 public:
     static FileManager& getInstance() ;
     int openTsvFile(const std::string &fileName, fileTSV **parsedFile);
+    static std::string escapeJson(const std::string &text) ;
+    static std::string getDataPath(const std::string &fileName) ;
+    static int replaceFile(const std::string &filePath, const std::string &description, const std::function<void(std::ostream &output)> &writeContent) ;
 
 private:
     FileManager();
     int parseTsvFile(const std::string tsvFolderPath, std::ifstream *inFile, fileTSV* parsedTSV);
-    int splitStdString(std::string str, std::regex, std::vector<std::string>& substrings) ;
+    size_t splitTsvLine(const char *line, const char *lineEnd, tsvField *fieldsList, size_t maxFieldsNbr) ;
+    int resolveBinaries(const std::string &tsvFolderPath, fileTSV* parsedTSV) ;
 
     DisplayManager displayManager = DisplayManager::getInstance() ;
 
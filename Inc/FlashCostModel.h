@@ -0,0 +1,96 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef FLASHCOSTMODEL_H
+#define FLASHCOSTMODEL_H
+
+#include <iostream>
+#include <mutex>
+#include <cstdint>
+#include "FileManager.h"
+#include "DisplayManager.h"
+#include "Fastboot.h"
+#include "Error.h"
+
+/* Cost model used by --dry-run when no path is given, updated after every successful flashing, in the toolbox data folder */
+#define COST_MODEL_DEFAULT_FILE "cost_model.cfg"
+
+/* Figures of a STM32MP board in USB high-speed fastboot mode, used until a flashing is measured */
+constexpr double COST_DEFAULT_LINK_SPEED = 30.0 ; /* MB/s */
+constexpr double COST_DEFAULT_WRITE_SPEED = 40.0 ; /* MB/s */
+constexpr uint32_t COST_DEFAULT_COMMAND_LATENCY = 5 ; /* ms */
+constexpr uint32_t COST_DEFAULT_ERASE_TIME = 100 ; /* ms */
+constexpr uint32_t COST_DEFAULT_FORMAT_TIME = 2000 ; /* ms */
+constexpr uint32_t COST_DEFAULT_MAX_DOWNLOAD_SIZE = 0x08000000 ;
+
+/* Smallest transfer whose duration is recorded as a link or write speed, shorter ones are dominated by the command latency */
+constexpr uint64_t COST_MIN_MEASURED_SZ = 1024 * 1024 ;
+
+/* Throughputs and latencies of a board, 0 when unknown */
+struct costFigures
+{
+    double linkSpeed = 0; // MB/s of the downloads
+    double writeSpeed = 0; // MB/s of the flash commands
+    uint32_t commandLatency = 0; // ms of a command round-trip
+    uint32_t eraseTime = 0; // ms of an erase command
+    uint32_t formatTime = 0; // ms of "oem format"
+    uint32_t maxDownloadSize = 0; // Device download buffer, larger images are sent in several downloads
+};
+
+/* Predicted duration of one flashing command */
+struct commandEstimate
+{
+    uint64_t size = 0; // Image bytes sent
+    uint32_t commandsNbr = 0; // Device commands, a flash is a download and a flash per piece
+    double transferSeconds = 0;
+    double writeSeconds = 0;
+    double commandSeconds = 0; // Latencies, erase and format
+};
+
+/**
+ * Predicts the flashing duration of a board from its link and memory figures.
+ * The figures are read from a "key = value" file with the keys of the emulator configuration:
+ * link-speed, write-speed, command-latency, erase-time, format-time and max-download-size, other keys are ignored.
+ * Missing figures keep the STM32MP defaults.
+ */
+class FlashCostModel
+{
+public:
+    explicit FlashCostModel(const std::string &modelPath);
+    int load() ;
+    int record(const costFigures &measured) ;
+    commandEstimate estimate(const fastbootStep &step, uint64_t imageSize) const ;
+    commandEstimate estimateFormat() const ;
+    std::string getPath() const { return modelPath; }
+    bool isLoaded() const { return loaded; }
+    const costFigures& getFigures() const { return figures; }
+
+    static std::string getDefaultPath() ;
+
+private:
+    int readFile(costFigures &fileFigures, bool &found) ;
+    int writeFile(const costFigures &fileFigures) ;
+    void applyDefaults(costFigures &fileFigures) const ;
+
+    DisplayManager displayManager = DisplayManager::getInstance() ;
+    std::string modelPath ;
+    costFigures figures ;
+    bool loaded = false ;
+    static std::mutex fileMutex ;
+};
+
+#endif // FLASHCOSTMODEL_H
@@ -0,0 +1,68 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef FLASHJOURNAL_H
+#define FLASHJOURNAL_H
+
+#include <iostream>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+#include "FileManager.h"
+#include "DisplayManager.h"
+#include "Error.h"
+
+/* Journals folder used by --resume when no folder is given, in the toolbox data folder */
+#define FLASH_JOURNAL_DEFAULT_FOLDER "journal"
+
+/* Step of the flash plan completed on the device */
+struct journalEntry
+{
+    std::string command = ""; // flash, erase, oem bootbus, oem partconf
+    std::string partName = "";
+    std::string sha256 = ""; // Image of a flash command, empty for the other commands
+};
+
+/**
+ * Per-device checkpoint of an interrupted flashing service, stored as a TSV file named after the serial number.
+ * It holds the layout digest of the plan, written once the memory is formatted, then the leading plan
+ * steps completed on the device with their image hashes, appended as each step ends. It is removed when the flashing service succeeds.
+ */
+class FlashJournal
+{
+public:
+    explicit FlashJournal(const std::string &journalPath);
+    int load() ;
+    bool isEnabled() const { return journalPath.empty() == false; }
+    bool isFormatted(const std::string &layoutDigest) const ;
+    size_t getCompletedNbr(const std::vector<journalEntry> &planEntriesList) const ;
+    int save(const std::string &layoutDigest, const std::vector<journalEntry> &completedList) ;
+    int append(const journalEntry &entry) ;
+    int clear() ;
+    std::string getPath() const { return journalPath; }
+
+    static std::string getDefaultFolder() ;
+    static std::string getJournalPath(const std::string &journalFolder, const std::string &serialNumber) ;
+
+private:
+    DisplayManager displayManager = DisplayManager::getInstance() ;
+    std::string journalPath ;
+    std::string layoutDigest ;
+    std::vector<journalEntry> entriesList ;
+};
+
+#endif // FLASHJOURNAL_H
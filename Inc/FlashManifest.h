@@ -0,0 +1,70 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLASHMANIFEST_H
+#define FLASHMANIFEST_H
+
+#include <iostream>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+#include "FileManager.h"
+#include "DisplayManager.h"
+#include "Error.h"
+
+/* Manifest file used by --incremental when no path is given, in the toolbox data folder */
+#define FLASH_MANIFEST_DEFAULT_FILE "flash_manifest.tsv"
+
+/* Image last flashed successfully to one partition of one device */
+struct manifestEntry
+{
+    std::string serialNumber = "";
+    std::string partName = ""; // Flashed partition, e.g. "mmc1boot0" for a TSV "fsbl1" line
+    std::string sha256 = "";
+    uint64_t size = 0;
+    partitionInfo tsvLine; // The TSV line the image comes from
+};
+
+/**
+ * Host-side record of the images written to each device partition, stored as a TSV file:
+ * serial, partition, SHA-256, size, then the 7 columns of the TSV line.
+ * Updates reload the file and replace it atomically, so the sessions of a gang programming can share it.
+ */
+class FlashManifest
+{
+public:
+    explicit FlashManifest(const std::string &manifestPath);
+    int load() ;
+    bool isUnchanged(const manifestEntry &entry) const ;
+    int forget(const std::string &serialNumber, const std::vector<std::string> &partNames) ;
+    int record(const std::vector<manifestEntry> &entriesList) ;
+    std::string getPath() const { return manifestPath; }
+
+    static std::string getDefaultPath() ;
+
+private:
+    int readFile(std::vector<manifestEntry> &fileEntriesList) ;
+    int writeFile(const std::vector<manifestEntry> &fileEntriesList) ;
+
+    DisplayManager displayManager = DisplayManager::getInstance() ;
+    std::string manifestPath ;
+    std::vector<manifestEntry> entriesList ;
+    static std::mutex fileMutex ;
+};
+
+#endif // FLASHMANIFEST_H
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef FLASHMETRICS_H
+#define FLASHMETRICS_H
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <cstdint>
+#include "FileManager.h"
+#include "DisplayManager.h"
+#include "Error.h"
+
+/* Prefix of the metrics names */
+#define METRICS_PREFIX "prg_toolbox_fb_"
+
+/* Flash command of a flashing service, as observed by the metrics */
+struct metricsPartition
+{
+    std::string partName = "";
+    uint64_t imageBytes = 0; // Size of the image file
+    uint64_t sentBytes = 0; // Bytes downloaded to the device, after the sparse conversion
+    double seconds = 0; // Transfer and write duration
+};
+
+/* Outcome of one flashing service */
+struct metricsRun
+{
+    int result = TOOLBOX_FASTBOOT_NO_ERROR;
+    double probeSeconds = -1; // Device probe latency, negative if the device was not probed
+    std::vector<metricsPartition> partitionsList; // Partitions flashed successfully
+};
+
+/**
+ * Station metrics in the Prometheus text format, read by the textfile collector of the node exporter.
+ * The counters and histograms already in the file are kept and added to, so that successive runs and the
+ * boards of a gang or station accumulate. The file is replaced atomically after every flashing service.
+ */
+class FlashMetrics
+{
+public:
+    explicit FlashMetrics(const std::string &metricsPath);
+    int record(const metricsRun &run) ;
+
+    static std::string getErrorName(int errorCode) ;
+
+private:
+    void readFile() ;
+    int writeFile() ;
+    void addSample(const std::string &sampleName, double value, bool isGauge = false) ;
+    void observe(const std::string &familyName, const std::string &labels, const std::vector<double> &bucketsList, double value) ;
+    static std::string formatNumber(double value) ;
+    static std::string escapeLabel(const std::string &text) ;
+
+    DisplayManager displayManager = DisplayManager::getInstance() ;
+    std::string metricsPath ;
+    std::vector<std::pair<std::string, double>> samplesList ; // "name{labels}" and value, in file order
+    std::map<std::string, size_t> samplesIndex ;
+    static std::mutex fileMutex ;
+};
+
+#endif // FLASHMETRICS_H
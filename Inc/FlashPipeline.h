@@ -0,0 +1,120 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef FLASHPIPELINE_H
+#define FLASHPIPELINE_H
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include "SparseImage.h"
+#include "ImageSource.h"
+#include "TraceRecorder.h"
+#include "Error.h"
+
+/* Memory the preparation stage may fill ahead of the transfer, when not given with --pipeline-memory */
+constexpr uint32_t PIPELINE_DEFAULT_MEMORY_MB = 256 ;
+
+/* Threads preparing the next images while the current one is transferred */
+constexpr unsigned int PIPELINE_WORKERS_NBR = 2 ;
+
+/* One download buffer of a flash step */
+struct preparedDownload
+{
+    std::string label = ""; // Description printed with the transfer result
+    uint64_t size = 0; // Bytes announced to the device
+    std::shared_ptr<SparseImage> image; // Sparse image to send, nullptr to send the image file as it is
+    std::vector<uint8_t> data; // Download content, empty when it is sent from the image file (mapped or read) during the transfer
+    bool ready = false;
+};
+
+/* Flash step made ready for the transfer by the preparation stage */
+struct preparedFlash
+{
+    int result = TOOLBOX_FASTBOOT_NO_ERROR; // TOOLBOX_FASTBOOT_ERROR_NOT_SUPPORTED if the fastboot tool must be used
+    std::string filePath = "";
+    std::string report = ""; // Sparse conversion summary, printed when the transfer starts
+    std::vector<preparedDownload> downloadsList;
+    bool planned = false; // downloadsList is complete, the buffers may still be filled
+    bool finished = false;
+    bool mapped = false; // The image file is mapped in memory, its downloads are sent from the mapping
+    double prepareSeconds = 0;
+    uint64_t bufferedBytes = 0;
+};
+
+/* Time spent by each stage for one flash step */
+struct pipelineTimings
+{
+    std::string partName = "";
+    double prepareSeconds = 0; // Preparation threads: sparse conversion, split and read of the image
+    double waitSeconds = 0; // Link idle, waiting for the preparation
+    double transferSeconds = 0; // Download commands and data
+    double writeSeconds = 0; // Flash commands, the device writes its memory
+    uint64_t bufferedBytes = 0;
+    uint64_t mappedBytes = 0;
+    uint64_t streamedBytes = 0;
+};
+
+/* Fills downloadsList and report for one step, without any access to the device. Called from the preparation threads */
+typedef std::function<int(size_t stepIndex, preparedFlash &prepared)> planFunction;
+
+/**
+ * Producer/consumer pipeline of a flashing sequence.
+ * Preparation threads plan the flash steps in order (sparse conversion, split) while the session thread transfers the previous ones.
+ * A mapped image is then only read ahead into the system cache, its downloads are sent from the mapping. The downloads of the other
+ * images are read into memory, in step order, without exceeding the memory budget: a download larger than the budget is read ahead
+ * and streamed from the file.
+ */
+class FlashPipeline
+{
+public:
+    FlashPipeline(uint64_t memoryBudget, unsigned int workersNbr = PIPELINE_WORKERS_NBR);
+    ~FlashPipeline();
+    void start(size_t stepsNbr, const planFunction &plan) ;
+    void stop() ;
+    preparedFlash& waitPlan(size_t stepIndex, double &waitSeconds) ;
+    preparedDownload* waitDownload(size_t stepIndex, size_t downloadIndex, double &waitSeconds) ;
+    void release(size_t stepIndex, size_t downloadIndex) ;
+    double getPrepareSeconds(size_t stepIndex) ;
+    uint64_t getMemoryBudget() const { return memoryBudget; }
+    unsigned int getWorkersNbr() const { return workersNbr; }
+
+private:
+    void runWorker(unsigned int workerIndex) ;
+    void prepareStep(size_t stepIndex) ;
+    int fillDownload(ImageSource &source, preparedDownload &download) ;
+
+    uint64_t memoryBudget ;
+    unsigned int workersNbr ;
+    planFunction plan ;
+    std::vector<preparedFlash> preparedList ;
+    std::vector<std::thread> workersList ;
+    std::mutex pipelineMutex ;
+    std::condition_variable pipelineCondition ;
+    size_t nextStep = 0 ; // Next step to plan
+    size_t fillingStep = 0 ; // Step whose buffers are being filled, buffers are filled in step order
+    uint64_t memoryUsed = 0 ;
+    bool stopping = false ;
+    std::string traceTrack = ""; // Track of the sequence thread, the workers draw their own tracks next to it
+};
+
+#endif // FLASHPIPELINE_H
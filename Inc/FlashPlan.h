@@ -0,0 +1,87 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef FLASHPLAN_H
+#define FLASHPLAN_H
+
+#include <iostream>
+#include <vector>
+#include <cstdint>
+#include "FileManager.h"
+#include "DisplayManager.h"
+#include "Fastboot.h"
+#include "Error.h"
+
+/* U-Boot names of the eMMC boot partitions written by the TSV "boot1" and "boot2" lines */
+#define PLAN_BOOT1_PARTITION "mmc1boot0"
+#define PLAN_BOOT2_PARTITION "mmc1boot1"
+
+/* Device command of a compiled flash plan */
+struct planCommand
+{
+    fastbootStep step = {STEP_FLASH, "", "", {0, 0, 0}, 0};
+    partitionInfo tsvLine = {"", "", "", "", "", "", "", 0, 0}; // The TSV line the command comes from
+    std::vector<size_t> dependsOn; // Commands that must be completed before this one
+};
+
+/* GPT partition of the TSV layout, as "oem format" creates it */
+struct planPartition
+{
+    std::string partName = "";
+    std::string partIp = ""; // Memory holding the partition, e.g. "mmc1"
+    std::string partType = ""; // Type column of the TSV line, e.g. "Binary" or "FileSystem"
+    uint64_t offset = 0;
+    uint64_t size = 0; // Up to the next partition of the same memory, 0 for the last one that takes the remaining space
+};
+
+/**
+ * Typed flashing sequence compiled once from a parsed TSV file.
+ * The TSV keywords are resolved to step types, the eMMC boot configuration is sent once after the
+ * last boot partition instead of after each of them, and identical repeated commands are dropped.
+ * The commands are kept in an executable order, the dependencies only describe the constraints between them.
+ */
+class FlashPlan
+{
+public:
+    FlashPlan();
+    void compile(const fileTSV &parsedTsvFile) ;
+    void print() ;
+    std::vector<fastbootStep> getSteps() const ;
+    const std::vector<planCommand>& getCommandsList() const { return commandsList; }
+    bool isCompiled() const { return compiled; }
+    size_t getTsvLinesNbr() const { return tsvLinesNbr; }
+    size_t getRemovedNbr() const { return removedNbr; }
+    std::string getLayoutDigest() const ;
+    const std::vector<planPartition>& getPartitionsList() const { return partitionsList; }
+
+    static const char* getCommandName(stepType type) ;
+
+private:
+    void addCommand(const planCommand &command) ;
+    void addBootConfiguration(size_t position, uint16_t bootPartition) ;
+    bool isBootPartition(const std::string &partName) const ;
+    void computePartitions(const fileTSV &parsedTsvFile) ;
+
+    DisplayManager displayManager = DisplayManager::getInstance() ;
+    std::vector<planCommand> commandsList ;
+    std::vector<planPartition> partitionsList ; /* GPT partitions of the layout, by memory and offset */
+    bool compiled = false ;
+    size_t tsvLinesNbr = 0 ;
+    size_t removedNbr = 0 ; /* Commands of the TSV sequence not needed in the plan */
+};
+
+#endif // FLASHPLAN_H
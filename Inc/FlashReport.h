@@ -0,0 +1,76 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef FLASHREPORT_H
+#define FLASHREPORT_H
+
+#include <iostream>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+#include "DisplayManager.h"
+#include "Error.h"
+
+/* Report file extension selecting JSON Lines, any other extension is written as CSV */
+#define REPORT_JSON_EXTENSION ".json"
+
+/* Flashing service the records of a report come from */
+struct reportContext
+{
+    std::string toolboxVersion = "";
+    std::string bootloaderVersion = ""; // "version-bootloader" variable, empty if the device does not give it
+    std::string transport = "";
+    std::string serialNumber = "";
+    std::string tsvPath = "";
+};
+
+/* One step of a flashing service, as written in the reports */
+struct reportRecord
+{
+    size_t stepIndex = 0; // Position in the flash plan, from 1
+    std::string command = ""; // flash, erase, oem bootbus, oem partconf
+    std::string partName = "";
+    std::string partType = ""; // Type column of the TSV line, e.g. "Binary" or "FileSystem"
+    uint64_t imageBytes = 0; // Size of the image file
+    uint64_t sentBytes = 0; // Bytes downloaded to the device, after the sparse conversion
+    double transferSeconds = 0;
+    double writeSeconds = 0;
+    double totalSeconds = 0;
+    std::string result = ""; // OK, FAILED or NOT_RUN
+};
+
+/**
+ * Per-step performance report of the flashing services, appended to a file so that successive runs and
+ * the sessions of a gang programming accumulate in the same report.
+ * ".json" files hold one JSON object per line (JSON Lines), other files are CSV with a header line.
+ */
+class FlashReport
+{
+public:
+    explicit FlashReport(const std::string &reportPath);
+    int append(const reportContext &context, const std::vector<reportRecord> &recordsList) ;
+    bool isJson() const ;
+
+private:
+    static std::string escapeCsv(const std::string &text) ;
+
+    DisplayManager displayManager = DisplayManager::getInstance() ;
+    std::string reportPath ;
+    static std::mutex fileMutex ;
+};
+
+#endif // FLASHREPORT_H
@@ -0,0 +1,114 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IMAGEHASH_H
+#define IMAGEHASH_H
+
+#include <iostream>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "Error.h"
+
+constexpr size_t SHA256_DIGEST_SZ = 32 ;
+constexpr size_t SHA256_BLOCK_SZ = 64 ;
+
+/* Integrity manifest written next to a TSV file: <file.tsv>.hash */
+#define INTEGRITY_MANIFEST_EXTENSION ".hash"
+
+/* SHA-256 compression function applied to complete 64-byte blocks */
+typedef void (*sha256BlocksFunction)(uint32_t *state, const uint8_t *data, size_t blocksNbr);
+
+/* CRC update, the crc argument and the result are the finalized (inverted) values so calls can be chained */
+typedef uint32_t (*crc32Function)(uint32_t crc, const uint8_t *data, size_t length);
+
+struct sha256EngineInfo
+{
+    std::string name;
+    sha256BlocksFunction process;
+};
+
+struct crc32EngineInfo
+{
+    std::string name;
+    crc32Function update;
+};
+
+/* Hashes of one image file */
+struct imageDigest
+{
+    std::string path = "";
+    uint64_t size = 0;
+    std::string sha256 = "";
+    uint32_t crc32c = 0;
+    int result = TOOLBOX_FASTBOOT_ERROR_OTHER;
+};
+
+/* Line of an integrity manifest */
+struct integrityEntry
+{
+    std::string partName = "";
+    uint64_t size = 0;
+    std::string sha256 = "";
+    uint32_t crc32c = 0;
+    std::string binary = ""; // Image path relative to the TSV folder
+};
+
+/**
+ * Incremental SHA-256 (FIPS 180-4).
+ */
+class Sha256
+{
+public:
+    explicit Sha256(sha256BlocksFunction process = nullptr);
+    void update(const uint8_t *data, size_t length) ;
+    std::string finish() ;
+
+private:
+    sha256BlocksFunction process ;
+    uint32_t state[8] ;
+    uint8_t pendingBlock[SHA256_BLOCK_SZ] ;
+    size_t pendingSize = 0 ;
+    uint64_t totalSize = 0 ;
+};
+
+/**
+ * Content hashes of the images referenced by a TSV file.
+ * SHA-256 identifies an image, CRC32C is a cheap check computed in the same file pass.
+ * Each algorithm has a portable implementation and CPU-specific ones selected at run time.
+ */
+class ImageHash
+{
+public:
+    static int sha256File(const std::string &path, std::string &digest, uint64_t *fileSize = nullptr) ;
+    static int hashFile(imageDigest &digest) ;
+    static int hashFiles(std::vector<imageDigest> &digestsList, unsigned int workersNbr = 0) ;
+
+    static uint32_t crc32c(const uint8_t *data, size_t length, uint32_t crc = 0) ;
+    static uint32_t crc32(const uint8_t *data, size_t length, uint32_t crc = 0) ;
+
+    static std::vector<sha256EngineInfo> getSha256Engines() ;
+    static std::vector<crc32EngineInfo> getCrc32cEngines() ;
+    static std::vector<crc32EngineInfo> getCrc32Engines() ;
+
+    static std::string getIntegrityManifestPath(const std::string &tsvPath) ;
+    static int readIntegrityManifest(const std::string &manifestPath, std::vector<integrityEntry> &entriesList) ;
+    static int writeIntegrityManifest(const std::string &manifestPath, const std::vector<integrityEntry> &entriesList) ;
+};
+
+#endif // IMAGEHASH_H
@@ -0,0 +1,60 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef IMAGESOURCE_H
+#define IMAGESOURCE_H
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include "Error.h"
+
+/* Largest piece handed to the output by ImageSource::read(), a multiple of the sparse block size */
+constexpr size_t IMAGE_SOURCE_READ_SZ = 1024 * 1024 ;
+
+/**
+ * Read-only access to an image file.
+ * The file is mapped in memory when the system allows it: read() then hands pointers into the mapping to its output,
+ * so the image reaches the transport without any copy. Otherwise the file is read by pieces into an internal buffer.
+ */
+class ImageSource
+{
+public:
+    explicit ImageSource(const std::string &path);
+    ~ImageSource();
+    int open() ;
+    void close() ;
+    int read(uint64_t offset, uint64_t length, const std::function<int(const uint8_t *data, size_t length)> &output) ;
+    void prefetch(uint64_t offset, uint64_t length) ;
+    std::string getPath() const { return path; }
+    uint64_t getSize() const { return size; }
+    bool isMapped() const { return mapping != nullptr; }
+
+private:
+    ImageSource(const ImageSource&) = delete ;
+    ImageSource& operator=(const ImageSource&) = delete ;
+
+    std::string path ;
+    uint64_t size = 0 ;
+    const uint8_t *mapping = nullptr ;
+    std::ifstream file ;
+    std::vector<uint8_t> buffer ;
+};
+
+#endif // IMAGESOURCE_H
@@ -0,0 +1,47 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LOOPBACKTRANSPORT_H
+#define LOOPBACKTRANSPORT_H
+
+#include <iostream>
+#include "FastbootTransport.h"
+#include "FastbootEmulator.h"
+
+/**
+ * In-process link to an emulated device, used to run the whole flashing flow without hardware.
+ */
+class LoopbackTransport : public FastbootTransport
+{
+public:
+    explicit LoopbackTransport(const std::string &configPath = "");
+    int open() ;
+    void close() ;
+    int read(uint8_t* data, size_t length, size_t* transferred) ;
+    int write(const uint8_t* data, size_t length) ;
+    std::string getName() ;
+
+    static bool parseSpec(const std::string &transportSpec, std::string &configPath) ;
+
+private:
+    FastbootEmulator emulator ;
+    std::string configPath ;
+    bool isOpen = false ;
+};
+
+#endif // LOOPBACKTRANSPORT_H
@@ -0,0 +1,59 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROCESSEXECUTOR_H
+#define PROCESSEXECUTOR_H
+
+#include <iostream>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include "DisplayManager.h"
+#include "TraceRecorder.h"
+#include "Error.h"
+
+enum outputStream
+{
+    STREAM_STDOUT = 0,
+    STREAM_STDERR = 1,
+};
+
+/* Output handler: return false to stop the child process */
+typedef std::function<bool(outputStream stream, const char *data, size_t length)> outputHandler;
+
+/**
+ * Runs an external program from an argument vector, without an intermediate shell.
+ * POSIX systems use posix_spawn() with dedicated stdout/stderr pipes, Windows uses CreateProcess() with one
+ * anonymous pipe for both outputs and the arguments quoted for the C runtime of the child.
+ */
+class ProcessExecutor
+{
+public:
+    static ProcessExecutor& getInstance() ;
+    int run(const std::string &program, const std::vector<std::string> &arguments, outputHandler handler, int *exitCode = nullptr, uint32_t silenceTimeoutMs = 0) ;
+    static std::string formatCommandLine(const std::string &program, const std::vector<std::string> &arguments) ;
+    static bool isExecutable(const std::string &program) ;
+
+private:
+    ProcessExecutor();
+    void terminate(long processId) ;
+
+    DisplayManager displayManager = DisplayManager::getInstance() ;
+};
+
+#endif // PROCESSEXECUTOR_H
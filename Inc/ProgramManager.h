@@ -20,23 +20,101 @@
 #define PROGRAMMANAGER_H
 
 #include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
 #include "FileManager.h"
 #include "DisplayManager.h"
 #include "Fastboot.h"
+#include "DeviceMonitor.h"
+#include "FlashManifest.h"
+#include "ImageHash.h"
+#include "FlashPlan.h"
+#include "FlashCostModel.h"
+#include "FlashReport.h"
+#include "FlashMetrics.h"
+#include "FlashJournal.h"
 #include "Error.h"
 
+/* Keyword of the -sn option selecting every connected device */
+#define GANG_ALL_DEVICES "ALL"
+
+/* Largest number of devices flashed at the same time */
+constexpr unsigned int MAX_GANG_WORKERS = 16 ;
+
+/* Flashing settings selected on the command line, shared by all the device sessions */
+struct flashingOptions
+{
+    sparseMode sparse = SPARSE_OFF;
+    bool incremental = false; // Skip the partitions whose image is recorded in the flash manifest
+    std::string manifestPath = ""; // Flash manifest, empty for FlashManifest::getDefaultPath()
+    bool checkIntegrity = true; // Check the images against the integrity manifest of the TSV file, if any
+    uint32_t pipelineMemoryMB = PIPELINE_DEFAULT_MEMORY_MB; // Memory of the images prepared ahead of their transfer, per device
+    std::string costModelPath = ""; // Cost model of --dry-run, empty for FlashCostModel::getDefaultPath()
+    std::string reportPath = ""; // Per-step performance report appended after each flashing, empty for none
+    std::string metricsPath = ""; // Prometheus metrics file updated after each flashing, empty for none
+    bool forceFormat = false; // Format the memory even if the device partitions match the TSV layout
+    bool resume = false; // Journal the completed steps and continue an interrupted flashing from its first unfinished step
+    std::string journalFolder = ""; // Journals of --resume, empty for FlashJournal::getDefaultFolder()
+    commandTimeouts timeouts; // Longest silence of the device per kind of command
+    std::string toolboxVersion = ""; // Written in the reports
+};
+
+/* Outcome of one device flashing session in gang mode */
+struct gangSession
+{
+    std::string serialNumber = "";
+    int result = TOOLBOX_FASTBOOT_NO_ERROR;
+    long long durationMs = 0;
+};
+
+/* Device being flashed in station mode */
+struct stationSession
+{
+    gangSession session;
+    std::thread worker;
+    std::atomic<bool> finished{false};
+};
+
 class ProgramManager
 {
 public:
-    ProgramManager(const std::string toolboxFolder, const std::string fastbootSerialNumber = "");
+    ProgramManager(const std::string toolboxFolder, const std::string fastbootSerialNumber = "", const std::string transportSpec = "");
     ~ProgramManager();
     int startFlashingService(const std::string inputTsvPath) ;
+    int startGangFlashingService(const std::string inputTsvPath, std::vector<std::string> serialNumbers) ;
+    int startStationService(const std::string inputTsvPath, uint32_t boardsNbr = 0) ;
+    int generateIntegrityManifest(const std::string inputTsvPath) ;
+    int printFlashPlan(const std::string inputTsvPath) ;
+    int estimateFlashingService(const std::string inputTsvPath) ;
+    flashingOptions options ;
 
 private:
+    int hashTsvImages() ;
+    void writeReport(const std::string &inputTsvPath, const std::vector<fastbootStep> &stepsList, const std::vector<manifestEntry> &stepsEntriesList) ;
+    void recordCostFigures(const std::vector<fastbootStep> &stepsList, double formatSeconds) ;
+    void recordMetrics(int result, double probeSeconds, const std::vector<fastbootStep> &stepsList, const std::vector<manifestEntry> &stepsEntriesList) ;
+    const imageDigest* findImageDigest(const std::string &path) const ;
+    int checkImagesIntegrity(const std::string &inputTsvPath) ;
+    int skipUnchangedSteps(FlashManifest &manifest, bool formatted, std::vector<fastbootStep> &stepsList, std::vector<manifestEntry> &stepsEntriesList) ;
+    std::string getDeviceSerialNumber() ;
+    bool isDeviceLayoutMatching() ;
+    int getImagesSize(const std::string &partName, uint64_t &imagesSize) ;
+    static bool isPartitionTypeMatching(const std::string &tsvType, const std::string &deviceType) ;
+    int openJournal(FlashJournal &journal, const std::vector<fastbootStep> &stepsList, std::vector<journalEntry> &journalStepsList) ;
+    void journalStep(FlashJournal &journal, const std::vector<journalEntry> &journalStepsList, size_t resumedNbr, const std::vector<fastbootStep> &stepsList, size_t stepIndex, size_t &completedNbr) ;
+    void updateJournal(FlashJournal &journal, size_t completedNbr, size_t stepsNbr, int result) ;
+    void runDeviceSession(const std::string &inputTsvPath, gangSession &session) ;
+    void printGangSummary(const std::vector<gangSession> &sessionsList, long long durationMs) ;
+
     DisplayManager displayManager = DisplayManager::getInstance() ;
     FileManager fileManager  = FileManager::getInstance() ;
     Fastboot *fastbootInterface;
     fileTSV *parsedTsvFile ;
+    std::string toolboxFolder ;
+    std::string transportSpec ;
+    std::vector<imageDigest> imageDigestsList ; /* Hashes of the TSV images, computed once */
+    FlashPlan flashPlan ; /* Commands compiled from the TSV file, compiled once */
 };
 
 #endif // PROGRAMMANAGER_H
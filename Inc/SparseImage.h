@@ -0,0 +1,106 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SPARSEIMAGE_H
+#define SPARSEIMAGE_H
+
+#include <iostream>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include "Error.h"
+
+/* Android sparse image format, as produced by img2simg and accepted by U-Boot */
+constexpr uint32_t SPARSE_HEADER_MAGIC = 0xed26ff3a ;
+constexpr uint16_t SPARSE_MAJOR_VERSION = 1 ;
+constexpr uint16_t SPARSE_MINOR_VERSION = 0 ;
+constexpr size_t SPARSE_HEADER_SZ = 28 ;
+constexpr size_t SPARSE_CHUNK_HEADER_SZ = 12 ;
+constexpr uint32_t SPARSE_BLOCK_SZ = 4096 ;
+
+constexpr uint16_t SPARSE_CHUNK_RAW = 0xCAC1 ;
+constexpr uint16_t SPARSE_CHUNK_FILL = 0xCAC2 ;
+constexpr uint16_t SPARSE_CHUNK_DONT_CARE = 0xCAC3 ;
+constexpr uint16_t SPARSE_CHUNK_CRC32 = 0xCAC4 ;
+
+/* Size of the reads of the raw image and of the buffers handed to the output */
+constexpr size_t SPARSE_IO_BUFFER_SZ = 1024 * 1024 ;
+
+enum sparseMode
+{
+    SPARSE_OFF,
+    SPARSE_FILL, // Uniform blocks become FILL chunks, zero blocks included
+    SPARSE_SKIP_ZERO, // Zero blocks become DONT_CARE chunks: their previous content is kept on the device
+};
+
+struct sparseChunk
+{
+    uint16_t type;
+    uint32_t blocksNbr;
+    uint64_t fileOffset; // RAW chunks: position of the data in the source file
+    uint32_t fillValue; // FILL chunks: the repeated 32-bit pattern
+};
+
+/* Block classifier: true if the block repeats one 32-bit pattern, returned in fillValue. Sizes are multiples of 128 bytes */
+typedef bool (*blockScanner)(const uint8_t *block, size_t size, uint32_t *fillValue);
+
+struct blockScannerInfo
+{
+    std::string name;
+    blockScanner scanner;
+};
+
+/**
+ * Conversion of a raw image into an Android sparse image.
+ * scan() builds the chunk list of a raw image, load() the one of an image that is already sparse. write() then streams
+ * the sparse image reading the RAW chunks from the source file, so the converted image is never held in memory.
+ */
+class SparseImage
+{
+public:
+    explicit SparseImage(const std::string &rawPath);
+    int scan(sparseMode mode, blockScanner scanner = nullptr) ;
+    int load() ;
+    std::vector<SparseImage> split(uint64_t maxSparseSize) const ;
+    int write(const std::function<int(const uint8_t *data, size_t length)> &output) const ;
+    int writeFile(const std::string &sparsePath) const ;
+    std::string getRawPath() const { return rawPath; }
+    uint64_t getRawSize() const { return rawSize; }
+    uint64_t getSparseSize() const ;
+    uint64_t getSkippedBytes() const ;
+    uint32_t getBlockSize() const { return blockSize; }
+    double getScanSeconds() const { return scanSeconds; }
+    const std::vector<sparseChunk>& getChunks() const { return chunksList; }
+
+    static bool isSparseFile(const std::string &path) ;
+    static std::vector<blockScannerInfo> getAvailableScanners() ;
+    static blockScannerInfo getBestScanner() ;
+
+private:
+    void addBlock(uint16_t type, uint32_t fillValue, uint64_t fileOffset) ;
+    uint64_t getChunkSize(const sparseChunk &chunk) const ;
+
+    std::string rawPath ;
+    uint64_t rawSize = 0 ; // Expanded image size
+    uint64_t sourceSize = 0 ; // Size of the file the RAW chunks are read from
+    uint32_t blockSize = SPARSE_BLOCK_SZ ;
+    double scanSeconds = 0 ;
+    std::vector<sparseChunk> chunksList ;
+};
+
+#endif // SPARSEIMAGE_H
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TCPTRANSPORT_H
+#define TCPTRANSPORT_H
+
+#include <iostream>
+#include <vector>
+#include <cstdint>
+#include "FastbootTransport.h"
+#include "DisplayManager.h"
+
+/* Default port of U-Boot and upstream fastboot over TCP */
+constexpr uint16_t FB_TCP_DEFAULT_PORT = 5554 ;
+
+/* Handshake "FB" + 2 digits protocol version, then 8-byte big-endian length before every packet */
+constexpr size_t FB_TCP_HANDSHAKE_SZ = 4 ;
+constexpr size_t FB_TCP_HEADER_SZ = 8 ;
+constexpr int FB_TCP_PROTOCOL_VERSION = 1 ;
+
+/**
+ * Fastboot over TCP link, following the upstream fastboot framing.
+ * The device is given by its numeric address: host names are not resolved by the static binary.
+ */
+class TcpTransport : public FastbootTransport
+{
+public:
+    TcpTransport(const std::string &hostName, uint16_t port);
+    ~TcpTransport();
+    int open() ;
+    void close() ;
+    int read(uint8_t* data, size_t length, size_t* transferred) ;
+    int write(const uint8_t* data, size_t length) ;
+    std::string getName() ;
+
+    static bool parseSpec(const std::string &transportSpec, std::string &hostName, uint16_t &port) ;
+    static intptr_t createSocket(int family, int type, int protocol) ;
+    static void protectSocket(intptr_t fd) ;
+    static long sendSocket(intptr_t fd, const uint8_t* data, size_t length) ;
+
+private:
+    static bool parseAddress(const std::string &hostName, uint16_t port, struct sockaddr_storage &address, size_t &addressLength) ;
+    int connectSocket(const struct sockaddr *address, size_t addressLength) ;
+    int waitSocket(short events) ;
+    int sendAll(const uint8_t* data, size_t length) ;
+    int receiveAll(uint8_t* data, size_t length) ;
+
+    DisplayManager displayManager = DisplayManager::getInstance() ;
+    std::string hostName ;
+    uint16_t port ;
+    intptr_t socketFd = -1 ;
+    bool wsaStarted = false ; // Windows: WSAStartup() called by open(), undone by close()
+    uint64_t packetRemaining = 0 ;
+};
+
+#endif // TCPTRANSPORT_H
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef TRACERECORDER_H
+#define TRACERECORDER_H
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "DisplayManager.h"
+#include "Error.h"
+
+typedef std::chrono::steady_clock::time_point traceTime ;
+
+/* Completed operation of a track, times in microseconds since the program start */
+struct traceEvent
+{
+    std::string name = "";
+    std::string category = ""; // main, session, device, tool, pipeline
+    uint32_t trackId = 0;
+    int64_t startUs = 0;
+    int64_t durationUs = 0;
+};
+
+/**
+ * Timeline of the program in the Chrome trace event format, opened with Perfetto or chrome://tracing.
+ * Each thread draws on a named track: "main", one per device in gang and station modes, one per preparation thread.
+ * Nothing is recorded until enable() is called, the traced scopes then cost two clock reads.
+ */
+class TraceRecorder
+{
+public:
+    static TraceRecorder& getInstance() ;
+    void enable() ;
+    bool isEnabled() const { return enabled; }
+    void addEvent(const std::string &name, const char *category, traceTime start, traceTime end) ;
+    int write(const std::string &tracePath) ;
+
+    static void setTrack(const std::string &trackName) ;
+    static std::string getTrack() ;
+
+private:
+    TraceRecorder();
+    uint32_t getTrackId(const std::string &trackName) ;
+
+    std::mutex eventsMutex ;
+    std::vector<traceEvent> eventsList ;
+    std::map<std::string, uint32_t> tracksList ;
+    std::atomic<bool> enabled{false} ;
+};
+
+/* Operation traced from its construction to its destruction, on the track of the calling thread */
+class TraceScope
+{
+public:
+    TraceScope(const std::string &name, const char *category);
+    ~TraceScope();
+
+private:
+    std::string name ;
+    const char *category ;
+    traceTime start ;
+    bool active ;
+};
+
+/* Trace file written when the program leaves the scope, nothing is recorded if its path is empty */
+class TraceFile
+{
+public:
+    explicit TraceFile(const std::string &tracePath);
+    ~TraceFile();
+
+private:
+    std::string tracePath ;
+};
+
+#endif // TRACERECORDER_H
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef USBTRANSPORT_H
+#define USBTRANSPORT_H
+
+#include <iostream>
+#include <vector>
+#include "FastbootTransport.h"
+#include "DisplayManager.h"
+
+/* Fastboot USB interface descriptor */
+constexpr uint8_t FB_USB_CLASS = 0xff ;
+constexpr uint8_t FB_USB_SUBCLASS = 0x42 ;
+constexpr uint8_t FB_USB_PROTOCOL = 0x03 ;
+
+/* usbdevfs bulk transfer limits, same as upstream fastboot */
+constexpr size_t MAX_USBFS_BULK_READ_SIZE = 16 * 1024 ;
+constexpr size_t MAX_USBFS_BULK_WRITE_SIZE = 256 * 1024 ;
+
+struct usbFastbootDevice
+{
+    std::string serialNumber = "";
+    std::string devicePath = "";
+    uint8_t interfaceNumber = 0;
+    uint8_t endpointIn = 0;
+    uint8_t endpointOut = 0;
+};
+
+/**
+ * Native USB link to a fastboot device, implemented over Linux usbdevfs.
+ * Other platforms report TOOLBOX_FASTBOOT_ERROR_INTERFACE_NOT_SUPPORTED and use the bundled fastboot tool.
+ */
+class UsbTransport : public FastbootTransport
+{
+public:
+    explicit UsbTransport(const std::string &serialNumber);
+    ~UsbTransport();
+    int open() ;
+    void close() ;
+    int read(uint8_t* data, size_t length, size_t* transferred) ;
+    int write(const uint8_t* data, size_t length) ;
+    std::string getName() ;
+
+    static bool isSupported() ;
+    static int listDevices(std::vector<usbFastbootDevice> &devicesList) ;
+
+private:
+    DisplayManager displayManager = DisplayManager::getInstance() ;
+    std::string serialNumber ;
+    usbFastbootDevice device ;
+    int deviceFd = -1 ;
+    size_t writeChunkSize = MAX_USBFS_BULK_WRITE_SIZE ;
+};
+
+#endif // USBTRANSPORT_H
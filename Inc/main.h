@@ -26,9 +26,16 @@
 #include "DisplayManager.h"
 #include "Error.h"
 
-constexpr uint8_t  MAX_COMMANDS_NBR = 10 ;
+constexpr uint8_t  MAX_COMMANDS_NBR = 32 ;
 constexpr uint8_t  MAX_PARAMS_NBR = 5 ;
 
+/* Buffer hashed by --hash-bench when no size is given */
+constexpr unsigned long HASH_BENCH_DEFAULT_SIZE_MB = 256 ;
+
+/* Layout generated by --tsv-bench when no size is given, and number of distinct binaries it refers to */
+constexpr unsigned long TSV_BENCH_DEFAULT_LINES = 100000 ;
+constexpr unsigned long TSV_BENCH_BINARIES_NBR = 64 ;
+
 struct command
 {
     std::string cmd; // command
@@ -38,7 +45,7 @@ struct command
 
 
 command argumentsList[MAX_COMMANDS_NBR];
-const std::string supportedCommandList[MAX_COMMANDS_NBR]={"-d", "--download", "?", "-h", "--help", "-v", "-sn", "--serial", "-l", "--list"} ;
+const std::string supportedCommandList[MAX_COMMANDS_NBR]={"-d", "--download", "?", "-h", "--help", "-v", "-sn", "--serial", "-l", "--list", "-t", "--transport", "-e", "--emulate", "--station", "--sparse", "--sparse-bench", "--incremental", "--hash", "--hash-bench", "--pipeline-memory", "--tsv-bench", "--plan", "--dry-run", "--report", "--trace", "--metrics", "--resume", "--force-format", "--log-level", "--log-json", "--timeout"} ;
 
 DisplayManager displayManager = DisplayManager::getInstance() ;
 int extractProgramCommands (int numberCommands, char* commands[]);
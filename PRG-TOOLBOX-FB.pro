@@ -3,8 +3,10 @@ CONFIG += console c++11
 CONFIG -= app_bundle
 CONFIG -= qt
 DESTDIR = $$PWD
-QMAKE_LFLAGS +=-static -static-libgcc -static-libstdc++
+QMAKE_LFLAGS +=-static -static-libgcc -static-libstdc++ -pthread
+QMAKE_CXXFLAGS += -pthread
 LIBS += -lstdc++fs
+win32: LIBS += -lws2_32
 MAKEFILE = qtMakefile
 
 VERSION = 2.2.0
@@ -18,7 +20,27 @@ SOURCES += \
         Src/DisplayManager.cpp \
         Src/FileManager.cpp \
         Src/ProgramManager.cpp \
+        Src/FlashPlan.cpp \
+        Src/FlashCostModel.cpp \
+        Src/FlashReport.cpp \
+        Src/FlashMetrics.cpp \
+        Src/FlashJournal.cpp \
+        Src/TraceRecorder.cpp \
+        Src/DeviceMonitor.cpp \
         Src/Fastboot.cpp \
+        Src/SparseImage.cpp \
+        Src/ImageSource.cpp \
+        Src/FlashPipeline.cpp \
+        Src/ImageHash.cpp \
+        Src/FlashManifest.cpp \
+        Src/FastbootProtocol.cpp \
+        Src/FastbootOutputParser.cpp \
+        Src/ProcessExecutor.cpp \
+        Src/FastbootTransport.cpp \
+        Src/UsbTransport.cpp \
+        Src/LoopbackTransport.cpp \
+        Src/FastbootEmulator.cpp \
+        Src/TcpTransport.cpp \
         Src/main.cpp
 
 HEADERS += \
@@ -26,8 +48,28 @@ HEADERS += \
     Inc/Error.h \
     Inc/FileManager.h \
     Inc/ProgramManager.h \
+    Inc/FlashPlan.h \
+    Inc/FlashCostModel.h \
+    Inc/FlashReport.h \
+    Inc/FlashMetrics.h \
+    Inc/FlashJournal.h \
+    Inc/TraceRecorder.h \
+    Inc/DeviceMonitor.h \
     Inc/main.h \
     Inc/Fastboot.h \
+    Inc/SparseImage.h \
+    Inc/ImageSource.h \
+    Inc/FlashPipeline.h \
+    Inc/ImageHash.h \
+    Inc/FlashManifest.h \
+    Inc/FastbootProtocol.h \
+    Inc/FastbootOutputParser.h \
+    Inc/ProcessExecutor.h \
+    Inc/FastbootTransport.h \
+    Inc/UsbTransport.h \
+    Inc/LoopbackTransport.h \
+    Inc/FastbootEmulator.h \
+    Inc/TcpTransport.h \
 
 DISTFILES += \
     License.txt \
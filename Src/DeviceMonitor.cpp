@@ -0,0 +1,202 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DeviceMonitor.h"
+#include <chrono>
+#include <cstring>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <cerrno>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+/* Netlink groups: raw kernel uevents, or the same events once udev has applied its rules (device node permissions) */
+constexpr unsigned int UEVENT_GROUP_KERNEL = 1 ;
+constexpr unsigned int UEVENT_GROUP_UDEV = 2 ;
+
+/* Header prepended by udev to the events it forwards */
+constexpr char UDEV_EVENT_PREFIX[] = "libudev" ;
+constexpr uint32_t UDEV_EVENT_MAGIC = 0xfeedcafe ;
+
+struct udevEventHeader
+{
+    char prefix[8];
+    uint32_t magic;
+    uint32_t headerSize;
+    uint32_t propertiesOffset;
+    uint32_t propertiesLength;
+};
+#endif
+
+DeviceMonitor::DeviceMonitor()
+{
+
+}
+
+DeviceMonitor::~DeviceMonitor()
+{
+    close() ;
+}
+
+/**
+ * @brief DeviceMonitor::open : Subscribe to the USB hotplug events.
+ * @return 0 if the events are available, TOOLBOX_FASTBOOT_ERROR_NOT_SUPPORTED if waitForEvent() falls back to a periodic wake up.
+ */
+int DeviceMonitor::open()
+{
+#ifdef __linux__
+    if(socketFd >= 0)
+        return TOOLBOX_FASTBOOT_NO_ERROR ;
+
+    socketFd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT) ;
+    if(socketFd >= 0)
+    {
+        /* Prefer the udev events when udevd runs, the device node may not be accessible yet on the kernel event */
+        struct sockaddr_nl address ;
+        memset(&address, 0, sizeof(address)) ;
+        address.nl_family = AF_NETLINK ;
+        address.nl_groups = (access("/run/udev/control", F_OK) == 0) ? UEVENT_GROUP_UDEV : UEVENT_GROUP_KERNEL ;
+
+        if((bind(socketFd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) == 0) && (pipe2(wakeUpPipe, O_CLOEXEC | O_NONBLOCK) == 0))
+            return TOOLBOX_FASTBOOT_NO_ERROR ;
+    }
+
+    displayManager.print(MSG_WARNING, L"USB hotplug events not available (%s), polling the devices list", strerror(errno)) ;
+    close() ;
+#endif
+    return TOOLBOX_FASTBOOT_ERROR_NOT_SUPPORTED ;
+}
+
+/**
+ * @brief DeviceMonitor::close : Stop listening to the hotplug events.
+ */
+void DeviceMonitor::close()
+{
+#ifdef __linux__
+    if(socketFd >= 0)
+        ::close(socketFd) ;
+    socketFd = -1 ;
+
+    for(int &fd : wakeUpPipe)
+    {
+        if(fd >= 0)
+            ::close(fd) ;
+        fd = -1 ;
+    }
+#endif
+}
+
+/**
+ * @brief DeviceMonitor::isUsbEvent : Check if a uevent message concerns a USB device or interface.
+ * @param message: The raw netlink message, kernel ("action@devpath\0KEY=value\0...") or udev format.
+ * @param length: The message size.
+ * @return True for a USB event.
+ */
+bool DeviceMonitor::isUsbEvent(const char *message, size_t length)
+{
+    size_t offset = 0 ;
+#ifdef __linux__
+    const udevEventHeader *header = reinterpret_cast<const udevEventHeader*>(message) ;
+    if((length >= sizeof(udevEventHeader)) && (memcmp(header->prefix, UDEV_EVENT_PREFIX, sizeof(UDEV_EVENT_PREFIX)) == 0))
+    {
+        if(ntohl(header->magic) != UDEV_EVENT_MAGIC)
+            return false ;
+        offset = header->propertiesOffset ;
+    }
+#endif
+
+    while(offset < length)
+    {
+        const char *property = message + offset ;
+        size_t propertyLength = strnlen(property, length - offset) ;
+        if((propertyLength == strlen("SUBSYSTEM=usb")) && (strncmp(property, "SUBSYSTEM=usb", propertyLength) == 0))
+            return true ;
+        offset += propertyLength + 1 ;
+    }
+
+    return false ;
+}
+
+/**
+ * @brief DeviceMonitor::waitForEvent : Block until a USB device is plugged or unplugged, or wakeUp() is called.
+ * Without hotplug events, return after STATION_POLL_INTERVAL_MS.
+ */
+void DeviceMonitor::waitForEvent()
+{
+#ifdef __linux__
+    if(socketFd >= 0)
+    {
+        char message[UEVENT_BUFFER_SZ] ;
+        while(true)
+        {
+            struct pollfd fds[2] = {{socketFd, POLLIN, 0}, {wakeUpPipe[0], POLLIN, 0}} ;
+            if(poll(fds, 2, -1) < 0)
+            {
+                if(errno == EINTR)
+                    continue ;
+                return ;
+            }
+
+            if(fds[1].revents & POLLIN)
+            {
+                while(read(wakeUpPipe[0], message, sizeof(message)) > 0) ;
+                return ;
+            }
+
+            /* Several events come with one plug (device, interfaces, bind), report them as one */
+            bool usbEvent = false ;
+            ssize_t length ;
+            while((length = recv(socketFd, message, sizeof(message), MSG_DONTWAIT)) > 0)
+                usbEvent |= isUsbEvent(message, static_cast<size_t>(length)) ;
+
+            if(usbEvent)
+                return ;
+        }
+    }
+#endif
+
+    std::unique_lock<std::mutex> lock(wakeUpMutex) ;
+    wakeUpCondition.wait_for(lock, std::chrono::milliseconds(STATION_POLL_INTERVAL_MS), [this]() { return wakeUpPending ; }) ;
+    wakeUpPending = false ;
+}
+
+/**
+ * @brief DeviceMonitor::wakeUp : Release a thread blocked in waitForEvent(), callable from any thread.
+ */
+void DeviceMonitor::wakeUp()
+{
+#ifdef __linux__
+    if(wakeUpPipe[1] >= 0)
+    {
+        char event = 1 ;
+        if(write(wakeUpPipe[1], &event, 1) < 0)
+        {
+            /* The pipe is already full: a wake up is pending anyway */
+        }
+        return ;
+    }
+#endif
+
+    std::lock_guard<std::mutex> lock(wakeUpMutex) ;
+    wakeUpPending = true ;
+    wakeUpCondition.notify_one() ;
+}
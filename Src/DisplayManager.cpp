@@ -17,6 +17,16 @@
  */
 
 #include "DisplayManager.h"
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <vector>
+#include <fstream>
+#include <chrono>
+#include <ctime>
+#include <cwchar>
+#include <cstdio>
 #ifdef _WIN32
 #include <windows.h>
 HANDLE  console;
@@ -26,63 +36,89 @@ WORD OriginalBgColors;
 #include <cstdlib>
 #endif
 
-DisplayManager::DisplayManager()
-{
+/* Longest wait of the writer thread before it checks the queue again */
+constexpr int DISPLAY_WRITER_PERIOD_MS = 20 ;
 
-}
+/* Message queued for the writer thread */
+struct displayLine
+{
+    messageType type = MSG_NORMAL;
+    std::wstring text = L""; // Device tag, severity prefix and message, as printed
+    size_t messageStart = 0; // Start of the message in text, for the JSON log
+    std::string device = "";
+    std::chrono::system_clock::time_point time;
+    bool console = true; // At or above the console level
+};
 
-DisplayManager & DisplayManager::getInstance()
+/* Slot of the bounded queue, its sequence tells whether it holds a message (Vyukov MPMC queue) */
+struct displaySlot
 {
-    static DisplayManager instance;
-    return instance;
-}
+    std::atomic<size_t> sequence{0};
+    displayLine line;
+};
 
 /**
- * @brief DisplayManager::print : display a message in variadic format.
- * @param messageType: Coloring message depending on the context.
- * @param message: The string to display.
+ * Writer thread of the DisplayManager and the queue feeding it.
+ * The strings of the slots keep their capacity, a message is copied into its slot without allocation once the slot is warm.
  */
-void DisplayManager::print(messageType messageType, const wchar_t* message, ...)
+class DisplayBackend
 {
-    va_list args;
-    va_start(args, message);
-    std::wstring msgIndicator;
+public:
+    DisplayBackend();
+    ~DisplayBackend();
+    void push(messageType type, const std::wstring &prefix, const wchar_t *message, size_t length, const std::string &device, bool console) ;
+    int openJsonLog(const std::string &logPath) ;
 
-    switch(messageType)
-    {
-    case MSG_WARNING:
-        msgIndicator = L"[Info]: ";
-        break;
-    case MSG_ERROR:
-        msgIndicator = L"[Error]: ";
-        break;
-    default: ;
-    }
+private:
+    void run() ;
+    bool pop(displayLine &line) ;
+    void appendJson(const displayLine &line, std::string &batch) ;
 
-    std::wstring s(std::move(msgIndicator));
+    std::vector<displaySlot> slotsList ;
+    std::atomic<size_t> enqueuePosition{0} ;
+    size_t dequeuePosition = 0 ; // Only used by the writer thread
+    std::atomic<bool> stopping{false} ;
+    std::atomic<bool> sleeping{false} ;
+    std::mutex wakeMutex ;
+    std::condition_variable wakeCondition ;
+    std::mutex jsonMutex ;
+    std::ofstream jsonLog ;
+    std::thread writer ;
+};
 
-    wchar_t * ws = (wchar_t *) malloc(30*1024*sizeof (wchar_t));
-    if(ws == nullptr)
-    {
-        std::cout << "Error : " << "Memory allocation failed " << std::endl ;
-        va_end(args);
-        return ;
-    }
-    vswprintf(ws, 30*1024, message, args);
-    s += std::wstring(ws);
+/* Messages printed directly when no writer thread runs, e.g. while the program exits */
+static std::mutex displayMutex ;
 
-    displayMessage(messageType, s.c_str()) ;
+/* Writer of the program, nullptr once it is stopped */
+static std::atomic<DisplayBackend*> activeBackend{nullptr} ;
 
-    free(ws);
-    va_end(args);
+/* Lowest messageType rank printed on the console */
+static std::atomic<int> consoleLevel{0} ;
+
+/* The JSON log receives every message, whatever the console level */
+static std::atomic<bool> jsonLogEnabled{false} ;
+
+/* Prefix of the messages printed by the current thread, e.g. "[0123ABCD] ", and its device name */
+static thread_local std::wstring deviceTag ;
+static thread_local std::string deviceName ;
+
+/**
+ * @brief getRank : Severity of a message type, the green messages are normal messages.
+ * @param type: The message type.
+ * @return 0 for the normal messages, 1 for the warnings, 2 for the errors.
+ */
+static int getRank(messageType type)
+{
+    return (type == MSG_ERROR) ? 2 : ((type == MSG_WARNING) ? 1 : 0) ;
 }
 
 /**
- * @brief DisplayManager::displayMessage : print a message inline.
- * @param type: Coloring message and background depending on the context.
- * @param str: the string to display.
+ * @brief writeConsole : Print a message with its color, the console is only written by one thread at a time.
+ * @param type: Coloring message depending on the context.
+ * @param text: The message.
+ * @param batch: Output accumulating the text and color sequences, written at once by the caller (not used on Windows).
  */
-void DisplayManager::displayMessage(messageType type, const wchar_t* str)
+static void writeConsole(messageType type, const std::wstring &text, std::wstring &batch)
 {
 #ifdef _WIN32
     console = GetStdHandle(STD_OUTPUT_HANDLE);
@@ -110,29 +146,394 @@ void DisplayManager::displayMessage(messageType type, const wchar_t* str)
         break;
     }
 
-    std::wcout << str << std::endl ;
+    /* The console attributes apply to the text already written */
+    (void)batch ;
+    std::wcout << text << L"\n" ;
+    std::wcout.flush() ;
     SetConsoleTextAttribute(console, backAttributes);
 
 #else
     switch (type)
     {
     case MSG_GREEN:
-        printf("\033[00;32m");
+        batch += L"\033[00;32m";
         break;
     case MSG_NORMAL:
-        printf("\033[39;49m");
+        batch += L"\033[39;49m";
         break;
     case MSG_WARNING:
-        printf("\033[00;33m");
+        batch += L"\033[00;33m";
         break;
     case MSG_ERROR:
-        printf("\033[00;31m");
+        batch += L"\033[00;31m";
         break;
     }
 
-    std::wcout << str << std::endl;
-    printf("\033[39;49m");
+    batch += text ;
+    batch += L"\n\033[39;49m" ;
 
 #endif
+}
+
+/**
+ * @brief appendUtf8 : Encode a wide string in UTF-8, as a JSON string content.
+ * @param text: The wide characters, UTF-16 or UTF-32 depending on the platform.
+ * @param start: First character to encode.
+ * @param output: Output, the encoded text is appended.
+ */
+static void appendUtf8(const std::wstring &text, size_t start, std::string &output)
+{
+    for(size_t i = start; i < text.size(); i++)
+    {
+        uint32_t code = static_cast<uint32_t>(text[i]) ;
+        if((code >= 0xD800) && (code < 0xDC00) && (i + 1 < text.size()))
+        {
+            uint32_t low = static_cast<uint32_t>(text[i + 1]) ;
+            if((low >= 0xDC00) && (low < 0xE000))
+            {
+                code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00) ;
+                i++ ;
+            }
+        }
+
+        if((code == '"') || (code == '\\'))
+        {
+            output += '\\' ;
+            output += static_cast<char>(code) ;
+        }
+        else if(code < 0x20)
+        {
+            char escaped[8] ;
+            snprintf(escaped, sizeof(escaped), "\\u%04x", code) ;
+            output += escaped ;
+        }
+        else if(code < 0x80)
+        {
+            output += static_cast<char>(code) ;
+        }
+        else if(code < 0x800)
+        {
+            output += static_cast<char>(0xC0 | (code >> 6)) ;
+            output += static_cast<char>(0x80 | (code & 0x3F)) ;
+        }
+        else if(code < 0x10000)
+        {
+            output += static_cast<char>(0xE0 | (code >> 12)) ;
+            output += static_cast<char>(0x80 | ((code >> 6) & 0x3F)) ;
+            output += static_cast<char>(0x80 | (code & 0x3F)) ;
+        }
+        else
+        {
+            output += static_cast<char>(0xF0 | (code >> 18)) ;
+            output += static_cast<char>(0x80 | ((code >> 12) & 0x3F)) ;
+            output += static_cast<char>(0x80 | ((code >> 6) & 0x3F)) ;
+            output += static_cast<char>(0x80 | (code & 0x3F)) ;
+        }
+    }
+}
+
+DisplayBackend::DisplayBackend() : slotsList(DISPLAY_QUEUE_SZ)
+{
+    for(size_t i = 0; i < slotsList.size(); i++)
+        slotsList[i].sequence.store(i, std::memory_order_relaxed) ;
+
+    writer = std::thread(&DisplayBackend::run, this) ;
+    activeBackend.store(this) ;
+}
+
+DisplayBackend::~DisplayBackend()
+{
+    activeBackend.store(nullptr) ;
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex) ;
+        stopping.store(true) ;
+    }
+    wakeCondition.notify_one() ;
+    writer.join() ;
+}
+
+/**
+ * @brief DisplayBackend::push : Queue a message, waiting while the queue is full.
+ * @param type: The message type.
+ * @param prefix: The device tag and severity prefix.
+ * @param message: The formatted message.
+ * @param length: Number of characters of the message.
+ * @param device: The device name of the calling thread, for the JSON log.
+ * @param console: Print the message on the console, otherwise it only goes to the JSON log.
+ */
+void DisplayBackend::push(messageType type, const std::wstring &prefix, const wchar_t *message, size_t length, const std::string &device, bool console)
+{
+    size_t position = enqueuePosition.load(std::memory_order_relaxed) ;
+    displaySlot *slot = nullptr ;
+    while(true)
+    {
+        slot = &slotsList[position & (DISPLAY_QUEUE_SZ - 1)] ;
+        size_t sequence = slot->sequence.load(std::memory_order_acquire) ;
+        intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position) ;
+        if(difference == 0)
+        {
+            if(enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                break ;
+        }
+        else if(difference < 0)
+        {
+            /* Full: the writer thread is behind, let it run */
+            std::this_thread::yield() ;
+            position = enqueuePosition.load(std::memory_order_relaxed) ;
+        }
+        else
+        {
+            position = enqueuePosition.load(std::memory_order_relaxed) ;
+        }
+    }
+
+    displayLine &line = slot->line ;
+    line.type = type ;
+    line.text.assign(prefix) ;
+    line.text.append(message, length) ;
+    line.messageStart = prefix.size() ;
+    line.device.assign(device) ;
+    line.time = std::chrono::system_clock::now() ;
+    line.console = console ;
+    slot->sequence.store(position + 1, std::memory_order_release) ;
+
+    /* A wake-up missed between the writer check and its wait only delays the message by the writer period */
+    if(sleeping.load())
+        wakeCondition.notify_one() ;
+}
+
+/**
+ * @brief DisplayBackend::pop : Take the oldest queued message, from the writer thread.
+ * @param line: Output, the message. The strings are swapped so that the slot keeps a buffer.
+ * @return True if a message was taken, false if the queue is empty.
+ */
+bool DisplayBackend::pop(displayLine &line)
+{
+    displaySlot &slot = slotsList[dequeuePosition & (DISPLAY_QUEUE_SZ - 1)] ;
+    if(slot.sequence.load(std::memory_order_acquire) != dequeuePosition + 1)
+        return false ;
+
+    line.type = slot.line.type ;
+    line.text.swap(slot.line.text) ;
+    line.messageStart = slot.line.messageStart ;
+    line.device.swap(slot.line.device) ;
+    line.time = slot.line.time ;
+    line.console = slot.line.console ;
+    slot.sequence.store(dequeuePosition + DISPLAY_QUEUE_SZ, std::memory_order_release) ;
+    dequeuePosition++ ;
+    return true ;
+}
+
+/**
+ * @brief DisplayBackend::run : Writer thread, prints the queued messages in batches until the program exits.
+ */
+void DisplayBackend::run()
+{
+    displayLine line ;
+    std::wstring consoleBatch ;
+    std::string jsonBatch ;
+
+    while(true)
+    {
+        bool taken = false ;
+        while(pop(line))
+        {
+            taken = true ;
+            if(line.console)
+            {
+                std::lock_guard<std::mutex> lock(displayMutex) ;
+                writeConsole(line.type, line.text, consoleBatch) ;
+            }
+            if(jsonLogEnabled.load())
+                appendJson(line, jsonBatch) ;
+        }
+
+        if(consoleBatch.empty() == false)
+        {
+            std::lock_guard<std::mutex> lock(displayMutex) ;
+            std::wcout << consoleBatch ;
+            std::wcout.flush() ;
+            consoleBatch.clear() ;
+        }
+
+        if(jsonBatch.empty() == false)
+        {
+            std::lock_guard<std::mutex> lock(jsonMutex) ;
+            jsonLog << jsonBatch ;
+            jsonLog.flush() ;
+            jsonBatch.clear() ;
+        }
+
+        if(taken)
+            continue ;
+        if(stopping.load())
+            break ;
+
+        std::unique_lock<std::mutex> lock(wakeMutex) ;
+        sleeping.store(true) ;
+        if(stopping.load() == false)
+            wakeCondition.wait_for(lock, std::chrono::milliseconds(DISPLAY_WRITER_PERIOD_MS)) ;
+        sleeping.store(false) ;
+    }
+}
+
+/**
+ * @brief DisplayBackend::openJsonLog : Append the next messages to a JSON Lines file.
+ * @param logPath: The log file.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int DisplayBackend::openJsonLog(const std::string &logPath)
+{
+    std::lock_guard<std::mutex> lock(jsonMutex) ;
+    jsonLog.close() ;
+    jsonLog.clear() ;
+    jsonLog.open(logPath, std::ios::app) ;
+    jsonLogEnabled.store(jsonLog.is_open()) ;
+    return jsonLog.is_open() ? TOOLBOX_FASTBOOT_NO_ERROR : TOOLBOX_FASTBOOT_ERROR_WRITE ;
+}
+
+/**
+ * @brief DisplayBackend::appendJson : Write a message as a JSON object line.
+ * @param line: The message.
+ * @param batch: Output, the line is appended.
+ */
+void DisplayBackend::appendJson(const displayLine &line, std::string &batch)
+{
+    static const char *levelsList[] = {"info", "success", "warning", "error"} ;
+
+    std::time_t seconds = std::chrono::system_clock::to_time_t(line.time) ;
+    long long milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(line.time.time_since_epoch()).count() % 1000 ;
+    char timestamp[48] ;
+    size_t timestampLength = std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", std::gmtime(&seconds)) ;
+    snprintf(timestamp + timestampLength, sizeof(timestamp) - timestampLength, ".%03lldZ", milliseconds) ;
+
+    batch += "{\"time\":\"" ;
+    batch += timestamp ;
+    batch += "\",\"level\":\"" ;
+    batch += levelsList[line.type] ;
+    batch += "\",\"device\":\"" ;
+    appendUtf8(std::wstring(line.device.begin(), line.device.end()), 0, batch) ;
+    batch += "\",\"message\":\"" ;
+    appendUtf8(line.text, line.messageStart, batch) ;
+    batch += "\"}\n" ;
+}
 
+DisplayManager::DisplayManager()
+{
+
+}
+
+DisplayManager & DisplayManager::getInstance()
+{
+    static DisplayManager instance;
+    return instance;
+}
+
+/**
+ * @brief getBackend : Start the writer thread on the first message.
+ * @return The writer, nullptr once it is stopped at the program exit.
+ */
+static DisplayBackend* getBackend()
+{
+    static DisplayBackend backend ;
+    return activeBackend.load() ;
+}
+
+/**
+ * @brief DisplayManager::setDeviceTag : Prefix the messages printed by the calling thread with a device name.
+ * @param tag: The device name, empty to remove the prefix.
+ */
+void DisplayManager::setDeviceTag(const std::string &tag)
+{
+    deviceTag = tag.empty() ? L"" : L"[" + std::wstring(tag.begin(), tag.end()) + L"] " ;
+    deviceName = tag ;
+}
+
+/**
+ * @brief DisplayManager::setLevel : Hide the console messages less severe than a type.
+ * @param minimumType: MSG_NORMAL to print everything, MSG_WARNING or MSG_ERROR.
+ */
+void DisplayManager::setLevel(messageType minimumType)
+{
+    consoleLevel.store(getRank(minimumType)) ;
+}
+
+/**
+ * @brief DisplayManager::setJsonLog : Also append every message to a JSON Lines file, with its time, level and device.
+ * @param logPath: The log file.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int DisplayManager::setJsonLog(const std::string &logPath)
+{
+    DisplayBackend *backend = getBackend() ;
+    return (backend != nullptr) ? backend->openJsonLog(logPath) : TOOLBOX_FASTBOOT_ERROR_NOT_SUPPORTED ;
+}
+
+/**
+ * @brief DisplayManager::print : display a message in variadic format.
+ * @param messageType: Coloring message depending on the context.
+ * @param message: The string to display.
+ */
+void DisplayManager::print(messageType messageType, const wchar_t* message, ...)
+{
+    /* Buffer of the calling thread, grown up to DISPLAY_MESSAGE_MAX_SZ and reused by its next messages */
+    static thread_local std::vector<wchar_t> formatBuffer(1024) ;
+
+    bool console = (getRank(messageType) >= consoleLevel.load()) ;
+    if((console == false) && (jsonLogEnabled.load() == false))
+        return ;
+
+    std::wstring msgIndicator;
+
+    switch(messageType)
+    {
+    case MSG_WARNING:
+        msgIndicator = L"[Info]: ";
+        break;
+    case MSG_ERROR:
+        msgIndicator = L"[Error]: ";
+        break;
+    default: ;
+    }
+
+    va_list args;
+    va_start(args, message);
+    int length = -1 ;
+    while(true)
+    {
+        va_list attemptArgs ;
+        va_copy(attemptArgs, args) ;
+        length = vswprintf(formatBuffer.data(), formatBuffer.size(), message, attemptArgs) ;
+        va_end(attemptArgs) ;
+
+        /* vswprintf does not tell the needed size: retry with a larger buffer, the message is cut at the largest one */
+        if((length >= 0) || (formatBuffer.size() >= DISPLAY_MESSAGE_MAX_SZ))
+            break ;
+        formatBuffer.resize(formatBuffer.size() * 2) ;
+    }
+    va_end(args);
+
+    if(length < 0)
+    {
+        formatBuffer.back() = L'\0' ;
+        length = static_cast<int>(wcslen(formatBuffer.data())) ;
+    }
+
+    std::wstring prefix = deviceTag + msgIndicator ;
+    DisplayBackend *backend = getBackend() ;
+    if(backend != nullptr)
+    {
+        backend->push(messageType, prefix, formatBuffer.data(), static_cast<size_t>(length), deviceName, console) ;
+        return ;
+    }
+
+    if(console)
+    {
+        std::lock_guard<std::mutex> lock(displayMutex) ;
+        std::wstring text = prefix + std::wstring(formatBuffer.data(), static_cast<size_t>(length)) ;
+        std::wstring batch ;
+        writeConsole(messageType, text, batch) ;
+        std::wcout << batch ;
+        std::wcout.flush() ;
+    }
 }
@@ -19,13 +19,536 @@
 #include <algorithm>
 #include "Fastboot.h"
 #include <experimental/filesystem>
-#include <regex>
+#include <fstream>
+#include <chrono>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include "UsbTransport.h"
+#include "ProcessExecutor.h"
+#include <memory>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+namespace fs = std::experimental::filesystem;
+
+/* U-Boot writes these partitions as they are received, a sparse image would be copied verbatim */
+static const char* const rawOnlyPartitions[] = {"mmc0boot0", "mmc0boot1", "mmc1boot0", "mmc1boot1", "mmc2boot0", "mmc2boot1", "gpt"} ;
 
 Fastboot::Fastboot()
 {
 
 }
 
+Fastboot::~Fastboot()
+{
+    closeSession() ;
+    removeTemporaryFiles() ;
+}
+
+/**
+ * @brief Fastboot::convertToSparse : Convert a raw image into a sparse one if the selected sparse mode allows it.
+ * Images that are already sparse are sent as they are.
+ * @param partitionName: The partition the image is written to.
+ * @param image: The image, scanned on success.
+ * @param report: Output, the conversion summary to print, empty if the image was not scanned.
+ * @return True if the sparse image is smaller than the raw one and must be sent instead.
+ */
+bool Fastboot::convertToSparse(const std::string &partitionName, SparseImage &image, std::string &report)
+{
+    TraceScope traceScope("Sparse conversion " + partitionName, "host") ;
+    report.clear() ;
+    if((sparse == SPARSE_OFF) || SparseImage::isSparseFile(image.getRawPath()) ||
+       (std::find(std::begin(rawOnlyPartitions), std::end(rawOnlyPartitions), partitionName) != std::end(rawOnlyPartitions)))
+        return false ;
+
+    if(image.scan(sparse) != TOOLBOX_FASTBOOT_NO_ERROR)
+        return false ;
+
+    char summary[256] ;
+    uint64_t rawSize = image.getRawSize() ;
+    double speed = (image.getScanSeconds() > 0) ? rawSize / (image.getScanSeconds() * 1024 * 1024) : 0 ;
+    if(image.getSparseSize() >= rawSize)
+    {
+        snprintf(summary, sizeof(summary), "Sparse '%s' : no uniform block, raw image kept (scan %.0f MB/s)", partitionName.c_str(), speed) ;
+        report = summary ;
+        return false ;
+    }
+
+    snprintf(summary, sizeof(summary), "Sparse '%s' : %llu KB -> %llu KB, %llu KB skipped (%lu chunks, %s scan %.0f MB/s)", partitionName.c_str(),
+             static_cast<unsigned long long>(rawSize / 1024), static_cast<unsigned long long>(image.getSparseSize() / 1024),
+             static_cast<unsigned long long>(image.getSkippedBytes() / 1024), static_cast<unsigned long>(image.getChunks().size()),
+             SparseImage::getBestScanner().name.c_str(), speed) ;
+    report = summary ;
+    return true ;
+}
+
+/**
+ * @brief Fastboot::prepareToolImage : Give the fastboot tool a sparse copy of a raw image when the sparse mode is selected.
+ * The copy is a temporary file removed once the tool exits.
+ * @param partitionName: The partition the image is written to.
+ * @param binary: The raw image path.
+ * @return The path to pass to the fastboot tool.
+ */
+std::string Fastboot::prepareToolImage(const std::string &partitionName, const std::string &binary)
+{
+    if(sparse == SPARSE_OFF)
+        return binary ;
+
+    SparseImage image(binary) ;
+    std::string report ;
+    bool sendSparse = convertToSparse(partitionName, image, report) ;
+    if(report.empty() == false)
+        displayManager.print(MSG_NORMAL, L"%s", report.c_str()) ;
+    if(sendSparse == false)
+        return binary ;
+
+    static std::atomic<unsigned int> temporaryCount(0) ;
+    std::string sparsePath ;
+    try
+    {
+        sparsePath = (fs::temp_directory_path() / ("prg-toolbox-fb-" + std::to_string(getpid()) + "-" + std::to_string(temporaryCount++) + ".simg")).string() ;
+    }
+    catch(...)
+    {
+        return binary ;
+    }
+
+    if(image.writeFile(sparsePath) != TOOLBOX_FASTBOOT_NO_ERROR)
+    {
+        displayManager.print(MSG_WARNING, L"Cannot write the sparse image %s, raw image kept", sparsePath.c_str()) ;
+        remove(sparsePath.c_str()) ;
+        return binary ;
+    }
+
+    temporaryFiles.push_back(sparsePath) ;
+    return sparsePath ;
+}
+
+/**
+ * @brief Fastboot::removeTemporaryFiles : Delete the sparse copies made for the fastboot tool.
+ */
+void Fastboot::removeTemporaryFiles()
+{
+    for(const auto &path : temporaryFiles)
+        remove(path.c_str()) ;
+    temporaryFiles.clear() ;
+}
+
+/**
+ * @brief Fastboot::openSession : Open the native fastboot session if the selected transport allows it.
+ * The session stays open until the Fastboot object is deleted, so all the commands share the same device link.
+ * The device download buffer size is read once here and used to split the images of the whole session.
+ * Without an explicit transport, a failed open selects the bundled fastboot tool for all the next commands.
+ * @return 0 if a native session is available, TOOLBOX_FASTBOOT_ERROR_NOT_SUPPORTED if the bundled
+ * fastboot tool must be used instead, otherwise an error occurred.
+ */
+int Fastboot::openSession()
+{
+    TraceScope traceScope("Session open", "session") ;
+    if(protocol != nullptr)
+        return TOOLBOX_FASTBOOT_NO_ERROR ;
+    if(useTool)
+        return TOOLBOX_FASTBOOT_ERROR_NOT_SUPPORTED ;
+
+    std::string spec = this->transportSpec ;
+    if(spec == "")
+        spec = UsbTransport::isSupported() ? TRANSPORT_USB : TRANSPORT_EXEC ;
+
+    transport = FastbootTransport::create(spec, this->fastbootSerialNumber) ;
+    if(transport == nullptr)
+    {
+        useTool = true ;
+        return TOOLBOX_FASTBOOT_ERROR_NOT_SUPPORTED ;
+    }
+    transport->setTimeout(timeouts.command) ;
+
+    int ret = transport->open() ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+    {
+        delete transport ;
+        transport = nullptr ;
+
+        /* No explicit transport: fall back to the bundled fastboot tool, without scanning the USB devices again */
+        if(this->transportSpec == "")
+        {
+            useTool = true ;
+            return TOOLBOX_FASTBOOT_ERROR_NOT_SUPPORTED ;
+        }
+
+        return ret ;
+    }
+
+    protocol = new FastbootProtocol(transport) ;
+    protocol->setTimeouts(timeouts) ;
+    readDeviceInfo() ;
+    maxDownloadSize = 0 ;
+    std::string value ;
+    if(getVariable("max-download-size", value) == TOOLBOX_FASTBOOT_NO_ERROR)
+        maxDownloadSize = static_cast<uint32_t>(strtoul(value.c_str(), nullptr, 0)) ;
+    if(getVariable("version-bootloader", value) == TOOLBOX_FASTBOOT_NO_ERROR)
+        bootloaderVersion = value ;
+
+    displayManager.print(MSG_NORMAL, L"Fastboot session opened on %s", transport->getName().c_str()) ;
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief Fastboot::readDeviceInfo : Read the bootloader variables of the device, with the native session if it is open,
+ * otherwise with a single fastboot tool run.
+ */
+void Fastboot::readDeviceInfo()
+{
+    TraceScope traceScope("Device info", "session") ;
+    deviceVariables = deviceInfo() ;
+    deviceVariables.loaded = true ;
+
+    if(protocol != nullptr)
+    {
+        if(protocol->getVarAll(deviceVariables.variablesList) == TOOLBOX_FASTBOOT_NO_ERROR)
+        {
+            deviceVariables.complete = true ;
+            return ;
+        }
+
+        /* "getvar all" is optional: read the variables every session needs, the others are read on demand */
+        for(const char *name : {"max-download-size", "version-bootloader", "serialno", "product"})
+        {
+            std::string value ;
+            if(protocol->getVar(name, value) == TOOLBOX_FASTBOOT_NO_ERROR)
+                deviceVariables.variablesList[name] = value ;
+        }
+        return ;
+    }
+
+    /* "(bootloader) <name>: <value>" lines */
+    FastbootOutputParser parser([this](const outputEvent &event)
+    {
+        size_t separator = event.reason.find(": ") ;
+        if((event.type == EVENT_INFO) && (separator != std::string::npos))
+            deviceVariables.variablesList[event.reason.substr(0, separator)] = event.reason.substr(separator + 2) ;
+    }) ;
+    deviceVariables.complete = (runFastbootTool({"getvar", "all"}, parser) == TOOLBOX_FASTBOOT_NO_ERROR) && (parser.hasFailed() == false) ;
+}
+
+/**
+ * @brief Fastboot::getVariable : Get a bootloader variable of the device, from the variables read when the session started.
+ * @param name: The variable name, e.g. "partition-size:rootfs".
+ * @param value: Output, the variable value.
+ * @return 0 if the variable is found, TOOLBOX_FASTBOOT_ERROR_OTHER if the device does not have it,
+ * otherwise the variables cannot be read.
+ */
+int Fastboot::getVariable(const std::string &name, std::string &value)
+{
+    if(deviceVariables.loaded == false)
+    {
+        int ret = openSession() ;
+        if((ret == TOOLBOX_FASTBOOT_NO_ERROR) && (deviceVariables.loaded == false))
+            readDeviceInfo() ;
+        else if(ret == TOOLBOX_FASTBOOT_ERROR_NOT_SUPPORTED)
+            readDeviceInfo() ;
+        else if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+            return ret ;
+    }
+
+    auto variable = deviceVariables.variablesList.find(name) ;
+    if(variable != deviceVariables.variablesList.end())
+    {
+        value = variable->second ;
+        return TOOLBOX_FASTBOOT_NO_ERROR ;
+    }
+
+    if(deviceVariables.complete)
+        return TOOLBOX_FASTBOOT_ERROR_OTHER ;
+    if(protocol == nullptr)
+        return TOOLBOX_FASTBOOT_ERROR_NOT_SUPPORTED ;
+
+    /* Not read when the session started: ask the device once, the value is kept */
+    int ret = protocol->getVar(name, value) ;
+    if(ret == TOOLBOX_FASTBOOT_NO_ERROR)
+        deviceVariables.variablesList[name] = value ;
+    return ret ;
+}
+
+/**
+ * @brief Fastboot::closeSession : Release the native fastboot session, if any.
+ */
+void Fastboot::closeSession()
+{
+    delete protocol ;
+    protocol = nullptr ;
+
+    if(transport != nullptr)
+    {
+        transport->close() ;
+        delete transport ;
+        transport = nullptr ;
+    }
+}
+
+/**
+ * @brief Fastboot::abandonSession : Close the native session after a device timeout or a link failure, a wedged device
+ * would answer the next commands with the late status of the abandoned one. The next command opens a new session.
+ * @param ret: The result of the failed operation.
+ * @return The result to report: the timeout is kept distinct, the other failures are write errors.
+ */
+int Fastboot::abandonSession(int ret)
+{
+    if(ret == TOOLBOX_FASTBOOT_ERROR_TIMEOUT)
+    {
+        displayManager.print(MSG_ERROR, L"The device stopped answering, fastboot session closed") ;
+        closeSession() ;
+        return ret ;
+    }
+
+    if(ret == TOOLBOX_FASTBOOT_ERROR_CONNECTION)
+    {
+        displayManager.print(MSG_ERROR, L"The link to the device failed, fastboot session closed") ;
+        closeSession() ;
+    }
+    return TOOLBOX_FASTBOOT_ERROR_WRITE ;
+}
+
+/**
+ * @brief Fastboot::printStatus : Print the result of a native step the same way as the fastboot tool.
+ * @param label: The step description, e.g. "Writing 'fsbl1'".
+ * @param ret: The step result.
+ * @param seconds: The step duration.
+ */
+void Fastboot::printStatus(const std::string &label, int ret, double seconds)
+{
+    if(ret == TOOLBOX_FASTBOOT_NO_ERROR)
+        displayManager.print(MSG_NORMAL, L"%-50s OKAY [%7.3fs]", label.c_str(), seconds) ;
+    else
+        displayManager.print(MSG_NORMAL, L"%-50s FAILED (%s)", label.c_str(), protocol->getLastError().c_str()) ;
+}
+
+/**
+ * @brief Fastboot::nativeCommand : Execute a command through the native session.
+ * @param cmd: The fastboot protocol command, e.g. "oem format".
+ * @param label: The step description printed with the result.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int Fastboot::nativeCommand(const std::string &cmd, const std::string &label)
+{
+    auto start = std::chrono::steady_clock::now() ;
+    int ret = protocol->command(cmd) ;
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start ;
+
+    printStatus(label, ret, elapsed.count()) ;
+    if(ret == TOOLBOX_FASTBOOT_NO_ERROR)
+        displayManager.print(MSG_NORMAL, L"Finished. Total time: %.3fs", elapsed.count()) ;
+
+    return ret ;
+}
+
+/**
+ * @brief Fastboot::planFlash : Prepare the downloads of an image, without any access to the device.
+ * An image larger than the device download buffer is sent as a series of sparse images, each one filling the buffer.
+ * Called from the preparation threads of the pipeline.
+ * @param partitionName: The name of the flash partition to update.
+ * @param partitionFirmwarePath: The binary file to be used to program.
+ * @param downloadLimit: The device download buffer size.
+ * @param prepared: Output, the downloads of the image.
+ * @return 0 if the operation is performed successfully, TOOLBOX_FASTBOOT_ERROR_NOT_SUPPORTED if the image
+ * cannot be sent with the device download buffer, otherwise an error occurred.
+ */
+int Fastboot::planFlash(const std::string &partitionName, const std::string &partitionFirmwarePath, uint32_t downloadLimit, preparedFlash &prepared)
+{
+    TraceScope traceScope("Plan " + partitionName, "pipeline") ;
+    prepared.filePath = partitionFirmwarePath ;
+    std::ifstream firmwareFile(partitionFirmwarePath, std::ios::binary | std::ios::ate) ;
+    if(firmwareFile.is_open() == false)
+        return TOOLBOX_FASTBOOT_ERROR_NO_FILE ;
+
+    uint64_t fileSize = static_cast<uint64_t>(firmwareFile.tellg()) ;
+    firmwareFile.close() ;
+
+    if(downloadLimit == 0)
+        return TOOLBOX_FASTBOOT_ERROR_NOT_SUPPORTED ;
+
+    std::shared_ptr<SparseImage> sparseImage = std::make_shared<SparseImage>(partitionFirmwarePath) ;
+    bool sendSparse = convertToSparse(partitionName, *sparseImage, prepared.report) ;
+    uint64_t downloadSize = sendSparse ? sparseImage->getSparseSize() : fileSize ;
+
+    char sendingLabel[256] ;
+    if(downloadSize <= downloadLimit)
+    {
+        snprintf(sendingLabel, sizeof(sendingLabel), "Sending %s'%s' (%lu KB)", sendSparse ? "sparse " : "", partitionName.c_str(), static_cast<unsigned long>(downloadSize / 1024)) ;
+        prepared.downloadsList.resize(1) ;
+        prepared.downloadsList[0].label = sendingLabel ;
+        prepared.downloadsList[0].size = downloadSize ;
+        if(sendSparse)
+            prepared.downloadsList[0].image = sparseImage ;
+        return TOOLBOX_FASTBOOT_NO_ERROR ;
+    }
+
+    if(std::find(std::begin(rawOnlyPartitions), std::end(rawOnlyPartitions), partitionName) != std::end(rawOnlyPartitions))
+        return TOOLBOX_FASTBOOT_ERROR_NOT_SUPPORTED ;
+
+    /* Raw images are split with FILL chunks: every block is written, whatever the sparse mode */
+    if(sendSparse == false)
+    {
+        int ret = SparseImage::isSparseFile(partitionFirmwarePath) ? sparseImage->load() : sparseImage->scan((sparse == SPARSE_OFF) ? SPARSE_FILL : sparse) ;
+        if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+            return TOOLBOX_FASTBOOT_ERROR_READ ;
+    }
+
+    std::vector<SparseImage> piecesList = sparseImage->split(downloadLimit) ;
+    if(piecesList.empty())
+        return TOOLBOX_FASTBOOT_ERROR_NOT_SUPPORTED ;
+
+    prepared.downloadsList.resize(piecesList.size()) ;
+    for(size_t i = 0; i < piecesList.size(); i++)
+    {
+        snprintf(sendingLabel, sizeof(sendingLabel), "Sending sparse '%s' %lu/%lu (%lu KB)", partitionName.c_str(), static_cast<unsigned long>(i + 1),
+                 static_cast<unsigned long>(piecesList.size()), static_cast<unsigned long>(piecesList[i].getSparseSize() / 1024)) ;
+        prepared.downloadsList[i].label = sendingLabel ;
+        prepared.downloadsList[i].size = piecesList[i].getSparseSize() ;
+        prepared.downloadsList[i].image = std::make_shared<SparseImage>(piecesList[i]) ;
+    }
+
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief Fastboot::nativeFlashPartition : Send the downloads of a step prepared by the pipeline and flash them through the native session.
+ * @param partitionName: The name of the flash partition to update.
+ * @param pipeline: The pipeline preparing the flashing sequence.
+ * @param stepIndex: The step of the partition in the sequence.
+ * @param timings: Updated with the time spent in each stage.
+ * @return 0 if the operation is performed successfully, TOOLBOX_FASTBOOT_ERROR_NOT_SUPPORTED if the image
+ * cannot be sent with the device download buffer, otherwise an error occurred.
+ */
+int Fastboot::nativeFlashPartition(const std::string &partitionName, FlashPipeline &pipeline, size_t stepIndex, pipelineTimings &timings)
+{
+    preparedFlash &prepared = pipeline.waitPlan(stepIndex, timings.waitSeconds) ;
+    if(prepared.report.empty() == false)
+        displayManager.print(MSG_NORMAL, L"%s", prepared.report.c_str()) ;
+
+    if(prepared.result == TOOLBOX_FASTBOOT_ERROR_NO_FILE)
+        displayManager.print(MSG_ERROR, L"Cannot open the file %s", prepared.filePath.c_str()) ;
+    else if(prepared.result == TOOLBOX_FASTBOOT_ERROR_READ)
+        displayManager.print(MSG_ERROR, L"Cannot split the image %s", prepared.filePath.c_str()) ;
+    if(prepared.result != TOOLBOX_FASTBOOT_NO_ERROR)
+        return prepared.result ;
+
+    auto start = std::chrono::steady_clock::now() ;
+    for(size_t i = 0; i < prepared.downloadsList.size(); i++)
+    {
+        preparedDownload *download = pipeline.waitDownload(stepIndex, i, timings.waitSeconds) ;
+        if(download == nullptr)
+        {
+            displayManager.print(MSG_ERROR, L"Failed to read the file %s", prepared.filePath.c_str()) ;
+            return TOOLBOX_FASTBOOT_ERROR_READ ;
+        }
+
+        int ret = nativeDownloadAndFlash(partitionName, download->label, download->size, [&](bool &readFailed)
+        {
+            int sendRet = TOOLBOX_FASTBOOT_NO_ERROR ;
+            auto output = [this, &sendRet](const uint8_t *data, size_t length) { return sendRet = protocol->sendData(data, length) ; } ;
+            if(download->data.empty() == false)
+            {
+                for(size_t offset = 0; offset < download->data.size(); offset += NATIVE_DOWNLOAD_CHUNK_SZ)
+                {
+                    int sendRet = output(download->data.data() + offset, std::min(NATIVE_DOWNLOAD_CHUNK_SZ, download->data.size() - offset)) ;
+                    if(sendRet != TOOLBOX_FASTBOOT_NO_ERROR)
+                        return sendRet ;
+                }
+                return static_cast<int>(TOOLBOX_FASTBOOT_NO_ERROR) ;
+            }
+
+            int readRet = TOOLBOX_FASTBOOT_NO_ERROR ;
+            if(download->image != nullptr)
+            {
+                readRet = download->image->write(output) ;
+            }
+            else
+            {
+                /* Sent straight from the mapping of the file when the system allows it */
+                ImageSource source(prepared.filePath) ;
+                readRet = source.open() ;
+                if(readRet == TOOLBOX_FASTBOOT_NO_ERROR)
+                    readRet = source.read(0, download->size, output) ;
+            }
+
+            /* The transport errors are reported with the download, only a file error is reported here */
+            if(sendRet != TOOLBOX_FASTBOOT_NO_ERROR)
+                return sendRet ;
+            if(readRet != TOOLBOX_FASTBOOT_NO_ERROR)
+            {
+                displayManager.print(MSG_ERROR, L"Failed to read the file %s", prepared.filePath.c_str()) ;
+                readFailed = true ;
+                return static_cast<int>(TOOLBOX_FASTBOOT_ERROR_READ) ;
+            }
+            return static_cast<int>(TOOLBOX_FASTBOOT_NO_ERROR) ;
+        }, timings) ;
+
+        if(download->data.empty() == false)
+            timings.bufferedBytes += download->size ;
+        else if(prepared.mapped)
+            timings.mappedBytes += download->size ;
+        else
+            timings.streamedBytes += download->size ;
+        pipeline.release(stepIndex, i) ;
+
+        if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+            return ret ;
+    }
+
+    displayManager.print(MSG_NORMAL, L"Finished. Total time: %.3fs", std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()) ;
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief Fastboot::nativeDownloadAndFlash : Send one download buffer and write it to a partition.
+ * @param partitionName: The name of the flash partition to update.
+ * @param sendingLabel: The download description printed with its result.
+ * @param downloadSize: Number of bytes announced to the device.
+ * @param sendPayload: Sends exactly downloadSize bytes with protocol->sendData(), sets its argument if the image file cannot be read.
+ * @param timings: Updated with the transfer and write durations.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int Fastboot::nativeDownloadAndFlash(const std::string &partitionName, const std::string &sendingLabel, uint64_t downloadSize, const std::function<int(bool &readFailed)> &sendPayload, pipelineTimings &timings)
+{
+    auto start = std::chrono::steady_clock::now() ;
+    int ret = protocol->downloadCommand(static_cast<uint32_t>(downloadSize)) ;
+    auto accepted = std::chrono::steady_clock::now() ;
+    bool readFailed = false ;
+    if(ret == TOOLBOX_FASTBOOT_NO_ERROR)
+        ret = sendPayload(readFailed) ;
+    if(readFailed)
+    {
+        /* The device still waits for the rest of the data */
+        closeSession() ;
+        return ret ;
+    }
+    auto transferred = std::chrono::steady_clock::now() ;
+    if(ret == TOOLBOX_FASTBOOT_NO_ERROR)
+        ret = protocol->readResponse() ;
+
+    auto sent = std::chrono::steady_clock::now() ;
+    TraceRecorder::getInstance().addEvent("Data transfer " + partitionName, "device", accepted, transferred) ;
+    TraceRecorder::getInstance().addEvent("OKAY wait", "device", transferred, sent) ;
+    timings.transferSeconds += std::chrono::duration<double>(sent - start).count() ;
+    printStatus(sendingLabel, ret, std::chrono::duration<double>(sent - start).count()) ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        return abandonSession(ret) ;
+
+    ret = protocol->flash(partitionName) ;
+    auto written = std::chrono::steady_clock::now() ;
+    timings.writeSeconds += std::chrono::duration<double>(written - sent).count() ;
+    printStatus("Writing '" + partitionName + "'", ret, std::chrono::duration<double>(written - sent).count()) ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        return abandonSession(ret) ;
+
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
 /**
  * @brief Fastboot::flashPartition : Get the fastboot command ready, then flash one partition..
  * @param partitionName: The name of the flash partition to update.
@@ -34,42 +557,65 @@ Fastboot::Fastboot()
  */
 int Fastboot::flashPartition(const std::string partitionName, const std::string partitionFirmwarePath)
 {
+    pipelineTimings timings ;
+    return flashPartition(partitionName, partitionFirmwarePath, nullptr, 0, timings) ;
+}
+
+/**
+ * @brief Fastboot::flashPartition : Flash one partition, with the image prepared by the pipeline of the sequence if any.
+ * @param partitionName: The name of the flash partition to update.
+ * @param partitionFirmwarePath: The binary file to be used to program.
+ * @param pipeline: The pipeline preparing the flashing sequence, nullptr to prepare the image here.
+ * @param stepIndex: The step of the partition in the pipeline sequence.
+ * @param timings: Updated with the time spent in each stage.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int Fastboot::flashPartition(const std::string &partitionName, const std::string &partitionFirmwarePath, FlashPipeline *pipeline, size_t stepIndex, pipelineTimings &timings)
+{
+    TraceScope traceScope("Flash " + partitionName, "session") ;
     displayManager.print(MSG_NORMAL, L"Partition name  : %s", partitionName.c_str());
     displayManager.print(MSG_NORMAL, L"Firmware path   : %s\n", partitionFirmwarePath.c_str());
 
-    std::string fastbootCmd = getFastbootProgramPath().append("flash ") ;
-    fastbootCmd.append(partitionName).append(" ").append(partitionFirmwarePath) ;
-    if(this->fastbootSerialNumber != "")
-        fastbootCmd.append(" -s ").append(this->fastbootSerialNumber);
-
-    fastbootCmd.append("  2>&1");
-#ifdef _WIN32
-    fastbootCmd = "\"" + fastbootCmd + "\"" ;
-#endif
-    displayManager.print(MSG_NORMAL, L"fastboot command: %s", fastbootCmd.data()) ;
-
-    FILE* pipe = popen(fastbootCmd.c_str(), "r");
-    if (pipe == nullptr)
+    int ret = openSession() ;
+    if(ret == TOOLBOX_FASTBOOT_NO_ERROR)
     {
-        displayManager.print(MSG_ERROR, L"Failed to open pipe") ;
-        return TOOLBOX_FASTBOOT_ERROR_NO_MEM;
-    }
+        FlashPipeline singlePipeline(0, 1) ;
+        if(pipeline == nullptr)
+        {
+            uint32_t downloadLimit = maxDownloadSize ;
+            singlePipeline.start(1, [&](size_t, preparedFlash &prepared) { return planFlash(partitionName, partitionFirmwarePath, downloadLimit, prepared) ; }) ;
+            pipeline = &singlePipeline ;
+            stepIndex = 0 ;
+        }
 
-    char buffer[4096];
-    std::string result = "";
-    while (!feof(pipe))
-    {
-        if (fgets(buffer, 4096, pipe) != nullptr)
+        ret = nativeFlashPartition(partitionName, *pipeline, stepIndex, timings) ;
+        if(ret == TOOLBOX_FASTBOOT_NO_ERROR)
+        {
+            displayManager.print(MSG_GREEN, L"Partition %s : Download Done\n", partitionName.c_str()) ;
+            return TOOLBOX_FASTBOOT_NO_ERROR ;
+        }
+        else if(ret != TOOLBOX_FASTBOOT_ERROR_NOT_SUPPORTED)
         {
-            result += buffer;
+            displayManager.print(MSG_ERROR, L"Partition %s : Download Failed", partitionName.c_str()) ;
+            return ret ;
         }
+
+        /* The image cannot be split for the device download buffer: leave it to the fastboot tool, release the device for it */
+        displayManager.print(MSG_NORMAL, L"Image larger than the device download buffer, using the fastboot tool") ;
+        closeSession() ;
+    }
+    else if(ret != TOOLBOX_FASTBOOT_ERROR_NOT_SUPPORTED)
+    {
+        displayManager.print(MSG_ERROR, L"Partition %s : Download Failed", partitionName.c_str()) ;
+        return ret ;
     }
-    pclose(pipe);
 
-    std::cout << result << std::endl ;
-    std::string searchString = "Finished.";
-    size_t pos = result.find(searchString);
-    if (pos != std::string::npos)
+    FastbootOutputParser parser([this](const outputEvent &event) { printOutputEvent(event) ; }) ;
+    ret = runFastbootTool({"flash", partitionName, prepareToolImage(partitionName, partitionFirmwarePath)}, parser) ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        return ret ;
+
+    if(parser.hasFinished() && (parser.hasFailed() == false))
     {
         displayManager.print(MSG_GREEN, L"Partition %s : Download Done\n", partitionName.c_str()) ;
         return TOOLBOX_FASTBOOT_NO_ERROR ;
@@ -88,37 +634,28 @@ int Fastboot::flashPartition(const std::string partitionName, const std::string
  */
 int Fastboot::oemFormatMemory()
 {
+    TraceScope traceScope("oem format", "session") ;
     displayManager.print(MSG_NORMAL, L"Memory partitioning...\n") ;
+    deviceVariables = deviceInfo() ; /* The partitions variables change */
 
-    std::string fastbootCmd = getFastbootProgramPath().append("oem format ") ;
-    if(this->fastbootSerialNumber != "")
-        fastbootCmd.append(" -s ").append(this->fastbootSerialNumber);
-
-    fastbootCmd.append("  2>&1");
-    displayManager.print(MSG_NORMAL, L"fastboot command: %s", fastbootCmd.data()) ;
-
-    FILE* pipe = popen(fastbootCmd.c_str(), "r");
-    if (pipe == nullptr)
+    int ret = openSession() ;
+    if(ret == TOOLBOX_FASTBOOT_NO_ERROR)
+        ret = nativeCommand("oem format", "oem format") ;
+    if(ret != TOOLBOX_FASTBOOT_ERROR_NOT_SUPPORTED)
     {
-        displayManager.print(MSG_ERROR, L"Failed to open pipe") ;
-        return TOOLBOX_FASTBOOT_ERROR_NO_MEM;
+        if(ret == TOOLBOX_FASTBOOT_NO_ERROR)
+            displayManager.print(MSG_NORMAL, L"Target memory partitioning is done.") ;
+        else
+            displayManager.print(MSG_ERROR, L"Failed to setup the partitions format.") ;
+        return (ret == TOOLBOX_FASTBOOT_NO_ERROR) ? TOOLBOX_FASTBOOT_NO_ERROR : abandonSession(ret) ;
     }
 
-    char buffer[4096];
-    std::string result = "";
-    while (!feof(pipe))
-    {
-        if (fgets(buffer, 4096, pipe) != nullptr)
-        {
-            result += buffer;
-        }
-    }
-    pclose(pipe);
+    FastbootOutputParser parser([this](const outputEvent &event) { printOutputEvent(event) ; }) ;
+    ret = runFastbootTool({"oem", "format"}, parser) ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        return ret ;
 
-    std::cout << result << std::endl ;
-    std::string searchString = "Finished.";
-    size_t pos = result.find(searchString);
-    if (pos != std::string::npos)
+    if(parser.hasFinished() && (parser.hasFailed() == false))
     {
         displayManager.print(MSG_NORMAL, L"Target memory partitioning is done.") ;
         return TOOLBOX_FASTBOOT_NO_ERROR ;
@@ -137,25 +674,26 @@ int Fastboot::oemFormatMemory()
  */
 bool Fastboot::isUbootFastbootRunning()
 {
-    std::string  fastbootCmd = getFastbootProgramPath().append("devices") ;
-    FILE* pipe = popen(fastbootCmd.c_str(), "r");
-    if (pipe == nullptr)
+    TraceScope traceScope("Device probe", "session") ;
+    int ret = openSession() ;
+    if(ret == TOOLBOX_FASTBOOT_NO_ERROR)
     {
-        displayManager.print(MSG_ERROR, L"Failed to open pipe") ;
-        return false;
+        displayManager.print(MSG_GREEN, L"U-Boot in Fastboot mode is running !") ;
+        return true ;
     }
-
-    char buffer[4096];
-    std::string result = "";
-
-    while (!feof(pipe))
+    else if(ret != TOOLBOX_FASTBOOT_ERROR_NOT_SUPPORTED)
     {
-        if (fgets(buffer, 4096, pipe) != nullptr)
-        {
-            result += buffer;
-        }
+        if(this->fastbootSerialNumber != "")
+            displayManager.print(MSG_WARNING, L"No U-Boot [%s] in Fastboot mode is running !", this->fastbootSerialNumber.data()) ;
+        else
+            displayManager.print(MSG_WARNING, L"No U-Boot in Fastboot mode is running !") ;
+        return false ;
     }
-    pclose(pipe);
+
+    std::string result = "";
+    FastbootOutputParser parser([&result](const outputEvent &event) { result.append(event.line).append("\n") ; }) ;
+    if(runFastbootTool({"devices"}, parser, false) != TOOLBOX_FASTBOOT_NO_ERROR)
+        return false;
 
     std::string searchString = "FASTBOOT" ;
     std::transform(result.begin(), result.end(), result.begin(), ::toupper);
@@ -190,26 +728,57 @@ bool Fastboot::isUbootFastbootRunning()
 
 /**
  * @brief Fastboot::getFastbootProgramPath : Get the path of fastboot program from the project directory.
- * @return The fastboot executable path.
+ * The path is resolved and checked once, then reused by every command.
+ * @return The fastboot executable path, empty if the program is missing.
  */
-std::string Fastboot::getFastbootProgramPath()
+const std::string& Fastboot::getFastbootProgramPath()
 {
+    if(fastbootProgramResolved)
+        return fastbootProgramPath ;
+
     std::string path = this->toolboxFolder; //from the project tree
 #ifdef _WIN32
     path.append("\\fastboot\\Windows\\fastboot.exe") ;
-    path = "\"" + path + "\" " ;
 #elif __APPLE__
     path.append("/fastboot/MacOS/fastboot") ;
-    path = "\"" + path + "\" " ;
 #elif __linux__
     path.append("/fastboot/Linux/fastboot") ;
-    path = "\"" + path + "\" " ;
 #else
     path = "" ;
 #endif
 
+    fastbootProgramResolved = true ;
+    if(path.empty() || (ProcessExecutor::isExecutable(path) == false))
+    {
+        displayManager.print(MSG_ERROR, L"fastboot application not found : %s", path.c_str()) ;
+        fastbootProgramPath = "" ;
+        return fastbootProgramPath ;
+    }
+
     displayManager.print(MSG_NORMAL, L"fastboot application path : %s", path.c_str()) ;
-    return path;
+    fastbootProgramPath = path ;
+    return fastbootProgramPath;
+}
+
+/**
+ * @brief Fastboot::getPartitionSizes : Read the size of partitions in the GPT of the device.
+ * @param partNames: The partitions.
+ * @param sizesList: Output, the size of each partition found on the device, the missing ones are not listed.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int Fastboot::getPartitionSizes(const std::vector<std::string> &partNames, std::map<std::string, uint64_t> &sizesList)
+{
+    sizesList.clear() ;
+    for(const auto &partName : partNames)
+    {
+        std::string value ;
+        int ret = getVariable("partition-size:" + partName, value) ;
+        if(ret == TOOLBOX_FASTBOOT_NO_ERROR)
+            sizesList[partName] = strtoull(value.c_str(), nullptr, 0) ;
+        else if(ret != TOOLBOX_FASTBOOT_ERROR_OTHER)
+            return ret ;
+    }
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
 }
 
 /**
@@ -219,41 +788,27 @@ std::string Fastboot::getFastbootProgramPath()
  */
 int Fastboot::erasePartition(const std::string partitionName)
 {
+    TraceScope traceScope("Erase " + partitionName, "session") ;
     displayManager.print(MSG_NORMAL, L"Erasing partition [%s]...", partitionName.c_str());
 
-    std::string fastbootCmd = getFastbootProgramPath().append("erase ") ;
-    fastbootCmd.append(partitionName) ;
-    if(this->fastbootSerialNumber != "")
-        fastbootCmd.append(" -s ").append(this->fastbootSerialNumber);
-
-    fastbootCmd.append("  2>&1");
-#ifdef _WIN32
-    fastbootCmd = "\"" + fastbootCmd + "\"" ;
-#endif
-    displayManager.print(MSG_NORMAL, L"fastboot command: %s", fastbootCmd.data()) ;
-
-    FILE* pipe = popen(fastbootCmd.c_str(), "r");
-    if (pipe == nullptr)
+    int ret = openSession() ;
+    if(ret == TOOLBOX_FASTBOOT_NO_ERROR)
+        ret = nativeCommand("erase:" + partitionName, "Erasing '" + partitionName + "'") ;
+    if(ret != TOOLBOX_FASTBOOT_ERROR_NOT_SUPPORTED)
     {
-        displayManager.print(MSG_ERROR, L"Failed to open pipe") ;
-        return TOOLBOX_FASTBOOT_ERROR_NO_MEM;
+        if(ret == TOOLBOX_FASTBOOT_NO_ERROR)
+            displayManager.print(MSG_GREEN, L"Partition %s : Erase Done\n", partitionName.c_str()) ;
+        else
+            displayManager.print(MSG_ERROR, L"Partition %s : Erase Failed", partitionName.c_str()) ;
+        return (ret == TOOLBOX_FASTBOOT_NO_ERROR) ? TOOLBOX_FASTBOOT_NO_ERROR : abandonSession(ret) ;
     }
 
-    char buffer[4096];
-    std::string result = "";
-    while (!feof(pipe))
-    {
-        if (fgets(buffer, 4096, pipe) != nullptr)
-        {
-            result += buffer;
-        }
-    }
-    pclose(pipe);
+    FastbootOutputParser parser([this](const outputEvent &event) { printOutputEvent(event) ; }) ;
+    ret = runFastbootTool({"erase", partitionName}, parser) ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        return ret ;
 
-    std::cout << result << std::endl ;
-    std::string searchString = "Finished.";
-    size_t pos = result.find(searchString);
-    if (pos != std::string::npos)
+    if(parser.hasFinished() && (parser.hasFailed() == false))
     {
         displayManager.print(MSG_GREEN, L"Partition %s : Erase Done\n", partitionName.c_str()) ;
         return TOOLBOX_FASTBOOT_NO_ERROR ;
@@ -268,52 +823,88 @@ int Fastboot::erasePartition(const std::string partitionName)
 
 
 /**
- * @brief Fastboot::displayDevicesList : Print the list of available Fastboot devices.
+ * @brief Fastboot::listDevices : Get the serial numbers of the available Fastboot devices.
+ * @param serialNumbers: Output, the serial numbers found.
  * @return 0 if the operation is performed successfully, otherwise an error occurred.
  */
-int Fastboot::displayDevicesList()
+int Fastboot::listDevices(std::vector<std::string> &serialNumbers)
 {
-    std::string  fastbootCmd =  getFastbootProgramPath().append(" devices") ;
-    displayManager.print(MSG_NORMAL, L"fastboot command: %s", fastbootCmd.data()) ;
+    TraceScope traceScope("List devices", "session") ;
+    serialNumbers.clear() ;
 
-    FILE* pipe = popen(fastbootCmd.c_str(), "r");
-    if (pipe == nullptr)
+    if((this->transportSpec.compare(0, strlen(TRANSPORT_TCP), TRANSPORT_TCP) == 0) ||
+       (this->transportSpec.compare(0, strlen(TRANSPORT_LOOPBACK), TRANSPORT_LOOPBACK) == 0))
     {
-        displayManager.print(MSG_ERROR, L"Failed to open pipe") ;
-        return TOOLBOX_FASTBOOT_ERROR_OTHER;
-    }
-
-    char buffer[4096];
-    std::string result = "";
-    while (!feof(pipe))
-    {
-        if (fgets(buffer, 4096, pipe) != nullptr)
+        /* Network and emulated devices are not discoverable, report the configured one if it answers */
+        bool probing = (protocol == nullptr) ;
+        if(openSession() == TOOLBOX_FASTBOOT_NO_ERROR)
         {
-            result += buffer;
+            std::string serialNumber ;
+            if(getVariable("serialno", serialNumber) != TOOLBOX_FASTBOOT_NO_ERROR)
+                serialNumber = this->transportSpec ;
+            serialNumbers.push_back(serialNumber) ;
+
+            /* Release the device for the session that will flash it */
+            if(probing)
+                closeSession() ;
         }
+        return TOOLBOX_FASTBOOT_NO_ERROR ;
     }
-    pclose(pipe);
 
-    std::vector<std::string> serialNumbers;
-    try
+    if(((this->transportSpec == "") || (this->transportSpec == TRANSPORT_USB)) && UsbTransport::isSupported())
     {
-        std::regex regex("([A-F0-9]+)\\s+(fastboot|Android Fastboot)");
-        std::smatch match;
-
-        std::string::const_iterator searchStart(result.cbegin());
-        while (std::regex_search(searchStart, result.cend(), match, regex))
+        std::vector<usbFastbootDevice> devicesList ;
+        int ret = UsbTransport::listDevices(devicesList) ;
+        if(ret == TOOLBOX_FASTBOOT_NO_ERROR)
         {
-            std::string serial = match[1];
-            serialNumbers.push_back(serial);
-            searchStart = match.suffix().first;
+            for(const auto &device : devicesList)
+                serialNumbers.push_back(device.serialNumber) ;
+            return TOOLBOX_FASTBOOT_NO_ERROR ;
+        }
+        else if(this->transportSpec == TRANSPORT_USB)
+        {
+            return ret ;
         }
     }
-    catch (const std::regex_error& e)
+
+    std::string result = "";
+    FastbootOutputParser parser([&result](const outputEvent &event) { result.append(event.line).append("\n") ; }) ;
+    if(runFastbootTool({"devices"}, parser, false) != TOOLBOX_FASTBOOT_NO_ERROR)
+        return TOOLBOX_FASTBOOT_ERROR_OTHER;
+
+    /* Lines "<serial number>\t<fastboot|Android Fastboot>" */
+    size_t lineStart = 0 ;
+    while(lineStart < result.size())
     {
-        displayManager.print(MSG_ERROR, L"Regex error: %s", e.what());
-        return false ;
+        size_t lineEnd = result.find('\n', lineStart) ;
+        if(lineEnd == std::string::npos)
+            lineEnd = result.size() ;
+
+        size_t serialStart = result.find_first_not_of(" \t", lineStart) ;
+        size_t serialEnd = (serialStart < lineEnd) ? result.find_first_not_of("0123456789ABCDEF", serialStart) : std::string::npos ;
+        size_t modeStart = (serialEnd < lineEnd) ? result.find_first_not_of(" \t", serialEnd) : std::string::npos ;
+        if((serialEnd > serialStart) && (modeStart > serialEnd) && (modeStart < lineEnd) &&
+           ((result.compare(modeStart, 8, "fastboot") == 0) || (result.compare(modeStart, 16, "Android Fastboot") == 0)))
+            serialNumbers.push_back(result.substr(serialStart, serialEnd - serialStart)) ;
+
+        lineStart = lineEnd + 1 ;
     }
 
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief Fastboot::displayDevicesList : Print the list of available Fastboot devices.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int Fastboot::displayDevicesList()
+{
+    TraceScope traceScope("Display devices", "session") ;
+    std::vector<std::string> serialNumbers;
+    int ret = listDevices(serialNumbers) ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        return ret ;
+
     // Check if any devices were found
     if (serialNumbers.empty())
     {
@@ -345,38 +936,28 @@ int Fastboot::displayDevicesList()
  */
 int Fastboot::oemBootbus(uint16_t width, uint16_t reset, uint16_t mode)
 {
+    TraceScope traceScope("oem bootbus", "session") ;
     displayManager.print(MSG_NORMAL, L"OEM Bootbus...\n") ;
 
-    std::string fastbootCmd = getFastbootProgramPath().append("oem bootbus: ") ;
-    fastbootCmd.append(std::to_string(width)).append(" ").append(std::to_string(reset)).append(" ").append(std::to_string(mode)) ;
-    if(this->fastbootSerialNumber != "")
-        fastbootCmd.append(" -s ").append(this->fastbootSerialNumber);
-
-    fastbootCmd.append("  2>&1");
-    displayManager.print(MSG_NORMAL, L"fastboot command: %s", fastbootCmd.data()) ;
-
-    FILE* pipe = popen(fastbootCmd.c_str(), "r");
-    if (pipe == nullptr)
+    std::string oemArguments = "bootbus: " + std::to_string(width) + " " + std::to_string(reset) + " " + std::to_string(mode) ;
+    int ret = openSession() ;
+    if(ret == TOOLBOX_FASTBOOT_NO_ERROR)
+        ret = nativeCommand("oem " + oemArguments, "oem " + oemArguments) ;
+    if(ret != TOOLBOX_FASTBOOT_ERROR_NOT_SUPPORTED)
     {
-        displayManager.print(MSG_ERROR, L"Failed to open pipe") ;
-        return TOOLBOX_FASTBOOT_ERROR_NO_MEM;
+        if(ret == TOOLBOX_FASTBOOT_NO_ERROR)
+            displayManager.print(MSG_NORMAL, L"OEM Bootbus command is done with success.") ;
+        else
+            displayManager.print(MSG_ERROR, L"Failed to execute OEM Bootbus command.") ;
+        return (ret == TOOLBOX_FASTBOOT_NO_ERROR) ? TOOLBOX_FASTBOOT_NO_ERROR : abandonSession(ret) ;
     }
 
-    char buffer[4096];
-    std::string result = "";
-    while (!feof(pipe))
-    {
-        if (fgets(buffer, 4096, pipe) != nullptr)
-        {
-            result += buffer;
-        }
-    }
-    pclose(pipe);
+    FastbootOutputParser parser([this](const outputEvent &event) { printOutputEvent(event) ; }) ;
+    ret = runFastbootTool({"oem", "bootbus:", std::to_string(width), std::to_string(reset), std::to_string(mode)}, parser) ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        return ret ;
 
-    std::cout << result << std::endl ;
-    std::string searchString = "Finished.";
-    size_t pos = result.find(searchString);
-    if (pos != std::string::npos)
+    if(parser.hasFinished() && (parser.hasFailed() == false))
     {
         displayManager.print(MSG_NORMAL, L"OEM Bootbus command is done with success.") ;
         return TOOLBOX_FASTBOOT_NO_ERROR ;
@@ -397,46 +978,464 @@ int Fastboot::oemBootbus(uint16_t width, uint16_t reset, uint16_t mode)
  */
 int Fastboot::oemPartconf(uint16_t bootAck, uint16_t activeEmmcBootPartition)
 {
+    TraceScope traceScope("oem partconf", "session") ;
     displayManager.print(MSG_NORMAL, L"OEM Partconf...\n") ;
 
-    std::string fastbootCmd = getFastbootProgramPath().append("oem partconf: ") ;
-    fastbootCmd.append(std::to_string(bootAck)).append(" ").append(std::to_string(activeEmmcBootPartition)) ;
-    if(this->fastbootSerialNumber != "")
-        fastbootCmd.append(" -s ").append(this->fastbootSerialNumber);
+    std::string oemArguments = "partconf: " + std::to_string(bootAck) + " " + std::to_string(activeEmmcBootPartition) ;
+    int ret = openSession() ;
+    if(ret == TOOLBOX_FASTBOOT_NO_ERROR)
+        ret = nativeCommand("oem " + oemArguments, "oem " + oemArguments) ;
+    if(ret != TOOLBOX_FASTBOOT_ERROR_NOT_SUPPORTED)
+    {
+        if(ret == TOOLBOX_FASTBOOT_NO_ERROR)
+            displayManager.print(MSG_NORMAL, L"OEM Partconf command is done with success.") ;
+        else
+            displayManager.print(MSG_ERROR, L"Failed to execute OEM Partconf command.") ;
+        return (ret == TOOLBOX_FASTBOOT_NO_ERROR) ? TOOLBOX_FASTBOOT_NO_ERROR : abandonSession(ret) ;
+    }
+
+    FastbootOutputParser parser([this](const outputEvent &event) { printOutputEvent(event) ; }) ;
+    ret = runFastbootTool({"oem", "partconf:", std::to_string(bootAck), std::to_string(activeEmmcBootPartition)}, parser) ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        return ret ;
 
-    fastbootCmd.append("  2>&1");
-    displayManager.print(MSG_NORMAL, L"fastboot command: %s", fastbootCmd.data()) ;
+    if(parser.hasFinished() && (parser.hasFailed() == false))
+    {
+        displayManager.print(MSG_NORMAL, L"OEM Partconf command is done with success.") ;
+        return TOOLBOX_FASTBOOT_NO_ERROR ;
 
-    FILE* pipe = popen(fastbootCmd.c_str(), "r");
-    if (pipe == nullptr)
+    }
+    else
     {
-        displayManager.print(MSG_ERROR, L"Failed to open pipe") ;
-        return TOOLBOX_FASTBOOT_ERROR_NO_MEM;
+        displayManager.print(MSG_ERROR, L"Failed to execute OEM Partconf command.") ;
+        return TOOLBOX_FASTBOOT_ERROR_WRITE ;
     }
+}
 
-    char buffer[4096];
-    std::string result = "";
-    while (!feof(pipe))
+/**
+ * @brief Fastboot::runFastbootTool : Run the bundled fastboot tool and stream its output to a parser.
+ * The tool is stopped at the first failure instead of waiting for it to give up, or when it prints nothing
+ * for longer than the slowest of its commands may take.
+ * @param arguments: The fastboot arguments, e.g. {"flash", "fsbl1", "file.stm32"}.
+ * @param parser: The parser receiving the output as it is produced.
+ * @param selectDevice: Add the "-s <serial number>" option when a device is selected.
+ * @return 0 if the tool could be started, TOOLBOX_FASTBOOT_ERROR_TIMEOUT if it was stopped for its silence,
+ * otherwise an error occurred.
+ */
+int Fastboot::runFastbootTool(const std::vector<std::string> &arguments, FastbootOutputParser &parser, bool selectDevice)
+{
+    TraceScope traceScope("fastboot " + (arguments.empty() ? std::string() : arguments[0]), "tool") ;
+    const std::string &programPath = getFastbootProgramPath() ;
+    if(programPath.empty())
+        return TOOLBOX_FASTBOOT_ERROR_NO_FILE ;
+
+    std::vector<std::string> toolArguments ;
+    if(selectDevice && (this->fastbootSerialNumber != ""))
+        toolArguments.insert(toolArguments.end(), {"-s", this->fastbootSerialNumber}) ;
+    toolArguments.insert(toolArguments.end(), arguments.begin(), arguments.end()) ;
+
+    displayManager.print(MSG_NORMAL, L"fastboot command: %s", ProcessExecutor::formatCommandLine(programPath, toolArguments).c_str()) ;
+
+    uint32_t timeoutMs = getToolTimeout(arguments) ;
+    int ret = ProcessExecutor::getInstance().run(programPath, toolArguments, [&parser](outputStream stream, const char *data, size_t length)
+    {
+        parser.feed(data, length, stream) ;
+        return parser.hasFailed() == false ;
+    }, nullptr, timeoutMs) ;
+    parser.finish() ;
+    removeTemporaryFiles() ;
+
+    if(ret == TOOLBOX_FASTBOOT_ERROR_TIMEOUT)
+        displayManager.print(MSG_ERROR, L"fastboot tool stopped: no output for %.1fs", timeoutMs / 1000.0) ;
+
+    return ret ;
+}
+
+/**
+ * @brief Fastboot::getToolTimeout : Longest silence allowed to the fastboot tool, the one of its slowest command.
+ * The tool prints a line when each transfer or device command starts and ends, or waits silently for the device.
+ * @param arguments: The fastboot arguments, several commands when they are chained.
+ * @return The timeout in ms, 0 to wait forever.
+ */
+uint32_t Fastboot::getToolTimeout(const std::vector<std::string> &arguments)
+{
+    std::vector<uint32_t> timeoutsList = {timeouts.command} ;
+    size_t i = 0 ;
+    while(i < arguments.size())
+    {
+        if((arguments[i] == "flash") && (i + 2 < arguments.size()))
+        {
+            std::error_code error ;
+            uintmax_t imageSize = fs::file_size(arguments[i + 2], error) ;
+            uint32_t flashTimeout = FastbootProtocol::getFlashTimeout(timeouts, error ? 0 : static_cast<uint64_t>(imageSize)) ;
+            timeoutsList.push_back(timeouts.transfer) ;
+            timeoutsList.push_back((flashTimeout == 0) ? 0 : static_cast<uint32_t>(std::min<uint64_t>(static_cast<uint64_t>(flashTimeout) + timeouts.transfer, UINT32_MAX))) ;
+            i += 3 ;
+        }
+        else if(arguments[i] == "erase")
+        {
+            timeoutsList.push_back(timeouts.erase) ;
+            i += 2 ;
+        }
+        else if(arguments[i] == "oem")
+        {
+            /* "oem" takes all the remaining arguments */
+            timeoutsList.push_back(((i + 1 < arguments.size()) && (arguments[i + 1] == "format")) ? timeouts.format : timeouts.command) ;
+            break ;
+        }
+        else
+        {
+            i++ ;
+        }
+    }
+
+    /* A disabled timeout of any command disables the watchdog of the whole run */
+    if(std::find(timeoutsList.begin(), timeoutsList.end(), 0u) != timeoutsList.end())
+        return 0 ;
+    return *std::max_element(timeoutsList.begin(), timeoutsList.end()) ;
+}
+
+/**
+ * @brief Fastboot::printOutputEvent : Print a fastboot tool output line as soon as it is parsed.
+ * @param event: The parsed output event.
+ */
+void Fastboot::printOutputEvent(const outputEvent &event)
+{
+    if(event.type == EVENT_STEP_START)
+        return ; /* Printed with its status when the line ends */
+
+    /* The tool times its own phases: they are traced as ending when their status line is read */
+    if(((event.type == EVENT_STEP_OKAY) || (event.type == EVENT_STEP_FAILED)) && TraceRecorder::getInstance().isEnabled())
+    {
+        auto end = std::chrono::steady_clock::now() ;
+        auto start = end - std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(event.seconds)) ;
+        std::string name = (event.phase == PHASE_SENDING) ? "Data transfer " + event.partName : (event.phase == PHASE_WRITING) ? "flash:" + event.partName :
+                           (event.phase == PHASE_ERASING) ? "erase:" + event.partName : std::string("oem") ;
+        TraceRecorder::getInstance().addEvent(name, "device", start, end) ;
+    }
+
+    if((event.type == EVENT_STEP_FAILED) || (event.type == EVENT_ERROR))
+        displayManager.print(MSG_ERROR, L"%s", event.line.c_str()) ;
+    else
+        displayManager.print(MSG_NORMAL, L"%s", event.line.c_str()) ;
+}
+
+/**
+ * @brief Fastboot::executeSteps : Execute a flashing sequence, stopping at the first failure.
+ * With a native session every step reuses the open device link, and the images of the next steps are
+ * prepared by a FlashPipeline while the current one is transferred. With the bundled fastboot tool,
+ * consecutive steps are chained on a single command line so the device is discovered and claimed
+ * once per batch instead of once per step.
+ * Each successful step is signaled through onStepCompleted when it ends, before the next one starts.
+ * @param stepsList: The steps to execute, their result field is updated.
+ * @return 0 if all the steps are performed successfully, otherwise the error of the failed step.
+ */
+int Fastboot::executeSteps(std::vector<fastbootStep> &stepsList)
+{
+    TraceScope traceScope("Flashing sequence", "session") ;
+    for(auto &step : stepsList)
+        step.result = TOOLBOX_FASTBOOT_ERROR_OTHER ;
+    stepsTimingsList.assign(stepsList.size(), stepTimings()) ;
+
+    int ret = openSession() ;
+    if(ret == TOOLBOX_FASTBOOT_NO_ERROR)
     {
-        if (fgets(buffer, 4096, pipe) != nullptr)
+        /* The images of the next steps are prepared while the current one is transferred */
+        uint32_t downloadLimit = maxDownloadSize ;
+        FlashPipeline pipeline(pipelineMemory) ;
+        pipeline.start(stepsList.size(), [this, &stepsList, downloadLimit](size_t stepIndex, preparedFlash &prepared)
         {
-            result += buffer;
+            const fastbootStep &step = stepsList[stepIndex] ;
+            return (step.type == STEP_FLASH) ? planFlash(step.partName, step.binary, downloadLimit, prepared) : static_cast<int>(TOOLBOX_FASTBOOT_NO_ERROR) ;
+        }) ;
+
+        std::vector<pipelineTimings> timingsList ;
+        ret = TOOLBOX_FASTBOOT_NO_ERROR ;
+        for(size_t i = 0; (i < stepsList.size()) && (ret == TOOLBOX_FASTBOOT_NO_ERROR); i++)
+        {
+            fastbootStep &step = stepsList[i] ;
+            stepTimings &measured = stepsTimingsList[i] ;
+            auto stepStart = std::chrono::steady_clock::now() ;
+            if(step.type == STEP_FLASH)
+            {
+                pipelineTimings timings ;
+                timings.partName = step.partName ;
+                step.result = flashPartition(step.partName, step.binary, &pipeline, i, timings) ;
+                timings.prepareSeconds = pipeline.getPrepareSeconds(i) ;
+                timingsList.push_back(timings) ;
+                measured.sentBytes = timings.bufferedBytes + timings.mappedBytes + timings.streamedBytes ;
+                measured.transferSeconds = timings.transferSeconds ;
+                measured.writeSeconds = timings.writeSeconds ;
+            }
+            else
+            {
+                step.result = executeStep(step) ;
+            }
+            measured.totalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - stepStart).count() ;
+            if(step.type != STEP_FLASH)
+                measured.writeSeconds = measured.totalSeconds ;
+            ret = step.result ;
+            if((ret == TOOLBOX_FASTBOOT_NO_ERROR) && onStepCompleted)
+                onStepCompleted(i) ;
         }
+
+        pipeline.stop() ;
+        printPipelineTimings(pipeline, timingsList) ;
+        return ret ;
+    }
+    else if(ret != TOOLBOX_FASTBOOT_ERROR_NOT_SUPPORTED)
+    {
+        return ret ;
     }
-    pclose(pipe);
 
-    std::cout << result << std::endl ;
-    std::string searchString = "Finished.";
-    size_t pos = result.find(searchString);
-    if (pos != std::string::npos)
+    /* fastboot "oem" consumes all the remaining arguments of the command line: it always closes a batch */
+    size_t first = 0 ;
+    while(first < stepsList.size())
     {
-        displayManager.print(MSG_NORMAL, L"OEM Partconf command is done with success.") ;
-        return TOOLBOX_FASTBOOT_NO_ERROR ;
+        size_t last = first ;
+        while((last + 1 < stepsList.size()) && ((stepsList[last].type == STEP_FLASH) || (stepsList[last].type == STEP_ERASE)))
+            last++ ;
+
+        ret = executeBatch(stepsList, first, last) ;
+        if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+            return ret ;
 
+        first = last + 1 ;
     }
+
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief Fastboot::printPipelineTimings : Print the time spent by each stage of the flashing pipeline and the slowest one.
+ * @param pipeline: The pipeline of the flashing sequence.
+ * @param timingsList: The timings of the flashed partitions.
+ */
+void Fastboot::printPipelineTimings(const FlashPipeline &pipeline, const std::vector<pipelineTimings> &timingsList)
+{
+    if(timingsList.empty())
+        return ;
+
+    pipelineTimings total ;
+    displayManager.print(MSG_NORMAL, L"Pipeline stages (%u preparation threads, %llu MB of buffers) :", pipeline.getWorkersNbr(),
+                         static_cast<unsigned long long>(pipeline.getMemoryBudget() / (1024 * 1024))) ;
+    displayManager.print(MSG_NORMAL, L"  %-20s %10s %10s %10s %10s %12s %12s %12s", "Partition", "Prepare", "Wait", "Transfer", "Write", "Buffered", "Mapped", "Streamed") ;
+    for(const auto &timings : timingsList)
+    {
+        displayManager.print(MSG_NORMAL, L"  %-20s %9.3fs %9.3fs %9.3fs %9.3fs %9llu KB %9llu KB %9llu KB", timings.partName.c_str(), timings.prepareSeconds, timings.waitSeconds,
+                             timings.transferSeconds, timings.writeSeconds, static_cast<unsigned long long>(timings.bufferedBytes / 1024),
+                             static_cast<unsigned long long>(timings.mappedBytes / 1024), static_cast<unsigned long long>(timings.streamedBytes / 1024)) ;
+        total.prepareSeconds += timings.prepareSeconds ;
+        total.waitSeconds += timings.waitSeconds ;
+        total.transferSeconds += timings.transferSeconds ;
+        total.writeSeconds += timings.writeSeconds ;
+        total.bufferedBytes += timings.bufferedBytes ;
+        total.mappedBytes += timings.mappedBytes ;
+        total.streamedBytes += timings.streamedBytes ;
+    }
+    displayManager.print(MSG_NORMAL, L"  %-20s %9.3fs %9.3fs %9.3fs %9.3fs %9llu KB %9llu KB %9llu KB", "Total", total.prepareSeconds, total.waitSeconds,
+                         total.transferSeconds, total.writeSeconds, static_cast<unsigned long long>(total.bufferedBytes / 1024),
+                         static_cast<unsigned long long>(total.mappedBytes / 1024), static_cast<unsigned long long>(total.streamedBytes / 1024)) ;
+
+    /* The link is the bottleneck as long as it does not wait for the preparation */
+    double deviceSeconds = total.transferSeconds + total.writeSeconds ;
+    if(total.waitSeconds > 0.1 * deviceSeconds)
+        displayManager.print(MSG_NORMAL, L"Bottleneck: host preparation, the link was idle %.3fs waiting for the images\n", total.waitSeconds) ;
+    else if(total.writeSeconds > total.transferSeconds)
+        displayManager.print(MSG_NORMAL, L"Bottleneck: device memory write\n") ;
     else
+        displayManager.print(MSG_NORMAL, L"Bottleneck: link transfer\n") ;
+}
+
+/**
+ * @brief Fastboot::executeStep : Execute a single step with the matching command.
+ * @param step: The step to execute.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int Fastboot::executeStep(fastbootStep &step)
+{
+    switch(step.type)
     {
-        displayManager.print(MSG_ERROR, L"Failed to execute OEM Partconf command.") ;
-        return TOOLBOX_FASTBOOT_ERROR_WRITE ;
+    case STEP_FLASH:
+        return flashPartition(step.partName, step.binary) ;
+    case STEP_ERASE:
+        return erasePartition(step.partName) ;
+    case STEP_OEM_BOOTBUS:
+        return oemBootbus(step.values[0], step.values[1], step.values[2]) ;
+    case STEP_OEM_PARTCONF:
+        return oemPartconf(step.values[0], step.values[1]) ;
+    }
+
+    return TOOLBOX_FASTBOOT_ERROR_NOT_SUPPORTED ;
+}
+
+/**
+ * @brief Fastboot::executeBatch : Run several steps with one invocation of the bundled fastboot tool.
+ * @param stepsList: The flashing sequence.
+ * @param first: Index of the first step of the batch.
+ * @param last: Index of the last step of the batch, only this one may be an OEM command.
+ * @return 0 if all the steps of the batch are performed successfully, otherwise an error occurred.
+ */
+int Fastboot::executeBatch(std::vector<fastbootStep> &stepsList, size_t first, size_t last)
+{
+    TraceScope traceScope("Batch of " + std::to_string(last - first + 1) + " steps", "tool") ;
+    std::vector<std::string> arguments ;
+
+    for(size_t i = first; i <= last; i++)
+    {
+        const fastbootStep &step = stepsList[i] ;
+        switch(step.type)
+        {
+        case STEP_FLASH:
+        {
+            displayManager.print(MSG_NORMAL, L"Partition name  : %s", step.partName.c_str());
+            displayManager.print(MSG_NORMAL, L"Firmware path   : %s\n", step.binary.c_str());
+            std::string imagePath = prepareToolImage(step.partName, step.binary) ;
+            std::error_code error ;
+            uintmax_t imageSize = fs::file_size(imagePath, error) ;
+            stepsTimingsList[i].sentBytes = error ? 0 : static_cast<uint64_t>(imageSize) ;
+            arguments.insert(arguments.end(), {"flash", step.partName, imagePath}) ;
+            break ;
+        }
+        case STEP_ERASE:
+            displayManager.print(MSG_NORMAL, L"Erasing partition [%s]...", step.partName.c_str());
+            arguments.insert(arguments.end(), {"erase", step.partName}) ;
+            break ;
+        case STEP_OEM_BOOTBUS:
+            displayManager.print(MSG_NORMAL, L"OEM Bootbus...\n") ;
+            arguments.insert(arguments.end(), {"oem", "bootbus:", std::to_string(step.values[0]), std::to_string(step.values[1]), std::to_string(step.values[2])}) ;
+            break ;
+        case STEP_OEM_PARTCONF:
+            displayManager.print(MSG_NORMAL, L"OEM Partconf...\n") ;
+            arguments.insert(arguments.end(), {"oem", "partconf:", std::to_string(step.values[0]), std::to_string(step.values[1])}) ;
+            break ;
+        }
+    }
+
+    size_t cursor = first ;
+    FastbootOutputParser parser([&](const outputEvent &event)
+    {
+        printOutputEvent(event) ;
+        attributeBatchEvent(event, stepsList, last, cursor) ;
+    }) ;
+    int ret = runFastbootTool(arguments, parser) ;
+    if((ret != TOOLBOX_FASTBOOT_NO_ERROR) && (ret != TOOLBOX_FASTBOOT_ERROR_TIMEOUT))
+        return ret ;
+
+    for(size_t i = first; i <= last; i++)
+    {
+        if(stepsList[i].result == TOOLBOX_FASTBOOT_NO_ERROR)
+            continue ;
+
+        if(ret == TOOLBOX_FASTBOOT_ERROR_TIMEOUT)
+        {
+            /* The tool was stopped during this step */
+            stepsList[i].result = ret ;
+            reportStep(stepsList[i]) ;
+            return ret ;
+        }
+
+        if(parser.hasFinished() && (parser.hasFailed() == false))
+        {
+            stepsList[i].result = TOOLBOX_FASTBOOT_NO_ERROR ;
+            reportStep(stepsList[i]) ;
+            if(onStepCompleted)
+                onStepCompleted(i) ;
+            continue ;
+        }
+
+        if(stepsList[i].result != TOOLBOX_FASTBOOT_ERROR_WRITE)
+        {
+            /* The tool stopped without a status line for this step (e.g. file or device error) */
+            stepsList[i].result = TOOLBOX_FASTBOOT_ERROR_WRITE ;
+            reportStep(stepsList[i]) ;
+        }
+        return stepsList[i].result ;
+    }
+
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief Fastboot::attributeBatchEvent : Attribute a status event of a chained fastboot invocation to its step.
+ * Flash and erase steps are found by the partition name quoted in "Sending/Writing/Erasing '<name>'" lines,
+ * the unnamed OKAY/FAILED status lines belong to the OEM commands. Each step is reported as soon as it ends,
+ * which for an image split by the tool is the writing of its last piece.
+ * @param event: The parsed output event.
+ * @param stepsList: The flashing sequence, the result of the batch steps is updated.
+ * @param last: Index of the last step of the batch.
+ * @param cursor: Input/output, index of the step currently running.
+ */
+void Fastboot::attributeBatchEvent(const outputEvent &event, std::vector<fastbootStep> &stepsList, size_t last, size_t &cursor)
+{
+    if((event.type != EVENT_STEP_OKAY) && (event.type != EVENT_STEP_FAILED))
+        return ;
+
+    bool isUnnamed = (event.phase == PHASE_COMMAND) ;
+    for(size_t i = cursor; i <= last; i++)
+    {
+        fastbootStep &step = stepsList[i] ;
+        bool isOem = (step.type == STEP_OEM_BOOTBUS) || (step.type == STEP_OEM_PARTCONF) ;
+        if(isUnnamed ? (isOem && (step.result != TOOLBOX_FASTBOOT_NO_ERROR)) : ((isOem == false) && (step.partName == event.partName)))
+        {
+            cursor = i ;
+            stepTimings &measured = stepsTimingsList[i] ;
+            if(event.phase == PHASE_SENDING)
+                measured.transferSeconds += event.seconds ;
+            else
+                measured.writeSeconds += event.seconds ;
+            measured.totalSeconds += event.seconds ;
+
+            if(event.type == EVENT_STEP_FAILED)
+            {
+                step.result = TOOLBOX_FASTBOOT_ERROR_WRITE ;
+                reportStep(step) ;
+            }
+            else if(((step.type != STEP_FLASH) || ((event.phase == PHASE_WRITING) && (event.partIndex == event.partsNbr))) &&
+                    (step.result != TOOLBOX_FASTBOOT_NO_ERROR))
+            {
+                step.result = TOOLBOX_FASTBOOT_NO_ERROR ;
+                reportStep(step) ;
+                if(onStepCompleted)
+                    onStepCompleted(i) ;
+            }
+            return ;
+        }
+    }
+}
+
+/**
+ * @brief Fastboot::reportStep : Print the result of a batch step with the same wording as the single commands.
+ * @param step: The executed step.
+ */
+void Fastboot::reportStep(const fastbootStep &step)
+{
+    bool success = (step.result == TOOLBOX_FASTBOOT_NO_ERROR) ;
+    switch(step.type)
+    {
+    case STEP_FLASH:
+        if(success)
+            displayManager.print(MSG_GREEN, L"Partition %s : Download Done\n", step.partName.c_str()) ;
+        else
+            displayManager.print(MSG_ERROR, L"Partition %s : Download Failed", step.partName.c_str()) ;
+        break ;
+    case STEP_ERASE:
+        if(success)
+            displayManager.print(MSG_GREEN, L"Partition %s : Erase Done\n", step.partName.c_str()) ;
+        else
+            displayManager.print(MSG_ERROR, L"Partition %s : Erase Failed", step.partName.c_str()) ;
+        break ;
+    case STEP_OEM_BOOTBUS:
+        if(success)
+            displayManager.print(MSG_NORMAL, L"OEM Bootbus command is done with success.") ;
+        else
+            displayManager.print(MSG_ERROR, L"Failed to execute OEM Bootbus command.") ;
+        break ;
+    case STEP_OEM_PARTCONF:
+        if(success)
+            displayManager.print(MSG_NORMAL, L"OEM Partconf command is done with success.") ;
+        else
+            displayManager.print(MSG_ERROR, L"Failed to execute OEM Partconf command.") ;
+        break ;
     }
 }
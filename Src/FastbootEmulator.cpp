@@ -0,0 +1,798 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FastbootEmulator.h"
+#include "FastbootProtocol.h"
+#include "TcpTransport.h"
+#include "SparseImage.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#define closeSocket(fd) closesocket(fd)
+#else
+#include <cerrno>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#define closeSocket(fd) ::close(fd)
+#endif
+
+/* Largest piece of a TCP data packet handed to the emulator at once */
+constexpr size_t EMULATOR_TCP_CHUNK_SZ = 1024 * 1024 ;
+
+/* eMMC boot partitions, always present whatever the GPT content */
+static const char* const emulatorBootPartitions[] = {"mmc1boot0", "mmc1boot1"} ;
+
+FastbootEmulator::FastbootEmulator()
+{
+    createPartitionTable(config.formatted) ;
+}
+
+/**
+ * @brief parseSize : Convert a size with an optional K/M/G suffix, e.g. "0x400000" or "64M".
+ * @param value: The size string.
+ * @param size: Output, the size in bytes.
+ * @return True if the value is valid.
+ */
+static bool parseSize(const std::string &value, uint64_t &size)
+{
+    char *end = nullptr ;
+    size = strtoull(value.c_str(), &end, 0) ;
+    if((end == value.c_str()) || (value[0] == '-'))
+        return false ;
+
+    std::string suffix = end ;
+    if(suffix == "K" || suffix == "k")
+        size <<= 10 ;
+    else if(suffix == "M" || suffix == "m")
+        size <<= 20 ;
+    else if(suffix == "G" || suffix == "g")
+        size <<= 30 ;
+    else if(suffix != "")
+        return false ;
+
+    return true ;
+}
+
+/**
+ * @brief FastbootEmulator::loadConfig : Load the emulated device description.
+ * The file holds "key = value" lines, '#' starts a comment:
+ *   serialno, product, version, max-download-size, formatted (0/1),
+ *   partition = <name> <size> [type]   (repeated, the GPT written by "oem format"),
+ *   var.<name> = <value>               (extra getvar variable),
+ *   fail = <command prefix>            (e.g. "flash:rootfs", answered with FAIL),
+ *   hang = <command prefix>            (e.g. "flash:rootfs", never answered),
+ *   link-speed, write-speed, erase-speed (MB/s), command-latency, format-time (ms).
+ * @param configPath: The configuration file path.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int FastbootEmulator::loadConfig(const std::string &configPath)
+{
+    std::ifstream configFile(configPath) ;
+    if(configFile.is_open() == false)
+    {
+        displayManager.print(MSG_ERROR, L"Cannot open the emulator configuration %s", configPath.c_str()) ;
+        return TOOLBOX_FASTBOOT_ERROR_NO_FILE ;
+    }
+
+    emulatorConfig newConfig ;
+    std::string line ;
+    int lineNumber = 0 ;
+    while(std::getline(configFile, line))
+    {
+        lineNumber++ ;
+        line = line.substr(0, line.find('#')) ;
+        size_t separator = line.find('=') ;
+        auto trim = [](const std::string &text)
+        {
+            size_t first = text.find_first_not_of(" \t\r") ;
+            size_t last = text.find_last_not_of(" \t\r") ;
+            return (first == std::string::npos) ? std::string() : text.substr(first, last - first + 1) ;
+        } ;
+
+        if(trim(line).empty())
+            continue ;
+
+        std::string key = (separator == std::string::npos) ? "" : trim(line.substr(0, separator)) ;
+        std::string value = (separator == std::string::npos) ? "" : trim(line.substr(separator + 1)) ;
+        uint64_t number = 0 ;
+        bool valid = (key.empty() == false) ;
+
+        if(key == "serialno")
+            newConfig.serialNumber = value ;
+        else if(key == "product")
+            newConfig.product = value ;
+        else if(key == "version")
+            newConfig.version = value ;
+        else if(key == "max-download-size")
+        {
+            valid = parseSize(value, number) && (number > 0) && (number <= 0xFFFFFFFF) ;
+            newConfig.maxDownloadSize = static_cast<uint32_t>(number) ;
+        }
+        else if(key == "formatted")
+            newConfig.formatted = (value == "1") || (value == "true") ;
+        else if(key == "partition")
+        {
+            emulatedPartition partition ;
+            std::string sizeString ;
+            std::istringstream fields(value) ;
+            fields >> partition.name >> sizeString >> partition.type ;
+            if(partition.type.empty())
+                partition.type = "raw" ;
+            valid = (partition.name.empty() == false) && parseSize(sizeString, partition.size) ;
+            newConfig.partitionsList.push_back(partition) ;
+        }
+        else if(key.compare(0, 4, "var.") == 0)
+            newConfig.variablesList[key.substr(4)] = value ;
+        else if(key == "fail")
+            newConfig.failList.push_back(value) ;
+        else if(key == "hang")
+            newConfig.hangList.push_back(value) ;
+        else if((key == "link-speed") || (key == "write-speed") || (key == "erase-speed"))
+        {
+            char *end = nullptr ;
+            double speed = strtod(value.c_str(), &end) ;
+            valid = (end != value.c_str()) && (*end == '\0') && (speed >= 0) ;
+            if(key == "link-speed")
+                newConfig.linkSpeed = speed ;
+            else if(key == "write-speed")
+                newConfig.writeSpeed = speed ;
+            else
+                newConfig.eraseSpeed = speed ;
+        }
+        else if((key == "command-latency") || (key == "format-time"))
+        {
+            valid = parseSize(value, number) && (number <= 0xFFFFFFFF) ;
+            if(key == "command-latency")
+                newConfig.commandLatency = static_cast<uint32_t>(number) ;
+            else
+                newConfig.formatTime = static_cast<uint32_t>(number) ;
+        }
+        else
+            valid = false ;
+
+        if(valid == false)
+        {
+            displayManager.print(MSG_ERROR, L"Emulator configuration %s line %d : invalid entry \"%s\"", configPath.c_str(), lineNumber, line.c_str()) ;
+            return TOOLBOX_FASTBOOT_ERROR_WRONG_PARAM ;
+        }
+    }
+
+    config = newConfig ;
+    createPartitionTable(config.formatted) ;
+    reset() ;
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief FastbootEmulator::reset : Restart the fastboot session, the memory content is kept.
+ */
+void FastbootEmulator::reset()
+{
+    responsesList.clear() ;
+    downloadSize = 0 ;
+    downloadRemaining = 0 ;
+}
+
+/**
+ * @brief FastbootEmulator::createPartitionTable : Build the emulated memory partitions.
+ * The eMMC boot partitions always exist and keep their content, the GPT ones are recreated empty.
+ * @param withGpt: True to add the partitions of the configured GPT.
+ */
+void FastbootEmulator::createPartitionTable(bool withGpt)
+{
+    partitionsList.erase(std::remove_if(partitionsList.begin(), partitionsList.end(), [](const emulatedPartition &partition)
+    {
+        return std::find(std::begin(emulatorBootPartitions), std::end(emulatorBootPartitions), partition.name) == std::end(emulatorBootPartitions) ;
+    }), partitionsList.end()) ;
+
+    if(partitionsList.empty())
+    {
+        for(const char *bootPartition : emulatorBootPartitions)
+        {
+            emulatedPartition partition ;
+            partition.name = bootPartition ;
+            partition.size = EMULATOR_BOOT_PARTITION_SIZE ;
+            partitionsList.push_back(partition) ;
+        }
+    }
+
+    if(withGpt)
+        partitionsList.insert(partitionsList.end(), config.partitionsList.begin(), config.partitionsList.end()) ;
+}
+
+/**
+ * @brief FastbootEmulator::findPartition : Look up a partition of the emulated memory.
+ * Without a configured partition table, any name is accepted and created on first use.
+ * @param partitionName: The partition name.
+ * @return The partition, nullptr if it does not exist.
+ */
+emulatedPartition* FastbootEmulator::findPartition(const std::string &partitionName)
+{
+    for(auto &partition : partitionsList)
+    {
+        if(partition.name == partitionName)
+            return &partition ;
+    }
+
+    if(config.partitionsList.empty() && (partitionName.empty() == false))
+    {
+        emulatedPartition partition ;
+        partition.name = partitionName ;
+        partitionsList.push_back(partition) ;
+        return &partitionsList.back() ;
+    }
+
+    return nullptr ;
+}
+
+/**
+ * @brief FastbootEmulator::simulateDuration : Block the caller for the time the real device would need.
+ * @param bytes: Number of bytes processed.
+ * @param speed: Processing speed in MB/s, 0 for no size-dependent delay.
+ * @param extraMs: Fixed delay added in milliseconds.
+ */
+void FastbootEmulator::simulateDuration(uint64_t bytes, double speed, uint32_t extraMs)
+{
+    double seconds = extraMs / 1000.0 ;
+    if(speed > 0)
+        seconds += static_cast<double>(bytes) / (speed * 1024 * 1024) ;
+
+    if(seconds > 0)
+        std::this_thread::sleep_for(std::chrono::duration<double>(seconds)) ;
+}
+
+/**
+ * @brief FastbootEmulator::receive : Process one packet sent by the host.
+ * @param data: The packet bytes, a command or a part of the download payload.
+ * @param length: Number of bytes.
+ * @return 0 if the packet is accepted, otherwise a protocol violation occurred.
+ */
+int FastbootEmulator::receive(const uint8_t* data, size_t length)
+{
+    if(downloadRemaining > 0)
+    {
+        if(length > downloadRemaining)
+            return TOOLBOX_FASTBOOT_ERROR_WRITE ;
+
+        downloadRemaining -= static_cast<uint32_t>(length) ;
+        parseSparseData(data, length) ;
+
+        /* Pace the payload as the emulated link would */
+        if(config.linkSpeed > 0)
+        {
+            double seconds = static_cast<double>(downloadSize - downloadRemaining) / (config.linkSpeed * 1024 * 1024) ;
+            std::this_thread::sleep_until(downloadStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds))) ;
+        }
+
+        if(downloadRemaining == 0)
+            responsesList.push_back("OKAY") ;
+        return TOOLBOX_FASTBOOT_NO_ERROR ;
+    }
+
+    if(length > FB_COMMAND_SZ)
+        return TOOLBOX_FASTBOOT_ERROR_WRONG_PARAM ;
+
+    handleCommand(std::string(reinterpret_cast<const char*>(data), length)) ;
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief FastbootEmulator::parseSparseData : Follow the sparse image structure in the download payload.
+ * Only the headers are kept, the chunk data is skipped.
+ * @param data: The payload bytes.
+ * @param length: Number of bytes.
+ */
+void FastbootEmulator::parseSparseData(const uint8_t* data, size_t length)
+{
+    sparseStreamState &stream = sparseStream ;
+    auto readLittleEndian = [&stream](size_t offset, size_t size)
+    {
+        uint32_t value = 0 ;
+        for(size_t i = 0; i < size; i++)
+            value |= static_cast<uint32_t>(static_cast<uint8_t>(stream.pending[offset + i])) << (8 * i) ;
+        return value ;
+    } ;
+
+    while((length > 0) && (stream.invalid == false))
+    {
+        if(stream.headerParsed && (stream.isSparse == false))
+            return ;
+
+        if(stream.payloadRemaining > 0)
+        {
+            size_t skipped = static_cast<size_t>(std::min<uint64_t>(stream.payloadRemaining, length)) ;
+            stream.payloadRemaining -= skipped ;
+            data += skipped ;
+            length -= skipped ;
+            continue ;
+        }
+
+        size_t headerSize = stream.headerParsed ? SPARSE_CHUNK_HEADER_SZ : SPARSE_HEADER_SZ ;
+        size_t copied = std::min(headerSize - stream.pending.size(), length) ;
+        stream.pending.append(reinterpret_cast<const char*>(data), copied) ;
+        data += copied ;
+        length -= copied ;
+        if(stream.pending.size() < headerSize)
+            return ;
+
+        if(stream.headerParsed == false)
+        {
+            stream.headerParsed = true ;
+            stream.isSparse = (readLittleEndian(0, 4) == SPARSE_HEADER_MAGIC) ;
+            if(stream.isSparse == false)
+                return ;
+
+            uint32_t fileHeaderSize = readLittleEndian(8, 2) ;
+            stream.chunkHeaderSize = readLittleEndian(10, 2) ;
+            stream.blockSize = readLittleEndian(12, 4) ;
+            stream.totalBlocks = readLittleEndian(16, 4) ;
+            stream.invalid = (readLittleEndian(4, 2) != SPARSE_MAJOR_VERSION) || (fileHeaderSize < SPARSE_HEADER_SZ) ||
+                             (stream.chunkHeaderSize < SPARSE_CHUNK_HEADER_SZ) || (stream.blockSize == 0) || (stream.blockSize % 4 != 0) ;
+            stream.payloadRemaining = fileHeaderSize - SPARSE_HEADER_SZ ;
+        }
+        else
+        {
+            uint32_t type = readLittleEndian(0, 2) ;
+            uint32_t blocksNbr = readLittleEndian(4, 4) ;
+            uint64_t totalSize = readLittleEndian(8, 4) ;
+            uint64_t dataSize = static_cast<uint64_t>(blocksNbr) * stream.blockSize ;
+            uint64_t expectedSize = stream.chunkHeaderSize + ((type == SPARSE_CHUNK_RAW) ? dataSize : (type == SPARSE_CHUNK_FILL) || (type == SPARSE_CHUNK_CRC32) ? 4 : 0) ;
+
+            stream.invalid = ((type < SPARSE_CHUNK_RAW) || (type > SPARSE_CHUNK_CRC32) || (totalSize != expectedSize)) ;
+            if((type == SPARSE_CHUNK_RAW) || (type == SPARSE_CHUNK_FILL))
+                stream.writtenSize += dataSize ;
+            if(type != SPARSE_CHUNK_CRC32)
+                stream.blocksSeen += blocksNbr ;
+            stream.payloadRemaining = totalSize - SPARSE_CHUNK_HEADER_SZ ;
+        }
+        stream.pending.clear() ;
+    }
+}
+
+/**
+ * @brief FastbootEmulator::nextResponse : Get the next packet sent by the device.
+ * @param packet: Output, the response packet, e.g. "OKAY" or "INFOtext".
+ * @return True if a packet was pending.
+ */
+bool FastbootEmulator::nextResponse(std::string &packet)
+{
+    if(responsesList.empty())
+        return false ;
+
+    packet = responsesList.front() ;
+    responsesList.pop_front() ;
+    return true ;
+}
+
+/**
+ * @brief FastbootEmulator::handleCommand : Dispatch a command the way U-Boot does: "<command>[:<parameter>]".
+ * @param cmd: The command packet.
+ */
+void FastbootEmulator::handleCommand(const std::string &cmd)
+{
+    for(const auto &failPrefix : config.failList)
+    {
+        if(cmd.compare(0, failPrefix.size(), failPrefix) == 0)
+        {
+            simulateDuration(0, 0, config.commandLatency) ;
+            responsesList.push_back("FAILemulated failure") ;
+            return ;
+        }
+    }
+
+    /* Wedged board: the host only sees its silence */
+    for(const auto &hangPrefix : config.hangList)
+    {
+        if(cmd.compare(0, hangPrefix.size(), hangPrefix) == 0)
+            return ;
+    }
+
+    simulateDuration(0, 0, config.commandLatency) ;
+
+    size_t separator = cmd.find(':') ;
+    std::string command = cmd.substr(0, separator) ;
+    std::string parameter = (separator == std::string::npos) ? "" : cmd.substr(separator + 1) ;
+
+    if(command == "getvar")
+    {
+        handleGetVar(parameter) ;
+    }
+    else if(command == "download")
+    {
+        char *end = nullptr ;
+        unsigned long size = strtoul(parameter.c_str(), &end, 16) ;
+        if((parameter.size() != 8) || (*end != '\0'))
+        {
+            responsesList.push_back("FAILinvalid download size") ;
+        }
+        else if(size > config.maxDownloadSize)
+        {
+            responsesList.push_back("FAILdata too large") ;
+        }
+        else
+        {
+            downloadSize = static_cast<uint32_t>(size) ;
+            downloadRemaining = downloadSize ;
+            sparseStream = sparseStreamState() ;
+            downloadStart = std::chrono::steady_clock::now() ;
+
+            char response[16] ;
+            snprintf(response, sizeof(response), "DATA%08x", downloadSize) ;
+            responsesList.push_back(response) ;
+            if(downloadSize == 0)
+                responsesList.push_back("OKAY") ;
+        }
+    }
+    else if(command == "flash")
+    {
+        handleFlash(parameter) ;
+    }
+    else if(command == "erase")
+    {
+        handleErase(parameter) ;
+    }
+    else if(command.compare(0, 4, "oem ") == 0)
+    {
+        handleOem(command.substr(4), parameter) ;
+    }
+    else if((command == "reboot") || (command == "reboot-bootloader") || (command == "continue"))
+    {
+        reset() ;
+        responsesList.push_back("OKAY") ;
+    }
+    else
+    {
+        responsesList.push_back("FAILunrecognized command") ;
+    }
+}
+
+/**
+ * @brief FastbootEmulator::handleGetVar : Answer a getvar command.
+ * @param name: The variable name, "all" lists every variable with INFO packets.
+ */
+void FastbootEmulator::handleGetVar(const std::string &name)
+{
+    std::map<std::string, std::string> variables = config.variablesList ;
+    char number[32] ;
+    snprintf(number, sizeof(number), "0x%08x", config.maxDownloadSize) ;
+    variables["max-download-size"] = number ;
+    variables["serialno"] = config.serialNumber ;
+    variables["product"] = config.product ;
+    variables["version"] = config.version ;
+    for(const auto &partition : partitionsList)
+    {
+        if(partition.size == 0)
+            continue ;
+        snprintf(number, sizeof(number), "0x%016llx", static_cast<unsigned long long>(partition.size)) ;
+        variables["partition-size:" + partition.name] = number ;
+        variables["partition-type:" + partition.name] = partition.type ;
+    }
+
+    if(name == "all")
+    {
+        for(const auto &variable : variables)
+            responsesList.push_back("INFO" + variable.first + ": " + variable.second) ;
+        responsesList.push_back("OKAY") ;
+        return ;
+    }
+
+    auto variable = variables.find(name) ;
+    if(variable == variables.end())
+        responsesList.push_back("FAILVariable not implemented") ;
+    else
+        responsesList.push_back("OKAY" + variable->second) ;
+}
+
+/**
+ * @brief FastbootEmulator::handleFlash : Write the downloaded image into a partition.
+ * @param partitionName: The partition name.
+ */
+void FastbootEmulator::handleFlash(const std::string &partitionName)
+{
+    emulatedPartition *partition = findPartition(partitionName) ;
+    if(partition == nullptr)
+    {
+        responsesList.push_back("FAILcannot find partition") ;
+        return ;
+    }
+
+    if(downloadRemaining != 0)
+    {
+        responsesList.push_back("FAILincomplete download") ;
+        return ;
+    }
+
+    /* Like U-Boot, the boot partitions are written as received, sparse or not */
+    bool bootPartition = std::find(std::begin(emulatorBootPartitions), std::end(emulatorBootPartitions), partitionName) != std::end(emulatorBootPartitions) ;
+    bool sparseImage = sparseStream.isSparse && (bootPartition == false) ;
+    if(sparseImage && (sparseStream.invalid || (sparseStream.blocksSeen != sparseStream.totalBlocks) || (sparseStream.payloadRemaining != 0) ||
+                       (sparseStream.pending.empty() == false)))
+    {
+        responsesList.push_back("FAILinvalid sparse image") ;
+        return ;
+    }
+
+    uint64_t imageSize = sparseImage ? static_cast<uint64_t>(sparseStream.totalBlocks) * sparseStream.blockSize : downloadSize ;
+    uint64_t writtenSize = sparseImage ? sparseStream.writtenSize : downloadSize ;
+    if((partition->size != 0) && (imageSize > partition->size))
+    {
+        responsesList.push_back("FAILtoo large for partition") ;
+        return ;
+    }
+
+    simulateDuration(writtenSize, config.writeSpeed, 0) ;
+    partition->written = imageSize ;
+    partition->flashCount++ ;
+    responsesList.push_back("OKAY") ;
+}
+
+/**
+ * @brief FastbootEmulator::handleErase : Erase a partition.
+ * @param partitionName: The partition name.
+ */
+void FastbootEmulator::handleErase(const std::string &partitionName)
+{
+    emulatedPartition *partition = findPartition(partitionName) ;
+    if(partition == nullptr)
+    {
+        responsesList.push_back("FAILcannot find partition") ;
+        return ;
+    }
+
+    simulateDuration(partition->size, config.eraseSpeed, 0) ;
+    partition->written = 0 ;
+    responsesList.push_back("OKAY") ;
+}
+
+/**
+ * @brief FastbootEmulator::handleOem : Execute the STM32MP OEM commands.
+ * @param oemCommand: The OEM command name, "format", "bootbus" or "partconf".
+ * @param parameters: The command parameters, e.g. " 0 0 0" for bootbus.
+ */
+void FastbootEmulator::handleOem(const std::string &oemCommand, const std::string &parameters)
+{
+    std::istringstream fields(parameters) ;
+    std::vector<long> values ;
+    std::string field ;
+    while(fields >> field)
+    {
+        char *end = nullptr ;
+        long value = strtol(field.c_str(), &end, 0) ;
+        if(*end != '\0')
+        {
+            responsesList.push_back("FAILinvalid parameter") ;
+            return ;
+        }
+        values.push_back(value) ;
+    }
+
+    if(oemCommand == "format")
+    {
+        simulateDuration(0, 0, config.formatTime) ;
+        createPartitionTable(true) ;
+        responsesList.push_back("OKAY") ;
+    }
+    else if(oemCommand == "bootbus")
+    {
+        /* mmc bootbus <dev> <boot_bus_width> <reset_boot_bus_width> <boot_mode> */
+        if((values.size() != 3) || (values[0] < 0) || (values[0] > 2) || (values[1] < 0) || (values[1] > 1) || (values[2] < 0) || (values[2] > 2))
+        {
+            responsesList.push_back("FAILinvalid bootbus parameters") ;
+            return ;
+        }
+
+        for(size_t i = 0; i < 3; i++)
+            bootBus[i] = static_cast<uint16_t>(values[i]) ;
+        responsesList.push_back("OKAY") ;
+    }
+    else if(oemCommand == "partconf")
+    {
+        /* mmc partconf <dev> <boot_ack> <boot_partition> */
+        if((values.size() != 2) || (values[0] < 0) || (values[0] > 1) || (values[1] < 0) || (values[1] > 7))
+        {
+            responsesList.push_back("FAILinvalid partconf parameters") ;
+            return ;
+        }
+
+        partConf[0] = static_cast<uint16_t>(values[0]) ;
+        partConf[1] = static_cast<uint16_t>(values[1]) ;
+        responsesList.push_back("OKAY") ;
+    }
+    else
+    {
+        responsesList.push_back("FAILunrecognized oem command") ;
+    }
+}
+
+/**
+ * @brief socketTransfer : Send or receive exactly the requested number of bytes.
+ * @param fd: The connected socket.
+ * @param data: The buffer.
+ * @param length: Number of bytes.
+ * @param sending: True to send, false to receive.
+ * @return True if the whole buffer was transferred.
+ */
+static bool socketTransfer(intptr_t fd, uint8_t* data, size_t length, bool sending)
+{
+    while(length > 0)
+    {
+        int chunk = static_cast<int>(std::min<size_t>(length, 0x40000000)) ;
+#ifdef _WIN32
+        long done = sending ? TcpTransport::sendSocket(fd, data, static_cast<size_t>(chunk)) :
+                              recv(static_cast<SOCKET>(fd), reinterpret_cast<char*>(data), chunk, 0) ;
+#else
+        long done = sending ? TcpTransport::sendSocket(fd, data, static_cast<size_t>(chunk)) :
+                              static_cast<long>(recv(static_cast<int>(fd), data, chunk, 0)) ;
+        if((done < 0) && (errno == EINTR))
+            continue ;
+#endif
+        if(done <= 0)
+            return false ;
+
+        data += done ;
+        length -= static_cast<size_t>(done) ;
+    }
+
+    return true ;
+}
+
+/**
+ * @brief FastbootEmulator::serveSession : Run the fastboot TCP protocol with one connected host.
+ * @param clientFd: The accepted socket.
+ * @return 0 when the host disconnects, otherwise a protocol violation occurred.
+ */
+int FastbootEmulator::serveSession(intptr_t clientFd)
+{
+    uint8_t handshake[FB_TCP_HANDSHAKE_SZ + 1] = {0} ;
+    if((socketTransfer(clientFd, handshake, FB_TCP_HANDSHAKE_SZ, false) == false) || (memcmp(handshake, "FB", 2) != 0))
+        return TOOLBOX_FASTBOOT_ERROR_CONNECTION ;
+
+    char answer[FB_TCP_HANDSHAKE_SZ + 1] ;
+    snprintf(answer, sizeof(answer), "FB%02d", FB_TCP_PROTOCOL_VERSION) ;
+    if(socketTransfer(clientFd, reinterpret_cast<uint8_t*>(answer), FB_TCP_HANDSHAKE_SZ, true) == false)
+        return TOOLBOX_FASTBOOT_ERROR_CONNECTION ;
+
+    std::vector<uint8_t> buffer(EMULATOR_TCP_CHUNK_SZ) ;
+    while(true)
+    {
+        uint8_t header[FB_TCP_HEADER_SZ] ;
+        if(socketTransfer(clientFd, header, FB_TCP_HEADER_SZ, false) == false)
+            return TOOLBOX_FASTBOOT_NO_ERROR ; /* host disconnected */
+
+        uint64_t packetLength = 0 ;
+        for(size_t i = 0; i < FB_TCP_HEADER_SZ; i++)
+            packetLength = (packetLength << 8) | header[i] ;
+
+        bool isCommand = (downloadRemaining == 0) ;
+        if(isCommand && (packetLength > FB_COMMAND_SZ))
+            return TOOLBOX_FASTBOOT_ERROR_WRONG_PARAM ;
+
+        while(packetLength > 0)
+        {
+            size_t chunk = static_cast<size_t>(std::min<uint64_t>(packetLength, buffer.size())) ;
+            if(socketTransfer(clientFd, buffer.data(), chunk, false) == false)
+                return TOOLBOX_FASTBOOT_ERROR_CONNECTION ;
+            if(isCommand)
+                displayManager.print(MSG_NORMAL, L"[emulator] %s", std::string(reinterpret_cast<char*>(buffer.data()), chunk).c_str()) ;
+            if(receive(buffer.data(), chunk) != TOOLBOX_FASTBOOT_NO_ERROR)
+                return TOOLBOX_FASTBOOT_ERROR_WRONG_PARAM ;
+            packetLength -= chunk ;
+        }
+
+        std::string packet ;
+        while(nextResponse(packet))
+        {
+            uint64_t responseLength = packet.size() ;
+            for(int i = FB_TCP_HEADER_SZ - 1; i >= 0; i--)
+            {
+                header[i] = static_cast<uint8_t>(responseLength & 0xFF) ;
+                responseLength >>= 8 ;
+            }
+
+            if((socketTransfer(clientFd, header, FB_TCP_HEADER_SZ, true) == false) ||
+               (socketTransfer(clientFd, reinterpret_cast<uint8_t*>(&packet[0]), packet.size(), true) == false))
+                return TOOLBOX_FASTBOOT_ERROR_CONNECTION ;
+
+            if(packet.compare(0, 4, "FAIL") == 0)
+                displayManager.print(MSG_WARNING, L"[emulator] %s", packet.c_str()) ;
+        }
+    }
+}
+
+/**
+ * @brief FastbootEmulator::serveTcp : Expose the emulated device as a fastboot TCP server.
+ * Hosts are served one after the other, the device state is kept between sessions.
+ * @param port: The TCP port to listen on.
+ * @param sessionsNbr: Number of host sessions to serve before returning, 0 to serve forever.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int FastbootEmulator::serveTcp(uint16_t port, uint32_t sessionsNbr)
+{
+#ifdef _WIN32
+    WSADATA wsaData ;
+    if(WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+        return TOOLBOX_FASTBOOT_ERROR_INTERFACE_NOT_SUPPORTED ;
+#endif
+    intptr_t serverFd = TcpTransport::createSocket(AF_INET, SOCK_STREAM, IPPROTO_TCP) ;
+    if(serverFd < 0)
+        return TOOLBOX_FASTBOOT_ERROR_CONNECTION ;
+
+    int option = 1 ;
+    setsockopt(serverFd, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&option), sizeof(option)) ;
+
+    struct sockaddr_in address ;
+    memset(&address, 0, sizeof(address)) ;
+    address.sin_family = AF_INET ;
+    address.sin_addr.s_addr = htonl(INADDR_ANY) ;
+    address.sin_port = htons(port) ;
+    if((bind(serverFd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0) || (listen(serverFd, 1) != 0))
+    {
+        displayManager.print(MSG_ERROR, L"Emulator cannot listen on port %u", port) ;
+        closeSocket(serverFd) ;
+        return TOOLBOX_FASTBOOT_ERROR_CONNECTION ;
+    }
+
+    displayManager.print(MSG_NORMAL, L"Emulated device %s listening on tcp port %u", config.serialNumber.c_str(), port) ;
+
+    int ret = TOOLBOX_FASTBOOT_NO_ERROR ;
+    for(uint32_t session = 0; (sessionsNbr == 0) || (session < sessionsNbr); session++)
+    {
+#ifdef _WIN32
+        SOCKET clientFd = accept(static_cast<SOCKET>(serverFd), nullptr, nullptr) ;
+        if(clientFd == INVALID_SOCKET)
+#else
+        int clientFd = accept(static_cast<int>(serverFd), nullptr, nullptr) ;
+        if(clientFd < 0)
+#endif
+        {
+            ret = TOOLBOX_FASTBOOT_ERROR_CONNECTION ;
+            break ;
+        }
+        TcpTransport::protectSocket(static_cast<intptr_t>(clientFd)) ;
+
+        option = 1 ;
+        setsockopt(clientFd, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&option), sizeof(option)) ;
+
+        displayManager.print(MSG_NORMAL, L"[emulator] host connected") ;
+        if(serveSession(static_cast<intptr_t>(clientFd)) != TOOLBOX_FASTBOOT_NO_ERROR)
+            displayManager.print(MSG_WARNING, L"[emulator] protocol error, session closed") ;
+        else
+            displayManager.print(MSG_NORMAL, L"[emulator] host disconnected") ;
+        closeSocket(clientFd) ;
+
+        /* A new host session starts with an idle download state, like after a USB reconnection */
+        reset() ;
+    }
+
+    closeSocket(serverFd) ;
+#ifdef _WIN32
+    WSACleanup() ;
+#endif
+    return ret ;
+}
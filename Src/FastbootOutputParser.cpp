@@ -0,0 +1,213 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FastbootOutputParser.h"
+#include <cstdlib>
+#include <cstdio>
+
+FastbootOutputParser::FastbootOutputParser(std::function<void(const outputEvent&)> eventHandler)
+{
+    this->eventHandler = eventHandler ;
+}
+
+void FastbootOutputParser::emit(outputEventType type, outputPhase phase, const std::string &partName, double seconds, const std::string &reason, const std::string &line)
+{
+    bool counted = ((phase == PHASE_SENDING) || (phase == PHASE_WRITING)) && (partName == counterPartName) ;
+    if(eventHandler)
+        eventHandler({type, phase, partName, seconds, reason, line, counted ? counterIndex : 1, counted ? counterTotal : 1}) ;
+}
+
+/**
+ * @brief FastbootOutputParser::parseLabel : Recognize a "Sending/Writing/Erasing '<name>'" operation label.
+ * @param text: The line, without leading spaces.
+ * @param phase: Output, the operation.
+ * @param partName: Output, the quoted partition name.
+ * @return True if the text starts with a complete label.
+ */
+bool FastbootOutputParser::parseLabel(const std::string &text, outputPhase &phase, std::string &partName)
+{
+    if(text.compare(0, 7, "Sending") == 0)
+        phase = PHASE_SENDING ;
+    else if(text.compare(0, 7, "Writing") == 0)
+        phase = PHASE_WRITING ;
+    else if(text.compare(0, 7, "Erasing") == 0)
+        phase = PHASE_ERASING ;
+    else
+        return false ;
+
+    size_t nameStart = text.find('\'') ;
+    size_t nameEnd = (nameStart != std::string::npos) ? text.find('\'', nameStart + 1) : std::string::npos ;
+    if(nameEnd == std::string::npos)
+        return false ;
+
+    partName = text.substr(nameStart + 1, nameEnd - nameStart - 1) ;
+    parseCounter(text, nameEnd, phase, partName) ;
+    return true ;
+}
+
+/**
+ * @brief FastbootOutputParser::parseCounter : Track the piece counter of a split image.
+ * The tool prints "Sending sparse '<name>' 1/3 (...)" for each piece, then a plain "Writing '<name>'":
+ * the writing line belongs to the piece sent last.
+ * @param text: The label line.
+ * @param nameEnd: Position of the closing quote of the partition name.
+ * @param phase: The operation of the label.
+ * @param partName: The partition name.
+ */
+void FastbootOutputParser::parseCounter(const std::string &text, size_t nameEnd, outputPhase phase, const std::string &partName)
+{
+    if(phase != PHASE_SENDING)
+    {
+        if((phase == PHASE_ERASING) || (partName != counterPartName))
+            counterPartName = "" ;
+        return ;
+    }
+
+    unsigned long index = 1, total = 1 ;
+    if((sscanf(text.c_str() + nameEnd + 1, " %lu/%lu", &index, &total) != 2) || (index == 0) || (index > total))
+        index = total = 1 ;
+
+    counterPartName = partName ;
+    counterIndex = index ;
+    counterTotal = total ;
+}
+
+/**
+ * @brief FastbootOutputParser::feed : Parse a new piece of output.
+ * Complete lines are turned into events. The label of a running operation is reported as soon as it is printed,
+ * before its status arrives on the same line.
+ * @param data: The output bytes.
+ * @param length: Number of bytes.
+ * @param stream: The output stream the bytes come from (0 for stdout, 1 for stderr).
+ */
+void FastbootOutputParser::feed(const char *data, size_t length, int stream)
+{
+    std::string &line = pendingLine[stream] ;
+    for(size_t i = 0; i < length; i++)
+    {
+        if(data[i] == '\n')
+        {
+            parseLine(line, startEmitted[stream]) ;
+            line.clear() ;
+            startEmitted[stream] = false ;
+        }
+        else if(line.size() < FB_OUTPUT_LINE_MAX)
+        {
+            line.push_back(data[i]) ;
+        }
+    }
+
+    if((startEmitted[stream] == false) && (line.empty() == false))
+    {
+        outputPhase phase ;
+        std::string partName ;
+        size_t textStart = line.find_first_not_of(" \t") ;
+        if((textStart != std::string::npos) && parseLabel(line.substr(textStart), phase, partName))
+        {
+            emit(EVENT_STEP_START, phase, partName, 0.0, "", line) ;
+            startEmitted[stream] = true ;
+        }
+    }
+}
+
+/**
+ * @brief FastbootOutputParser::finish : Parse the last lines when the output ends without a new line.
+ */
+void FastbootOutputParser::finish()
+{
+    for(int stream = 0; stream < FB_OUTPUT_STREAMS; stream++)
+    {
+        if(pendingLine[stream].empty() == false)
+            parseLine(pendingLine[stream], startEmitted[stream]) ;
+
+        pendingLine[stream].clear() ;
+        startEmitted[stream] = false ;
+    }
+}
+
+/**
+ * @brief FastbootOutputParser::parseLine : Turn one complete output line into an event.
+ * @param line: The line, without its new line character.
+ * @param startEmitted: True if the start of this operation has already been reported.
+ */
+void FastbootOutputParser::parseLine(const std::string &line, bool startEmitted)
+{
+    std::string text = line ;
+    if((text.empty() == false) && (text.back() == '\r'))
+        text.pop_back() ;
+
+    size_t textStart = text.find_first_not_of(" \t") ;
+    if(textStart == std::string::npos)
+        return ;
+    std::string trimmed = text.substr(textStart) ;
+
+    if(trimmed.compare(0, 13, "(bootloader) ") == 0)
+    {
+        emit(EVENT_INFO, PHASE_NONE, "", 0.0, trimmed.substr(13), text) ;
+        return ;
+    }
+
+    if(trimmed.compare(0, 16, "fastboot: error:") == 0)
+    {
+        size_t reasonStart = trimmed.find_first_not_of(' ', 16) ;
+        failed = true ;
+        emit(EVENT_ERROR, PHASE_NONE, "", 0.0, (reasonStart != std::string::npos) ? trimmed.substr(reasonStart) : "", text) ;
+        return ;
+    }
+
+    if(trimmed.compare(0, 9, "Finished.") == 0)
+    {
+        size_t colon = trimmed.find(':') ;
+        double seconds = (colon != std::string::npos) ? strtod(trimmed.c_str() + colon + 1, nullptr) : 0.0 ;
+        finished = true ;
+        emit(EVENT_FINISHED, PHASE_NONE, "", seconds, "", text) ;
+        return ;
+    }
+
+    outputPhase phase = PHASE_COMMAND ;
+    std::string partName = "" ;
+    bool isLabel = parseLabel(trimmed, phase, partName) ;
+
+    size_t failedPos = trimmed.find("FAILED") ;
+    size_t okayPos = trimmed.find("OKAY") ;
+    if(failedPos != std::string::npos)
+    {
+        std::string reason = "" ;
+        size_t reasonStart = trimmed.find('(', failedPos) ;
+        size_t reasonEnd = trimmed.rfind(')') ;
+        if((reasonStart != std::string::npos) && (reasonEnd != std::string::npos) && (reasonEnd > reasonStart))
+            reason = trimmed.substr(reasonStart + 1, reasonEnd - reasonStart - 1) ;
+
+        failed = true ;
+        emit(EVENT_STEP_FAILED, phase, partName, 0.0, reason, text) ;
+    }
+    else if(okayPos != std::string::npos)
+    {
+        size_t timeStart = trimmed.find('[', okayPos) ;
+        double seconds = (timeStart != std::string::npos) ? strtod(trimmed.c_str() + timeStart + 1, nullptr) : 0.0 ;
+        emit(EVENT_STEP_OKAY, phase, partName, seconds, "", text) ;
+    }
+    else if(isLabel && (startEmitted == false))
+    {
+        emit(EVENT_STEP_START, phase, partName, 0.0, "", text) ;
+    }
+    else if(isLabel == false)
+    {
+        emit(EVENT_TEXT, PHASE_NONE, "", 0.0, "", text) ;
+    }
+}
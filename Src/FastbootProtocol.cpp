@@ -0,0 +1,407 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FastbootProtocol.h"
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+FastbootProtocol::FastbootProtocol(FastbootTransport *transport)
+{
+    this->transport = transport ;
+}
+
+/**
+ * @brief FastbootProtocol::getFlashTimeout : Longest silence of the device while it writes an image.
+ * @param timeouts: The timeouts settings.
+ * @param imageSize: Number of bytes written.
+ * @return The timeout in ms, 0 to wait forever.
+ */
+uint32_t FastbootProtocol::getFlashTimeout(const commandTimeouts &timeouts, uint64_t imageSize)
+{
+    if(timeouts.flash == 0)
+        return 0 ;
+
+    uint64_t megabytes = (imageSize + 1024 * 1024 - 1) / (1024 * 1024) ;
+    uint64_t timeoutMs = timeouts.flash + megabytes * timeouts.flashPerMB ;
+    return static_cast<uint32_t>(std::min<uint64_t>(timeoutMs, std::numeric_limits<uint32_t>::max())) ;
+}
+
+/**
+ * @brief FastbootProtocol::parseTimeouts : Update timeouts from a "name=seconds[,name=seconds...]" option.
+ * The names are command, transfer, flash, flash-per-mb, erase and format, 0 seconds waits forever.
+ * @param timeoutsSpec: The option value, e.g. "flash=20,erase=120".
+ * @param timeouts: Input/output, the timeouts settings.
+ * @return True if the option is valid.
+ */
+bool FastbootProtocol::parseTimeouts(const std::string &timeoutsSpec, commandTimeouts &timeouts)
+{
+    commandTimeouts parsed = timeouts ;
+    size_t begin = 0 ;
+    while(begin <= timeoutsSpec.size())
+    {
+        size_t end = timeoutsSpec.find(',', begin) ;
+        if(end == std::string::npos)
+            end = timeoutsSpec.size() ;
+
+        std::string item = timeoutsSpec.substr(begin, end - begin) ;
+        size_t separator = item.find('=') ;
+        if(separator == std::string::npos)
+            return false ;
+
+        std::string name = item.substr(0, separator) ;
+        std::string secondsString = item.substr(separator + 1) ;
+        char *last = nullptr ;
+        double seconds = strtod(secondsString.c_str(), &last) ;
+        if(secondsString.empty() || (*last != '\0') || (seconds < 0) || (seconds > 4000000))
+            return false ;
+
+        uint32_t milliseconds = static_cast<uint32_t>(std::lround(seconds * 1000)) ;
+        if(name == "command")
+            parsed.command = milliseconds ;
+        else if(name == "transfer")
+            parsed.transfer = milliseconds ;
+        else if(name == "flash")
+            parsed.flash = milliseconds ;
+        else if(name == "flash-per-mb")
+            parsed.flashPerMB = milliseconds ;
+        else if(name == "erase")
+            parsed.erase = milliseconds ;
+        else if(name == "format")
+            parsed.format = milliseconds ;
+        else
+            return false ;
+
+        begin = end + 1 ;
+    }
+
+    timeouts = parsed ;
+    return true ;
+}
+
+/**
+ * @brief FastbootProtocol::getTimeout : Longest silence of the device allowed for a command.
+ * @param cmd: The command string.
+ * @return The timeout in ms, 0 to wait forever.
+ */
+uint32_t FastbootProtocol::getTimeout(const std::string &cmd) const
+{
+    if(cmd.compare(0, 6, "flash:") == 0)
+        return getFlashTimeout(timeouts, downloadedSize) ;
+    if(cmd.compare(0, 6, "erase:") == 0)
+        return timeouts.erase ;
+    if(cmd == "oem format")
+        return timeouts.format ;
+    return timeouts.command ;
+}
+
+/**
+ * @brief FastbootProtocol::setTransportTimeout : Set the longest wait of the next transport reads and writes.
+ * @param timeoutMs: The timeout in ms, 0 to wait forever.
+ */
+void FastbootProtocol::setTransportTimeout(uint32_t timeoutMs)
+{
+    transportTimeout = timeoutMs ;
+    transport->setTimeout(timeoutMs) ;
+}
+
+/**
+ * @brief FastbootProtocol::sendCommand : Write one command packet to the device.
+ * @param cmd: The command string, e.g. "getvar:version".
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int FastbootProtocol::sendCommand(const std::string &cmd)
+{
+    if(cmd.size() > FB_COMMAND_SZ)
+    {
+        lastError = "command too large" ;
+        return TOOLBOX_FASTBOOT_ERROR_WRONG_PARAM ;
+    }
+
+    int ret = transport->write(reinterpret_cast<const uint8_t*>(cmd.data()), cmd.size()) ;
+    if(ret == TOOLBOX_FASTBOOT_ERROR_TIMEOUT)
+    {
+        lastError = "command write timed out" ;
+        return TOOLBOX_FASTBOOT_ERROR_TIMEOUT ;
+    }
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+    {
+        lastError = "command write failed" ;
+        return TOOLBOX_FASTBOOT_ERROR_CONNECTION ;
+    }
+
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief FastbootProtocol::readResponse : Read device packets until a final status is received.
+ * INFO and TEXT packets are printed, OKAY/FAIL end the command, DATA announces the download size.
+ * Each packet is waited for at most the timeout of the current operation.
+ * @param response: Optional output, the payload following OKAY or DATA.
+ * @return 0 on OKAY/DATA, TOOLBOX_FASTBOOT_ERROR_TIMEOUT if the device stopped answering,
+ * otherwise an error occurred (lastError holds the reason).
+ */
+int FastbootProtocol::readResponse(std::string *response)
+{
+    uint8_t packet[FB_RESPONSE_SZ + 1] ;
+
+    while(true)
+    {
+        size_t received = 0 ;
+        int ret = transport->read(packet, FB_RESPONSE_SZ, &received) ;
+        if(ret == TOOLBOX_FASTBOOT_ERROR_TIMEOUT)
+        {
+            char reason[64] ;
+            snprintf(reason, sizeof(reason), "no answer within %.1fs", transportTimeout / 1000.0) ;
+            lastError = reason ;
+            return TOOLBOX_FASTBOOT_ERROR_TIMEOUT ;
+        }
+        if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        {
+            lastError = "status read failed" ;
+            return TOOLBOX_FASTBOOT_ERROR_CONNECTION ;
+        }
+
+        if(received < 4)
+        {
+            lastError = "status malformed (" + std::to_string(received) + " bytes)" ;
+            return TOOLBOX_FASTBOOT_ERROR_CONNECTION ;
+        }
+
+        packet[received] = '\0' ;
+        std::string status(reinterpret_cast<char*>(packet), 4) ;
+        std::string payload(reinterpret_cast<char*>(packet) + 4, received - 4) ;
+
+        if(status == "INFO")
+        {
+            if(infoList != nullptr)
+                infoList->push_back(payload) ;
+            else
+                displayManager.print(MSG_NORMAL, L"(bootloader) %s", payload.c_str()) ;
+        }
+        else if(status == "TEXT")
+        {
+            displayManager.print(MSG_NORMAL, L"%s", payload.c_str()) ;
+        }
+        else if(status == "OKAY")
+        {
+            if(response != nullptr)
+                *response = payload ;
+            return TOOLBOX_FASTBOOT_NO_ERROR ;
+        }
+        else if(status == "FAIL")
+        {
+            lastError = "remote: '" + payload + "'" ;
+            return TOOLBOX_FASTBOOT_ERROR_OTHER ;
+        }
+        else if(status == "DATA")
+        {
+            if(payload.size() != 8)
+            {
+                lastError = "data size malformed" ;
+                return TOOLBOX_FASTBOOT_ERROR_CONNECTION ;
+            }
+            dataRemaining = static_cast<uint32_t>(strtoul(payload.c_str(), nullptr, 16)) ;
+            if(response != nullptr)
+                *response = payload ;
+            return TOOLBOX_FASTBOOT_NO_ERROR ;
+        }
+        else
+        {
+            lastError = "unknown status code " + status ;
+            return TOOLBOX_FASTBOOT_ERROR_CONNECTION ;
+        }
+    }
+}
+
+/**
+ * @brief FastbootProtocol::command : Send a command and wait for its final status.
+ * @param cmd: The command string.
+ * @param response: Optional output, the payload following OKAY.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int FastbootProtocol::command(const std::string &cmd, std::string *response)
+{
+    TraceScope traceScope(cmd, "device") ;
+    setTransportTimeout(getTimeout(cmd)) ;
+    int ret = sendCommand(cmd) ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        return ret ;
+
+    dataRemaining = 0 ;
+    ret = readResponse(response) ;
+    if((ret == TOOLBOX_FASTBOOT_NO_ERROR) && (dataRemaining != 0))
+    {
+        lastError = "unexpected DATA response to " + cmd ;
+        return TOOLBOX_FASTBOOT_ERROR_CONNECTION ;
+    }
+
+    return ret ;
+}
+
+/**
+ * @brief FastbootProtocol::getVar : Read a bootloader variable.
+ * @param name: The variable name, e.g. "max-download-size".
+ * @param value: Output, the variable value.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int FastbootProtocol::getVar(const std::string &name, std::string &value)
+{
+    return command("getvar:" + name, &value) ;
+}
+
+/**
+ * @brief FastbootProtocol::getVarAll : Read all the bootloader variables with a single command.
+ * The device sends one "INFO<name>: <value>" packet per variable before its final status.
+ * @param variablesList: Output, the variables values by name.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred (getvar all is optional).
+ */
+int FastbootProtocol::getVarAll(std::map<std::string, std::string> &variablesList)
+{
+    std::vector<std::string> linesList ;
+    infoList = &linesList ;
+    int ret = command("getvar:all") ;
+    infoList = nullptr ;
+
+    variablesList.clear() ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        return ret ;
+
+    for(const auto &line : linesList)
+    {
+        size_t separator = line.find(": ") ;
+        if(separator != std::string::npos)
+            variablesList[line.substr(0, separator)] = line.substr(separator + 2) ;
+    }
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief FastbootProtocol::downloadCommand : Start a download, the device must accept the whole size.
+ * The payload is then sent with sendData() and completed by readResponse().
+ * @param size: Number of bytes that will be sent.
+ * @return 0 if the device is ready to receive the data, otherwise an error occurred.
+ */
+int FastbootProtocol::downloadCommand(uint32_t size)
+{
+    char cmd[32] ;
+    snprintf(cmd, sizeof(cmd), "download:%08x", size) ;
+    TraceScope traceScope(cmd, "device") ;
+
+    setTransportTimeout(timeouts.command) ;
+    int ret = sendCommand(cmd) ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        return ret ;
+
+    dataRemaining = 0 ;
+    ret = readResponse() ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        return ret ;
+
+    if(dataRemaining != size)
+    {
+        lastError = "device accepted " + std::to_string(dataRemaining) + " bytes instead of " + std::to_string(size) ;
+        return TOOLBOX_FASTBOOT_ERROR_CONNECTION ;
+    }
+
+    downloadedSize = size ;
+    setTransportTimeout(timeouts.transfer) ;
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief FastbootProtocol::sendData : Send a part of the payload announced by downloadCommand().
+ * @param data: The payload bytes.
+ * @param length: Number of bytes, must not exceed the remaining announced size.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int FastbootProtocol::sendData(const uint8_t *data, size_t length)
+{
+    if(length > dataRemaining)
+    {
+        lastError = "data overflows the download size" ;
+        return TOOLBOX_FASTBOOT_ERROR_WRONG_PARAM ;
+    }
+
+    int ret = transport->write(data, length) ;
+    if(ret == TOOLBOX_FASTBOOT_ERROR_TIMEOUT)
+    {
+        lastError = "data write timed out" ;
+        return TOOLBOX_FASTBOOT_ERROR_TIMEOUT ;
+    }
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+    {
+        lastError = "data write failed" ;
+        return TOOLBOX_FASTBOOT_ERROR_CONNECTION ;
+    }
+
+    dataRemaining -= static_cast<uint32_t>(length) ;
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief FastbootProtocol::download : Send a whole buffer to the device download area.
+ * @param data: The payload bytes.
+ * @param size: Number of bytes.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int FastbootProtocol::download(const uint8_t *data, uint32_t size)
+{
+    int ret = downloadCommand(size) ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        return ret ;
+
+    ret = sendData(data, size) ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        return ret ;
+
+    return readResponse() ;
+}
+
+/**
+ * @brief FastbootProtocol::flash : Write the downloaded data into a partition.
+ * @param partitionName: The partition name.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int FastbootProtocol::flash(const std::string &partitionName)
+{
+    return command("flash:" + partitionName) ;
+}
+
+/**
+ * @brief FastbootProtocol::erase : Erase a partition.
+ * @param partitionName: The partition name.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int FastbootProtocol::erase(const std::string &partitionName)
+{
+    return command("erase:" + partitionName) ;
+}
+
+/**
+ * @brief FastbootProtocol::oem : Execute an OEM-specific command.
+ * @param arguments: The command arguments, e.g. "format".
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int FastbootProtocol::oem(const std::string &arguments)
+{
+    return command("oem " + arguments) ;
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FastbootTransport.h"
+#include "UsbTransport.h"
+#include "LoopbackTransport.h"
+#include "TcpTransport.h"
+
+/**
+ * @brief FastbootTransport::create : Instantiate the native transport matching the -t/--transport option.
+ * @param transportSpec: The transport description, e.g. "usb", "tcp:192.168.0.2:5554" or "loopback:device.cfg".
+ * @param serialNumber: The device serial number to select, empty for the first device found.
+ * @return The transport (closed), nullptr if the spec does not name a native transport.
+ */
+FastbootTransport* FastbootTransport::create(const std::string &transportSpec, const std::string &serialNumber)
+{
+    if(transportSpec == TRANSPORT_USB)
+        return new UsbTransport(serialNumber) ;
+
+    std::string configPath ;
+    if(LoopbackTransport::parseSpec(transportSpec, configPath))
+        return new LoopbackTransport(configPath) ;
+
+    std::string hostName ;
+    uint16_t port ;
+    if(TcpTransport::parseSpec(transportSpec, hostName, port))
+        return new TcpTransport(hostName, port) ;
+
+    return nullptr ;
+}
+
+/**
+ * @brief FastbootTransport::isValidSpec : Check the syntax of a -t/--transport option value.
+ * @param transportSpec: The transport description.
+ * @return True if the transport is known.
+ */
+bool FastbootTransport::isValidSpec(const std::string &transportSpec)
+{
+    std::string hostName, configPath ;
+    uint16_t port ;
+    return (transportSpec == TRANSPORT_USB) || (transportSpec == TRANSPORT_EXEC) ||
+           LoopbackTransport::parseSpec(transportSpec, configPath) || TcpTransport::parseSpec(transportSpec, hostName, port) ;
+}
@@ -18,13 +18,16 @@
 
 #include "FileManager.h"
 #include <iomanip>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <sys/stat.h>
 #ifdef _WIN32
 #include <windows.h>
-#else
-#include <cstdlib>
 #endif
 
 #include <experimental/filesystem>
+namespace fs = std::experimental::filesystem;
 
 FileManager::FileManager()
 {
@@ -45,6 +48,7 @@ FileManager & FileManager::getInstance()
  */
 int FileManager::openTsvFile(const std::string &fileName, fileTSV **parsedFile)
 {
+    TraceScope trace("TSV parsing", "session") ;
     fileTSV* parsedTSV = NULL;
     std::ifstream inFile(fileName);
 
@@ -94,6 +98,7 @@ int FileManager::openTsvFile(const std::string &fileName, fileTSV **parsedFile)
 
 /**
  * @brief FileManager::parseTsvFile : The engine part of the methode "openTsvFile"
+ * The whole file is read at once and tokenized in a single pass, the binaries are then checked with one stat per distinct file.
  * @param tsvFolderPath: The folder that contains the TSV file.
  * @param inFile: The TSV file path.
  * @param parsedTSV: Output variable to store the parsed file information.
@@ -102,8 +107,8 @@ int FileManager::openTsvFile(const std::string &fileName, fileTSV **parsedFile)
 int FileManager::parseTsvFile(const std::string tsvFolderPath, std::ifstream *inFile, fileTSV* parsedTSV)
 {   
     inFile->seekg(0, std::ios::end) ;
-    int fSize = inFile->tellg() ;
-    if(fSize == 0)
+    std::streamoff fSize = inFile->tellg() ;
+    if(fSize <= 0)
     {
         displayManager.print(MSG_ERROR, L"TSV file is empty !") ;
         return TOOLBOX_FASTBOOT_ERROR_NO_FILE ;
@@ -113,93 +118,254 @@ int FileManager::parseTsvFile(const std::string tsvFolderPath, std::ifstream *in
         inFile->seekg(0, std::ios::beg) ;
     }
 
-    while (inFile->eof() == false)
+    std::string content ;
+    try
+    {
+        content.resize(static_cast<size_t>(fSize)) ;
+    }
+    catch(const std::bad_alloc&)
     {
-        partitionInfo tempPartition;
-        std::string line ;
-        std::getline(*inFile, line) ;
+        displayManager.print(MSG_ERROR, L"Cannot allocate memory to read the TSV file") ;
+        return TOOLBOX_FASTBOOT_ERROR_NO_MEM ;
+    }
 
-        if(line.empty() == true)
-            continue;
+    inFile->read(&content[0], fSize) ;
+    content.resize(static_cast<size_t>(inFile->gcount())) ;
 
-        if(line.at(0) == '#') /* filter the header which starts with "#" */
-            continue;
+    const char *cursor = content.data() ;
+    const char *contentEnd = cursor + content.size() ;
+    while(cursor < contentEnd)
+    {
+        const char *lineEnd = static_cast<const char*>(memchr(cursor, '\n', static_cast<size_t>(contentEnd - cursor))) ;
+        if(lineEnd == nullptr)
+            lineEnd = contentEnd ;
+        const char *nextLine = (lineEnd < contentEnd) ? lineEnd + 1 : contentEnd ;
+        if((lineEnd > cursor) && (lineEnd[-1] == '\r'))
+            lineEnd-- ; /* TSV file edited on Windows */
 
-        std::vector<std::string> infomartionList ;
-        try
-        {
-            std::regex delimiter("\\t+");
-            if(splitStdString(std::move(line), std::move(delimiter) , infomartionList))
-                return TOOLBOX_FASTBOOT_ERROR_OTHER ;
-        }
-        catch (const std::regex_error& e)
+        if((lineEnd == cursor) || (*cursor == '#')) /* filter the empty lines and the header which starts with "#" */
         {
-            displayManager.print(MSG_ERROR, L"Regex error: %s", e.what());
-            return TOOLBOX_FASTBOOT_ERROR_NO_MEM;
+            cursor = nextLine ;
+            continue;
         }
 
-        if(infomartionList.size() != TSV_NB_COLUMNS )
+        tsvField fieldsList[TSV_NB_COLUMNS] ;
+        if(splitTsvLine(cursor, lineEnd, fieldsList, TSV_NB_COLUMNS) != TSV_NB_COLUMNS)
         {
             displayManager.print(MSG_ERROR, L"TSV file is not conform, it may miss some columns or fields");
             return TOOLBOX_FASTBOOT_ERROR_WRONG_PARAM;
         }
 
-        tempPartition.opt   = infomartionList[0];
-        tempPartition.phaseID = infomartionList[1];
-        tempPartition.partName = infomartionList[2];
-        tempPartition.partType = infomartionList[3];
-        tempPartition.partIp = infomartionList[4];
-        tempPartition.offset  = infomartionList[5];
-        tempPartition.binary =  infomartionList[6];
+        parsedTSV->partitionsList.emplace_back() ;
+        partitionInfo &tempPartition = parsedTSV->partitionsList.back() ;
+        tempPartition.opt.assign(fieldsList[0].data, fieldsList[0].length) ;
+        tempPartition.phaseID.assign(fieldsList[1].data, fieldsList[1].length) ;
+        tempPartition.partName.assign(fieldsList[2].data, fieldsList[2].length) ;
+        tempPartition.partType.assign(fieldsList[3].data, fieldsList[3].length) ;
+        tempPartition.partIp.assign(fieldsList[4].data, fieldsList[4].length) ;
+        tempPartition.offset.assign(fieldsList[5].data, fieldsList[5].length) ;
+        tempPartition.binary.assign(fieldsList[6].data, fieldsList[6].length) ;
+        tempPartition.binarySize = 0 ;
+        tempPartition.binaryModified = 0 ;
+
+        cursor = nextLine ;
+    }
+
+    return resolveBinaries(tsvFolderPath, parsedTSV) ;
+}
 
-        if(tempPartition.binary != "none")
+/**
+ * @brief FileManager::splitTsvLine : Cut a line into its fields, separated by one or more tabulations.
+ * A line starting with a tabulation has an empty first field, the tabulations ending a line are ignored.
+ * @param line: The first character of the line.
+ * @param lineEnd: The end of the line, the line feed excluded.
+ * @param fieldsList: Output, the first maxFieldsNbr fields.
+ * @param maxFieldsNbr: Size of fieldsList.
+ * @return The number of fields of the line, which may exceed maxFieldsNbr.
+ */
+size_t FileManager::splitTsvLine(const char *line, const char *lineEnd, tsvField *fieldsList, size_t maxFieldsNbr)
+{
+    size_t fieldsNbr = 0 ;
+    const char *fieldStart = line ;
+    while(true)
+    {
+        const char *fieldEnd = static_cast<const char*>(memchr(fieldStart, '\t', static_cast<size_t>(lineEnd - fieldStart))) ;
+        if(fieldEnd == nullptr)
+            fieldEnd = lineEnd ;
+
+        if(fieldsNbr < maxFieldsNbr)
+            fieldsList[fieldsNbr] = {fieldStart, static_cast<size_t>(fieldEnd - fieldStart)} ;
+        fieldsNbr++ ;
+
+        while((fieldEnd < lineEnd) && (*fieldEnd == '\t'))
+            fieldEnd++ ;
+        if(fieldEnd == lineEnd)
+            return fieldsNbr ;
+        fieldStart = fieldEnd ;
+    }
+}
+
+/**
+ * @brief getFileStatus : Read the size and the modification time of a file.
+ * @param path: The file path.
+ * @param size: Output, the file size.
+ * @param modified: Output, the last modification time in seconds since the epoch.
+ * @return True if the file exists.
+ */
+static bool getFileStatus(const std::string &path, uint64_t &size, int64_t &modified)
+{
+#ifdef _WIN32
+    struct _stat64 fileStatus ;
+    if(_stat64(path.c_str(), &fileStatus) != 0)
+        return false ;
+#else
+    struct stat fileStatus ;
+    if(stat(path.c_str(), &fileStatus) != 0)
+        return false ;
+#endif
+
+    size = static_cast<uint64_t>(fileStatus.st_size) ;
+    modified = static_cast<int64_t>(fileStatus.st_mtime) ;
+    return true ;
+}
+
+/**
+ * @brief FileManager::resolveBinaries : Find the binary of every partition and record its size and modification time.
+ * A binary is searched from the working folder first, then from the folder that contains the TSV file.
+ * A file used by several partitions is looked up once.
+ * @param tsvFolderPath: The folder that contains the TSV file.
+ * @param parsedTSV: The parsed file, binary paths are updated.
+ * @return 0 if all the binaries exist, otherwise an error occurred.
+ */
+int FileManager::resolveBinaries(const std::string &tsvFolderPath, fileTSV* parsedTSV)
+{
+    std::map<std::string, partitionInfo> resolvedList ; /* Binary as written in the TSV file -> path, size and time found */
+    for(auto &tempPartition : parsedTSV->partitionsList)
+    {
+        if(tempPartition.binary == "none")
+            continue ;
+
+        auto resolved = resolvedList.find(tempPartition.binary) ;
+        if(resolved == resolvedList.end())
         {
-            std::ifstream binaryFile(tempPartition.binary);
-            if(binaryFile.is_open() == false) // file does not exist
+            partitionInfo binaryInfo ;
+            binaryInfo.binary = tempPartition.binary ;
+            if(getFileStatus(binaryInfo.binary, binaryInfo.binarySize, binaryInfo.binaryModified) == false) // file does not exist
             {
                 /* Try to search from the folder that contains the TSV file */
                 std::string tmpPath = "" ;
                 tmpPath.append(tsvFolderPath).append("/").append(tempPartition.binary) ;
-                tempPartition.binary = std::move(tmpPath)  ;
+                binaryInfo.binary = std::move(tmpPath)  ;
 
-                binaryFile.close();
-                binaryFile.open(tempPartition.binary);
-                if(binaryFile.is_open() == false)
+                if(getFileStatus(binaryInfo.binary, binaryInfo.binarySize, binaryInfo.binaryModified) == false)
                 {
-                    displayManager.print(MSG_ERROR, L"File %s does not exist !", tempPartition.binary.c_str());
+                    displayManager.print(MSG_ERROR, L"File %s does not exist !", binaryInfo.binary.c_str());
                     return TOOLBOX_FASTBOOT_ERROR_WRONG_PARAM;
                 }
             }
-            tempPartition.binary = "\"" + tempPartition.binary + "\""; //To take into account the paths with white spaces;
+            resolved = resolvedList.insert(std::make_pair(tempPartition.binary, binaryInfo)).first ;
         }
 
-        parsedTSV->partitionsList.push_back(tempPartition);
+        tempPartition.binary = resolved->second.binary ;
+        tempPartition.binarySize = resolved->second.binarySize ;
+        tempPartition.binaryModified = resolved->second.binaryModified ;
     }
 
     return TOOLBOX_FASTBOOT_NO_ERROR ;
 }
 
 /**
- * @brief FileManager::splitStdString : Split an input string basiong on a specifc format and delimiter.
- * @param str: The input string.
- * @param delimiter: the separator to apply like "\\t+"...
- * @param stringsList: The output variable to store the splited strings.
+ * @brief FileManager::escapeJson : Quote the special characters of a JSON string.
+ * @param text: The raw text.
+ * @return The text to write between double quotes.
+ */
+std::string FileManager::escapeJson(const std::string &text)
+{
+    std::string escaped ;
+    for(char character : text)
+    {
+        if((character == '"') || (character == '\\'))
+        {
+            escaped += '\\' ;
+            escaped += character ;
+        }
+        else if(static_cast<unsigned char>(character) < 0x20)
+        {
+            char code[8] ;
+            snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned int>(character)) ;
+            escaped += code ;
+        }
+        else
+        {
+            escaped += character ;
+        }
+    }
+    return escaped ;
+}
+
+/**
+ * @brief FileManager::getDataPath : Locate a file kept between the runs, shared by all the TSV files of the user.
+ * @param fileName: The file or folder name in the toolbox data folder.
+ * @return The path in the user home folder, or in the current folder if the home folder is unknown.
+ */
+std::string FileManager::getDataPath(const std::string &fileName)
+{
+#ifdef _WIN32
+    const char *homeFolder = getenv("USERPROFILE") ;
+#else
+    const char *homeFolder = getenv("HOME") ;
+#endif
+    if((homeFolder == nullptr) || (homeFolder[0] == '\0'))
+        return fileName ;
+
+    return (fs::path(homeFolder) / TOOLBOX_DATA_FOLDER / fileName).string() ;
+}
+
+/**
+ * @brief FileManager::replaceFile : Replace a file through a temporary file renamed over it, so that it is never read partially written.
+ * The folder of the file is created if needed.
+ * @param filePath: The file to replace.
+ * @param description: The file description used by the warnings, e.g. "flash manifest".
+ * @param writeContent: Writes the new content of the file.
  * @return 0 if the operation is performed successfully, otherwise an error occurred.
  */
-int FileManager::splitStdString(std::string str, std::regex delimiter, std::vector<std::string>& stringsList)
+int FileManager::replaceFile(const std::string &filePath, const std::string &description, const std::function<void(std::ostream &output)> &writeContent)
 {
-    if(str.empty())
+    DisplayManager displayManager = DisplayManager::getInstance() ;
+    std::string temporaryPath = filePath + ".tmp" ;
+    try
+    {
+        fs::path parentFolder = fs::path(filePath).parent_path() ;
+        if((parentFolder.empty() == false) && (fs::exists(parentFolder) == false))
+            fs::create_directories(parentFolder) ;
+    }
+    catch(...)
     {
-        displayManager.print(MSG_ERROR, L"Cannot split string, input is empty") ;
-        return TOOLBOX_FASTBOOT_ERROR_WRONG_PARAM;
+        displayManager.print(MSG_WARNING, L"Cannot create the folder of the %s %s", description.c_str(), filePath.c_str()) ;
+        return TOOLBOX_FASTBOOT_ERROR_WRITE ;
     }
 
-    std::vector<std::string> substrings(
-                std::sregex_token_iterator(str.begin(), str.end(), delimiter, -1),
-                std::sregex_token_iterator()
-                );
+    std::ofstream temporaryFile(temporaryPath, std::ios::trunc) ;
+    writeContent(temporaryFile) ;
+    temporaryFile.close() ;
 
-    stringsList = std::move(substrings);
+    if(temporaryFile.fail())
+    {
+        displayManager.print(MSG_WARNING, L"Cannot write the %s %s", description.c_str(), temporaryPath.c_str()) ;
+        remove(temporaryPath.c_str()) ;
+        return TOOLBOX_FASTBOOT_ERROR_WRITE ;
+    }
+
+    try
+    {
+        fs::rename(temporaryPath, filePath) ;
+    }
+    catch(...)
+    {
+        displayManager.print(MSG_WARNING, L"Cannot update the %s %s", description.c_str(), filePath.c_str()) ;
+        remove(temporaryPath.c_str()) ;
+        return TOOLBOX_FASTBOOT_ERROR_WRITE ;
+    }
 
     return TOOLBOX_FASTBOOT_NO_ERROR ;
 }
@@ -0,0 +1,252 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FlashCostModel.h"
+#include <fstream>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+
+std::mutex FlashCostModel::fileMutex ;
+
+FlashCostModel::FlashCostModel(const std::string &modelPath)
+{
+    this->modelPath = modelPath ;
+    applyDefaults(figures) ;
+}
+
+/**
+ * @brief FlashCostModel::getDefaultPath : Locate the cost model measured by the previous flashing services of the user.
+ * @return The cost model path in the user home folder, or in the current folder if the home folder is unknown.
+ */
+std::string FlashCostModel::getDefaultPath()
+{
+    return FileManager::getDataPath(COST_MODEL_DEFAULT_FILE) ;
+}
+
+/**
+ * @brief FlashCostModel::load : Read the figures of the cost model file, the defaults are kept if it does not exist.
+ * @return 0 if the operation is performed successfully, TOOLBOX_FASTBOOT_ERROR_NO_FILE if the file does not exist, otherwise an error occurred.
+ */
+int FlashCostModel::load()
+{
+    std::lock_guard<std::mutex> lock(fileMutex) ;
+    costFigures fileFigures ;
+    bool found = false ;
+    int ret = readFile(fileFigures, found) ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        return ret ;
+    if(found == false)
+        return TOOLBOX_FASTBOOT_ERROR_NO_FILE ;
+
+    applyDefaults(fileFigures) ;
+    figures = fileFigures ;
+    loaded = true ;
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief FlashCostModel::record : Store the figures measured by a flashing service, the unknown ones keep their previous value.
+ * @param measured: The measured figures, 0 when not measured.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int FlashCostModel::record(const costFigures &measured)
+{
+    std::lock_guard<std::mutex> lock(fileMutex) ;
+    costFigures fileFigures ;
+    bool found = false ;
+    int ret = readFile(fileFigures, found) ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        return ret ;
+
+    if(measured.linkSpeed > 0)
+        fileFigures.linkSpeed = measured.linkSpeed ;
+    if(measured.writeSpeed > 0)
+        fileFigures.writeSpeed = measured.writeSpeed ;
+    if(measured.commandLatency > 0)
+        fileFigures.commandLatency = measured.commandLatency ;
+    if(measured.eraseTime > 0)
+        fileFigures.eraseTime = measured.eraseTime ;
+    if(measured.formatTime > 0)
+        fileFigures.formatTime = measured.formatTime ;
+    if(measured.maxDownloadSize > 0)
+        fileFigures.maxDownloadSize = measured.maxDownloadSize ;
+
+    applyDefaults(fileFigures) ;
+    return writeFile(fileFigures) ;
+}
+
+/**
+ * @brief FlashCostModel::estimate : Predict the duration of a flashing command.
+ * Images larger than the download buffer are counted as several downloads of the same total size.
+ * @param step: The command.
+ * @param imageSize: Size of the flashed image, unused for the other commands.
+ * @return The predicted duration.
+ */
+commandEstimate FlashCostModel::estimate(const fastbootStep &step, uint64_t imageSize) const
+{
+    commandEstimate result ;
+    double latency = figures.commandLatency / 1000.0 ;
+
+    switch(step.type)
+    {
+    case STEP_FLASH:
+    {
+        uint64_t piecesNbr = (imageSize + figures.maxDownloadSize - 1) / figures.maxDownloadSize ;
+        result.size = imageSize ;
+        result.commandsNbr = 2 * static_cast<uint32_t>(std::max<uint64_t>(piecesNbr, 1)) ;
+        result.transferSeconds = imageSize / (figures.linkSpeed * 1024 * 1024) ;
+        result.writeSeconds = imageSize / (figures.writeSpeed * 1024 * 1024) ;
+        result.commandSeconds = result.commandsNbr * latency ;
+        break ;
+    }
+    case STEP_ERASE:
+        result.commandsNbr = 1 ;
+        result.commandSeconds = latency + figures.eraseTime / 1000.0 ;
+        break ;
+    case STEP_OEM_BOOTBUS:
+    case STEP_OEM_PARTCONF:
+        result.commandsNbr = 1 ;
+        result.commandSeconds = latency ;
+        break ;
+    }
+
+    return result ;
+}
+
+/**
+ * @brief FlashCostModel::estimateFormat : Predict the duration of the "oem format" preceding every flashing service.
+ * @return The predicted duration.
+ */
+commandEstimate FlashCostModel::estimateFormat() const
+{
+    commandEstimate result ;
+    result.commandsNbr = 1 ;
+    result.commandSeconds = (figures.commandLatency + figures.formatTime) / 1000.0 ;
+    return result ;
+}
+
+/**
+ * @brief FlashCostModel::applyDefaults : Replace the unknown figures with the STM32MP defaults.
+ * @param fileFigures: Input/output, the figures.
+ */
+void FlashCostModel::applyDefaults(costFigures &fileFigures) const
+{
+    if(fileFigures.linkSpeed <= 0)
+        fileFigures.linkSpeed = COST_DEFAULT_LINK_SPEED ;
+    if(fileFigures.writeSpeed <= 0)
+        fileFigures.writeSpeed = COST_DEFAULT_WRITE_SPEED ;
+    if(fileFigures.commandLatency == 0)
+        fileFigures.commandLatency = COST_DEFAULT_COMMAND_LATENCY ;
+    if(fileFigures.eraseTime == 0)
+        fileFigures.eraseTime = COST_DEFAULT_ERASE_TIME ;
+    if(fileFigures.formatTime == 0)
+        fileFigures.formatTime = COST_DEFAULT_FORMAT_TIME ;
+    if(fileFigures.maxDownloadSize == 0)
+        fileFigures.maxDownloadSize = COST_DEFAULT_MAX_DOWNLOAD_SIZE ;
+}
+
+/**
+ * @brief FlashCostModel::readFile : Parse the cost model file.
+ * @param fileFigures: Output, the figures of the file, 0 for the missing ones.
+ * @param found: Output, false if the file does not exist.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int FlashCostModel::readFile(costFigures &fileFigures, bool &found)
+{
+    fileFigures = costFigures() ;
+
+    std::ifstream modelFile(modelPath) ;
+    found = modelFile.is_open() ;
+    if(found == false)
+        return TOOLBOX_FASTBOOT_NO_ERROR ;
+
+    auto trim = [](const std::string &text)
+    {
+        size_t first = text.find_first_not_of(" \t\r") ;
+        size_t last = text.find_last_not_of(" \t\r") ;
+        return (first == std::string::npos) ? std::string() : text.substr(first, last - first + 1) ;
+    } ;
+
+    std::string line ;
+    int lineNumber = 0 ;
+    while(std::getline(modelFile, line))
+    {
+        lineNumber++ ;
+        line = trim(line.substr(0, line.find('#'))) ;
+        size_t separator = line.find('=') ;
+        if(line.empty() || (separator == std::string::npos))
+            continue ;
+
+        std::string key = trim(line.substr(0, separator)) ;
+        std::string value = trim(line.substr(separator + 1)) ;
+        char *end = nullptr ;
+        bool valid = true ;
+
+        if((key == "link-speed") || (key == "write-speed"))
+        {
+            double speed = strtod(value.c_str(), &end) ;
+            valid = (end != value.c_str()) && (*end == '\0') && (speed >= 0) ;
+            (key == "link-speed" ? fileFigures.linkSpeed : fileFigures.writeSpeed) = speed ;
+        }
+        else if((key == "command-latency") || (key == "erase-time") || (key == "format-time") || (key == "max-download-size"))
+        {
+            unsigned long long number = strtoull(value.c_str(), &end, 0) ;
+            valid = (end != value.c_str()) && (*end == '\0') && (value[0] != '-') && (number <= 0xFFFFFFFF) ;
+            if(key == "command-latency")
+                fileFigures.commandLatency = static_cast<uint32_t>(number) ;
+            else if(key == "erase-time")
+                fileFigures.eraseTime = static_cast<uint32_t>(number) ;
+            else if(key == "format-time")
+                fileFigures.formatTime = static_cast<uint32_t>(number) ;
+            else
+                fileFigures.maxDownloadSize = static_cast<uint32_t>(number) ;
+        }
+
+        if(valid == false)
+        {
+            displayManager.print(MSG_ERROR, L"Cost model %s line %d : invalid entry \"%s\"", modelPath.c_str(), lineNumber, line.c_str()) ;
+            return TOOLBOX_FASTBOOT_ERROR_WRONG_PARAM ;
+        }
+    }
+
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief FlashCostModel::writeFile : Replace the cost model file, through a temporary file renamed over it.
+ * @param fileFigures: The figures to store.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int FlashCostModel::writeFile(const costFigures &fileFigures)
+{
+    char maxDownloadSize[16] ;
+    snprintf(maxDownloadSize, sizeof(maxDownloadSize), "0x%08x", fileFigures.maxDownloadSize) ;
+
+    return FileManager::replaceFile(modelPath, "cost model", [&](std::ostream &modelFile)
+    {
+        modelFile << "# Flashing cost model, updated by every successful flashing service\n"
+                  << "# Speeds in MB/s, durations in ms\n"
+                  << "link-speed = " << fileFigures.linkSpeed << "\n"
+                  << "write-speed = " << fileFigures.writeSpeed << "\n"
+                  << "command-latency = " << fileFigures.commandLatency << "\n"
+                  << "erase-time = " << fileFigures.eraseTime << "\n"
+                  << "format-time = " << fileFigures.formatTime << "\n"
+                  << "max-download-size = " << maxDownloadSize << "\n" ;
+    }) ;
+}
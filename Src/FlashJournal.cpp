@@ -0,0 +1,195 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "FlashJournal.h"
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cctype>
+#include <cstdio>
+#include <experimental/filesystem>
+namespace fs = std::experimental::filesystem;
+
+/* Journal lines: "layout <digest>" then "step <command> <partition> <SHA-256>", tab separated */
+#define JOURNAL_LAYOUT_KEY "layout"
+#define JOURNAL_STEP_KEY "step"
+
+FlashJournal::FlashJournal(const std::string &journalPath)
+{
+    this->journalPath = journalPath ;
+}
+
+/**
+ * @brief FlashJournal::getDefaultFolder : Locate the journals folder shared by all the TSV files of the user.
+ * @return The folder in the user home folder, or in the current folder if the home folder is unknown.
+ */
+std::string FlashJournal::getDefaultFolder()
+{
+    return FileManager::getDataPath(FLASH_JOURNAL_DEFAULT_FOLDER) ;
+}
+
+/**
+ * @brief FlashJournal::getJournalPath : Get the journal file of a device.
+ * @param journalFolder: The journals folder.
+ * @param serialNumber: The device serial number, the characters not allowed in a file name are replaced.
+ * @return The journal path.
+ */
+std::string FlashJournal::getJournalPath(const std::string &journalFolder, const std::string &serialNumber)
+{
+    std::string fileName = serialNumber ;
+    for(char &character : fileName)
+    {
+        if((isalnum(static_cast<unsigned char>(character)) == 0) && (character != '-') && (character != '_') && (character != '.'))
+            character = '_' ;
+    }
+    return (fs::path(journalFolder) / (fileName + ".journal")).string() ;
+}
+
+/**
+ * @brief FlashJournal::load : Read the journal, a missing file means no interrupted flashing service.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int FlashJournal::load()
+{
+    layoutDigest.clear() ;
+    entriesList.clear() ;
+
+    std::ifstream journalFile(journalPath) ;
+    if(journalFile.is_open() == false)
+        return TOOLBOX_FASTBOOT_NO_ERROR ;
+
+    std::string line ;
+    while(std::getline(journalFile, line))
+    {
+        if(line.empty() || (line[0] == '#'))
+            continue ;
+
+        std::vector<std::string> columnsList ;
+        std::istringstream lineStream(line) ;
+        std::string column ;
+        while(std::getline(lineStream, column, '\t'))
+            columnsList.push_back(column) ;
+
+        if((columnsList.size() == 2) && (columnsList[0] == JOURNAL_LAYOUT_KEY))
+        {
+            layoutDigest = columnsList[1] ;
+        }
+        else if((columnsList.size() >= 3) && (columnsList[0] == JOURNAL_STEP_KEY))
+        {
+            journalEntry entry ;
+            entry.command = columnsList[1] ;
+            entry.partName = columnsList[2] ;
+            entry.sha256 = (columnsList.size() > 3) ? columnsList[3] : "" ;
+            entriesList.push_back(entry) ;
+        }
+    }
+
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief FlashJournal::isFormatted : Check if the interrupted flashing service formatted the memory for the same layout.
+ * @param layoutDigest: The layout digest of the plan about to be applied.
+ * @return True if "oem format" can be skipped.
+ */
+bool FlashJournal::isFormatted(const std::string &layoutDigest) const
+{
+    return (this->layoutDigest.empty() == false) && (this->layoutDigest == layoutDigest) ;
+}
+
+/**
+ * @brief FlashJournal::getCompletedNbr : Count the leading plan steps already completed with the same images.
+ * @param planEntriesList: The steps of the plan about to be applied.
+ * @return The number of steps to skip, the flashing continues with the first step that did not finish.
+ */
+size_t FlashJournal::getCompletedNbr(const std::vector<journalEntry> &planEntriesList) const
+{
+    size_t completedNbr = 0 ;
+    while((completedNbr < entriesList.size()) && (completedNbr < planEntriesList.size()))
+    {
+        const journalEntry &recorded = entriesList[completedNbr], &planned = planEntriesList[completedNbr] ;
+        if((recorded.command != planned.command) || (recorded.partName != planned.partName) || (recorded.sha256 != planned.sha256))
+            break ;
+        completedNbr++ ;
+    }
+    return completedNbr ;
+}
+
+/**
+ * @brief FlashJournal::save : Replace the journal, through a temporary file renamed over it.
+ * @param layoutDigest: The layout formatted on the device.
+ * @param completedList: The leading plan steps completed on the device.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int FlashJournal::save(const std::string &layoutDigest, const std::vector<journalEntry> &completedList)
+{
+    int ret = FileManager::replaceFile(journalPath, "flash journal", [&](std::ostream &journalFile)
+    {
+        journalFile << "# Flashing service in progress, continued by --resume\n"
+                    << JOURNAL_LAYOUT_KEY << '\t' << layoutDigest << '\n' ;
+        for(const auto &entry : completedList)
+            journalFile << JOURNAL_STEP_KEY << '\t' << entry.command << '\t' << entry.partName << '\t' << entry.sha256 << '\n' ;
+    }) ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        return ret ;
+
+    this->layoutDigest = layoutDigest ;
+    entriesList = completedList ;
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief FlashJournal::append : Record the next completed step at the end of the journal written by save().
+ * A line cut by an interruption does not match the plan step, the next run only flashes that step again.
+ * @param entry: The completed step.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int FlashJournal::append(const journalEntry &entry)
+{
+    std::ofstream journalFile(journalPath, std::ios::app) ;
+    journalFile << JOURNAL_STEP_KEY << '\t' << entry.command << '\t' << entry.partName << '\t' << entry.sha256 << '\n' ;
+    journalFile.close() ;
+
+    if(journalFile.fail())
+    {
+        displayManager.print(MSG_WARNING, L"Cannot write the flash journal %s", journalPath.c_str()) ;
+        return TOOLBOX_FASTBOOT_ERROR_WRITE ;
+    }
+
+    entriesList.push_back(entry) ;
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief FlashJournal::clear : Remove the journal once the flashing service is complete.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int FlashJournal::clear()
+{
+    layoutDigest.clear() ;
+    entriesList.clear() ;
+
+    std::error_code error ;
+    fs::remove(journalPath, error) ;
+    if(error)
+    {
+        displayManager.print(MSG_WARNING, L"Cannot remove the flash journal %s", journalPath.c_str()) ;
+        return TOOLBOX_FASTBOOT_ERROR_WRITE ;
+    }
+
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
@@ -0,0 +1,193 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FlashManifest.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+
+/* Manifest columns: serial, partition, SHA-256, size and the TSV line */
+constexpr size_t MANIFEST_NB_COLUMNS = 4 + TSV_NB_COLUMNS ;
+
+std::mutex FlashManifest::fileMutex ;
+
+FlashManifest::FlashManifest(const std::string &manifestPath)
+{
+    this->manifestPath = manifestPath ;
+}
+
+/**
+ * @brief FlashManifest::getDefaultPath : Locate the manifest shared by all the TSV files of the user.
+ * @return The manifest path in the user home folder, or in the current folder if the home folder is unknown.
+ */
+std::string FlashManifest::getDefaultPath()
+{
+    return FileManager::getDataPath(FLASH_MANIFEST_DEFAULT_FILE) ;
+}
+
+/**
+ * @brief FlashManifest::load : Read the manifest, a missing file is an empty manifest.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int FlashManifest::load()
+{
+    std::lock_guard<std::mutex> lock(fileMutex) ;
+    return readFile(entriesList) ;
+}
+
+/**
+ * @brief FlashManifest::isUnchanged : Check if an image is already on the device, as recorded when the manifest was loaded.
+ * The image content and the layout columns of its TSV line must match, the binary path may differ.
+ * @param entry: The image about to be flashed.
+ * @return True if the partition can be skipped.
+ */
+bool FlashManifest::isUnchanged(const manifestEntry &entry) const
+{
+    for(const auto &recorded : entriesList)
+    {
+        if((recorded.serialNumber != entry.serialNumber) || (recorded.partName != entry.partName))
+            continue ;
+
+        const partitionInfo &a = recorded.tsvLine, &b = entry.tsvLine ;
+        return (recorded.sha256 == entry.sha256) && (recorded.size == entry.size) && (a.opt == b.opt) && (a.phaseID == b.phaseID) &&
+               (a.partName == b.partName) && (a.partType == b.partType) && (a.partIp == b.partIp) && (a.offset == b.offset) ;
+    }
+
+    return false ;
+}
+
+/**
+ * @brief FlashManifest::forget : Remove the entries of partitions about to be modified, so that an interrupted
+ * write is never taken for the previous content.
+ * @param serialNumber: The device serial number.
+ * @param partNames: The partitions.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int FlashManifest::forget(const std::string &serialNumber, const std::vector<std::string> &partNames)
+{
+    std::lock_guard<std::mutex> lock(fileMutex) ;
+    std::vector<manifestEntry> fileEntriesList ;
+    int ret = readFile(fileEntriesList) ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        return ret ;
+
+    size_t entriesNbr = fileEntriesList.size() ;
+    fileEntriesList.erase(std::remove_if(fileEntriesList.begin(), fileEntriesList.end(), [&](const manifestEntry &recorded)
+    {
+        return (recorded.serialNumber == serialNumber) && (std::find(partNames.begin(), partNames.end(), recorded.partName) != partNames.end()) ;
+    }), fileEntriesList.end()) ;
+
+    if(fileEntriesList.size() == entriesNbr)
+        return TOOLBOX_FASTBOOT_NO_ERROR ;
+
+    return writeFile(fileEntriesList) ;
+}
+
+/**
+ * @brief FlashManifest::record : Store the images flashed successfully, replacing the previous entries of their partitions.
+ * @param entriesList: The flashed images.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int FlashManifest::record(const std::vector<manifestEntry> &entriesList)
+{
+    if(entriesList.empty())
+        return TOOLBOX_FASTBOOT_NO_ERROR ;
+
+    std::lock_guard<std::mutex> lock(fileMutex) ;
+    std::vector<manifestEntry> fileEntriesList ;
+    int ret = readFile(fileEntriesList) ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        return ret ;
+
+    for(const auto &entry : entriesList)
+    {
+        auto it = std::find_if(fileEntriesList.begin(), fileEntriesList.end(), [&entry](const manifestEntry &recorded)
+        {
+            return (recorded.serialNumber == entry.serialNumber) && (recorded.partName == entry.partName) ;
+        }) ;
+
+        if(it != fileEntriesList.end())
+            *it = entry ;
+        else
+            fileEntriesList.push_back(entry) ;
+    }
+
+    return writeFile(fileEntriesList) ;
+}
+
+/**
+ * @brief FlashManifest::readFile : Parse the manifest file, malformed lines are ignored.
+ * @param fileEntriesList: Output, the entries of the file.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int FlashManifest::readFile(std::vector<manifestEntry> &fileEntriesList)
+{
+    fileEntriesList.clear() ;
+
+    std::ifstream manifestFile(manifestPath) ;
+    if(manifestFile.is_open() == false)
+        return TOOLBOX_FASTBOOT_NO_ERROR ;
+
+    std::string line ;
+    while(std::getline(manifestFile, line))
+    {
+        if(line.empty() || (line[0] == '#'))
+            continue ;
+
+        std::vector<std::string> columnsList ;
+        std::istringstream lineStream(line) ;
+        std::string column ;
+        while(std::getline(lineStream, column, '\t'))
+            columnsList.push_back(column) ;
+
+        if(columnsList.size() != MANIFEST_NB_COLUMNS)
+            continue ;
+
+        manifestEntry entry ;
+        entry.serialNumber = columnsList[0] ;
+        entry.partName = columnsList[1] ;
+        entry.sha256 = columnsList[2] ;
+        entry.size = strtoull(columnsList[3].c_str(), nullptr, 10) ;
+        entry.tsvLine = {columnsList[4], columnsList[5], columnsList[6], columnsList[7], columnsList[8], columnsList[9], columnsList[10], 0, 0} ;
+        fileEntriesList.push_back(entry) ;
+    }
+
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief FlashManifest::writeFile : Replace the manifest file, through a temporary file renamed over it.
+ * @param fileEntriesList: The entries to store.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int FlashManifest::writeFile(const std::vector<manifestEntry> &fileEntriesList)
+{
+    return FileManager::replaceFile(manifestPath, "flash manifest", [&](std::ostream &manifestFile)
+    {
+        manifestFile << "#Serial\tPartition\tSHA-256\tSize\tOpt\tId\tName\tType\tIP\tOffset\tBinary\n" ;
+        for(const auto &entry : fileEntriesList)
+        {
+            const partitionInfo &part = entry.tsvLine ;
+            manifestFile << entry.serialNumber << '\t' << entry.partName << '\t' << entry.sha256 << '\t' << entry.size << '\t'
+                         << part.opt << '\t' << part.phaseID << '\t' << part.partName << '\t' << part.partType << '\t'
+                         << part.partIp << '\t' << part.offset << '\t' << part.binary << '\n' ;
+        }
+    }) ;
+}
@@ -0,0 +1,252 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "FlashMetrics.h"
+#include <fstream>
+#include <cmath>
+#include <ctime>
+#include <cstdio>
+
+std::mutex FlashMetrics::fileMutex ;
+
+/* Metrics families, written in this order with their HELP and TYPE lines */
+struct metricsFamily
+{
+    const char *name ;
+    const char *type ;
+    const char *help ;
+};
+
+static const metricsFamily familiesList[] =
+{
+    {METRICS_PREFIX "boards_flashed_total", "counter", "Boards flashed successfully."},
+    {METRICS_PREFIX "failures_total", "counter", "Failed flashing services, by ToolboxError code."},
+    {METRICS_PREFIX "transferred_bytes_total", "counter", "Bytes downloaded to the devices by the successful flash commands."},
+    {METRICS_PREFIX "partition_duration_seconds", "histogram", "Transfer and write duration of each flashed partition."},
+    {METRICS_PREFIX "partition_throughput_bytes_per_second", "histogram", "Image size divided by the flash duration, for each flashed partition."},
+    {METRICS_PREFIX "device_probe_seconds", "histogram", "Time taken to find the device in fastboot mode."},
+    {METRICS_PREFIX "last_run_timestamp_seconds", "gauge", "End of the last flashing service, in seconds since the epoch."},
+    {METRICS_PREFIX "last_run_result", "gauge", "ToolboxError code of the last flashing service, 0 on success."},
+} ;
+
+/* Histograms upper bounds, the +Inf bucket is added */
+static const std::vector<double> durationBucketsList = {0.1, 0.5, 1, 2, 5, 10, 30, 60, 120, 300, 600} ;
+static const std::vector<double> throughputBucketsList = {1e6, 2e6, 5e6, 10e6, 20e6, 40e6, 80e6, 160e6} ;
+static const std::vector<double> probeBucketsList = {0.01, 0.05, 0.1, 0.25, 0.5, 1, 2, 5, 10} ;
+
+FlashMetrics::FlashMetrics(const std::string &metricsPath)
+{
+    this->metricsPath = metricsPath ;
+}
+
+/**
+ * @brief FlashMetrics::record : Add a flashing service to the metrics file.
+ * @param run: The outcome of the flashing service.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int FlashMetrics::record(const metricsRun &run)
+{
+    std::lock_guard<std::mutex> lock(fileMutex) ;
+    readFile() ;
+
+    /* The counters exist from the first run, rate() then sees their first increment */
+    addSample(METRICS_PREFIX "boards_flashed_total", (run.result == TOOLBOX_FASTBOOT_NO_ERROR) ? 1 : 0) ;
+    if(run.result != TOOLBOX_FASTBOOT_NO_ERROR)
+        addSample(METRICS_PREFIX "failures_total{error=\"" + getErrorName(run.result) + "\"}", 1) ;
+    addSample(METRICS_PREFIX "transferred_bytes_total", 0) ;
+
+    for(const auto &partition : run.partitionsList)
+    {
+        std::string labels = "partition=\"" + escapeLabel(partition.partName) + "\"" ;
+        addSample(METRICS_PREFIX "transferred_bytes_total", static_cast<double>(partition.sentBytes)) ;
+        observe(METRICS_PREFIX "partition_duration_seconds", labels, durationBucketsList, partition.seconds) ;
+        if(partition.seconds > 0)
+            observe(METRICS_PREFIX "partition_throughput_bytes_per_second", labels, throughputBucketsList, partition.imageBytes / partition.seconds) ;
+    }
+
+    if(run.probeSeconds >= 0)
+        observe(METRICS_PREFIX "device_probe_seconds", "", probeBucketsList, run.probeSeconds) ;
+
+    addSample(METRICS_PREFIX "last_run_timestamp_seconds", static_cast<double>(std::time(nullptr)), true) ;
+    addSample(METRICS_PREFIX "last_run_result", run.result, true) ;
+
+    return writeFile() ;
+}
+
+/**
+ * @brief FlashMetrics::getErrorName : Get the label value of an error code.
+ * @param errorCode: The ToolboxError code.
+ * @return The code name without its TOOLBOX_FASTBOOT_ERROR_ prefix.
+ */
+std::string FlashMetrics::getErrorName(int errorCode)
+{
+    switch(errorCode)
+    {
+    case TOOLBOX_FASTBOOT_NO_ERROR: return "NO_ERROR" ;
+    case TOOLBOX_FASTBOOT_ERROR_NOT_CONNECTED: return "NOT_CONNECTED" ;
+    case TOOLBOX_FASTBOOT_ERROR_NO_DEVICE: return "NO_DEVICE" ;
+    case TOOLBOX_FASTBOOT_ERROR_CONNECTION: return "CONNECTION" ;
+    case TOOLBOX_FASTBOOT_ERROR_NO_FILE: return "NO_FILE" ;
+    case TOOLBOX_FASTBOOT_ERROR_NOT_SUPPORTED: return "NOT_SUPPORTED" ;
+    case TOOLBOX_FASTBOOT_ERROR_INTERFACE_NOT_SUPPORTED: return "INTERFACE_NOT_SUPPORTED" ;
+    case TOOLBOX_FASTBOOT_ERROR_NO_MEM: return "NO_MEM" ;
+    case TOOLBOX_FASTBOOT_ERROR_WRONG_PARAM: return "WRONG_PARAM" ;
+    case TOOLBOX_FASTBOOT_ERROR_READ: return "READ" ;
+    case TOOLBOX_FASTBOOT_ERROR_WRITE: return "WRITE" ;
+    case TOOLBOX_FASTBOOT_ERROR_UNSUPPORTED_FILE_FORMAT: return "UNSUPPORTED_FILE_FORMAT" ;
+    case TOOLBOX_FASTBOOT_ERROR_TIMEOUT: return "TIMEOUT" ;
+    default: return "OTHER" ;
+    }
+}
+
+/**
+ * @brief FlashMetrics::readFile : Load the samples of the metrics file, a missing or unreadable file starts from zero.
+ */
+void FlashMetrics::readFile()
+{
+    samplesList.clear() ;
+    samplesIndex.clear() ;
+
+    std::ifstream metricsFile(metricsPath) ;
+    std::string line ;
+    while(std::getline(metricsFile, line))
+    {
+        if(line.empty() == false && line.back() == '\r')
+            line.pop_back() ;
+
+        size_t separator = line.rfind(' ') ;
+        if(line.empty() || (line[0] == '#') || (separator == std::string::npos) || (separator == 0))
+            continue ;
+
+        std::string value = line.substr(separator + 1) ;
+        char *end = nullptr ;
+        double number = strtod(value.c_str(), &end) ;
+        if((end == value.c_str()) || (*end != '\0'))
+            continue ;
+
+        addSample(line.substr(0, separator), number) ;
+    }
+}
+
+/**
+ * @brief FlashMetrics::writeFile : Replace the metrics file, through a temporary file so that the collector never reads a partial file.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int FlashMetrics::writeFile()
+{
+    return FileManager::replaceFile(metricsPath, "metrics", [&](std::ostream &metricsFile)
+    {
+        for(const auto &family : familiesList)
+        {
+            std::string familyName = family.name ;
+            bool headerWritten = false ;
+            for(const auto &sample : samplesList)
+            {
+                std::string metricName = sample.first.substr(0, sample.first.find('{')) ;
+                if((metricName != familyName) && (metricName != familyName + "_bucket") && (metricName != familyName + "_sum") && (metricName != familyName + "_count"))
+                    continue ;
+
+                if(headerWritten == false)
+                {
+                    metricsFile << "# HELP " << familyName << " " << family.help << "\n"
+                                << "# TYPE " << familyName << " " << family.type << "\n" ;
+                    headerWritten = true ;
+                }
+                metricsFile << sample.first << " " << formatNumber(sample.second) << "\n" ;
+            }
+        }
+    }) ;
+}
+
+/**
+ * @brief FlashMetrics::addSample : Add a value to a sample, created if it does not exist yet.
+ * @param sampleName: The metric name and its labels.
+ * @param value: The increment, or the new value of a gauge.
+ * @param isGauge: Replace the value instead of adding to it.
+ */
+void FlashMetrics::addSample(const std::string &sampleName, double value, bool isGauge)
+{
+    auto sample = samplesIndex.find(sampleName) ;
+    if(sample == samplesIndex.end())
+    {
+        samplesIndex[sampleName] = samplesList.size() ;
+        samplesList.push_back(std::make_pair(sampleName, value)) ;
+    }
+    else if(isGauge)
+    {
+        samplesList[sample->second].second = value ;
+    }
+    else
+    {
+        samplesList[sample->second].second += value ;
+    }
+}
+
+/**
+ * @brief FlashMetrics::observe : Count a value in a histogram.
+ * @param familyName: The histogram name.
+ * @param labels: Its labels, empty for none.
+ * @param bucketsList: The buckets upper bounds, in increasing order.
+ * @param value: The observed value.
+ */
+void FlashMetrics::observe(const std::string &familyName, const std::string &labels, const std::vector<double> &bucketsList, double value)
+{
+    std::string bucketLabels = labels.empty() ? "" : labels + "," ;
+    for(double bound : bucketsList)
+        addSample(familyName + "_bucket{" + bucketLabels + "le=\"" + formatNumber(bound) + "\"}", (value <= bound) ? 1 : 0) ;
+    addSample(familyName + "_bucket{" + bucketLabels + "le=\"+Inf\"}", 1) ;
+
+    std::string sampleLabels = labels.empty() ? "" : "{" + labels + "}" ;
+    addSample(familyName + "_sum" + sampleLabels, value) ;
+    addSample(familyName + "_count" + sampleLabels, 1) ;
+}
+
+/**
+ * @brief FlashMetrics::formatNumber : Write a sample value, integers without exponent nor decimals.
+ * @param value: The value.
+ * @return The text of the value.
+ */
+std::string FlashMetrics::formatNumber(double value)
+{
+    char text[32] ;
+    if((value == std::floor(value)) && (std::fabs(value) < 1e15))
+        snprintf(text, sizeof(text), "%.0f", value) ;
+    else
+        snprintf(text, sizeof(text), "%.15g", value) ;
+    return text ;
+}
+
+/**
+ * @brief FlashMetrics::escapeLabel : Quote the special characters of a label value.
+ * @param text: The raw text.
+ * @return The text to write between double quotes.
+ */
+std::string FlashMetrics::escapeLabel(const std::string &text)
+{
+    std::string escaped ;
+    for(char character : text)
+    {
+        if((character == '"') || (character == '\\'))
+            escaped += '\\' ;
+
+        if(character == '\n')
+            escaped += "\\n" ;
+        else
+            escaped += character ;
+    }
+    return escaped ;
+}
@@ -0,0 +1,278 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "FlashPipeline.h"
+#include <chrono>
+
+FlashPipeline::FlashPipeline(uint64_t memoryBudget, unsigned int workersNbr)
+{
+    this->memoryBudget = memoryBudget ;
+    this->workersNbr = (workersNbr == 0) ? 1 : workersNbr ;
+}
+
+FlashPipeline::~FlashPipeline()
+{
+    stop() ;
+}
+
+/**
+ * @brief FlashPipeline::start : Start the preparation threads.
+ * @param stepsNbr: Number of steps of the flashing sequence.
+ * @param plan: Fills the downloads of one step, a step without download is ready at once.
+ */
+void FlashPipeline::start(size_t stepsNbr, const planFunction &plan)
+{
+    stop() ;
+
+    this->plan = plan ;
+    preparedList.assign(stepsNbr, preparedFlash()) ;
+    nextStep = 0 ;
+    fillingStep = 0 ;
+    memoryUsed = 0 ;
+    stopping = false ;
+    traceTrack = TraceRecorder::getTrack() ;
+
+    for(unsigned int i = 0; (i < workersNbr) && (i < stepsNbr); i++)
+        workersList.push_back(std::thread(&FlashPipeline::runWorker, this, i)) ;
+}
+
+/**
+ * @brief FlashPipeline::stop : Stop the preparation threads, the step being planned is completed first.
+ */
+void FlashPipeline::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(pipelineMutex) ;
+        stopping = true ;
+    }
+    pipelineCondition.notify_all() ;
+
+    for(auto &worker : workersList)
+        worker.join() ;
+    workersList.clear() ;
+}
+
+/**
+ * @brief FlashPipeline::runWorker : Preparation thread, takes the steps in sequence order.
+ * @param workerIndex: The thread number, names its trace track next to the one of the sequence.
+ */
+void FlashPipeline::runWorker(unsigned int workerIndex)
+{
+    TraceRecorder::setTrack((traceTrack.empty() ? "main" : traceTrack) + " prepare " + std::to_string(workerIndex + 1)) ;
+
+    while(true)
+    {
+        size_t stepIndex ;
+        {
+            std::lock_guard<std::mutex> lock(pipelineMutex) ;
+            if(stopping || (nextStep >= preparedList.size()))
+                return ;
+            stepIndex = nextStep++ ;
+        }
+
+        prepareStep(stepIndex) ;
+    }
+}
+
+/**
+ * @brief FlashPipeline::prepareStep : Plan one step, then fill its download buffers once the previous steps are filled.
+ * @param stepIndex: The step to prepare.
+ */
+void FlashPipeline::prepareStep(size_t stepIndex)
+{
+    preparedFlash &prepared = preparedList[stepIndex] ;
+
+    auto start = std::chrono::steady_clock::now() ;
+    int ret = plan(stepIndex, prepared) ;
+    double planSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() ;
+
+    std::unique_lock<std::mutex> lock(pipelineMutex) ;
+    prepared.result = ret ;
+    prepared.planned = true ;
+    prepared.prepareSeconds = planSeconds ;
+    pipelineCondition.notify_all() ;
+
+    /* A mapped image needs no buffer: its pages are read ahead into the system cache and sent from the mapping */
+    ImageSource source(prepared.filePath) ;
+    if((prepared.result == TOOLBOX_FASTBOOT_NO_ERROR) && (prepared.downloadsList.empty() == false))
+    {
+        lock.unlock() ;
+        int openRet = source.open() ;
+        lock.lock() ;
+        if(openRet != TOOLBOX_FASTBOOT_NO_ERROR)
+            prepared.result = openRet ;
+        prepared.mapped = source.isMapped() ;
+    }
+
+    bool readAhead = false ;
+    for(auto &download : prepared.downloadsList)
+    {
+        if(prepared.result != TOOLBOX_FASTBOOT_NO_ERROR)
+            break ;
+
+        /* A download larger than the whole budget is streamed, it never waits for memory */
+        bool buffered = (prepared.mapped == false) && (download.size <= memoryBudget) ;
+        pipelineCondition.wait(lock, [&]() { return stopping || ((fillingStep == stepIndex) && ((buffered == false) || (memoryUsed + download.size <= memoryBudget))) ; }) ;
+        if(stopping)
+            return ;
+
+        if(buffered)
+            memoryUsed += download.size ;
+        lock.unlock() ;
+
+        start = std::chrono::steady_clock::now() ;
+        if(buffered)
+        {
+            ret = fillDownload(source, download) ;
+        }
+        else if(readAhead == false)
+        {
+            /* Ask the system to load the file while the previous downloads are sent */
+            source.prefetch(0, source.getSize()) ;
+            readAhead = true ;
+        }
+        auto end = std::chrono::steady_clock::now() ;
+        TraceRecorder::getInstance().addEvent((buffered ? "Read step " : "Prefetch step ") + std::to_string(stepIndex + 1), "pipeline", start, end) ;
+        double fillSeconds = std::chrono::duration<double>(end - start).count() ;
+
+        lock.lock() ;
+        prepared.prepareSeconds += fillSeconds ;
+        if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        {
+            memoryUsed -= download.size ;
+            std::vector<uint8_t>().swap(download.data) ;
+            prepared.result = ret ;
+            break ;
+        }
+
+        prepared.bufferedBytes += download.data.size() ;
+        download.ready = true ;
+        pipelineCondition.notify_all() ;
+    }
+
+    pipelineCondition.wait(lock, [&]() { return stopping || (fillingStep == stepIndex) ; }) ;
+    if(stopping)
+        return ;
+
+    fillingStep++ ;
+    prepared.finished = true ;
+    pipelineCondition.notify_all() ;
+}
+
+/**
+ * @brief FlashPipeline::fillDownload : Read the content of a download buffer into memory.
+ * @param source: The image file of the step, opened.
+ * @param download: The download to fill, its size is reserved in the budget.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int FlashPipeline::fillDownload(ImageSource &source, preparedDownload &download)
+{
+    try
+    {
+        download.data.reserve(static_cast<size_t>(download.size)) ;
+    }
+    catch(...)
+    {
+        return TOOLBOX_FASTBOOT_ERROR_READ ;
+    }
+
+    auto append = [&download](const uint8_t *data, size_t length)
+    {
+        download.data.insert(download.data.end(), data, data + length) ;
+        return static_cast<int>(TOOLBOX_FASTBOOT_NO_ERROR) ;
+    } ;
+
+    int ret = (download.image != nullptr) ? download.image->write(append) : source.read(0, download.size, append) ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        return ret ;
+
+    return (download.data.size() == download.size) ? TOOLBOX_FASTBOOT_NO_ERROR : TOOLBOX_FASTBOOT_ERROR_READ ;
+}
+
+/**
+ * @brief FlashPipeline::waitPlan : Wait until the downloads of a step are known.
+ * @param stepIndex: The step.
+ * @param waitSeconds: Incremented by the time spent waiting.
+ * @return The prepared step, its result tells if it can be transferred.
+ */
+preparedFlash& FlashPipeline::waitPlan(size_t stepIndex, double &waitSeconds)
+{
+    auto start = std::chrono::steady_clock::now() ;
+    std::unique_lock<std::mutex> lock(pipelineMutex) ;
+    pipelineCondition.wait(lock, [&]() { return stopping || preparedList[stepIndex].planned ; }) ;
+    auto end = std::chrono::steady_clock::now() ;
+    waitSeconds += std::chrono::duration<double>(end - start).count() ;
+    TraceRecorder::getInstance().addEvent("Wait for plan of step " + std::to_string(stepIndex + 1), "pipeline", start, end) ;
+
+    if(preparedList[stepIndex].planned == false)
+        preparedList[stepIndex].result = TOOLBOX_FASTBOOT_ERROR_OTHER ;
+    return preparedList[stepIndex] ;
+}
+
+/**
+ * @brief FlashPipeline::waitDownload : Wait until a download of a planned step can be sent.
+ * @param stepIndex: The step.
+ * @param downloadIndex: The download of the step.
+ * @param waitSeconds: Incremented by the time spent waiting.
+ * @return The download, nullptr if its preparation failed (the error is the step result).
+ */
+preparedDownload* FlashPipeline::waitDownload(size_t stepIndex, size_t downloadIndex, double &waitSeconds)
+{
+    auto start = std::chrono::steady_clock::now() ;
+    std::unique_lock<std::mutex> lock(pipelineMutex) ;
+    preparedFlash &prepared = preparedList[stepIndex] ;
+    preparedDownload &download = prepared.downloadsList[downloadIndex] ;
+    pipelineCondition.wait(lock, [&]() { return stopping || download.ready || (prepared.result != TOOLBOX_FASTBOOT_NO_ERROR) ; }) ;
+    auto end = std::chrono::steady_clock::now() ;
+    waitSeconds += std::chrono::duration<double>(end - start).count() ;
+    TraceRecorder::getInstance().addEvent("Wait for image of step " + std::to_string(stepIndex + 1), "pipeline", start, end) ;
+
+    if(download.ready)
+        return &download ;
+
+    if(prepared.result == TOOLBOX_FASTBOOT_NO_ERROR)
+        prepared.result = TOOLBOX_FASTBOOT_ERROR_OTHER ;
+    return nullptr ;
+}
+
+/**
+ * @brief FlashPipeline::release : Free the buffer of a sent download, so the next ones can be filled.
+ * @param stepIndex: The step.
+ * @param downloadIndex: The download of the step.
+ */
+void FlashPipeline::release(size_t stepIndex, size_t downloadIndex)
+{
+    {
+        std::lock_guard<std::mutex> lock(pipelineMutex) ;
+        preparedDownload &download = preparedList[stepIndex].downloadsList[downloadIndex] ;
+        if(download.data.empty() == false)
+            memoryUsed -= download.size ;
+        std::vector<uint8_t>().swap(download.data) ;
+    }
+    pipelineCondition.notify_all() ;
+}
+
+/**
+ * @brief FlashPipeline::getPrepareSeconds : Time the preparation threads spent on a step.
+ * @param stepIndex: The step.
+ * @return The planning and buffer filling time, in seconds.
+ */
+double FlashPipeline::getPrepareSeconds(size_t stepIndex)
+{
+    std::lock_guard<std::mutex> lock(pipelineMutex) ;
+    return preparedList[stepIndex].prepareSeconds ;
+}
@@ -0,0 +1,279 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FlashPlan.h"
+#include "ImageHash.h"
+#include <algorithm>
+#include <cstdlib>
+
+using namespace std ;
+
+FlashPlan::FlashPlan()
+{
+}
+
+/**
+ * @brief FlashPlan::compile: Turn the lines of a parsed TSV file into the flashing commands.
+ * "PED" lines without binary erase their partition, the "-" lines and the lines without binary are ignored,
+ * the "boot1" and "boot2" lines flash an eMMC boot partition followed by a single boot configuration.
+ * Compiling cannot fail: the lines read by FileManager are only classified and reordered.
+ * @param parsedTsvFile: The parsed TSV file.
+ */
+void FlashPlan::compile(const fileTSV &parsedTsvFile)
+{
+    TraceScope trace("Plan compile", "session") ;
+    const std::string patternNone = "none" ;
+    size_t bootLinesNbr = 0 ;
+    size_t bootConfigPosition = 0 ;
+    uint16_t bootPartition = 0 ;
+
+    commandsList.clear() ;
+    partitionsList.clear() ;
+    compiled = false ;
+    removedNbr = 0 ;
+    tsvLinesNbr = parsedTsvFile.partitionsList.size() ;
+
+    for(const auto &part : parsedTsvFile.partitionsList)
+    {
+        planCommand command ;
+        command.tsvLine = part ;
+
+        if((part.opt == "PED") && (part.binary == "none"))
+        {
+            command.step = {STEP_ERASE, part.partName, "", {0, 0, 0}, 0} ;
+            addCommand(command) ;
+        }
+
+        if((part.opt == "-") || (part.binary == "none") || (part.binary.size() >= patternNone.size() && part.binary.substr(part.binary.size() - patternNone.size()) == patternNone)) //ignore the field containing none keyword
+            continue ;
+
+        if((part.partType == "Binary") && ((part.offset == "boot1") || (part.offset == "boot2")))
+        {
+            /* U-Boot's keyword to update this specific boot partition for eMMC memory: fsbl1 or fsbl2 */
+            bootPartition = (part.offset == "boot1") ? 1 : 2 ;
+            command.step = {STEP_FLASH, (bootPartition == 1) ? PLAN_BOOT1_PARTITION : PLAN_BOOT2_PARTITION, part.binary, {0, 0, 0}, 0} ;
+            addCommand(command) ;
+            bootConfigPosition = commandsList.size() ;
+            bootLinesNbr++ ;
+        }
+        else
+        {
+            command.step = {STEP_FLASH, part.partName, part.binary, {0, 0, 0}, 0} ;
+            addCommand(command) ;
+        }
+    }
+
+    /* Every boot line used to send the same bus width and its own boot partition: only the last one takes effect */
+    if(bootLinesNbr != 0)
+    {
+        addBootConfiguration(bootConfigPosition, bootPartition) ;
+        removedNbr += 2 * (bootLinesNbr - 1) ;
+    }
+
+    for(size_t i = 0; i < commandsList.size(); i++)
+    {
+        planCommand &command = commandsList[i] ;
+        bool isOem = (command.step.type == STEP_OEM_BOOTBUS) || (command.step.type == STEP_OEM_PARTCONF) ;
+        size_t j = i ;
+        while(j-- > 0)
+        {
+            const fastbootStep &previous = commandsList[j].step ;
+            bool previousIsOem = (previous.type == STEP_OEM_BOOTBUS) || (previous.type == STEP_OEM_PARTCONF) ;
+
+            if(isOem)
+            {
+                /* The boot configuration comes after the boot partitions content and the previous configuration commands */
+                if(previousIsOem || isBootPartition(previous.partName))
+                    command.dependsOn.insert(command.dependsOn.begin(), j) ;
+            }
+            else if((previousIsOem == false) && (previous.partName == command.step.partName))
+            {
+                /* Only the last previous write of the same partition is needed, it depends on the others */
+                command.dependsOn.push_back(j) ;
+                break ;
+            }
+        }
+    }
+
+    computePartitions(parsedTsvFile) ;
+
+    compiled = true ;
+}
+
+/**
+ * @brief FlashPlan::computePartitions: Get the GPT partitions of the TSV layout, whether the plan writes them or not.
+ * The lines with a hexadecimal offset in a memory are partitions, each one extends up to the next one of the same memory.
+ * @param parsedTsvFile: The parsed TSV file.
+ */
+void FlashPlan::computePartitions(const fileTSV &parsedTsvFile)
+{
+    partitionsList.clear() ;
+    for(const auto &part : parsedTsvFile.partitionsList)
+    {
+        if((part.partIp == "none") || (part.offset.compare(0, 2, "0x") != 0))
+            continue ;
+
+        planPartition partition ;
+        partition.partName = part.partName ;
+        partition.partIp = part.partIp ;
+        partition.partType = part.partType ;
+        partition.offset = strtoull(part.offset.c_str(), nullptr, 16) ;
+        partitionsList.push_back(partition) ;
+    }
+
+    std::stable_sort(partitionsList.begin(), partitionsList.end(), [](const planPartition &a, const planPartition &b)
+    {
+        return (a.partIp != b.partIp) ? (a.partIp < b.partIp) : (a.offset < b.offset) ;
+    }) ;
+
+    for(size_t i = 0; i + 1 < partitionsList.size(); i++)
+    {
+        if(partitionsList[i + 1].partIp == partitionsList[i].partIp)
+            partitionsList[i].size = partitionsList[i + 1].offset - partitionsList[i].offset ;
+    }
+}
+
+/**
+ * @brief FlashPlan::addCommand: Append a flash or erase command, unless it repeats the previous command of the same partition.
+ * @param command: The command to append.
+ */
+void FlashPlan::addCommand(const planCommand &command)
+{
+    for(auto it = commandsList.rbegin(); it != commandsList.rend(); it++)
+    {
+        if(it->step.partName != command.step.partName)
+            continue ;
+
+        if((it->step.type == command.step.type) && (it->step.binary == command.step.binary))
+        {
+            removedNbr++ ;
+            return ;
+        }
+        break ;
+    }
+
+    commandsList.push_back(command) ;
+}
+
+/**
+ * @brief FlashPlan::addBootConfiguration: Insert the eMMC boot bus width and boot partition commands.
+ * @param position: Index of the inserted commands, after the last boot partition flash.
+ * @param bootPartition: The boot partition enabled, 1 or 2.
+ */
+void FlashPlan::addBootConfiguration(size_t position, uint16_t bootPartition)
+{
+    planCommand bootBus ;
+    bootBus.step = {STEP_OEM_BOOTBUS, "", "", {0, 0, 0}, 0} ;
+    bootBus.tsvLine = commandsList[position - 1].tsvLine ;
+
+    planCommand partConf ;
+    partConf.step = {STEP_OEM_PARTCONF, "", "", {1, bootPartition, 0}, 0} ;
+    partConf.tsvLine = bootBus.tsvLine ;
+
+    commandsList.insert(commandsList.begin() + position, {bootBus, partConf}) ;
+}
+
+/**
+ * @brief FlashPlan::isBootPartition: Check if a partition is an eMMC boot partition.
+ * @param partName: The U-Boot partition name.
+ * @return true for the boot partitions written by the "boot1" and "boot2" lines.
+ */
+bool FlashPlan::isBootPartition(const std::string &partName) const
+{
+    return (partName == PLAN_BOOT1_PARTITION) || (partName == PLAN_BOOT2_PARTITION) ;
+}
+
+/**
+ * @brief FlashPlan::getSteps: Get the flashing sequence to execute.
+ * @return The steps, in the plan order.
+ */
+std::vector<fastbootStep> FlashPlan::getSteps() const
+{
+    std::vector<fastbootStep> stepsList ;
+    stepsList.reserve(commandsList.size()) ;
+    for(const auto &command : commandsList)
+        stepsList.push_back(command.step) ;
+    return stepsList ;
+}
+
+/**
+ * @brief FlashPlan::getCommandName: Get the fastboot command of a step type.
+ * @param type: The step type.
+ * @return The command name, as displayed.
+ */
+const char* FlashPlan::getCommandName(stepType type)
+{
+    switch(type)
+    {
+    case STEP_FLASH:
+        return "flash" ;
+    case STEP_ERASE:
+        return "erase" ;
+    case STEP_OEM_BOOTBUS:
+        return "oem bootbus" ;
+    case STEP_OEM_PARTCONF:
+        return "oem partconf" ;
+    }
+    return "" ;
+}
+
+/**
+ * @brief FlashPlan::getLayoutDigest: Identify the memory layout the plan writes, whatever the images content.
+ * @return SHA-256 of the commands, their parameters and the layout columns of their TSV lines.
+ */
+std::string FlashPlan::getLayoutDigest() const
+{
+    Sha256 hash ;
+    for(const auto &command : commandsList)
+    {
+        const partitionInfo &line = command.tsvLine ;
+        std::string text = std::string(getCommandName(command.step.type)) + '\t' + command.step.partName + '\t' + std::to_string(command.step.values[0]) + '\t' +
+                           std::to_string(command.step.values[1]) + '\t' + std::to_string(command.step.values[2]) + '\t' + line.opt + '\t' + line.phaseID + '\t' +
+                           line.partName + '\t' + line.partType + '\t' + line.partIp + '\t' + line.offset + '\n' ;
+        hash.update(reinterpret_cast<const uint8_t*>(text.data()), text.size()) ;
+    }
+    return hash.finish() ;
+}
+
+/**
+ * @brief FlashPlan::print: Display the commands of the plan with their dependencies.
+ */
+void FlashPlan::print()
+{
+    displayManager.print(MSG_NORMAL, L"Flash plan : %lu TSV lines, %lu commands, %lu redundant commands removed", tsvLinesNbr, commandsList.size(), removedNbr) ;
+    displayManager.print(MSG_NORMAL, L"  %3s  %-13s %-16s %-10s %s", "#", "Command", "Partition", "After", "Binary") ;
+
+    for(size_t i = 0; i < commandsList.size(); i++)
+    {
+        const fastbootStep &step = commandsList[i].step ;
+        std::string after = "" ;
+        for(size_t dependency : commandsList[i].dependsOn)
+            after += (after.empty() ? "" : ",") + std::to_string(dependency + 1) ;
+
+        std::string argument = "" ;
+        if(step.type == STEP_FLASH)
+            argument = step.binary ;
+        else if(step.type == STEP_OEM_BOOTBUS)
+            argument = std::to_string(step.values[0]) + " " + std::to_string(step.values[1]) + " " + std::to_string(step.values[2]) ;
+        else if(step.type == STEP_OEM_PARTCONF)
+            argument = std::to_string(step.values[0]) + " " + std::to_string(step.values[1]) ;
+
+        displayManager.print(MSG_NORMAL, L"  %3lu  %-13s %-16s %-10s %s", i + 1, getCommandName(step.type), step.partName.empty() ? "-" : step.partName.c_str(),
+                             after.empty() ? "-" : after.c_str(), argument.c_str()) ;
+    }
+}
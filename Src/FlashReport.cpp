@@ -0,0 +1,121 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FlashReport.h"
+#include "FileManager.h"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <ctime>
+#include <cstdio>
+#include <experimental/filesystem>
+namespace fs = std::experimental::filesystem;
+
+std::mutex FlashReport::fileMutex ;
+
+FlashReport::FlashReport(const std::string &reportPath)
+{
+    this->reportPath = reportPath ;
+}
+
+/**
+ * @brief FlashReport::isJson : Check the report format selected by the file extension.
+ * @return true for JSON Lines, false for CSV.
+ */
+bool FlashReport::isJson() const
+{
+    std::string extension = REPORT_JSON_EXTENSION ;
+    return (reportPath.size() >= extension.size()) && (reportPath.compare(reportPath.size() - extension.size(), extension.size(), extension) == 0) ;
+}
+
+/**
+ * @brief FlashReport::append : Add the steps of a flashing service at the end of the report file.
+ * @param context: The flashing service.
+ * @param recordsList: Its steps.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int FlashReport::append(const reportContext &context, const std::vector<reportRecord> &recordsList)
+{
+    std::lock_guard<std::mutex> lock(fileMutex) ;
+
+    char timestamp[32] ;
+    std::time_t now = std::time(nullptr) ;
+    std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now)) ;
+
+    std::error_code error ;
+    bool newFile = (fs::exists(reportPath, error) == false) || (fs::file_size(reportPath, error) == 0) ;
+
+    std::ostringstream lines ;
+    lines << std::fixed << std::setprecision(3) ;
+    if(newFile && (isJson() == false))
+        lines << "timestamp,toolbox_version,bootloader_version,transport,serial,tsv,step,command,partition,type,image_bytes,sent_bytes,transfer_s,write_s,total_s,mbps,result\n" ;
+
+    for(const auto &record : recordsList)
+    {
+        double speed = (record.totalSeconds > 0) ? record.imageBytes / (record.totalSeconds * 1024 * 1024) : 0.0 ;
+        if(isJson())
+        {
+            lines << "{\"timestamp\":\"" << timestamp << "\",\"toolbox_version\":\"" << FileManager::escapeJson(context.toolboxVersion)
+                  << "\",\"bootloader_version\":\"" << FileManager::escapeJson(context.bootloaderVersion) << "\",\"transport\":\"" << FileManager::escapeJson(context.transport)
+                  << "\",\"serial\":\"" << FileManager::escapeJson(context.serialNumber) << "\",\"tsv\":\"" << FileManager::escapeJson(context.tsvPath)
+                  << "\",\"step\":" << record.stepIndex << ",\"command\":\"" << FileManager::escapeJson(record.command)
+                  << "\",\"partition\":\"" << FileManager::escapeJson(record.partName) << "\",\"type\":\"" << FileManager::escapeJson(record.partType)
+                  << "\",\"image_bytes\":" << record.imageBytes << ",\"sent_bytes\":" << record.sentBytes
+                  << ",\"transfer_s\":" << record.transferSeconds << ",\"write_s\":" << record.writeSeconds << ",\"total_s\":" << record.totalSeconds
+                  << ",\"mbps\":" << speed << ",\"result\":\"" << record.result << "\"}\n" ;
+        }
+        else
+        {
+            lines << timestamp << ',' << escapeCsv(context.toolboxVersion) << ',' << escapeCsv(context.bootloaderVersion) << ',' << escapeCsv(context.transport)
+                  << ',' << escapeCsv(context.serialNumber) << ',' << escapeCsv(context.tsvPath) << ',' << record.stepIndex << ',' << escapeCsv(record.command)
+                  << ',' << escapeCsv(record.partName) << ',' << escapeCsv(record.partType) << ',' << record.imageBytes << ',' << record.sentBytes
+                  << ',' << record.transferSeconds << ',' << record.writeSeconds << ',' << record.totalSeconds << ',' << speed << ',' << record.result << '\n' ;
+        }
+    }
+
+    std::ofstream reportFile(reportPath, std::ios::app) ;
+    reportFile << lines.str() ;
+    reportFile.close() ;
+    if(reportFile.fail())
+    {
+        displayManager.print(MSG_WARNING, L"Cannot write the report %s", reportPath.c_str()) ;
+        return TOOLBOX_FASTBOOT_ERROR_WRITE ;
+    }
+
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief FlashReport::escapeCsv : Quote a CSV field containing a separator, a quote or a line break.
+ * @param text: The raw text.
+ * @return The field to write.
+ */
+std::string FlashReport::escapeCsv(const std::string &text)
+{
+    if(text.find_first_of(",\"\r\n") == std::string::npos)
+        return text ;
+
+    std::string escaped = "\"" ;
+    for(char character : text)
+    {
+        if(character == '"')
+            escaped += '"' ;
+        escaped += character ;
+    }
+    return escaped + "\"" ;
+}
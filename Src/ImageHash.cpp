@@ -0,0 +1,572 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ImageHash.h"
+#include "ImageSource.h"
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HASH_X86_ENGINES
+#include <immintrin.h>
+#include <cpuid.h>
+#endif
+
+/* Polynomials of the reflected CRCs: CRC32 (Ethernet, zlib) and CRC32C (Castagnoli) */
+constexpr uint32_t CRC32_POLYNOMIAL = 0xEDB88320 ;
+constexpr uint32_t CRC32C_POLYNOMIAL = 0x82F63B78 ;
+
+static const uint32_t sha256RoundConstants[64] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t rotateRight(uint32_t value, unsigned int count)
+{
+    return (value >> count) | (value << (32 - count)) ;
+}
+
+/**
+ * @brief sha256BlocksScalar : Portable SHA-256 compression function.
+ * @param state: The hash state, 8 words.
+ * @param data: The blocks.
+ * @param blocksNbr: Number of 64-byte blocks.
+ */
+static void sha256BlocksScalar(uint32_t *state, const uint8_t *data, size_t blocksNbr)
+{
+    for(size_t block = 0; block < blocksNbr; block++, data += SHA256_BLOCK_SZ)
+    {
+        uint32_t schedule[64] ;
+        for(int i = 0; i < 16; i++)
+            schedule[i] = (static_cast<uint32_t>(data[4 * i]) << 24) | (data[4 * i + 1] << 16) | (data[4 * i + 2] << 8) | data[4 * i + 3] ;
+        for(int i = 16; i < 64; i++)
+        {
+            uint32_t s0 = rotateRight(schedule[i - 15], 7) ^ rotateRight(schedule[i - 15], 18) ^ (schedule[i - 15] >> 3) ;
+            uint32_t s1 = rotateRight(schedule[i - 2], 17) ^ rotateRight(schedule[i - 2], 19) ^ (schedule[i - 2] >> 10) ;
+            schedule[i] = schedule[i - 16] + s0 + schedule[i - 7] + s1 ;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7] ;
+        for(int i = 0; i < 64; i++)
+        {
+            uint32_t t1 = h + (rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25)) + ((e & f) ^ (~e & g)) + sha256RoundConstants[i] + schedule[i] ;
+            uint32_t t2 = (rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22)) + ((a & b) ^ (a & c) ^ (b & c)) ;
+            h = g ; g = f ; f = e ; e = d + t1 ;
+            d = c ; c = b ; b = a ; a = t1 + t2 ;
+        }
+
+        state[0] += a ; state[1] += b ; state[2] += c ; state[3] += d ;
+        state[4] += e ; state[5] += f ; state[6] += g ; state[7] += h ;
+    }
+}
+
+/**
+ * @brief buildCrcTable : Byte-wise lookup table of a reflected CRC.
+ * @param table: Output, 256 entries.
+ * @param polynomial: The reflected polynomial.
+ */
+static void buildCrcTable(uint32_t *table, uint32_t polynomial)
+{
+    for(uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t value = i ;
+        for(int bit = 0; bit < 8; bit++)
+            value = (value & 1) ? (value >> 1) ^ polynomial : value >> 1 ;
+        table[i] = value ;
+    }
+}
+
+static uint32_t crcTableUpdate(const uint32_t *table, uint32_t crc, const uint8_t *data, size_t length)
+{
+    for(size_t i = 0; i < length; i++)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8) ;
+    return crc ;
+}
+
+static uint32_t crc32cScalar(uint32_t crc, const uint8_t *data, size_t length)
+{
+    static uint32_t table[256] ;
+    static bool tableReady = (buildCrcTable(table, CRC32C_POLYNOMIAL), true) ;
+    (void)tableReady ;
+    return ~crcTableUpdate(table, ~crc, data, length) ;
+}
+
+static uint32_t crc32Scalar(uint32_t crc, const uint8_t *data, size_t length)
+{
+    static uint32_t table[256] ;
+    static bool tableReady = (buildCrcTable(table, CRC32_POLYNOMIAL), true) ;
+    (void)tableReady ;
+    return ~crcTableUpdate(table, ~crc, data, length) ;
+}
+
+#ifdef HASH_X86_ENGINES
+/**
+ * @brief sha256BlocksShaNi : SHA-256 compression function with the x86 SHA extensions.
+ * Each iteration performs 4 rounds, the message schedule is kept in 4 registers used in turn.
+ */
+__attribute__((target("sha,sse4.1,ssse3")))
+static void sha256BlocksShaNi(uint32_t *state, const uint8_t *data, size_t blocksNbr)
+{
+    const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL) ;
+
+    /* The instructions use the state as ABEF and CDGH */
+    __m128i cdab = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0xB1) ;
+    __m128i efgh = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 4)), 0x1B) ;
+    __m128i abef = _mm_alignr_epi8(cdab, efgh, 8) ;
+    __m128i cdgh = _mm_blend_epi16(efgh, cdab, 0xF0) ;
+
+    for(size_t block = 0; block < blocksNbr; block++, data += SHA256_BLOCK_SZ)
+    {
+        __m128i abefSaved = abef, cdghSaved = cdgh ;
+        __m128i words[4] ;
+
+#pragma GCC unroll 16
+        for(int i = 0; i < 16; i++)
+        {
+            if(i < 4)
+                words[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * i)), byteSwap) ;
+
+            __m128i message = _mm_add_epi32(words[i % 4], _mm_loadu_si128(reinterpret_cast<const __m128i*>(sha256RoundConstants + 4 * i))) ;
+            cdgh = _mm_sha256rnds2_epu32(cdgh, abef, message) ;
+            if((i >= 3) && (i <= 14))
+            {
+                __m128i &next = words[(i + 1) % 4] ;
+                next = _mm_add_epi32(next, _mm_alignr_epi8(words[i % 4], words[(i + 3) % 4], 4)) ;
+                next = _mm_sha256msg2_epu32(next, words[i % 4]) ;
+            }
+            abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(message, 0x0E)) ;
+            if((i >= 1) && (i <= 12))
+                words[(i + 3) % 4] = _mm_sha256msg1_epu32(words[(i + 3) % 4], words[i % 4]) ;
+        }
+
+        abef = _mm_add_epi32(abef, abefSaved) ;
+        cdgh = _mm_add_epi32(cdgh, cdghSaved) ;
+    }
+
+    __m128i feba = _mm_shuffle_epi32(abef, 0x1B) ;
+    __m128i dchg = _mm_shuffle_epi32(cdgh, 0xB1) ;
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_blend_epi16(feba, dchg, 0xF0)) ;
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), _mm_alignr_epi8(dchg, feba, 8)) ;
+}
+
+/**
+ * @brief crc32cSse42 : CRC32C with the SSE4.2 crc32 instruction, 8 bytes per instruction.
+ */
+__attribute__((target("sse4.2")))
+static uint32_t crc32cSse42(uint32_t crc, const uint8_t *data, size_t length)
+{
+    uint64_t value = ~crc ;
+    for(; length >= sizeof(uint64_t); length -= sizeof(uint64_t), data += sizeof(uint64_t))
+    {
+        uint64_t word ;
+        memcpy(&word, data, sizeof(word)) ;
+        value = _mm_crc32_u64(value, word) ;
+    }
+
+    uint32_t value32 = static_cast<uint32_t>(value) ;
+    for(; length > 0; length--, data++)
+        value32 = _mm_crc32_u8(value32, *data) ;
+
+    return ~value32 ;
+}
+
+/**
+ * @brief foldCrc128 : Fold 128 bits of CRC remainder over the next 128 bits of data.
+ */
+__attribute__((target("pclmul,sse4.1")))
+static inline __m128i foldCrc128(__m128i value, __m128i next, __m128i k)
+{
+    return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(value, k, 0x11), next), _mm_clmulepi64_si128(value, k, 0x00)) ;
+}
+
+/**
+ * @brief crc32Pclmul : CRC32 by carry-less multiplication folding of 64-byte blocks (Intel white paper
+ * "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ"), the tail uses the lookup table.
+ */
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32Pclmul(uint32_t crc, const uint8_t *data, size_t length)
+{
+    if(length < 64)
+        return crc32Scalar(crc, data, length) ;
+
+    alignas(16) static const uint64_t k1k2[] = {0x0154442bd4, 0x01c6e41596} ;
+    alignas(16) static const uint64_t k3k4[] = {0x01751997d0, 0x00ccaa009e} ;
+    alignas(16) static const uint64_t k5k0[] = {0x0163cd6124, 0x0000000000} ;
+    alignas(16) static const uint64_t poly[] = {0x01db710641, 0x01f7011641} ;
+
+    size_t foldedLength = length & ~static_cast<size_t>(15) ;
+    const uint8_t *end = data + foldedLength ;
+
+    __m128i x1 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), _mm_cvtsi32_si128(static_cast<int>(~crc))) ;
+    __m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16)) ;
+    __m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 32)) ;
+    __m128i x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 48)) ;
+    __m128i k = _mm_load_si128(reinterpret_cast<const __m128i*>(k1k2)) ;
+    data += 64 ;
+
+    /* Fold 4 x 128 bits in parallel */
+    while(end - data >= 64)
+    {
+        __m128i x5 = _mm_clmulepi64_si128(x1, k, 0x00), x6 = _mm_clmulepi64_si128(x2, k, 0x00) ;
+        __m128i x7 = _mm_clmulepi64_si128(x3, k, 0x00), x8 = _mm_clmulepi64_si128(x4, k, 0x00) ;
+        x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k, 0x11), x5), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data))) ;
+        x2 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x2, k, 0x11), x6), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16))) ;
+        x3 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x3, k, 0x11), x7), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 32))) ;
+        x4 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x4, k, 0x11), x8), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 48))) ;
+        data += 64 ;
+    }
+
+    /* Fold into 128 bits, then the remaining 16-byte blocks */
+    k = _mm_load_si128(reinterpret_cast<const __m128i*>(k3k4)) ;
+    x1 = foldCrc128(foldCrc128(foldCrc128(x1, x2, k), x3, k), x4, k) ;
+    for(; data < end; data += 16)
+        x1 = foldCrc128(x1, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), k) ;
+
+    /* Fold 128 bits to 64 bits */
+    const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0) ;
+    x2 = _mm_clmulepi64_si128(x1, k, 0x10) ;
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2) ;
+    k = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(k5k0)) ;
+    x2 = _mm_srli_si128(x1, 4) ;
+    x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k, 0x00), x2) ;
+
+    /* Barrett reduction to 32 bits */
+    k = _mm_load_si128(reinterpret_cast<const __m128i*>(poly)) ;
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k, 0x10) ;
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask32), k, 0x00) ;
+    x1 = _mm_xor_si128(x1, x2) ;
+
+    crc = ~static_cast<uint32_t>(_mm_extract_epi32(x1, 1)) ;
+    return crc32Scalar(crc, end, length - foldedLength) ;
+}
+
+/**
+ * @brief isShaNiSupported : Check the SHA extensions, reported by CPUID leaf 7.
+ */
+static bool isShaNiSupported()
+{
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0 ;
+    if(__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) == 0)
+        return false ;
+
+    return ((ebx & bit_SHA) != 0) && __builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("ssse3") ;
+}
+#endif
+
+/**
+ * @brief ImageHash::getSha256Engines : List the SHA-256 implementations supported by this CPU, slowest first.
+ * @return The engines list, the portable one is always available.
+ */
+std::vector<sha256EngineInfo> ImageHash::getSha256Engines()
+{
+    std::vector<sha256EngineInfo> enginesList = {{"scalar", sha256BlocksScalar}} ;
+#ifdef HASH_X86_ENGINES
+    if(isShaNiSupported())
+        enginesList.push_back({"SHA-NI", sha256BlocksShaNi}) ;
+#endif
+    return enginesList ;
+}
+
+/**
+ * @brief ImageHash::getCrc32cEngines : List the CRC32C implementations supported by this CPU, slowest first.
+ * @return The engines list, the portable one is always available.
+ */
+std::vector<crc32EngineInfo> ImageHash::getCrc32cEngines()
+{
+    std::vector<crc32EngineInfo> enginesList = {{"scalar", crc32cScalar}} ;
+#ifdef HASH_X86_ENGINES
+    if(__builtin_cpu_supports("sse4.2"))
+        enginesList.push_back({"SSE4.2", crc32cSse42}) ;
+#endif
+    return enginesList ;
+}
+
+/**
+ * @brief ImageHash::getCrc32Engines : List the CRC32 implementations supported by this CPU, slowest first.
+ * @return The engines list, the portable one is always available.
+ */
+std::vector<crc32EngineInfo> ImageHash::getCrc32Engines()
+{
+    std::vector<crc32EngineInfo> enginesList = {{"scalar", crc32Scalar}} ;
+#ifdef HASH_X86_ENGINES
+    if(__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1"))
+        enginesList.push_back({"PCLMUL", crc32Pclmul}) ;
+#endif
+    return enginesList ;
+}
+
+/**
+ * @brief ImageHash::crc32c : Compute or continue a CRC32C with the fastest implementation.
+ * @param data: The bytes.
+ * @param length: Number of bytes.
+ * @param crc: The CRC of the previous bytes, 0 to start.
+ * @return The CRC.
+ */
+uint32_t ImageHash::crc32c(const uint8_t *data, size_t length, uint32_t crc)
+{
+    static const crc32Function update = getCrc32cEngines().back().update ;
+    return update(crc, data, length) ;
+}
+
+/**
+ * @brief ImageHash::crc32 : Compute or continue a CRC32 (zlib) with the fastest implementation.
+ * @param data: The bytes.
+ * @param length: Number of bytes.
+ * @param crc: The CRC of the previous bytes, 0 to start.
+ * @return The CRC.
+ */
+uint32_t ImageHash::crc32(const uint8_t *data, size_t length, uint32_t crc)
+{
+    static const crc32Function update = getCrc32Engines().back().update ;
+    return update(crc, data, length) ;
+}
+
+Sha256::Sha256(sha256BlocksFunction process)
+{
+    static const sha256BlocksFunction bestProcess = ImageHash::getSha256Engines().back().process ;
+    static const uint32_t initialState[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19} ;
+
+    this->process = (process != nullptr) ? process : bestProcess ;
+    memcpy(state, initialState, sizeof(state)) ;
+}
+
+/**
+ * @brief Sha256::update : Hash the next bytes of the message.
+ * @param data: The bytes.
+ * @param length: Number of bytes.
+ */
+void Sha256::update(const uint8_t *data, size_t length)
+{
+    totalSize += length ;
+
+    if(pendingSize > 0)
+    {
+        size_t copied = std::min(SHA256_BLOCK_SZ - pendingSize, length) ;
+        memcpy(pendingBlock + pendingSize, data, copied) ;
+        pendingSize += copied ;
+        data += copied ;
+        length -= copied ;
+        if(pendingSize < SHA256_BLOCK_SZ)
+            return ;
+
+        process(state, pendingBlock, 1) ;
+        pendingSize = 0 ;
+    }
+
+    process(state, data, length / SHA256_BLOCK_SZ) ;
+    pendingSize = length % SHA256_BLOCK_SZ ;
+    memcpy(pendingBlock, data + length - pendingSize, pendingSize) ;
+}
+
+/**
+ * @brief Sha256::finish : Pad the message and return its digest. The object must not be updated afterwards.
+ * @return The digest as 64 lowercase hexadecimal characters.
+ */
+std::string Sha256::finish()
+{
+    uint64_t bitsNbr = totalSize * 8 ;
+    uint8_t padding[2 * SHA256_BLOCK_SZ] = {0x80} ;
+    size_t paddingSize = ((pendingSize < SHA256_BLOCK_SZ - 8) ? SHA256_BLOCK_SZ : 2 * SHA256_BLOCK_SZ) - pendingSize ;
+    for(int i = 0; i < 8; i++)
+        padding[paddingSize - 1 - i] = static_cast<uint8_t>(bitsNbr >> (8 * i)) ;
+    update(padding, paddingSize) ;
+
+    static const char hexDigits[] = "0123456789abcdef" ;
+    std::string digest ;
+    for(uint32_t word : state)
+    {
+        for(int shift = 28; shift >= 0; shift -= 4)
+            digest.push_back(hexDigits[(word >> shift) & 0xF]) ;
+    }
+    return digest ;
+}
+
+/**
+ * @brief ImageHash::hashFile : Compute the SHA-256 and the CRC32C of a file in a single read pass.
+ * @param digest: The file path as input, its hashes, size and result as output.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int ImageHash::hashFile(imageDigest &digest)
+{
+    ImageSource source(digest.path) ;
+    if(source.open() != TOOLBOX_FASTBOOT_NO_ERROR)
+        return digest.result = TOOLBOX_FASTBOOT_ERROR_NO_FILE ;
+
+    Sha256 hash ;
+    uint32_t crc = 0 ;
+    digest.size = source.getSize() ;
+    int ret = source.read(0, digest.size, [&](const uint8_t *data, size_t length)
+    {
+        hash.update(data, length) ;
+        crc = crc32c(data, length, crc) ;
+        return static_cast<int>(TOOLBOX_FASTBOOT_NO_ERROR) ;
+    }) ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        return digest.result = TOOLBOX_FASTBOOT_ERROR_READ ;
+
+    digest.sha256 = hash.finish() ;
+    digest.crc32c = crc ;
+    return digest.result = TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief ImageHash::hashFiles : Hash several files in parallel, one file per worker thread at a time.
+ * @param digestsList: The files, their hashes and result are filled in.
+ * @param workersNbr: Number of worker threads, 0 for one per CPU core.
+ * @return 0 if all the files are hashed successfully, otherwise the error of the first failed file.
+ */
+int ImageHash::hashFiles(std::vector<imageDigest> &digestsList, unsigned int workersNbr)
+{
+    if(workersNbr == 0)
+        workersNbr = std::max(1u, std::thread::hardware_concurrency()) ;
+    workersNbr = std::min<unsigned int>(workersNbr, static_cast<unsigned int>(digestsList.size())) ;
+
+    std::atomic<size_t> nextFile(0) ;
+    auto worker = [&]()
+    {
+        size_t index ;
+        while((index = nextFile++) < digestsList.size())
+            hashFile(digestsList[index]) ;
+    } ;
+
+    std::vector<std::thread> workersList ;
+    for(unsigned int i = 1; i < workersNbr; i++)
+        workersList.emplace_back(worker) ;
+    worker() ;
+    for(auto &workerThread : workersList)
+        workerThread.join() ;
+
+    for(const auto &digest : digestsList)
+    {
+        if(digest.result != TOOLBOX_FASTBOOT_NO_ERROR)
+            return digest.result ;
+    }
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief ImageHash::sha256File : Compute the SHA-256 digest of a file.
+ * @param path: The file path.
+ * @param digest: Output, the digest in hexadecimal.
+ * @param fileSize: Optional output, the number of bytes hashed.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int ImageHash::sha256File(const std::string &path, std::string &digest, uint64_t *fileSize)
+{
+    imageDigest fileDigest ;
+    fileDigest.path = path ;
+    int ret = hashFile(fileDigest) ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        return ret ;
+
+    digest = fileDigest.sha256 ;
+    if(fileSize != nullptr)
+        *fileSize = fileDigest.size ;
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief ImageHash::getIntegrityManifestPath : Locate the integrity manifest of a TSV file.
+ * @param tsvPath: The TSV file path.
+ * @return The manifest path, next to the TSV file.
+ */
+std::string ImageHash::getIntegrityManifestPath(const std::string &tsvPath)
+{
+    return tsvPath + INTEGRITY_MANIFEST_EXTENSION ;
+}
+
+/**
+ * @brief ImageHash::readIntegrityManifest : Parse an integrity manifest.
+ * @param manifestPath: The manifest path.
+ * @param entriesList: Output, the manifest lines.
+ * @return 0 if the operation is performed successfully, TOOLBOX_FASTBOOT_ERROR_NO_FILE if there is no manifest,
+ * otherwise an error occurred.
+ */
+int ImageHash::readIntegrityManifest(const std::string &manifestPath, std::vector<integrityEntry> &entriesList)
+{
+    entriesList.clear() ;
+
+    std::ifstream manifestFile(manifestPath) ;
+    if(manifestFile.is_open() == false)
+        return TOOLBOX_FASTBOOT_ERROR_NO_FILE ;
+
+    std::string line ;
+    while(std::getline(manifestFile, line))
+    {
+        if((line.empty() == false) && (line.back() == '\r'))
+            line.pop_back() ;
+        if(line.empty() || (line[0] == '#'))
+            continue ;
+
+        std::vector<std::string> columnsList ;
+        std::istringstream lineStream(line) ;
+        std::string column ;
+        while(std::getline(lineStream, column, '\t'))
+            columnsList.push_back(column) ;
+
+        if((columnsList.size() != 5) || (columnsList[2].size() != 2 * SHA256_DIGEST_SZ))
+            return TOOLBOX_FASTBOOT_ERROR_WRONG_PARAM ;
+
+        integrityEntry entry ;
+        entry.partName = columnsList[0] ;
+        entry.size = strtoull(columnsList[1].c_str(), nullptr, 10) ;
+        entry.sha256 = columnsList[2] ;
+        entry.crc32c = static_cast<uint32_t>(strtoul(columnsList[3].c_str(), nullptr, 16)) ;
+        entry.binary = columnsList[4] ;
+        entriesList.push_back(entry) ;
+    }
+
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief ImageHash::writeIntegrityManifest : Save an integrity manifest.
+ * @param manifestPath: The manifest path.
+ * @param entriesList: The manifest lines.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int ImageHash::writeIntegrityManifest(const std::string &manifestPath, const std::vector<integrityEntry> &entriesList)
+{
+    std::ofstream manifestFile(manifestPath, std::ios::trunc) ;
+    if(manifestFile.is_open() == false)
+        return TOOLBOX_FASTBOOT_ERROR_NO_FILE ;
+
+    manifestFile << "#Name\tSize\tSHA-256\tCRC32C\tBinary\n" ;
+    for(const auto &entry : entriesList)
+    {
+        char crcText[16] ;
+        snprintf(crcText, sizeof(crcText), "%08x", entry.crc32c) ;
+        manifestFile << entry.partName << '\t' << entry.size << '\t' << entry.sha256 << '\t' << crcText << '\t' << entry.binary << '\n' ;
+    }
+
+    manifestFile.close() ;
+    return manifestFile.fail() ? TOOLBOX_FASTBOOT_ERROR_WRITE : TOOLBOX_FASTBOOT_NO_ERROR ;
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "ImageSource.h"
+#include <algorithm>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+ImageSource::ImageSource(const std::string &path)
+{
+    this->path = path ;
+}
+
+ImageSource::~ImageSource()
+{
+    close() ;
+}
+
+/**
+ * @brief ImageSource::open : Map the file in memory, or open it for buffered reads if it cannot be mapped.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int ImageSource::open()
+{
+    close() ;
+
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY) ;
+    if(fd < 0)
+        return TOOLBOX_FASTBOOT_ERROR_NO_FILE ;
+
+    struct stat fileStatus ;
+    if((fstat(fd, &fileStatus) == 0) && S_ISREG(fileStatus.st_mode) && (fileStatus.st_size > 0))
+    {
+        void *address = mmap(nullptr, static_cast<size_t>(fileStatus.st_size), PROT_READ, MAP_PRIVATE, fd, 0) ;
+        if(address != MAP_FAILED)
+        {
+            madvise(address, static_cast<size_t>(fileStatus.st_size), MADV_SEQUENTIAL) ;
+            mapping = static_cast<const uint8_t*>(address) ;
+            size = static_cast<uint64_t>(fileStatus.st_size) ;
+        }
+    }
+    ::close(fd) ; /* The mapping stays valid */
+
+    if(mapping != nullptr)
+        return TOOLBOX_FASTBOOT_NO_ERROR ;
+#endif
+
+    file.open(path, std::ios::binary | std::ios::ate) ;
+    if(file.is_open() == false)
+        return TOOLBOX_FASTBOOT_ERROR_NO_FILE ;
+
+    size = static_cast<uint64_t>(file.tellg()) ;
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief ImageSource::close : Release the mapping or the file.
+ */
+void ImageSource::close()
+{
+#ifndef _WIN32
+    if(mapping != nullptr)
+        munmap(const_cast<uint8_t*>(mapping), static_cast<size_t>(size)) ;
+#endif
+    mapping = nullptr ;
+    if(file.is_open())
+        file.close() ;
+    file.clear() ;
+    std::vector<uint8_t>().swap(buffer) ;
+    size = 0 ;
+}
+
+/**
+ * @brief ImageSource::read : Hand a part of the file to an output, by pieces of at most IMAGE_SOURCE_READ_SZ bytes.
+ * The pieces point into the mapping when the file is mapped, so they must not be kept once the output returns.
+ * @param offset: Position of the first byte.
+ * @param length: Number of bytes, the range must be inside the file.
+ * @param output: Receives the pieces in order, returns 0 to continue.
+ * @return 0 if the operation is performed successfully, otherwise the error of the read or of the output.
+ */
+int ImageSource::read(uint64_t offset, uint64_t length, const std::function<int(const uint8_t *data, size_t length)> &output)
+{
+    if((offset > size) || (length > size - offset))
+        return TOOLBOX_FASTBOOT_ERROR_READ ;
+
+    if((mapping == nullptr) && (file.is_open() == false))
+        return TOOLBOX_FASTBOOT_ERROR_NO_FILE ;
+
+    if(mapping == nullptr)
+    {
+        buffer.resize(IMAGE_SOURCE_READ_SZ) ;
+        file.clear() ;
+        file.seekg(static_cast<std::streamoff>(offset)) ;
+    }
+
+    while(length > 0)
+    {
+        size_t pieceLength = static_cast<size_t>(std::min<uint64_t>(length, IMAGE_SOURCE_READ_SZ)) ;
+        const uint8_t *piece = buffer.data() ;
+        if(mapping != nullptr)
+            piece = mapping + offset ;
+        else if(!file.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(pieceLength)))
+            return TOOLBOX_FASTBOOT_ERROR_READ ;
+
+        int ret = output(piece, pieceLength) ;
+        if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+            return ret ;
+
+        offset += pieceLength ;
+        length -= pieceLength ;
+    }
+
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief ImageSource::prefetch : Ask the system to load a part of the mapped file before it is read.
+ * Files read by pieces are left alone: the stream reads them in order and the system read-ahead already covers it.
+ * @param offset: Position of the first byte.
+ * @param length: Number of bytes.
+ */
+void ImageSource::prefetch(uint64_t offset, uint64_t length)
+{
+#ifndef _WIN32
+    if((mapping == nullptr) || (offset >= size) || (length == 0))
+        return ;
+    length = std::min(length, size - offset) ;
+
+    uint64_t pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE)) ;
+    uint64_t start = offset / pageSize * pageSize ;
+    madvise(const_cast<uint8_t*>(mapping) + start, static_cast<size_t>(offset + length - start), MADV_WILLNEED) ;
+#else
+    (void)offset ;
+    (void)length ;
+#endif
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "LoopbackTransport.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <chrono>
+
+LoopbackTransport::LoopbackTransport(const std::string &configPath)
+{
+    this->configPath = configPath ;
+}
+
+/**
+ * @brief LoopbackTransport::parseSpec : Extract the emulator configuration from a "loopback[:config]" transport option.
+ * @param transportSpec: The transport description.
+ * @param configPath: Output, the emulator configuration file, empty for the default device.
+ * @return True if the spec is a valid loopback transport.
+ */
+bool LoopbackTransport::parseSpec(const std::string &transportSpec, std::string &configPath)
+{
+    size_t nameLength = strlen(TRANSPORT_LOOPBACK) ;
+    if(transportSpec.compare(0, nameLength, TRANSPORT_LOOPBACK) != 0)
+        return false ;
+
+    if(transportSpec.size() == nameLength)
+    {
+        configPath = "" ;
+        return true ;
+    }
+
+    if((transportSpec[nameLength] != ':') || (transportSpec.size() == nameLength + 1))
+        return false ;
+
+    configPath = transportSpec.substr(nameLength + 1) ;
+    return true ;
+}
+
+/**
+ * @brief LoopbackTransport::open : Power on the emulated device.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int LoopbackTransport::open()
+{
+    if((isOpen == false) && (configPath.empty() == false))
+    {
+        int ret = emulator.loadConfig(configPath) ;
+        if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+            return ret ;
+    }
+
+    isOpen = true ;
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief LoopbackTransport::close : Disconnect from the emulated device.
+ */
+void LoopbackTransport::close()
+{
+    isOpen = false ;
+    emulator.reset() ;
+}
+
+/**
+ * @brief LoopbackTransport::read : Get the next response packet of the emulated device.
+ * The emulated device answers synchronously: without a pending response, it will never answer.
+ * @param data: Output buffer.
+ * @param length: Output buffer size.
+ * @param transferred: Output, number of bytes received.
+ * @return 0 if the operation is performed successfully, TOOLBOX_FASTBOOT_ERROR_TIMEOUT after the transport timeout
+ * if the device does not answer, otherwise an error occurred.
+ */
+int LoopbackTransport::read(uint8_t* data, size_t length, size_t* transferred)
+{
+    std::string response ;
+    if(isOpen == false)
+        return TOOLBOX_FASTBOOT_ERROR_READ ;
+
+    if(emulator.nextResponse(response) == false)
+    {
+        if(timeoutMs == 0)
+            return TOOLBOX_FASTBOOT_ERROR_READ ;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs)) ;
+        return TOOLBOX_FASTBOOT_ERROR_TIMEOUT ;
+    }
+
+    *transferred = std::min(length, response.size()) ;
+    memcpy(data, response.data(), *transferred) ;
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief LoopbackTransport::write : Hand a packet to the emulated device.
+ * @param data: The bytes to send.
+ * @param length: Number of bytes.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int LoopbackTransport::write(const uint8_t* data, size_t length)
+{
+    if(isOpen == false)
+        return TOOLBOX_FASTBOOT_ERROR_WRITE ;
+
+    if(emulator.receive(data, length) != TOOLBOX_FASTBOOT_NO_ERROR)
+        return TOOLBOX_FASTBOOT_ERROR_WRITE ;
+
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief LoopbackTransport::getName : Describe the link for the console output.
+ * @return The transport description.
+ */
+std::string LoopbackTransport::getName()
+{
+    return std::string(TRANSPORT_LOOPBACK) + " (" + emulator.getSerialNumber() + ")" ;
+}
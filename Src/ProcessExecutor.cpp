@@ -0,0 +1,410 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ProcessExecutor.h"
+#include <cstring>
+#include <cstdio>
+#include <chrono>
+#include <algorithm>
+#include <mutex>
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+extern char **environ;
+#endif
+
+/* Grace period given to a stopped child before it is killed */
+constexpr int TERMINATE_GRACE_MS = 1000 ;
+
+#ifdef _WIN32
+/* Interval between two looks at the output pipe of a silent child */
+constexpr DWORD PROCESS_POLL_MS = 10 ;
+#endif
+
+/* Held from the creation of the pipes of a child until it is started: the children started by the other
+   threads (gang mode) must not inherit them, or the end of the output would only be seen when they exit */
+static std::mutex spawnMutex ;
+
+ProcessExecutor::ProcessExecutor()
+{
+
+}
+
+ProcessExecutor & ProcessExecutor::getInstance()
+{
+    static ProcessExecutor instance;
+    return instance;
+}
+
+/**
+ * @brief ProcessExecutor::isExecutable : Check that a program file exists and can be executed.
+ * @param program: The program path.
+ * @return True if the program can be started.
+ */
+bool ProcessExecutor::isExecutable(const std::string &program)
+{
+#ifdef _WIN32
+    return _access(program.c_str(), 0) == 0 ;
+#else
+    return access(program.c_str(), X_OK) == 0 ;
+#endif
+}
+
+/**
+ * @brief ProcessExecutor::formatCommandLine : Build a printable command line, quoting the arguments with spaces.
+ * @param program: The program path.
+ * @param arguments: The program arguments.
+ * @return The command line.
+ */
+std::string ProcessExecutor::formatCommandLine(const std::string &program, const std::vector<std::string> &arguments)
+{
+    std::string commandLine = "\"" + program + "\"" ;
+    for(const auto &argument : arguments)
+    {
+        if(argument.empty() || (argument.find_first_of(" \t\"") != std::string::npos))
+            commandLine.append(" \"").append(argument).append("\"") ;
+        else
+            commandLine.append(" ").append(argument) ;
+    }
+    return commandLine ;
+}
+
+#ifdef _WIN32
+/**
+ * @brief quoteWindowsArgument : Quote an argument the way the C runtime of the child splits its command line.
+ * @param argument: The argument.
+ * @return The argument, quoted and with its quotes and trailing backslashes escaped when needed.
+ */
+static std::string quoteWindowsArgument(const std::string &argument)
+{
+    if((argument.empty() == false) && (argument.find_first_of(" \t\n\v\"") == std::string::npos))
+        return argument ;
+
+    std::string quoted = "\"" ;
+    size_t backslashes = 0 ;
+    for(char character : argument)
+    {
+        if(character == '\\')
+        {
+            backslashes++ ;
+            continue ;
+        }
+
+        /* Backslashes are only special before a quote */
+        quoted.append((character == '"') ? (backslashes * 2 + 1) : backslashes, '\\') ;
+        quoted.push_back(character) ;
+        backslashes = 0 ;
+    }
+    quoted.append(backslashes * 2, '\\') ;
+    quoted.push_back('"') ;
+    return quoted ;
+}
+#endif
+
+/**
+ * @brief ProcessExecutor::terminate : Stop a child process, killing it if it does not exit in time.
+ * Windows has no termination request for a console program started without a console: it is killed right away.
+ * @param processId: The child process.
+ */
+void ProcessExecutor::terminate(long processId)
+{
+#ifdef _WIN32
+    HANDLE processHandle = OpenProcess(PROCESS_TERMINATE | SYNCHRONIZE, FALSE, static_cast<DWORD>(processId)) ;
+    if(processHandle == nullptr)
+        return ;
+
+    TerminateProcess(processHandle, 1) ;
+    WaitForSingleObject(processHandle, TERMINATE_GRACE_MS) ;
+    CloseHandle(processHandle) ;
+#else
+    kill(static_cast<pid_t>(processId), SIGTERM) ;
+    for(int elapsed = 0; elapsed < TERMINATE_GRACE_MS; elapsed += 10)
+    {
+        if(waitpid(static_cast<pid_t>(processId), nullptr, WNOHANG) != 0)
+            return ;
+        usleep(10 * 1000) ;
+    }
+    kill(static_cast<pid_t>(processId), SIGKILL) ;
+    waitpid(static_cast<pid_t>(processId), nullptr, 0) ;
+#endif
+}
+
+/**
+ * @brief ProcessExecutor::run : Start a program and stream its output to a handler until it exits.
+ * @param program: The program path.
+ * @param arguments: The program arguments, passed as is (no shell interpretation).
+ * @param handler: Receives the output as it is produced, returns false to stop the program.
+ * @param exitCode: Optional output, the program exit code (-1 if it was stopped).
+ * @param silenceTimeoutMs: Stop the program when it prints nothing for this duration (ms), 0 to wait forever.
+ * @return 0 if the program could be started, TOOLBOX_FASTBOOT_ERROR_TIMEOUT if it was stopped for its silence,
+ * otherwise an error occurred.
+ */
+int ProcessExecutor::run(const std::string &program, const std::vector<std::string> &arguments, outputHandler handler, int *exitCode, uint32_t silenceTimeoutMs)
+{
+    TraceScope traceScope("Process " + program.substr(program.find_last_of("/\\") + 1), "tool") ;
+#ifdef _WIN32
+    /* One inheritable pipe receives both stdout and stderr, in the order they are written */
+    std::unique_lock<std::mutex> spawnLock(spawnMutex) ;
+    SECURITY_ATTRIBUTES security = {sizeof(SECURITY_ATTRIBUTES), nullptr, TRUE} ;
+    HANDLE readPipe = nullptr ;
+    HANDLE writePipe = nullptr ;
+    if(CreatePipe(&readPipe, &writePipe, &security, 0) == FALSE)
+    {
+        displayManager.print(MSG_ERROR, L"Failed to open pipe") ;
+        return TOOLBOX_FASTBOOT_ERROR_NO_MEM ;
+    }
+    SetHandleInformation(readPipe, HANDLE_FLAG_INHERIT, 0) ;
+    HANDLE nullInput = CreateFileA("NUL", GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, &security, OPEN_EXISTING, 0, nullptr) ;
+
+    STARTUPINFOA startup ;
+    ZeroMemory(&startup, sizeof(startup)) ;
+    startup.cb = sizeof(startup) ;
+    startup.dwFlags = STARTF_USESTDHANDLES ;
+    startup.hStdInput = nullInput ;
+    startup.hStdOutput = writePipe ;
+    startup.hStdError = writePipe ;
+
+    /* The arguments reach the program as is: no cmd.exe in between */
+    std::string commandLine = quoteWindowsArgument(program) ;
+    for(const auto &argument : arguments)
+        commandLine.append(" ").append(quoteWindowsArgument(argument)) ;
+    std::vector<char> commandBuffer(commandLine.begin(), commandLine.end()) ;
+    commandBuffer.push_back('\0') ;
+
+    PROCESS_INFORMATION process ;
+    ZeroMemory(&process, sizeof(process)) ;
+    BOOL created = CreateProcessA(program.c_str(), commandBuffer.data(), nullptr, nullptr, TRUE, CREATE_NO_WINDOW, nullptr, nullptr, &startup, &process) ;
+    DWORD createError = GetLastError() ;
+    CloseHandle(writePipe) ;
+    if(nullInput != INVALID_HANDLE_VALUE)
+        CloseHandle(nullInput) ;
+    spawnLock.unlock() ;
+
+    if(created == FALSE)
+    {
+        displayManager.print(MSG_ERROR, L"Cannot start %s : error %lu", program.c_str(), static_cast<unsigned long>(createError)) ;
+        CloseHandle(readPipe) ;
+        return TOOLBOX_FASTBOOT_ERROR_NO_FILE ;
+    }
+    CloseHandle(process.hThread) ;
+
+    /* Anonymous pipes cannot be read with a timeout: the pipe is polled, waking up as soon as the program exits */
+    char buffer[4096] ;
+    bool stopped = false ;
+    bool exited = false ;
+    bool timedOut = false ;
+    auto lastOutput = std::chrono::steady_clock::now() ;
+    while(stopped == false)
+    {
+        DWORD available = 0 ;
+        if(PeekNamedPipe(readPipe, nullptr, 0, nullptr, &available, nullptr) == FALSE)
+            break ; /* Broken pipe: the program and its children closed their output */
+
+        if(available == 0)
+        {
+            /* Everything written before the exit has been read */
+            if(exited)
+                break ;
+
+            /* Hung tool or device: nothing printed for the whole timeout */
+            auto silence = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - lastOutput).count() ;
+            if((silenceTimeoutMs != 0) && (silence >= static_cast<long long>(silenceTimeoutMs)))
+            {
+                timedOut = true ;
+                stopped = true ;
+                break ;
+            }
+
+            exited = (WaitForSingleObject(process.hProcess, PROCESS_POLL_MS) == WAIT_OBJECT_0) ;
+            continue ;
+        }
+
+        DWORD length = 0 ;
+        DWORD readLength = (available < sizeof(buffer)) ? available : static_cast<DWORD>(sizeof(buffer)) ;
+        if((ReadFile(readPipe, buffer, readLength, &length, nullptr) == FALSE) || (length == 0))
+            break ;
+
+        lastOutput = std::chrono::steady_clock::now() ;
+        if(handler(STREAM_STDOUT, buffer, static_cast<size_t>(length)) == false)
+            stopped = true ;
+    }
+    CloseHandle(readPipe) ;
+
+    /* The process handle stays open until then, its identifier cannot be given to another process */
+    if(stopped)
+        terminate(static_cast<long>(process.dwProcessId)) ;
+
+    DWORD status = 0 ;
+    WaitForSingleObject(process.hProcess, INFINITE) ;
+    GetExitCodeProcess(process.hProcess, &status) ;
+    CloseHandle(process.hProcess) ;
+    if(exitCode != nullptr)
+        *exitCode = stopped ? -1 : static_cast<int>(status) ;
+
+    return timedOut ? TOOLBOX_FASTBOOT_ERROR_TIMEOUT : TOOLBOX_FASTBOOT_NO_ERROR ;
+#else
+    std::unique_lock<std::mutex> spawnLock(spawnMutex) ;
+    int pipes[2][2] = {{-1, -1}, {-1, -1}} ;
+    for(int stream = 0; stream < 2; stream++)
+    {
+        if(pipe(pipes[stream]) != 0)
+        {
+            displayManager.print(MSG_ERROR, L"Failed to open pipe") ;
+            for(int i = 0; i < stream; i++)
+            {
+                close(pipes[i][0]) ;
+                close(pipes[i][1]) ;
+            }
+            return TOOLBOX_FASTBOOT_ERROR_NO_MEM ;
+        }
+
+        /* pipe2() is Linux only, spawnMutex keeps the descriptors from leaking until they are flagged */
+        fcntl(pipes[stream][0], F_SETFD, FD_CLOEXEC) ;
+        fcntl(pipes[stream][1], F_SETFD, FD_CLOEXEC) ;
+    }
+
+    posix_spawn_file_actions_t actions ;
+    posix_spawn_file_actions_init(&actions) ;
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0) ;
+    posix_spawn_file_actions_adddup2(&actions, pipes[STREAM_STDOUT][1], STDOUT_FILENO) ;
+    posix_spawn_file_actions_adddup2(&actions, pipes[STREAM_STDERR][1], STDERR_FILENO) ;
+
+    std::vector<char*> argv ;
+    argv.push_back(const_cast<char*>(program.c_str())) ;
+    for(const auto &argument : arguments)
+        argv.push_back(const_cast<char*>(argument.c_str())) ;
+    argv.push_back(nullptr) ;
+
+    pid_t processId ;
+    auto spawnStart = std::chrono::steady_clock::now() ;
+    int ret = posix_spawn(&processId, program.c_str(), &actions, nullptr, argv.data(), environ) ;
+    auto spawnEnd = std::chrono::steady_clock::now() ;
+    TraceRecorder::getInstance().addEvent("Process spawn", "tool", spawnStart, spawnEnd) ;
+    posix_spawn_file_actions_destroy(&actions) ;
+    close(pipes[STREAM_STDOUT][1]) ;
+    close(pipes[STREAM_STDERR][1]) ;
+    spawnLock.unlock() ;
+
+    if(ret != 0)
+    {
+        displayManager.print(MSG_ERROR, L"Cannot start %s : %s", program.c_str(), strerror(ret)) ;
+        close(pipes[STREAM_STDOUT][0]) ;
+        close(pipes[STREAM_STDERR][0]) ;
+        return TOOLBOX_FASTBOOT_ERROR_NO_FILE ;
+    }
+
+    struct pollfd fds[2] ;
+    fds[STREAM_STDOUT] = {pipes[STREAM_STDOUT][0], POLLIN, 0} ;
+    fds[STREAM_STDERR] = {pipes[STREAM_STDERR][0], POLLIN, 0} ;
+    int openStreams = 2 ;
+    bool stopped = false ;
+    bool started = false ;
+    bool timedOut = false ;
+    char buffer[4096] ;
+    auto lastOutput = std::chrono::steady_clock::now() ;
+
+    while((openStreams > 0) && (stopped == false))
+    {
+        int waitMs = -1 ;
+        if(silenceTimeoutMs != 0)
+        {
+            auto silence = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - lastOutput).count() ;
+            waitMs = static_cast<int>(std::max<long long>(0, static_cast<long long>(silenceTimeoutMs) - silence)) ;
+        }
+
+        int ready = poll(fds, 2, waitMs) ;
+        if(ready < 0)
+        {
+            if(errno == EINTR)
+                continue ;
+            break ;
+        }
+
+        /* Hung tool or device: nothing printed for the whole timeout */
+        if(ready == 0)
+        {
+            timedOut = true ;
+            stopped = true ;
+            break ;
+        }
+
+        for(int stream = 0; (stream < 2) && (stopped == false); stream++)
+        {
+            if((fds[stream].fd < 0) || (fds[stream].revents == 0))
+                continue ;
+
+            ssize_t length = read(fds[stream].fd, buffer, sizeof(buffer)) ;
+            if((length < 0) && (errno == EINTR))
+                continue ;
+
+            if(length <= 0)
+            {
+                close(fds[stream].fd) ;
+                fds[stream].fd = -1 ;
+                openStreams-- ;
+                continue ;
+            }
+
+            lastOutput = std::chrono::steady_clock::now() ;
+
+            /* Time the tool needs to load and find the device before its first output */
+            if(started == false)
+            {
+                TraceRecorder::getInstance().addEvent("Process startup", "tool", spawnEnd, std::chrono::steady_clock::now()) ;
+                started = true ;
+            }
+
+            if(handler(static_cast<outputStream>(stream), buffer, static_cast<size_t>(length)) == false)
+                stopped = true ;
+        }
+    }
+
+    for(int stream = 0; stream < 2; stream++)
+    {
+        if(fds[stream].fd >= 0)
+            close(fds[stream].fd) ;
+    }
+
+    int status = 0 ;
+    if(stopped)
+    {
+        terminate(processId) ;
+        status = -1 ;
+    }
+    else
+    {
+        while((waitpid(processId, &status, 0) < 0) && (errno == EINTR)) ;
+        status = WIFEXITED(status) ? WEXITSTATUS(status) : -1 ;
+    }
+
+    if(exitCode != nullptr)
+        *exitCode = status ;
+
+    return timedOut ? TOOLBOX_FASTBOOT_ERROR_TIMEOUT : TOOLBOX_FASTBOOT_NO_ERROR ;
+#endif
+}
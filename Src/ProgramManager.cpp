@@ -19,15 +19,24 @@
 
 #include "ProgramManager.h"
 #include <chrono>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <list>
+#include <set>
+#include <algorithm>
 
 using namespace std ;
 
-ProgramManager::ProgramManager(const std::string toolboxFolder, const std::string fastbootSerialNumber)
+ProgramManager::ProgramManager(const std::string toolboxFolder, const std::string fastbootSerialNumber, const std::string transportSpec)
 {
     fastbootInterface = new Fastboot() ;
     fastbootInterface->toolboxFolder = toolboxFolder ;
     fastbootInterface->fastbootSerialNumber = fastbootSerialNumber ;
+    fastbootInterface->transportSpec = transportSpec ;
     parsedTsvFile = nullptr;
+    this->toolboxFolder = toolboxFolder ;
+    this->transportSpec = transportSpec ;
 }
 
 ProgramManager::~ProgramManager()
@@ -44,97 +53,1057 @@ ProgramManager::~ProgramManager()
 int ProgramManager::startFlashingService(const std::string inputTsvPath)
 {
     auto start = std::chrono::high_resolution_clock::now(); // get start time
+    TraceScope trace("Flashing service", "session") ;
 
     int ret = TOOLBOX_FASTBOOT_NO_ERROR ;
 
-    if(fastbootInterface->isUbootFastbootRunning() == false)
+    /* The images are checked before the device is touched, the device sessions reuse the plan of their gang or station */
+    if(flashPlan.isCompiled() == false)
     {
-        displayManager.print(MSG_NORMAL, L"No flashing service will be performed !");
-        return TOOLBOX_FASTBOOT_ERROR_NO_DEVICE ;
+        if(fileManager.openTsvFile(inputTsvPath, &parsedTsvFile) != 0)
+        {
+            displayManager.print(MSG_ERROR, L"Failed to download TSV partitions: %s", inputTsvPath.c_str());
+            return TOOLBOX_FASTBOOT_ERROR_NO_FILE ;
+        }
+
+        if(options.checkIntegrity && (checkImagesIntegrity(inputTsvPath) != TOOLBOX_FASTBOOT_NO_ERROR))
+            return TOOLBOX_FASTBOOT_ERROR_READ ;
+
+        flashPlan.compile(*parsedTsvFile) ;
     }
 
-    if(fileManager.openTsvFile(inputTsvPath, &parsedTsvFile) != 0)
+    fastbootInterface->timeouts = options.timeouts ;
+    auto probeStart = std::chrono::steady_clock::now() ;
+    bool deviceFound = fastbootInterface->isUbootFastbootRunning() ;
+    double probeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - probeStart).count() ;
+    if(deviceFound == false)
     {
-        displayManager.print(MSG_ERROR, L"Failed to download TSV partitions: %s", inputTsvPath.c_str());
-        return TOOLBOX_FASTBOOT_ERROR_NO_FILE ;
+        displayManager.print(MSG_NORMAL, L"No flashing service will be performed !");
+        recordMetrics(TOOLBOX_FASTBOOT_ERROR_NO_DEVICE, probeSeconds, {}, {}) ;
+        return TOOLBOX_FASTBOOT_ERROR_NO_DEVICE ;
     }
 
     displayManager.print(MSG_NORMAL, L"-----------------------------------------");
     displayManager.print(MSG_GREEN, L"TSV fastboot downloading...");
     displayManager.print(MSG_NORMAL, L"  TSV path           : %s", inputTsvPath.data() );
-    displayManager.print(MSG_NORMAL, L"  Partitions number  : %lu", parsedTsvFile->partitionsList.size() );
+    displayManager.print(MSG_NORMAL, L"  Partitions number  : %lu", flashPlan.getTsvLinesNbr() );
+    displayManager.print(MSG_NORMAL, L"  Plan commands      : %lu (%lu redundant removed)", flashPlan.getCommandsList().size(), flashPlan.getRemovedNbr() );
     displayManager.print(MSG_NORMAL,L"-----------------------------------------\n" );
 
-    if(fastbootInterface->oemFormatMemory() != TOOLBOX_FASTBOOT_NO_ERROR)
+    std::vector<fastbootStep> stepsList = flashPlan.getSteps() ;
+    std::vector<manifestEntry> stepsEntriesList(stepsList.size()) ; /* TSV line of each step, for the flash manifest */
+    for(size_t i = 0; i < stepsList.size(); i++)
+        stepsEntriesList[i].tsvLine = flashPlan.getCommandsList()[i].tsvLine ;
+
+    /* An interrupted flashing of the same layout continues without formatting, from its first unfinished step */
+    std::string layoutDigest = flashPlan.getLayoutDigest() ;
+    std::vector<journalEntry> journalStepsList ; /* Journal entry of each plan step */
+    FlashJournal journal("") ;
+    if(options.resume)
+        openJournal(journal, stepsList, journalStepsList) ;
+
+    size_t resumedNbr = 0 ;
+    double formatSeconds = 0 ;
+    bool formatted = false ;
+    if(journal.isEnabled() && journal.isFormatted(layoutDigest))
+    {
+        resumedNbr = journal.getCompletedNbr(journalStepsList) ;
+        displayManager.print(MSG_GREEN, L"Resuming the interrupted flashing : format skipped, %lu/%lu steps already completed", resumedNbr, stepsList.size()) ;
+
+        /* Drop the recorded steps that no longer match the plan, the next ones are appended after the kept ones */
+        journal.save(layoutDigest, std::vector<journalEntry>(journalStepsList.begin(), journalStepsList.begin() + resumedNbr)) ;
+    }
+    else
     {
-        displayManager.print(MSG_ERROR, L"Failed to format partitions, No flashing service will be performed !");
-        return TOOLBOX_FASTBOOT_ERROR_INTERFACE_NOT_SUPPORTED;
+        /* Repartitioning forces the rewrite of every partition, it is only needed if the device layout differs */
+        if((options.forceFormat == false) && isDeviceLayoutMatching())
+        {
+            displayManager.print(MSG_GREEN, L"The device partitions match the TSV layout, format skipped") ;
+        }
+        else
+        {
+            auto formatStart = std::chrono::steady_clock::now() ;
+            if(fastbootInterface->oemFormatMemory() != TOOLBOX_FASTBOOT_NO_ERROR)
+            {
+                displayManager.print(MSG_ERROR, L"Failed to format partitions, No flashing service will be performed !");
+                recordMetrics(TOOLBOX_FASTBOOT_ERROR_INTERFACE_NOT_SUPPORTED, probeSeconds, {}, {}) ;
+                return TOOLBOX_FASTBOOT_ERROR_INTERFACE_NOT_SUPPORTED;
+            }
+
+            formatSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - formatStart).count() ;
+            formatted = true ;
+        }
+
+        if(journal.isEnabled())
+            journal.save(layoutDigest, {}) ;
     }
 
+    stepsList.erase(stepsList.begin(), stepsList.begin() + resumedNbr) ;
+    stepsEntriesList.erase(stepsEntriesList.begin(), stepsEntriesList.begin() + resumedNbr) ;
+
     displayManager.print(MSG_NORMAL, L"\nStart flashing service...\n\n");
 
-    for(auto &part: parsedTsvFile->partitionsList)
+    fastbootInterface->sparse = options.sparse ;
+    fastbootInterface->pipelineMemory = static_cast<uint64_t>(options.pipelineMemoryMB) * 1024 * 1024 ;
+
+    FlashManifest manifest(options.manifestPath.empty() ? FlashManifest::getDefaultPath() : options.manifestPath) ;
+    if(options.incremental && (skipUnchangedSteps(manifest, formatted, stepsList, stepsEntriesList) != TOOLBOX_FASTBOOT_NO_ERROR))
     {
-        std::string patternNone = "none\"";
+        for(auto &entry : stepsEntriesList)
+            entry.sha256.clear() ;
+    }
 
-        if((part.opt == "PED") && (part.binary == "none"))
+    size_t journaledNbr = resumedNbr ;
+    if(journal.isEnabled())
+    {
+        fastbootInterface->onStepCompleted = [&](size_t stepIndex)
         {
-            ret = fastbootInterface->erasePartition(part.partName) ;
-            if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
-                break ;
+            journalStep(journal, journalStepsList, resumedNbr, stepsList, stepIndex, journaledNbr) ;
+        } ;
+    }
+
+    ret = fastbootInterface->executeSteps(stepsList) ;
+    fastbootInterface->onStepCompleted = nullptr ;
+
+    if(journal.isEnabled())
+        updateJournal(journal, journaledNbr, journalStepsList.size(), ret) ;
+
+    if(options.reportPath.empty() == false)
+        writeReport(inputTsvPath, stepsList, stepsEntriesList) ;
+    recordMetrics(ret, probeSeconds, stepsList, stepsEntriesList) ;
+
+    if(options.incremental)
+    {
+        std::vector<manifestEntry> flashedList ;
+        for(size_t i = 0; i < stepsList.size(); i++)
+        {
+            if((stepsList[i].result == TOOLBOX_FASTBOOT_NO_ERROR) && (stepsEntriesList[i].sha256.empty() == false))
+                flashedList.push_back(stepsEntriesList[i]) ;
+        }
+        manifest.record(flashedList) ;
+    }
+
+    if(ret == TOOLBOX_FASTBOOT_NO_ERROR)
+    {
+        recordCostFigures(stepsList, formatSeconds) ;
+
+        auto end = std::chrono::high_resolution_clock::now(); // get end time
+        auto duration = std::chrono::duration_cast< std::chrono::milliseconds>(end - start);
+        displayManager.print(MSG_NORMAL, L"Flashing service finished."),
+        displayManager.print(MSG_GREEN, L"Time elapsed to flash all partitions: %ld min, %02ld s, %03ld ms", (duration.count() / (1000 * 60)), ((duration.count() / 1000) % 60), (duration.count() % 1000));
+    }
+    else
+    {
+        displayManager.print(MSG_ERROR, L"Failed to flash partitions !");
+    }
+
+    return ret ;
+}
+
+/**
+ * @brief ProgramManager::estimateFlashingService: Predict the duration of each command of a TSV file and of the whole
+ * flashing service from the cost model, without any device.
+ * @param inputTsvPath: The TSV file to apply.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int ProgramManager::estimateFlashingService(const std::string inputTsvPath)
+{
+    if(fileManager.openTsvFile(inputTsvPath, &parsedTsvFile) != 0)
+    {
+        displayManager.print(MSG_ERROR, L"Failed to compile TSV partitions: %s", inputTsvPath.c_str());
+        return TOOLBOX_FASTBOOT_ERROR_NO_FILE ;
+    }
+
+    flashPlan.compile(*parsedTsvFile) ;
+
+    /* The default cost model only exists once a board has been flashed, the STM32MP figures are used until then */
+    bool defaultModel = options.costModelPath.empty() ;
+    FlashCostModel costModel(defaultModel ? FlashCostModel::getDefaultPath() : options.costModelPath) ;
+    int ret = costModel.load() ;
+    if((ret == TOOLBOX_FASTBOOT_ERROR_NO_FILE) && defaultModel)
+        ret = TOOLBOX_FASTBOOT_NO_ERROR ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+    {
+        if(ret == TOOLBOX_FASTBOOT_ERROR_NO_FILE)
+            displayManager.print(MSG_ERROR, L"Cannot open the cost model %s", costModel.getPath().c_str()) ;
+        return ret ;
+    }
+
+    const costFigures &figures = costModel.getFigures() ;
+    displayManager.print(MSG_NORMAL, L"-----------------------------------------");
+    displayManager.print(MSG_GREEN, L"TSV fastboot dry run, nothing is sent to the device...");
+    displayManager.print(MSG_NORMAL, L"  TSV path           : %s", inputTsvPath.c_str() );
+    displayManager.print(MSG_NORMAL, L"  Cost model         : %s", costModel.isLoaded() ? costModel.getPath().c_str() : "STM32MP defaults, no board measured yet" );
+    displayManager.print(MSG_NORMAL, L"  Link, write speed  : %.1f MB/s, %.1f MB/s", figures.linkSpeed, figures.writeSpeed );
+    displayManager.print(MSG_NORMAL, L"  Command latency    : %u ms (erase %u ms, format %u ms)", figures.commandLatency, figures.eraseTime, figures.formatTime );
+    displayManager.print(MSG_NORMAL, L"  Download buffer    : %u KB", figures.maxDownloadSize / 1024 );
+    displayManager.print(MSG_NORMAL, L"-----------------------------------------\n" );
+
+    displayManager.print(MSG_NORMAL, L"  %3s  %-13s %-16s %12s %10s %10s %8s %10s", "#", "Command", "Partition", "Size", "Transfer", "Write", "Commands", "Total") ;
+
+    commandEstimate total ;
+    auto printEstimate = [this, &total](const std::string &index, const std::string &name, const std::string &target, const commandEstimate &estimate)
+    {
+        displayManager.print(MSG_NORMAL, L"  %3s  %-13s %-16s %9llu KB %9.3fs %9.3fs %8u %9.3fs", index.c_str(), name.c_str(), target.c_str(),
+                             static_cast<unsigned long long>(estimate.size / 1024), estimate.transferSeconds, estimate.writeSeconds, estimate.commandsNbr,
+                             estimate.transferSeconds + estimate.writeSeconds + estimate.commandSeconds) ;
+        total.size += estimate.size ;
+        total.commandsNbr += estimate.commandsNbr ;
+        total.transferSeconds += estimate.transferSeconds ;
+        total.writeSeconds += estimate.writeSeconds ;
+        total.commandSeconds += estimate.commandSeconds ;
+    } ;
+
+    printEstimate("-", "oem format", "-", costModel.estimateFormat()) ;
+    const std::vector<planCommand> &commandsList = flashPlan.getCommandsList() ;
+    for(size_t i = 0; i < commandsList.size(); i++)
+    {
+        const fastbootStep &step = commandsList[i].step ;
+        printEstimate(std::to_string(i + 1), FlashPlan::getCommandName(step.type), step.partName.empty() ? "-" : step.partName, costModel.estimate(step, commandsList[i].tsvLine.binarySize)) ;
+    }
+
+    long long durationMs = static_cast<long long>((total.transferSeconds + total.writeSeconds + total.commandSeconds) * 1000) ;
+    displayManager.print(MSG_NORMAL, L"  %3s  %-13s %-16s %9llu KB %9.3fs %9.3fs %8u %9.3fs\n", "", "Total", "",
+                         static_cast<unsigned long long>(total.size / 1024), total.transferSeconds, total.writeSeconds, total.commandsNbr, durationMs / 1000.0) ;
+    displayManager.print(MSG_GREEN, L"Predicted time to flash all partitions: %lld min, %02lld s, %03lld ms", durationMs / (1000 * 60), (durationMs / 1000) % 60, durationMs % 1000) ;
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief ProgramManager::writeReport: Append the measured steps of the last flashing sequence to the --report file.
+ * The steps after a failure are reported as not run.
+ * @param inputTsvPath: The TSV file applied.
+ * @param stepsList: The executed flashing sequence.
+ * @param stepsEntriesList: The TSV line of each step.
+ */
+void ProgramManager::writeReport(const std::string &inputTsvPath, const std::vector<fastbootStep> &stepsList, const std::vector<manifestEntry> &stepsEntriesList)
+{
+    TraceScope trace("Report", "session") ;
+    const std::vector<stepTimings> &timingsList = fastbootInterface->getStepsTimings() ;
+
+    reportContext context ;
+    context.toolboxVersion = options.toolboxVersion ;
+    context.bootloaderVersion = fastbootInterface->getBootloaderVersion() ;
+    context.transport = transportSpec.empty() ? "default" : transportSpec ;
+    context.serialNumber = fastbootInterface->fastbootSerialNumber ;
+    if(context.serialNumber.empty())
+        fastbootInterface->getVariable("serialno", context.serialNumber) ;
+    context.tsvPath = inputTsvPath ;
+
+    std::vector<reportRecord> recordsList ;
+    bool failed = false ;
+    for(size_t i = 0; i < stepsList.size(); i++)
+    {
+        reportRecord record ;
+        record.stepIndex = i + 1 ;
+        record.command = FlashPlan::getCommandName(stepsList[i].type) ;
+        record.partName = stepsList[i].partName ;
+        record.partType = stepsList[i].partName.empty() ? "" : stepsEntriesList[i].tsvLine.partType ;
+        record.imageBytes = (stepsList[i].type == STEP_FLASH) ? stepsEntriesList[i].tsvLine.binarySize : 0 ;
+        if(i < timingsList.size())
+        {
+            record.sentBytes = timingsList[i].sentBytes ;
+            record.transferSeconds = timingsList[i].transferSeconds ;
+            record.writeSeconds = timingsList[i].writeSeconds ;
+            record.totalSeconds = timingsList[i].totalSeconds ;
         }
+        record.result = failed ? "NOT_RUN" : ((stepsList[i].result == TOOLBOX_FASTBOOT_NO_ERROR) ? "OK" : "FAILED") ;
+        failed = failed || (stepsList[i].result != TOOLBOX_FASTBOOT_NO_ERROR) ;
+        recordsList.push_back(record) ;
+    }
+
+    FlashReport report(options.reportPath) ;
+    if(report.append(context, recordsList) == TOOLBOX_FASTBOOT_NO_ERROR)
+        displayManager.print(MSG_NORMAL, L"Flashing report appended to %s (%s)", options.reportPath.c_str(), report.isJson() ? "JSON Lines" : "CSV") ;
+}
+
+/**
+ * @brief ProgramManager::recordMetrics: Add a flashing service to the station metrics, if a metrics file is given.
+ * @param result: The flashing service result.
+ * @param probeSeconds: Time taken to find the device.
+ * @param stepsList: The executed flashing sequence, empty if it was not started.
+ * @param stepsEntriesList: The TSV line of each step.
+ */
+void ProgramManager::recordMetrics(int result, double probeSeconds, const std::vector<fastbootStep> &stepsList, const std::vector<manifestEntry> &stepsEntriesList)
+{
+    if(options.metricsPath.empty())
+        return ;
+
+    const std::vector<stepTimings> &timingsList = fastbootInterface->getStepsTimings() ;
+
+    metricsRun run ;
+    run.result = result ;
+    run.probeSeconds = probeSeconds ;
+    for(size_t i = 0; (i < stepsList.size()) && (i < timingsList.size()); i++)
+    {
+        if((stepsList[i].type != STEP_FLASH) || (stepsList[i].result != TOOLBOX_FASTBOOT_NO_ERROR) || (timingsList[i].totalSeconds <= 0))
+            continue ;
+
+        metricsPartition partition ;
+        partition.partName = stepsList[i].partName ;
+        partition.imageBytes = stepsEntriesList[i].tsvLine.binarySize ;
+        partition.sentBytes = timingsList[i].sentBytes ;
+        partition.seconds = timingsList[i].totalSeconds ;
+        run.partitionsList.push_back(partition) ;
+    }
+
+    FlashMetrics metrics(options.metricsPath) ;
+    metrics.record(run) ;
+}
+
+/**
+ * @brief ProgramManager::recordCostFigures: Store the throughputs measured by the last flashing sequence in the default cost model.
+ * The emulated loopback device is not a board to predict.
+ * @param stepsList: The executed flashing sequence.
+ * @param formatSeconds: Duration of the "oem format" of the flashing service.
+ */
+void ProgramManager::recordCostFigures(const std::vector<fastbootStep> &stepsList, double formatSeconds)
+{
+    const std::vector<stepTimings> &timingsList = fastbootInterface->getStepsTimings() ;
+    if((timingsList.size() != stepsList.size()) || (transportSpec.compare(0, strlen(TRANSPORT_LOOPBACK), TRANSPORT_LOOPBACK) == 0))
+        return ;
+
+    uint64_t sentBytes = 0 ;
+    double transferSeconds = 0, writeSeconds = 0 ;
+    for(size_t i = 0; i < stepsList.size(); i++)
+    {
+        if(stepsList[i].type != STEP_FLASH)
+            continue ;
+
+        sentBytes += timingsList[i].sentBytes ;
+        transferSeconds += timingsList[i].transferSeconds ;
+        writeSeconds += timingsList[i].writeSeconds ;
+    }
+
+    costFigures measured ;
+    if((sentBytes >= COST_MIN_MEASURED_SZ) && (transferSeconds > 0))
+        measured.linkSpeed = sentBytes / (transferSeconds * 1024 * 1024) ;
+    if((sentBytes >= COST_MIN_MEASURED_SZ) && (writeSeconds > 0))
+        measured.writeSpeed = sentBytes / (writeSeconds * 1024 * 1024) ;
+    measured.formatTime = static_cast<uint32_t>(formatSeconds * 1000) ;
+    measured.maxDownloadSize = fastbootInterface->getMaxDownloadSize() ;
+
+    FlashCostModel costModel(FlashCostModel::getDefaultPath()) ;
+    costModel.record(measured) ;
+}
+
+/**
+ * @brief ProgramManager::hashTsvImages: Hash every image of the parsed TSV file, in parallel, unless already done.
+ * @return 0 if all the images are hashed successfully, otherwise an error occurred.
+ */
+int ProgramManager::hashTsvImages()
+{
+    if(imageDigestsList.empty() == false)
+        return TOOLBOX_FASTBOOT_NO_ERROR ;
+
+    TraceScope trace("Hash images", "session") ;
+
+    /* Device sessions get the hashes of their gang or station, the TSV file has no image if there are none */
+    if(parsedTsvFile == nullptr)
+        return TOOLBOX_FASTBOOT_NO_ERROR ;
+
+    for(const auto &part : parsedTsvFile->partitionsList)
+    {
+        if((part.binary == "none") || (findImageDigest(part.binary) != nullptr))
+            continue ;
+
+        imageDigestsList.emplace_back() ;
+        imageDigestsList.back().path = part.binary ;
+    }
+
+    auto start = std::chrono::steady_clock::now() ;
+    int ret = ImageHash::hashFiles(imageDigestsList) ;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() ;
+
+    uint64_t totalSize = 0 ;
+    for(const auto &digest : imageDigestsList)
+    {
+        totalSize += digest.size ;
+        if(digest.result != TOOLBOX_FASTBOOT_NO_ERROR)
+            displayManager.print(MSG_ERROR, L"Cannot hash the image %s", digest.path.c_str()) ;
+    }
+
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+    {
+        imageDigestsList.clear() ;
+        return ret ;
+    }
+
+    displayManager.print(MSG_NORMAL, L"Hashed %lu images, %llu KB in %.3fs (%.0f MB/s, SHA-256 %s, CRC32C %s)", imageDigestsList.size(),
+                         static_cast<unsigned long long>(totalSize / 1024), seconds, (seconds > 0) ? totalSize / (seconds * 1024 * 1024) : 0.0,
+                         ImageHash::getSha256Engines().back().name.c_str(), ImageHash::getCrc32cEngines().back().name.c_str()) ;
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief ProgramManager::findImageDigest: Get the hashes of a TSV image computed by hashTsvImages().
+ * @param path: The image path, as resolved by the TSV parser.
+ * @return The hashes, or nullptr if the image has not been hashed.
+ */
+const imageDigest* ProgramManager::findImageDigest(const std::string &path) const
+{
+    for(const auto &digest : imageDigestsList)
+    {
+        if(digest.path == path)
+            return &digest ;
+    }
+    return nullptr ;
+}
+
+/**
+ * @brief ProgramManager::checkImagesIntegrity: Compare the TSV images with the integrity manifest written by --hash.
+ * Nothing is checked when the TSV file has no manifest.
+ * @param inputTsvPath: The TSV file path.
+ * @return 0 if all the images match the manifest, otherwise an error occurred.
+ */
+int ProgramManager::checkImagesIntegrity(const std::string &inputTsvPath)
+{
+    TraceScope trace("Integrity check", "session") ;
+    std::string manifestPath = ImageHash::getIntegrityManifestPath(inputTsvPath) ;
+    std::vector<integrityEntry> entriesList ;
+    int ret = ImageHash::readIntegrityManifest(manifestPath, entriesList) ;
+    if(ret == TOOLBOX_FASTBOOT_ERROR_NO_FILE)
+        return TOOLBOX_FASTBOOT_NO_ERROR ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+    {
+        displayManager.print(MSG_ERROR, L"The integrity manifest %s is not conform", manifestPath.c_str()) ;
+        return ret ;
+    }
+
+    displayManager.print(MSG_NORMAL, L"Checking the images against %s", manifestPath.c_str()) ;
+    ret = hashTsvImages() ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        return ret ;
 
-        if((part.opt == "-") || (part.binary == "none") || (part.binary.size() >= patternNone.size() && part.binary.substr(part.binary.size() - patternNone.size()) == patternNone)) //ignore the field containing none keyword
+    size_t mismatchNbr = 0 ;
+    for(const auto &part : parsedTsvFile->partitionsList)
+    {
+        if(part.binary == "none")
             continue ;
 
-        if((part.partType == "Binary") && (part.offset == "boot1"))
+        const imageDigest *digest = findImageDigest(part.binary) ;
+        auto entry = std::find_if(entriesList.begin(), entriesList.end(), [&part](const integrityEntry &manifestEntry)
         {
-            ret = fastbootInterface->flashPartition("mmc1boot0", part.binary) ; //U-Boot's keyword to update this specific boot partition for eMMC memory: fsbl1
-            if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
-                break ;
+            return manifestEntry.partName == part.partName ;
+        }) ;
 
-            ret = fastbootInterface->oemBootbus(0, 0, 0);
-            if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
-                break ;
+        if(entry == entriesList.end())
+        {
+            displayManager.print(MSG_ERROR, L"Partition %s : not in the integrity manifest", part.partName.c_str()) ;
+            mismatchNbr++ ;
+        }
+        else if((digest == nullptr) || (digest->size != entry->size) || (digest->sha256 != entry->sha256))
+        {
+            displayManager.print(MSG_ERROR, L"Partition %s : %s does not match the integrity manifest", part.partName.c_str(), part.binary.c_str()) ;
+            mismatchNbr++ ;
+        }
+    }
 
-            ret = fastbootInterface->oemPartconf(1, 1);
-            if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
-                break ;
+    if(mismatchNbr != 0)
+    {
+        displayManager.print(MSG_ERROR, L"Images integrity check failed, no flashing service will be performed !") ;
+        return TOOLBOX_FASTBOOT_ERROR_READ ;
+    }
+
+    displayManager.print(MSG_GREEN, L"Images integrity checked\n") ;
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief ProgramManager::generateIntegrityManifest: Hash the images of a TSV file and write its integrity manifest next to it.
+ * @param inputTsvPath: The TSV file path.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int ProgramManager::generateIntegrityManifest(const std::string inputTsvPath)
+{
+    if(fileManager.openTsvFile(inputTsvPath, &parsedTsvFile) != 0)
+    {
+        displayManager.print(MSG_ERROR, L"Failed to hash TSV partitions: %s", inputTsvPath.c_str());
+        return TOOLBOX_FASTBOOT_ERROR_NO_FILE ;
+    }
+
+    int ret = hashTsvImages() ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        return ret ;
+
+    /* Image paths are stored relative to the TSV folder, as written in the TSV file */
+    std::string tsvFolder = inputTsvPath.substr(0, inputTsvPath.find_last_of("/\\") + 1) ;
+    std::vector<integrityEntry> entriesList ;
+    for(const auto &part : parsedTsvFile->partitionsList)
+    {
+        const imageDigest *digest = findImageDigest(part.binary) ;
+        if(digest == nullptr)
+            continue ;
+
+        integrityEntry entry ;
+        entry.partName = part.partName ;
+        entry.size = digest->size ;
+        entry.sha256 = digest->sha256 ;
+        entry.crc32c = digest->crc32c ;
+        entry.binary = ((tsvFolder.empty() == false) && (part.binary.compare(0, tsvFolder.size(), tsvFolder) == 0)) ? part.binary.substr(tsvFolder.size()) : part.binary ;
+        entriesList.push_back(entry) ;
+        displayManager.print(MSG_NORMAL, L"  %-16s %s  %08x  %s", entry.partName.c_str(), entry.sha256.c_str(), entry.crc32c, entry.binary.c_str()) ;
+    }
+
+    std::string manifestPath = ImageHash::getIntegrityManifestPath(inputTsvPath) ;
+    ret = ImageHash::writeIntegrityManifest(manifestPath, entriesList) ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+    {
+        displayManager.print(MSG_ERROR, L"Cannot write the integrity manifest %s", manifestPath.c_str()) ;
+        return ret ;
+    }
+
+    displayManager.print(MSG_GREEN, L"Integrity manifest written : %s", manifestPath.c_str()) ;
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief ProgramManager::printFlashPlan: Compile a TSV file and display the resulting device commands, without any device.
+ * @param inputTsvPath: The TSV file path.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int ProgramManager::printFlashPlan(const std::string inputTsvPath)
+{
+    if(fileManager.openTsvFile(inputTsvPath, &parsedTsvFile) != 0)
+    {
+        displayManager.print(MSG_ERROR, L"Failed to compile TSV partitions: %s", inputTsvPath.c_str());
+        return TOOLBOX_FASTBOOT_ERROR_NO_FILE ;
+    }
+
+    flashPlan.compile(*parsedTsvFile) ;
+    flashPlan.print() ;
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief ProgramManager::skipUnchangedSteps: Remove the flash steps whose image is already on the device according to the manifest.
+ * The remaining flash and erase steps are removed from the manifest before they start.
+ * "oem format" recreates the GPT partitions empty: after it nothing is skipped and all of them are removed from the manifest.
+ * @param manifest: The flash manifest.
+ * @param formatted: True if the memory has just been formatted.
+ * @param stepsList: Input/output, the flashing sequence.
+ * @param stepsEntriesList: Input/output, the TSV line of each step, completed with the hash of the flashed images.
+ * @return 0 if the manifest can be used, otherwise the steps are left unchanged and nothing must be recorded.
+ */
+int ProgramManager::skipUnchangedSteps(FlashManifest &manifest, bool formatted, std::vector<fastbootStep> &stepsList, std::vector<manifestEntry> &stepsEntriesList)
+{
+    std::string serialNumber = getDeviceSerialNumber() ;
+    if(serialNumber.empty())
+    {
+        displayManager.print(MSG_WARNING, L"Incremental mode needs a single device or its serial number, all partitions are flashed") ;
+        return TOOLBOX_FASTBOOT_ERROR_NO_DEVICE ;
+    }
+
+    if(manifest.load() != TOOLBOX_FASTBOOT_NO_ERROR)
+        return TOOLBOX_FASTBOOT_ERROR_READ ;
+
+    displayManager.print(MSG_NORMAL, L"Incremental mode, flash manifest : %s", manifest.getPath().c_str()) ;
+
+    if(hashTsvImages() != TOOLBOX_FASTBOOT_NO_ERROR)
+        return TOOLBOX_FASTBOOT_ERROR_READ ;
+
+    std::vector<std::string> modifiedPartitions ;
+    if(formatted)
+    {
+        for(const auto &partition : flashPlan.getPartitionsList())
+            modifiedPartitions.push_back(partition.partName) ;
+    }
+
+    std::vector<fastbootStep> keptStepsList ;
+    std::vector<manifestEntry> keptEntriesList ;
+    for(size_t i = 0; i < stepsList.size(); i++)
+    {
+        const fastbootStep &step = stepsList[i] ;
+        manifestEntry entry = stepsEntriesList[i] ;
+        if(step.type == STEP_FLASH)
+        {
+            const imageDigest *digest = findImageDigest(step.binary) ;
+            entry.serialNumber = serialNumber ;
+            entry.partName = step.partName ;
+            entry.sha256 = (digest != nullptr) ? digest->sha256 : "" ;
+            entry.size = (digest != nullptr) ? digest->size : 0 ;
+
+            if((formatted == false) && (entry.sha256.empty() == false) && manifest.isUnchanged(entry))
+            {
+                displayManager.print(MSG_GREEN, L"Partition %s : unchanged, skipped", step.partName.c_str()) ;
+                continue ;
+            }
+        }
+
+        if((step.type == STEP_FLASH) || (step.type == STEP_ERASE))
+            modifiedPartitions.push_back(step.partName) ;
+
+        keptStepsList.push_back(step) ;
+        keptEntriesList.push_back(entry) ;
+    }
+    displayManager.print(MSG_NORMAL, L"") ;
+
+    int ret = manifest.forget(serialNumber, modifiedPartitions) ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        return ret ;
+
+    stepsList = std::move(keptStepsList) ;
+    stepsEntriesList = std::move(keptEntriesList) ;
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief ProgramManager::isDeviceLayoutMatching: Compare the GPT of the device with the partitions of the TSV layout.
+ * The last partition of a memory takes the remaining space: its size is only checked against the images flashed into it.
+ * A partition whose size or type cannot be read is not verified, and the memory is then formatted.
+ * @return True if every TSV partition exists on the device with the same size and a content matching its type.
+ */
+bool ProgramManager::isDeviceLayoutMatching()
+{
+    const std::vector<planPartition> &partitionsList = flashPlan.getPartitionsList() ;
+    if(partitionsList.empty())
+        return false ;
+
+    std::vector<std::string> partNames ;
+    for(const auto &partition : partitionsList)
+        partNames.push_back(partition.partName) ;
+
+    std::map<std::string, uint64_t> sizesList ;
+    if(fastbootInterface->getPartitionSizes(partNames, sizesList) != TOOLBOX_FASTBOOT_NO_ERROR)
+        return false ;
+
+    for(const auto &partition : partitionsList)
+    {
+        auto size = sizesList.find(partition.partName) ;
+        if(size == sizesList.end())
+        {
+            displayManager.print(MSG_NORMAL, L"Partition %s not found on the device, the memory is formatted", partition.partName.c_str()) ;
+            return false ;
         }
-        else if ((part.partType == "Binary") && (part.offset == "boot2"))
+
+        if((partition.size != 0) && (size->second != partition.size))
         {
-            ret = fastbootInterface->flashPartition("mmc1boot1", part.binary) ; //U-Boot's keyword to update this specific boot partition for eMMC memory: fsbl2
-            if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
-                break ;
+            displayManager.print(MSG_NORMAL, L"Partition %s : 0x%llx bytes on the device, 0x%llx in the TSV layout, the memory is formatted", partition.partName.c_str(),
+                                 static_cast<unsigned long long>(size->second), static_cast<unsigned long long>(partition.size)) ;
+            return false ;
+        }
 
-            ret = fastbootInterface->oemBootbus(0, 0, 0);
-            if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
-                break ;
+        uint64_t imagesSize = 0 ;
+        if((partition.size == 0) && (getImagesSize(partition.partName, imagesSize) != TOOLBOX_FASTBOOT_NO_ERROR))
+        {
+            displayManager.print(MSG_NORMAL, L"Partition %s : the size of its image cannot be read, the memory is formatted", partition.partName.c_str()) ;
+            return false ;
+        }
+
+        if((partition.size == 0) && ((size->second == 0) || (size->second < imagesSize)))
+        {
+            displayManager.print(MSG_NORMAL, L"Partition %s : 0x%llx bytes on the device, 0x%llx needed by its image, the memory is formatted", partition.partName.c_str(),
+                                 static_cast<unsigned long long>(size->second), static_cast<unsigned long long>(imagesSize)) ;
+            return false ;
+        }
+
+        /* A device without the variable reports no file system */
+        std::string deviceType = "" ;
+        int ret = fastbootInterface->getVariable("partition-type:" + partition.partName, deviceType) ;
+        if((ret != TOOLBOX_FASTBOOT_NO_ERROR) && (ret != TOOLBOX_FASTBOOT_ERROR_OTHER))
+        {
+            displayManager.print(MSG_NORMAL, L"Partition %s : its type cannot be read, the memory is formatted", partition.partName.c_str()) ;
+            return false ;
+        }
+
+        if(isPartitionTypeMatching(partition.partType, deviceType) == false)
+        {
+            displayManager.print(MSG_NORMAL, L"Partition %s : \"%s\" content on the device, %s in the TSV layout, the memory is formatted", partition.partName.c_str(),
+                                 deviceType.c_str(), partition.partType.c_str()) ;
+            return false ;
+        }
+    }
 
-            ret = fastbootInterface->oemPartconf(1, 2);
+    return true ;
+}
+
+/**
+ * @brief ProgramManager::getImagesSize: Get the space needed by the images the plan flashes into a partition.
+ * @param partName: The partition.
+ * @param imagesSize: Output, the size of the largest image, expanded for the sparse images. 0 if none is flashed.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int ProgramManager::getImagesSize(const std::string &partName, uint64_t &imagesSize)
+{
+    imagesSize = 0 ;
+    for(const auto &command : flashPlan.getCommandsList())
+    {
+        if((command.step.type != STEP_FLASH) || (command.step.partName != partName))
+            continue ;
+
+        uint64_t imageSize = 0 ;
+        if(SparseImage::isSparseFile(command.step.binary))
+        {
+            SparseImage image(command.step.binary) ;
+            int ret = image.load() ;
             if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
-                break ;
+                return ret ;
+            imageSize = image.getRawSize() ;
         }
         else
         {
-            ret = fastbootInterface->flashPartition(part.partName, part.binary) ;
-            if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
-                break ;
+            std::ifstream imageFile(command.step.binary, std::ios::binary | std::ios::ate) ;
+            if(imageFile.is_open() == false)
+                return TOOLBOX_FASTBOOT_ERROR_NO_FILE ;
+            imageSize = static_cast<uint64_t>(imageFile.tellg()) ;
         }
+        imagesSize = std::max(imagesSize, imageSize) ;
+    }
+
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief ProgramManager::isPartitionTypeMatching: Compare the partition content reported by the device with the TSV type.
+ * "partition-type" reports the file system found in the partition: the TSV types holding a file system must find one,
+ * the raw types must not. The other TSV types are not compared.
+ * @param tsvType: The type column of the TSV line, e.g. "FileSystem".
+ * @param deviceType: The "partition-type" value, e.g. "ext4", empty if the device does not report it.
+ * @return True if the device content is consistent with the TSV type.
+ */
+bool ProgramManager::isPartitionTypeMatching(const std::string &tsvType, const std::string &deviceType)
+{
+    bool hasFileSystem = (deviceType.empty() == false) && (deviceType != "raw") && (deviceType != "unknown") && (deviceType != "unsupported") ;
+
+    if((tsvType == "FileSystem") || (tsvType == "System") || (tsvType == "ESP"))
+        return hasFileSystem ;
+    if((tsvType == "Binary") || (tsvType == "FIP") || (tsvType == "ENV") || (tsvType == "FWU_MDATA"))
+        return hasFileSystem == false ;
+
+    return true ;
+}
+
+/**
+ * @brief ProgramManager::getDeviceSerialNumber: Get the serial number of the flashed device, given or found if it is the only one.
+ * @return The serial number, empty if it is not given and several devices or none are connected.
+ */
+std::string ProgramManager::getDeviceSerialNumber()
+{
+    if(fastbootInterface->fastbootSerialNumber.empty() == false)
+        return fastbootInterface->fastbootSerialNumber ;
+
+    std::vector<std::string> serialNumbers ;
+    if((fastbootInterface->listDevices(serialNumbers) == TOOLBOX_FASTBOOT_NO_ERROR) && (serialNumbers.size() == 1))
+        return serialNumbers[0] ;
+
+    return "" ;
+}
 
+/**
+ * @brief ProgramManager::openJournal: Read the journal of the device and identify the steps of the plan in it.
+ * @param journal: Output, the journal of the device, left disabled if it cannot be used.
+ * @param stepsList: The flashing sequence of the plan.
+ * @param journalStepsList: Output, the journal entry of each step, with the hash of its image.
+ * @return 0 if the journal can be used, otherwise the flashing service runs without it.
+ */
+int ProgramManager::openJournal(FlashJournal &journal, const std::vector<fastbootStep> &stepsList, std::vector<journalEntry> &journalStepsList)
+{
+    std::string serialNumber = getDeviceSerialNumber() ;
+    if(serialNumber.empty())
+    {
+        displayManager.print(MSG_WARNING, L"Resume mode needs a single device or its serial number, the flashing is not journaled") ;
+        return TOOLBOX_FASTBOOT_ERROR_NO_DEVICE ;
     }
 
-    if(ret == TOOLBOX_FASTBOOT_NO_ERROR)
+    if(hashTsvImages() != TOOLBOX_FASTBOOT_NO_ERROR)
+        return TOOLBOX_FASTBOOT_ERROR_READ ;
+
+    journalStepsList.clear() ;
+    for(const auto &step : stepsList)
     {
-        auto end = std::chrono::high_resolution_clock::now(); // get end time
-        auto duration = std::chrono::duration_cast< std::chrono::milliseconds>(end - start);
-        displayManager.print(MSG_NORMAL, L"Flashing service finished."),
-        displayManager.print(MSG_GREEN, L"Time elapsed to flash all partitions: %ld min, %02ld s, %03ld ms", (duration.count() / (1000 * 60)), ((duration.count() / 1000) % 60), (duration.count() % 1000));
+        journalEntry entry ;
+        entry.command = FlashPlan::getCommandName(step.type) ;
+        entry.partName = step.partName ;
+        if(step.type == STEP_FLASH)
+        {
+            const imageDigest *digest = findImageDigest(step.binary) ;
+            if(digest == nullptr)
+                return TOOLBOX_FASTBOOT_ERROR_READ ;
+            entry.sha256 = digest->sha256 ;
+        }
+        journalStepsList.push_back(entry) ;
     }
-    else
+
+    FlashJournal deviceJournal(FlashJournal::getJournalPath(options.journalFolder.empty() ? FlashJournal::getDefaultFolder() : options.journalFolder, serialNumber)) ;
+    if(deviceJournal.load() != TOOLBOX_FASTBOOT_NO_ERROR)
+        return TOOLBOX_FASTBOOT_ERROR_READ ;
+
+    displayManager.print(MSG_NORMAL, L"Resume mode, flash journal : %s", deviceJournal.getPath().c_str()) ;
+    journal = deviceJournal ;
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief ProgramManager::journalStep: Append a step to the journal as soon as it succeeds, so a killed process keeps it.
+ * Only the leading completed steps of the plan are recorded: the next run continues with the first one that did not finish.
+ * @param journal: The journal of the device.
+ * @param journalStepsList: The journal entry of each step of the plan.
+ * @param resumedNbr: The leading plan steps skipped because completed by a previous run.
+ * @param stepsList: The flashing sequence being executed.
+ * @param stepIndex: Index of the completed step in the sequence.
+ * @param completedNbr: Input/output, the leading plan steps recorded in the journal.
+ */
+void ProgramManager::journalStep(FlashJournal &journal, const std::vector<journalEntry> &journalStepsList, size_t resumedNbr, const std::vector<fastbootStep> &stepsList, size_t stepIndex, size_t &completedNbr)
+{
+    /* The incremental mode may have removed steps, the plan order stops at the first one */
+    const std::vector<planCommand> &commandsList = flashPlan.getCommandsList() ;
+    if((completedNbr != resumedNbr + stepIndex) || (completedNbr >= commandsList.size()) || (completedNbr >= journalStepsList.size()))
+        return ;
+
+    const fastbootStep &step = stepsList[stepIndex], &planned = commandsList[completedNbr].step ;
+    if((step.type != planned.type) || (step.partName != planned.partName) || (step.binary != planned.binary))
+        return ;
+
+    if(journal.append(journalStepsList[completedNbr]) == TOOLBOX_FASTBOOT_NO_ERROR)
+        completedNbr++ ;
+}
+
+/**
+ * @brief ProgramManager::updateJournal: Remove the journal once the flashing sequence succeeded, otherwise report what it holds.
+ * @param journal: The journal of the device.
+ * @param completedNbr: The leading plan steps recorded in the journal.
+ * @param stepsNbr: The number of steps of the plan.
+ * @param result: The flashing sequence result.
+ */
+void ProgramManager::updateJournal(FlashJournal &journal, size_t completedNbr, size_t stepsNbr, int result)
+{
+    if(result == TOOLBOX_FASTBOOT_NO_ERROR)
     {
-        displayManager.print(MSG_ERROR, L"Failed to flash partitions !");
+        journal.clear() ;
+        return ;
     }
 
-    return ret ;
+    displayManager.print(MSG_NORMAL, L"Flash journal : %lu/%lu steps completed, run again with --resume to continue", completedNbr, stepsNbr) ;
+}
+
+/**
+ * @brief ProgramManager::startGangFlashingService: Flash several devices in parallel with the same TSV file.
+ * Every device gets its own flashing session and Fastboot instance, run by a pool of worker threads.
+ * @param inputTsvPath: The TSV file to apply.
+ * @param serialNumbers: The devices serial numbers, or GANG_ALL_DEVICES to flash every connected device.
+ * @return 0 if all the devices are flashed successfully, otherwise an error occurred.
+ */
+int ProgramManager::startGangFlashingService(const std::string inputTsvPath, std::vector<std::string> serialNumbers)
+{
+    auto start = std::chrono::steady_clock::now() ;
+
+    if((serialNumbers.size() == 1) && (serialNumbers[0] == GANG_ALL_DEVICES))
+    {
+        int ret = fastbootInterface->listDevices(serialNumbers) ;
+        if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+            return ret ;
+    }
+
+    if(serialNumbers.empty())
+    {
+        displayManager.print(MSG_WARNING, L"No U-Boot in Fastboot mode is running !") ;
+        displayManager.print(MSG_NORMAL, L"No flashing service will be performed !");
+        return TOOLBOX_FASTBOOT_ERROR_NO_DEVICE ;
+    }
+
+    /* Check the TSV file and the images once instead of failing in every session */
+    if(fileManager.openTsvFile(inputTsvPath, &parsedTsvFile) != 0)
+    {
+        displayManager.print(MSG_ERROR, L"Failed to download TSV partitions: %s", inputTsvPath.c_str());
+        return TOOLBOX_FASTBOOT_ERROR_NO_FILE ;
+    }
+
+    if(options.checkIntegrity && (checkImagesIntegrity(inputTsvPath) != TOOLBOX_FASTBOOT_NO_ERROR))
+        return TOOLBOX_FASTBOOT_ERROR_READ ;
+    if(options.incremental && (hashTsvImages() != TOOLBOX_FASTBOOT_NO_ERROR))
+        return TOOLBOX_FASTBOOT_ERROR_READ ;
+
+    flashPlan.compile(*parsedTsvFile) ;
+
+    std::vector<gangSession> sessionsList(serialNumbers.size()) ;
+    for(size_t i = 0; i < serialNumbers.size(); i++)
+        sessionsList[i].serialNumber = serialNumbers[i] ;
+
+    unsigned int workersNbr = std::min<unsigned int>(static_cast<unsigned int>(sessionsList.size()), MAX_GANG_WORKERS) ;
+    displayManager.print(MSG_GREEN, L"Gang programming of %lu devices (%u in parallel)\n", sessionsList.size(), workersNbr) ;
+
+    std::atomic<size_t> nextSession(0) ;
+    auto worker = [&]()
+    {
+        size_t index ;
+        while((index = nextSession++) < sessionsList.size())
+        {
+            runDeviceSession(inputTsvPath, sessionsList[index]) ;
+        }
+    } ;
+
+    std::vector<std::thread> workersList ;
+    for(unsigned int i = 0; i < workersNbr; i++)
+        workersList.emplace_back(worker) ;
+    for(auto &workerThread : workersList)
+        workerThread.join() ;
+
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start) ;
+    printGangSummary(sessionsList, duration.count()) ;
+
+    for(const auto &session : sessionsList)
+    {
+        if(session.result != TOOLBOX_FASTBOOT_NO_ERROR)
+            return TOOLBOX_FASTBOOT_ERROR_OTHER ;
+    }
+
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief ProgramManager::runDeviceSession: Flash one device of a gang or station, from the calling worker thread.
+ * @param inputTsvPath: The TSV file to apply.
+ * @param session: The device to flash, its result and duration are filled in.
+ */
+void ProgramManager::runDeviceSession(const std::string &inputTsvPath, gangSession &session)
+{
+    DisplayManager::setDeviceTag(session.serialNumber) ;
+    TraceRecorder::setTrack(session.serialNumber) ;
+
+    auto sessionStart = std::chrono::steady_clock::now() ;
+    ProgramManager deviceProgramManager(toolboxFolder, session.serialNumber, transportSpec) ;
+    deviceProgramManager.options = options ;
+    deviceProgramManager.options.checkIntegrity = false ; /* Already checked for all the sessions */
+    deviceProgramManager.imageDigestsList = imageDigestsList ;
+    deviceProgramManager.flashPlan = flashPlan ;
+    session.result = deviceProgramManager.startFlashingService(inputTsvPath) ;
+    auto sessionEnd = std::chrono::steady_clock::now() ;
+    session.durationMs = std::chrono::duration_cast<std::chrono::milliseconds>(sessionEnd - sessionStart).count() ;
+    TraceRecorder::getInstance().addEvent("Device session", "host", sessionStart, sessionEnd) ;
+
+    TraceRecorder::setTrack("") ;
+    DisplayManager::setDeviceTag("") ;
+}
+
+/**
+ * @brief ProgramManager::printGangSummary: Display the per-device result table of a gang programming.
+ * @param sessionsList: The devices sessions.
+ * @param durationMs: Total duration of the gang programming.
+ */
+void ProgramManager::printGangSummary(const std::vector<gangSession> &sessionsList, long long durationMs)
+{
+    size_t passedNbr = 0 ;
+
+    displayManager.print(MSG_NORMAL, L"\n-----------------------------------------");
+    displayManager.print(MSG_GREEN, L"Gang programming summary");
+    displayManager.print(MSG_NORMAL, L"  %-32s %-6s %s", "Serial number", "Result", "Duration");
+    for(const auto &session : sessionsList)
+    {
+        bool passed = (session.result == TOOLBOX_FASTBOOT_NO_ERROR) ;
+        passedNbr += passed ? 1 : 0 ;
+        displayManager.print(passed ? MSG_GREEN : MSG_NORMAL, L"  %-32s %-6s %lld min, %02lld s, %03lld ms", session.serialNumber.c_str(), passed ? "PASS" : "FAIL",
+                             session.durationMs / (1000 * 60), (session.durationMs / 1000) % 60, session.durationMs % 1000);
+    }
+    displayManager.print(MSG_NORMAL, L"-----------------------------------------");
+    displayManager.print((passedNbr == sessionsList.size()) ? MSG_GREEN : MSG_ERROR, L"%lu/%lu devices flashed successfully in %lld min, %02lld s, %03lld ms",
+                         passedNbr, sessionsList.size(), durationMs / (1000 * 60), (durationMs / 1000) % 60, durationMs % 1000);
+}
+
+/**
+ * @brief ProgramManager::startStationService: Flash every device as soon as it is plugged, until the boards count is reached.
+ * A device is flashed once per plug: it must be unplugged before being flashed again.
+ * @param inputTsvPath: The TSV file to apply.
+ * @param boardsNbr: Number of boards to flash before returning, 0 to run forever.
+ * @return 0 if all the boards are flashed successfully, otherwise an error occurred.
+ */
+int ProgramManager::startStationService(const std::string inputTsvPath, uint32_t boardsNbr)
+{
+    if(fileManager.openTsvFile(inputTsvPath, &parsedTsvFile) != 0)
+    {
+        displayManager.print(MSG_ERROR, L"Failed to download TSV partitions: %s", inputTsvPath.c_str());
+        return TOOLBOX_FASTBOOT_ERROR_NO_FILE ;
+    }
+
+    if(options.checkIntegrity && (checkImagesIntegrity(inputTsvPath) != TOOLBOX_FASTBOOT_NO_ERROR))
+        return TOOLBOX_FASTBOOT_ERROR_READ ;
+    if(options.incremental && (hashTsvImages() != TOOLBOX_FASTBOOT_NO_ERROR))
+        return TOOLBOX_FASTBOOT_ERROR_READ ;
+
+    flashPlan.compile(*parsedTsvFile) ;
+
+    /* Network and emulated devices do not raise USB hotplug events */
+    DeviceMonitor deviceMonitor ;
+    if((transportSpec == "") || (transportSpec == TRANSPORT_USB) || (transportSpec == TRANSPORT_EXEC))
+        deviceMonitor.open() ;
+
+    displayManager.print(MSG_GREEN, L"Station mode: waiting for Fastboot devices (%s)...\n", deviceMonitor.isEventDriven() ? "hotplug events" : "polling") ;
+
+    std::list<stationSession> activeSessionsList ;
+    std::set<std::string> attachedSerials ; /* Devices being flashed, or flashed and not unplugged yet */
+    uint32_t startedNbr = 0, passedNbr = 0, failedNbr = 0 ;
+
+    while(true)
+    {
+        for(auto it = activeSessionsList.begin(); it != activeSessionsList.end(); )
+        {
+            if(it->finished == false)
+            {
+                it++ ;
+                continue ;
+            }
+
+            it->worker.join() ;
+            const gangSession &session = it->session ;
+            if(session.result == TOOLBOX_FASTBOOT_NO_ERROR)
+            {
+                passedNbr++ ;
+                displayManager.print(MSG_GREEN, L"Board %s : PASS in %lld min, %02lld s, %03lld ms", session.serialNumber.c_str(),
+                                     session.durationMs / (1000 * 60), (session.durationMs / 1000) % 60, session.durationMs % 1000) ;
+            }
+            else
+            {
+                failedNbr++ ;
+                displayManager.print(MSG_ERROR, L"Board %s : FAIL after %lld min, %02lld s, %03lld ms", session.serialNumber.c_str(),
+                                     session.durationMs / (1000 * 60), (session.durationMs / 1000) % 60, session.durationMs % 1000) ;
+            }
+            displayManager.print(MSG_NORMAL, L"Station: %u passed, %u failed, %lu in progress\n", passedNbr, failedNbr, activeSessionsList.size() - 1) ;
+            it = activeSessionsList.erase(it) ;
+        }
+
+        if((boardsNbr != 0) && (startedNbr >= boardsNbr) && activeSessionsList.empty())
+            break ;
+
+        std::vector<std::string> serialNumbers ;
+        if(fastbootInterface->listDevices(serialNumbers) != TOOLBOX_FASTBOOT_NO_ERROR)
+            serialNumbers.clear() ;
+
+        /* Unplugged boards can be flashed again on their next plug */
+        for(auto it = attachedSerials.begin(); it != attachedSerials.end(); )
+        {
+            bool active = std::find_if(activeSessionsList.begin(), activeSessionsList.end(), [&it](const stationSession &activeSession)
+            {
+                return activeSession.session.serialNumber == *it ;
+            }) != activeSessionsList.end() ;
+
+            if((active == false) && (std::find(serialNumbers.begin(), serialNumbers.end(), *it) == serialNumbers.end()))
+                it = attachedSerials.erase(it) ;
+            else
+                it++ ;
+        }
+
+        for(const auto &serialNumber : serialNumbers)
+        {
+            if((attachedSerials.count(serialNumber) != 0) || ((boardsNbr != 0) && (startedNbr >= boardsNbr)))
+                continue ;
+
+            attachedSerials.insert(serialNumber) ;
+            startedNbr++ ;
+            displayManager.print(MSG_GREEN, L"Board %s plugged, start flashing", serialNumber.c_str()) ;
+
+            activeSessionsList.emplace_back() ;
+            stationSession &activeSession = activeSessionsList.back() ;
+            activeSession.session.serialNumber = serialNumber ;
+            activeSession.worker = std::thread([this, &activeSession, &deviceMonitor, inputTsvPath]()
+            {
+                runDeviceSession(inputTsvPath, activeSession.session) ;
+                activeSession.finished = true ;
+                deviceMonitor.wakeUp() ;
+            }) ;
+        }
+
+        deviceMonitor.waitForEvent() ;
+    }
+
+    displayManager.print(MSG_NORMAL, L"Station stopped after %u boards: %u passed, %u failed", startedNbr, passedNbr, failedNbr) ;
+    return (failedNbr == 0) ? TOOLBOX_FASTBOOT_NO_ERROR : TOOLBOX_FASTBOOT_ERROR_OTHER ;
 }
@@ -0,0 +1,592 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SparseImage.h"
+#include "ImageSource.h"
+#include <fstream>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SPARSE_X86_SCANNERS
+#include <immintrin.h>
+#endif
+
+/* Smaller RAW chunks are copied next to their header rather than sent as a separate transfer */
+constexpr uint64_t SPARSE_DIRECT_RAW_MIN_SZ = 64 * 1024 ;
+
+/* Largest RAW chunk: its size in bytes, header included, is stored on 32 bits */
+constexpr uint32_t SPARSE_MAX_RAW_CHUNK_BLOCKS = (0xFFFFFFFFu - SPARSE_CHUNK_HEADER_SZ) / SPARSE_BLOCK_SZ ;
+
+/**
+ * @brief scanBlockScalar : Portable block classifier.
+ * @param block: The block data, size multiple of 128 bytes.
+ * @param size: The block size.
+ * @param fillValue: Output, the repeated pattern if the block is uniform.
+ * @return True if the block repeats one 32-bit pattern.
+ */
+static bool scanBlockScalar(const uint8_t *block, size_t size, uint32_t *fillValue)
+{
+    uint32_t value ;
+    memcpy(&value, block, sizeof(value)) ;
+    uint64_t pattern = (static_cast<uint64_t>(value) << 32) | value ;
+
+    for(size_t offset = 0; offset < size; offset += sizeof(pattern))
+    {
+        uint64_t word ;
+        memcpy(&word, block + offset, sizeof(word)) ;
+        if(word != pattern)
+            return false ;
+    }
+
+    *fillValue = value ;
+    return true ;
+}
+
+#ifdef SPARSE_X86_SCANNERS
+/**
+ * @brief scanBlockSse2 : SSE2 block classifier, 64 bytes compared per iteration.
+ */
+__attribute__((target("sse2")))
+static bool scanBlockSse2(const uint8_t *block, size_t size, uint32_t *fillValue)
+{
+    uint32_t value ;
+    memcpy(&value, block, sizeof(value)) ;
+    const __m128i pattern = _mm_set1_epi32(static_cast<int>(value)) ;
+
+    for(size_t offset = 0; offset < size; offset += 64)
+    {
+        const __m128i *data = reinterpret_cast<const __m128i*>(block + offset) ;
+        __m128i difference = _mm_or_si128(_mm_or_si128(_mm_xor_si128(_mm_loadu_si128(data), pattern), _mm_xor_si128(_mm_loadu_si128(data + 1), pattern)),
+                                          _mm_or_si128(_mm_xor_si128(_mm_loadu_si128(data + 2), pattern), _mm_xor_si128(_mm_loadu_si128(data + 3), pattern))) ;
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(difference, _mm_setzero_si128())) != 0xFFFF)
+            return false ;
+    }
+
+    *fillValue = value ;
+    return true ;
+}
+
+/**
+ * @brief scanBlockAvx2 : AVX2 block classifier, 128 bytes compared per iteration.
+ */
+__attribute__((target("avx2")))
+static bool scanBlockAvx2(const uint8_t *block, size_t size, uint32_t *fillValue)
+{
+    uint32_t value ;
+    memcpy(&value, block, sizeof(value)) ;
+    const __m256i pattern = _mm256_set1_epi32(static_cast<int>(value)) ;
+
+    for(size_t offset = 0; offset < size; offset += 128)
+    {
+        const __m256i *data = reinterpret_cast<const __m256i*>(block + offset) ;
+        __m256i difference = _mm256_or_si256(_mm256_or_si256(_mm256_xor_si256(_mm256_loadu_si256(data), pattern), _mm256_xor_si256(_mm256_loadu_si256(data + 1), pattern)),
+                                             _mm256_or_si256(_mm256_xor_si256(_mm256_loadu_si256(data + 2), pattern), _mm256_xor_si256(_mm256_loadu_si256(data + 3), pattern))) ;
+        if(_mm256_testz_si256(difference, difference) == 0)
+            return false ;
+    }
+
+    *fillValue = value ;
+    return true ;
+}
+#endif
+
+SparseImage::SparseImage(const std::string &rawPath)
+{
+    this->rawPath = rawPath ;
+}
+
+/**
+ * @brief SparseImage::getAvailableScanners : List the block classifiers supported by this CPU, slowest first.
+ * @return The scanners list, the scalar one is always available.
+ */
+std::vector<blockScannerInfo> SparseImage::getAvailableScanners()
+{
+    std::vector<blockScannerInfo> scannersList = {{"scalar", scanBlockScalar}} ;
+#ifdef SPARSE_X86_SCANNERS
+    if(__builtin_cpu_supports("sse2"))
+        scannersList.push_back({"SSE2", scanBlockSse2}) ;
+    if(__builtin_cpu_supports("avx2"))
+        scannersList.push_back({"AVX2", scanBlockAvx2}) ;
+#endif
+    return scannersList ;
+}
+
+/**
+ * @brief SparseImage::getBestScanner : Select the fastest block classifier supported by this CPU.
+ * @return The scanner.
+ */
+blockScannerInfo SparseImage::getBestScanner()
+{
+    static const blockScannerInfo bestScanner = getAvailableScanners().back() ;
+    return bestScanner ;
+}
+
+/**
+ * @brief SparseImage::isSparseFile : Check if a file is already an Android sparse image.
+ * @param path: The file path.
+ * @return True if the file starts with the sparse header magic.
+ */
+bool SparseImage::isSparseFile(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary) ;
+    uint8_t magic[4] = {0} ;
+    if(!file.read(reinterpret_cast<char*>(magic), sizeof(magic)))
+        return false ;
+
+    uint32_t value = magic[0] | (magic[1] << 8) | (magic[2] << 16) | (static_cast<uint32_t>(magic[3]) << 24) ;
+    return value == SPARSE_HEADER_MAGIC ;
+}
+
+/**
+ * @brief SparseImage::addBlock : Append one block to the chunk list, merging it with the previous chunk when possible.
+ * @param type: The chunk type of the block.
+ * @param fillValue: The pattern of a FILL block.
+ * @param fileOffset: The block position in the raw image.
+ */
+void SparseImage::addBlock(uint16_t type, uint32_t fillValue, uint64_t fileOffset)
+{
+    if(chunksList.empty() == false)
+    {
+        sparseChunk &chunk = chunksList.back() ;
+        bool sameChunk = (chunk.type == type) && (chunk.blocksNbr < 0xFFFFFFFFu) ;
+        if(type == SPARSE_CHUNK_FILL)
+            sameChunk = sameChunk && (chunk.fillValue == fillValue) ;
+        else if(type == SPARSE_CHUNK_RAW)
+            sameChunk = sameChunk && (chunk.blocksNbr < SPARSE_MAX_RAW_CHUNK_BLOCKS) ;
+
+        if(sameChunk)
+        {
+            chunk.blocksNbr++ ;
+            return ;
+        }
+    }
+
+    chunksList.push_back({type, 1, fileOffset, fillValue}) ;
+}
+
+/**
+ * @brief SparseImage::scan : Classify every block of the raw image and build the chunk list.
+ * The last block is padded with zeros when the image size is not a multiple of the block size.
+ * @param mode: SPARSE_FILL or SPARSE_SKIP_ZERO.
+ * @param scanner: The block classifier, nullptr for the fastest one.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int SparseImage::scan(sparseMode mode, blockScanner scanner)
+{
+    if(scanner == nullptr)
+        scanner = getBestScanner().scanner ;
+
+    ImageSource source(rawPath) ;
+    if(source.open() != TOOLBOX_FASTBOOT_NO_ERROR)
+        return TOOLBOX_FASTBOOT_ERROR_NO_FILE ;
+
+    auto start = std::chrono::steady_clock::now() ;
+    rawSize = source.getSize() ;
+    sourceSize = rawSize ;
+    blockSize = SPARSE_BLOCK_SZ ;
+    chunksList.clear() ;
+
+    /* The blocks are classified where the source puts them, only the last one is copied to be padded */
+    uint8_t lastBlock[SPARSE_BLOCK_SZ] ;
+    uint64_t offset = 0 ;
+    int ret = source.read(0, rawSize, [&](const uint8_t *data, size_t length)
+    {
+        for(size_t blockOffset = 0; blockOffset < length; blockOffset += SPARSE_BLOCK_SZ)
+        {
+            const uint8_t *block = data + blockOffset ;
+            size_t blockLength = std::min<size_t>(SPARSE_BLOCK_SZ, length - blockOffset) ;
+            if(blockLength < SPARSE_BLOCK_SZ)
+            {
+                memcpy(lastBlock, block, blockLength) ;
+                memset(lastBlock + blockLength, 0, SPARSE_BLOCK_SZ - blockLength) ;
+                block = lastBlock ;
+            }
+
+            uint32_t fillValue = 0 ;
+            if(scanner(block, SPARSE_BLOCK_SZ, &fillValue) == false)
+                addBlock(SPARSE_CHUNK_RAW, 0, offset + blockOffset) ;
+            else if((fillValue == 0) && (mode == SPARSE_SKIP_ZERO))
+                addBlock(SPARSE_CHUNK_DONT_CARE, 0, offset + blockOffset) ;
+            else
+                addBlock(SPARSE_CHUNK_FILL, fillValue, offset + blockOffset) ;
+        }
+
+        offset += length ;
+        return static_cast<int>(TOOLBOX_FASTBOOT_NO_ERROR) ;
+    }) ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        return TOOLBOX_FASTBOOT_ERROR_READ ;
+
+    scanSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() ;
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief SparseImage::load : Build the chunk list of a file that is already an Android sparse image.
+ * CRC32 chunks are dropped, the written image does not carry checksums.
+ * @return 0 if the operation is performed successfully, TOOLBOX_FASTBOOT_ERROR_READ if the file is not a valid sparse image,
+ * otherwise an error occurred.
+ */
+int SparseImage::load()
+{
+    std::ifstream sparseFile(rawPath, std::ios::binary) ;
+    if(sparseFile.is_open() == false)
+        return TOOLBOX_FASTBOOT_ERROR_NO_FILE ;
+
+    auto start = std::chrono::steady_clock::now() ;
+    sparseFile.seekg(0, std::ios::end) ;
+    sourceSize = static_cast<uint64_t>(sparseFile.tellg()) ;
+    sparseFile.seekg(0, std::ios::beg) ;
+    chunksList.clear() ;
+
+    auto getLittleEndian = [](const uint8_t *data, size_t size)
+    {
+        uint32_t value = 0 ;
+        for(size_t i = 0; i < size; i++)
+            value |= static_cast<uint32_t>(data[i]) << (8 * i) ;
+        return value ;
+    } ;
+
+    uint8_t header[SPARSE_HEADER_SZ] ;
+    if(!sparseFile.read(reinterpret_cast<char*>(header), sizeof(header)) || (getLittleEndian(header, 4) != SPARSE_HEADER_MAGIC) ||
+       (getLittleEndian(header + 4, 2) != SPARSE_MAJOR_VERSION))
+        return TOOLBOX_FASTBOOT_ERROR_READ ;
+
+    uint32_t fileHeaderSize = getLittleEndian(header + 8, 2) ;
+    uint32_t chunkHeaderSize = getLittleEndian(header + 10, 2) ;
+    blockSize = getLittleEndian(header + 12, 4) ;
+    uint32_t totalBlocks = getLittleEndian(header + 16, 4) ;
+    uint32_t totalChunks = getLittleEndian(header + 20, 4) ;
+    if((fileHeaderSize < SPARSE_HEADER_SZ) || (chunkHeaderSize < SPARSE_CHUNK_HEADER_SZ) || (blockSize == 0) || (blockSize % 4 != 0))
+        return TOOLBOX_FASTBOOT_ERROR_READ ;
+
+    uint64_t position = fileHeaderSize ;
+    uint64_t blocksNbr = 0 ;
+    for(uint32_t i = 0; i < totalChunks; i++)
+    {
+        uint8_t chunkHeader[SPARSE_CHUNK_HEADER_SZ + sizeof(uint32_t)] ;
+        sparseFile.seekg(static_cast<std::streamoff>(position)) ;
+        if(!sparseFile.read(reinterpret_cast<char*>(chunkHeader), SPARSE_CHUNK_HEADER_SZ))
+            return TOOLBOX_FASTBOOT_ERROR_READ ;
+
+        sparseChunk chunk = {static_cast<uint16_t>(getLittleEndian(chunkHeader, 2)), getLittleEndian(chunkHeader + 4, 4), position + chunkHeaderSize, 0} ;
+        uint64_t totalSize = getLittleEndian(chunkHeader + 8, 4) ;
+        uint64_t payloadSize = (chunk.type == SPARSE_CHUNK_RAW) ? static_cast<uint64_t>(chunk.blocksNbr) * blockSize :
+                               ((chunk.type == SPARSE_CHUNK_FILL) || (chunk.type == SPARSE_CHUNK_CRC32)) ? sizeof(uint32_t) : 0 ;
+        if((chunk.type < SPARSE_CHUNK_RAW) || (chunk.type > SPARSE_CHUNK_CRC32) || (totalSize != chunkHeaderSize + payloadSize) ||
+           (position + totalSize > sourceSize))
+            return TOOLBOX_FASTBOOT_ERROR_READ ;
+
+        if(chunk.type == SPARSE_CHUNK_FILL)
+        {
+            sparseFile.seekg(static_cast<std::streamoff>(chunk.fileOffset)) ;
+            if(!sparseFile.read(reinterpret_cast<char*>(chunkHeader + SPARSE_CHUNK_HEADER_SZ), sizeof(uint32_t)))
+                return TOOLBOX_FASTBOOT_ERROR_READ ;
+            chunk.fillValue = getLittleEndian(chunkHeader + SPARSE_CHUNK_HEADER_SZ, 4) ;
+        }
+
+        if(chunk.type != SPARSE_CHUNK_CRC32)
+        {
+            chunksList.push_back(chunk) ;
+            blocksNbr += chunk.blocksNbr ;
+        }
+        position += totalSize ;
+    }
+
+    if(blocksNbr != totalBlocks)
+        return TOOLBOX_FASTBOOT_ERROR_READ ;
+
+    rawSize = blocksNbr * blockSize ;
+    scanSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() ;
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief SparseImage::split : Cut the image into sparse images that each fit in a device download buffer.
+ * Every piece describes the whole image: the blocks written by the other pieces are DONT_CARE,
+ * so the pieces can be flashed one after the other to the same partition. RAW chunks are cut at block boundaries.
+ * @param maxSparseSize: The largest sparse image accepted, the device max-download-size.
+ * @return The pieces, in block order, or an empty list if one block does not fit in the buffer.
+ */
+std::vector<SparseImage> SparseImage::split(uint64_t maxSparseSize) const
+{
+    std::vector<SparseImage> piecesList ;
+
+    /* Room left for the chunks once the header and the two DONT_CARE chunks around the piece are counted */
+    const uint64_t overhead = SPARSE_HEADER_SZ + 2 * SPARSE_CHUNK_HEADER_SZ ;
+    if(maxSparseSize < overhead + SPARSE_CHUNK_HEADER_SZ + blockSize)
+        return piecesList ;
+    const uint64_t budget = maxSparseSize - overhead ;
+
+    uint64_t totalBlocks = 0 ;
+    for(const auto &chunk : chunksList)
+        totalBlocks += chunk.blocksNbr ;
+
+    SparseImage piece(*this) ;
+    piece.chunksList.clear() ;
+    uint64_t pieceSize = 0 ;
+    uint64_t pieceFirstBlock = 0 ;
+    uint64_t currentBlock = 0 ;
+
+    auto closePiece = [&]()
+    {
+        std::vector<sparseChunk> chunks ;
+        if(pieceFirstBlock > 0)
+            chunks.push_back({SPARSE_CHUNK_DONT_CARE, static_cast<uint32_t>(pieceFirstBlock), 0, 0}) ;
+        chunks.insert(chunks.end(), piece.chunksList.begin(), piece.chunksList.end()) ;
+        if(currentBlock < totalBlocks)
+            chunks.push_back({SPARSE_CHUNK_DONT_CARE, static_cast<uint32_t>(totalBlocks - currentBlock), 0, 0}) ;
+
+        piecesList.push_back(piece) ;
+        piecesList.back().chunksList = chunks ;
+        piece.chunksList.clear() ;
+        pieceSize = 0 ;
+        pieceFirstBlock = currentBlock ;
+    } ;
+
+    for(sparseChunk chunk : chunksList)
+    {
+        while(chunk.blocksNbr > 0)
+        {
+            uint64_t chunkSize = getChunkSize(chunk) ;
+            if(pieceSize + chunkSize <= budget)
+            {
+                piece.chunksList.push_back(chunk) ;
+                pieceSize += chunkSize ;
+                currentBlock += chunk.blocksNbr ;
+                break ;
+            }
+
+            if(chunk.type == SPARSE_CHUNK_RAW)
+            {
+                uint64_t room = budget - pieceSize ;
+                uint32_t blocksFit = (room > SPARSE_CHUNK_HEADER_SZ) ? static_cast<uint32_t>((room - SPARSE_CHUNK_HEADER_SZ) / blockSize) : 0 ;
+                if(blocksFit > 0)
+                {
+                    piece.chunksList.push_back({SPARSE_CHUNK_RAW, blocksFit, chunk.fileOffset, 0}) ;
+                    currentBlock += blocksFit ;
+                    chunk.blocksNbr -= blocksFit ;
+                    chunk.fileOffset += static_cast<uint64_t>(blocksFit) * blockSize ;
+                }
+            }
+            closePiece() ;
+        }
+    }
+
+    if(piece.chunksList.empty() == false)
+        closePiece() ;
+
+    return piecesList ;
+}
+
+/**
+ * @brief SparseImage::getChunkSize : Compute the size of one chunk in the sparse image.
+ * @param chunk: The chunk.
+ * @return The chunk header and payload size.
+ */
+uint64_t SparseImage::getChunkSize(const sparseChunk &chunk) const
+{
+    if(chunk.type == SPARSE_CHUNK_RAW)
+        return SPARSE_CHUNK_HEADER_SZ + static_cast<uint64_t>(chunk.blocksNbr) * blockSize ;
+    else if(chunk.type == SPARSE_CHUNK_FILL)
+        return SPARSE_CHUNK_HEADER_SZ + sizeof(uint32_t) ;
+
+    return SPARSE_CHUNK_HEADER_SZ ;
+}
+
+/**
+ * @brief SparseImage::getSparseSize : Compute the size of the sparse image.
+ * @return The number of bytes that write() produces.
+ */
+uint64_t SparseImage::getSparseSize() const
+{
+    uint64_t size = SPARSE_HEADER_SZ ;
+    for(const auto &chunk : chunksList)
+        size += getChunkSize(chunk) ;
+
+    return size ;
+}
+
+/**
+ * @brief SparseImage::getSkippedBytes : Compute the raw image bytes that are not transferred.
+ * @return The size of the FILL and DONT_CARE blocks.
+ */
+uint64_t SparseImage::getSkippedBytes() const
+{
+    uint64_t rawBytes = 0 ;
+    for(const auto &chunk : chunksList)
+    {
+        if(chunk.type == SPARSE_CHUNK_RAW)
+            rawBytes += static_cast<uint64_t>(chunk.blocksNbr) * blockSize ;
+    }
+
+    return (rawBytes >= rawSize) ? 0 : rawSize - rawBytes ;
+}
+
+/**
+ * @brief putLittleEndian : Serialize an integer of the sparse format.
+ * @param data: Output position.
+ * @param value: The value.
+ * @param size: Number of bytes, 2 or 4.
+ */
+static void putLittleEndian(uint8_t *data, uint32_t value, size_t size)
+{
+    for(size_t i = 0; i < size; i++)
+        data[i] = static_cast<uint8_t>(value >> (8 * i)) ;
+}
+
+/**
+ * @brief SparseImage::write : Stream the sparse image, scan() must have been called.
+ * The large RAW chunks are handed to the output straight from the image source, without any copy when the file is mapped.
+ * @param output: Receives the image by pieces of at most SPARSE_IO_BUFFER_SZ bytes, returns 0 to continue.
+ * @return 0 if the operation is performed successfully, otherwise the error of the read or of the output.
+ */
+int SparseImage::write(const std::function<int(const uint8_t *data, size_t length)> &output) const
+{
+    ImageSource source(rawPath) ;
+    if(source.open() != TOOLBOX_FASTBOOT_NO_ERROR)
+        return TOOLBOX_FASTBOOT_ERROR_NO_FILE ;
+
+    std::vector<uint8_t> buffer(SPARSE_IO_BUFFER_SZ) ;
+    size_t used = 0 ;
+    auto flush = [&]()
+    {
+        int ret = (used > 0) ? output(buffer.data(), used) : TOOLBOX_FASTBOOT_NO_ERROR ;
+        used = 0 ;
+        return ret ;
+    } ;
+
+    uint64_t totalBlocks = 0 ;
+    for(const auto &chunk : chunksList)
+        totalBlocks += chunk.blocksNbr ;
+
+    uint8_t *header = buffer.data() ;
+    putLittleEndian(header, SPARSE_HEADER_MAGIC, 4) ;
+    putLittleEndian(header + 4, SPARSE_MAJOR_VERSION, 2) ;
+    putLittleEndian(header + 6, SPARSE_MINOR_VERSION, 2) ;
+    putLittleEndian(header + 8, SPARSE_HEADER_SZ, 2) ;
+    putLittleEndian(header + 10, SPARSE_CHUNK_HEADER_SZ, 2) ;
+    putLittleEndian(header + 12, blockSize, 4) ;
+    putLittleEndian(header + 16, static_cast<uint32_t>(totalBlocks), 4) ;
+    putLittleEndian(header + 20, static_cast<uint32_t>(chunksList.size()), 4) ;
+    putLittleEndian(header + 24, 0, 4) ; /* No image checksum */
+    used = SPARSE_HEADER_SZ ;
+
+    for(const auto &chunk : chunksList)
+    {
+        uint64_t payloadSize = getChunkSize(chunk) - SPARSE_CHUNK_HEADER_SZ ;
+
+        if(buffer.size() - used < SPARSE_CHUNK_HEADER_SZ + sizeof(uint32_t))
+        {
+            int ret = flush() ;
+            if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+                return ret ;
+        }
+
+        header = buffer.data() + used ;
+        putLittleEndian(header, chunk.type, 2) ;
+        putLittleEndian(header + 2, 0, 2) ;
+        putLittleEndian(header + 4, chunk.blocksNbr, 4) ;
+        putLittleEndian(header + 8, static_cast<uint32_t>(SPARSE_CHUNK_HEADER_SZ + payloadSize), 4) ;
+        used += SPARSE_CHUNK_HEADER_SZ ;
+
+        if(chunk.type == SPARSE_CHUNK_FILL)
+        {
+            putLittleEndian(buffer.data() + used, chunk.fillValue, 4) ;
+            used += sizeof(uint32_t) ;
+        }
+        else if(chunk.type == SPARSE_CHUNK_RAW)
+        {
+            uint64_t available = (chunk.fileOffset >= sourceSize) ? 0 : std::min<uint64_t>(payloadSize, sourceSize - chunk.fileOffset) ;
+            if(available >= SPARSE_DIRECT_RAW_MIN_SZ)
+            {
+                /* Handed over as the source gives it: straight from the mapping, or from its read buffer */
+                int ret = flush() ;
+                if(ret == TOOLBOX_FASTBOOT_NO_ERROR)
+                    ret = source.read(chunk.fileOffset, available, output) ;
+                if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+                    return ret ;
+            }
+            else
+            {
+                uint64_t position = chunk.fileOffset ;
+                uint64_t remaining = available ;
+                while(remaining > 0)
+                {
+                    if(used == buffer.size())
+                    {
+                        int ret = flush() ;
+                        if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+                            return ret ;
+                    }
+
+                    size_t length = static_cast<size_t>(std::min<uint64_t>(remaining, buffer.size() - used)) ;
+                    int ret = source.read(position, length, [&](const uint8_t *data, size_t dataLength)
+                    {
+                        memcpy(buffer.data() + used, data, dataLength) ;
+                        used += dataLength ;
+                        return static_cast<int>(TOOLBOX_FASTBOOT_NO_ERROR) ;
+                    }) ;
+                    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+                        return ret ;
+                    position += length ;
+                    remaining -= length ;
+                }
+            }
+
+            /* Padding of the last block, shorter than a block so it always fits once the buffer is flushed */
+            size_t padding = static_cast<size_t>(payloadSize - available) ;
+            if(buffer.size() - used < padding)
+            {
+                int ret = flush() ;
+                if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+                    return ret ;
+            }
+            memset(buffer.data() + used, 0, padding) ;
+            used += padding ;
+        }
+    }
+
+    return flush() ;
+}
+
+/**
+ * @brief SparseImage::writeFile : Save the sparse image, scan() must have been called.
+ * @param sparsePath: The output file path.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int SparseImage::writeFile(const std::string &sparsePath) const
+{
+    std::ofstream sparseFile(sparsePath, std::ios::binary | std::ios::trunc) ;
+    if(sparseFile.is_open() == false)
+        return TOOLBOX_FASTBOOT_ERROR_NO_FILE ;
+
+    int ret = write([&sparseFile](const uint8_t *data, size_t length)
+    {
+        sparseFile.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(length)) ;
+        return sparseFile.good() ? TOOLBOX_FASTBOOT_NO_ERROR : TOOLBOX_FASTBOOT_ERROR_WRITE ;
+    }) ;
+
+    sparseFile.close() ;
+    if((ret == TOOLBOX_FASTBOOT_NO_ERROR) && sparseFile.fail())
+        ret = TOOLBOX_FASTBOOT_ERROR_WRITE ;
+
+    return ret ;
+}
@@ -0,0 +1,476 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TcpTransport.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef int socklen_t ;
+#define closeSocket(fd) closesocket(fd)
+#define pollSocket(fds, count, timeout) WSAPoll(fds, count, timeout)
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#define closeSocket(fd) ::close(fd)
+#define pollSocket(fds, count, timeout) poll(fds, count, timeout)
+#endif
+
+/* Socket buffers sized for gigabit links */
+constexpr int FB_TCP_SOCKET_BUFFER_SZ = 4 * 1024 * 1024 ;
+
+TcpTransport::TcpTransport(const std::string &hostName, uint16_t port)
+{
+    this->hostName = hostName ;
+    this->port = port ;
+}
+
+TcpTransport::~TcpTransport()
+{
+    close() ;
+}
+
+/**
+ * @brief TcpTransport::parseSpec : Extract the host and port from a "tcp:host[:port]" transport option.
+ * @param transportSpec: The transport description.
+ * @param hostName: Output, the device IPv4 or IPv6 address.
+ * @param port: Output, the device port, 5554 if not specified.
+ * @return True if the spec is a valid TCP transport.
+ */
+bool TcpTransport::parseSpec(const std::string &transportSpec, std::string &hostName, uint16_t &port)
+{
+    if(transportSpec.compare(0, 4, "tcp:") != 0)
+        return false ;
+
+    std::string address = transportSpec.substr(4) ;
+    port = FB_TCP_DEFAULT_PORT ;
+
+    size_t separator = address.rfind(':') ;
+    if((separator != std::string::npos) && (address.find(':') == separator)) /* IPv6 addresses are used without port */
+    {
+        std::string portString = address.substr(separator + 1) ;
+        char *end = nullptr ;
+        unsigned long value = strtoul(portString.c_str(), &end, 10) ;
+        if(portString.empty() || (*end != '\0') || (value == 0) || (value > 0xFFFF))
+            return false ;
+
+        port = static_cast<uint16_t>(value) ;
+        address = address.substr(0, separator) ;
+    }
+
+    hostName = address ;
+    return (hostName.empty() == false) ;
+}
+
+/**
+ * @brief TcpTransport::parseAddress : Build the socket address of the device from its numeric address.
+ * Host names are not resolved: the name resolution of a static glibc binary needs the shared libraries
+ * of the glibc version it was linked with, which the flashing stations may not have.
+ * @param hostName: The IPv4 or IPv6 address, IPv6 optionally in brackets, or "localhost".
+ * @param port: The device port.
+ * @param address: Output, the socket address.
+ * @param addressLength: Output, the size of the socket address.
+ * @return True if the address is valid.
+ */
+bool TcpTransport::parseAddress(const std::string &hostName, uint16_t port, struct sockaddr_storage &address, size_t &addressLength)
+{
+    std::string numericAddress = (hostName == "localhost") ? "127.0.0.1" : hostName ;
+    if((numericAddress.size() > 2) && (numericAddress.front() == '[') && (numericAddress.back() == ']'))
+        numericAddress = numericAddress.substr(1, numericAddress.size() - 2) ;
+
+    memset(&address, 0, sizeof(address)) ;
+    struct sockaddr_in *address4 = reinterpret_cast<struct sockaddr_in*>(&address) ;
+    if(inet_pton(AF_INET, numericAddress.c_str(), &address4->sin_addr) == 1)
+    {
+        address4->sin_family = AF_INET ;
+        address4->sin_port = htons(port) ;
+        addressLength = sizeof(struct sockaddr_in) ;
+        return true ;
+    }
+
+    struct sockaddr_in6 *address6 = reinterpret_cast<struct sockaddr_in6*>(&address) ;
+    if(inet_pton(AF_INET6, numericAddress.c_str(), &address6->sin6_addr) == 1)
+    {
+        address6->sin6_family = AF_INET6 ;
+        address6->sin6_port = htons(port) ;
+        addressLength = sizeof(struct sockaddr_in6) ;
+        return true ;
+    }
+
+    return false ;
+}
+
+/**
+ * @brief TcpTransport::protectSocket : Keep a socket out of the child processes and make a write to a closed
+ * connection fail instead of raising SIGPIPE. SOCK_CLOEXEC and MSG_NOSIGNAL are not available everywhere (macOS).
+ * @param fd: The socket.
+ */
+void TcpTransport::protectSocket(intptr_t fd)
+{
+#ifdef _WIN32
+    (void)fd ;
+#else
+    fcntl(static_cast<int>(fd), F_SETFD, FD_CLOEXEC) ;
+#ifdef SO_NOSIGPIPE
+    int option = 1 ;
+    setsockopt(static_cast<int>(fd), SOL_SOCKET, SO_NOSIGPIPE, &option, sizeof(option)) ;
+#endif
+#endif
+}
+
+/**
+ * @brief TcpTransport::createSocket : Create a socket protected with protectSocket().
+ * @param family: The address family.
+ * @param type: The socket type.
+ * @param protocol: The protocol.
+ * @return The socket, -1 if it cannot be created.
+ */
+intptr_t TcpTransport::createSocket(int family, int type, int protocol)
+{
+#ifdef _WIN32
+    SOCKET fd = socket(family, type, protocol) ;
+    if(fd == INVALID_SOCKET)
+        return -1 ;
+#else
+    int fd = socket(family, type, protocol) ;
+    if(fd < 0)
+        return -1 ;
+#endif
+    protectSocket(static_cast<intptr_t>(fd)) ;
+    return static_cast<intptr_t>(fd) ;
+}
+
+/**
+ * @brief TcpTransport::sendSocket : Send bytes on a socket protected with protectSocket(), a closed connection is an error.
+ * @param fd: The connected socket.
+ * @param data: The bytes to send.
+ * @param length: Number of bytes, at most 1 GB.
+ * @return Number of bytes sent, negative on error.
+ */
+long TcpTransport::sendSocket(intptr_t fd, const uint8_t* data, size_t length)
+{
+#ifdef _WIN32
+    return send(static_cast<SOCKET>(fd), reinterpret_cast<const char*>(data), static_cast<int>(length), 0) ;
+#elif defined(MSG_NOSIGNAL)
+    return static_cast<long>(send(static_cast<int>(fd), data, length, MSG_NOSIGNAL)) ;
+#else
+    return static_cast<long>(send(static_cast<int>(fd), data, length, 0)) ;
+#endif
+}
+
+/**
+ * @brief TcpTransport::connectSocket : Connect the socket, waiting at most the transport timeout.
+ * An unreachable board would otherwise block for the whole SYN retry time of the system.
+ * @param address: The device address.
+ * @param addressLength: Size of the address.
+ * @return 0 if the operation is performed successfully, TOOLBOX_FASTBOOT_ERROR_TIMEOUT if the device did not answer in time,
+ * otherwise an error occurred.
+ */
+int TcpTransport::connectSocket(const struct sockaddr *address, size_t addressLength)
+{
+    if(timeoutMs == 0)
+        return (connect(socketFd, address, static_cast<socklen_t>(addressLength)) == 0) ? TOOLBOX_FASTBOOT_NO_ERROR : TOOLBOX_FASTBOOT_ERROR_CONNECTION ;
+
+#ifdef _WIN32
+    u_long nonBlocking = 1 ;
+    ioctlsocket(static_cast<SOCKET>(socketFd), FIONBIO, &nonBlocking) ;
+    bool pending = (connect(socketFd, address, static_cast<socklen_t>(addressLength)) != 0) ;
+    if(pending && (WSAGetLastError() != WSAEWOULDBLOCK))
+        return TOOLBOX_FASTBOOT_ERROR_CONNECTION ;
+#else
+    int flags = fcntl(static_cast<int>(socketFd), F_GETFL, 0) ;
+    fcntl(static_cast<int>(socketFd), F_SETFL, flags | O_NONBLOCK) ;
+    bool pending = (connect(static_cast<int>(socketFd), address, static_cast<socklen_t>(addressLength)) != 0) ;
+    if(pending && (errno != EINPROGRESS))
+        return TOOLBOX_FASTBOOT_ERROR_CONNECTION ;
+#endif
+
+    if(pending)
+    {
+        if(waitSocket(POLLOUT) != TOOLBOX_FASTBOOT_NO_ERROR)
+            return TOOLBOX_FASTBOOT_ERROR_TIMEOUT ;
+
+        int error = 0 ;
+        socklen_t errorLength = sizeof(error) ;
+        if((getsockopt(socketFd, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&error), &errorLength) != 0) || (error != 0))
+            return TOOLBOX_FASTBOOT_ERROR_CONNECTION ;
+    }
+
+    /* The transfers are blocking, bounded by waitSocket() */
+#ifdef _WIN32
+    nonBlocking = 0 ;
+    ioctlsocket(static_cast<SOCKET>(socketFd), FIONBIO, &nonBlocking) ;
+#else
+    fcntl(static_cast<int>(socketFd), F_SETFL, flags) ;
+#endif
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief TcpTransport::waitSocket : Wait until the socket can be read or written, at most the transport timeout.
+ * @param events: POLLIN or POLLOUT.
+ * @return 0 if the socket is ready or in error (reported by the next call), TOOLBOX_FASTBOOT_ERROR_TIMEOUT if it did not move in time.
+ */
+int TcpTransport::waitSocket(short events)
+{
+    if(timeoutMs == 0)
+        return TOOLBOX_FASTBOOT_NO_ERROR ;
+
+    struct pollfd fds ;
+    fds.fd = static_cast<decltype(fds.fd)>(socketFd) ;
+    fds.events = events ;
+    fds.revents = 0 ;
+    int ret = pollSocket(&fds, 1, static_cast<int>(timeoutMs)) ;
+#ifndef _WIN32
+    while((ret < 0) && (errno == EINTR))
+        ret = pollSocket(&fds, 1, static_cast<int>(timeoutMs)) ;
+#endif
+
+    return (ret == 0) ? TOOLBOX_FASTBOOT_ERROR_TIMEOUT : TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief TcpTransport::sendAll : Write a whole buffer to the socket.
+ * @param data: The bytes to send.
+ * @param length: Number of bytes.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int TcpTransport::sendAll(const uint8_t* data, size_t length)
+{
+    while(length > 0)
+    {
+        if(waitSocket(POLLOUT) != TOOLBOX_FASTBOOT_NO_ERROR)
+            return TOOLBOX_FASTBOOT_ERROR_TIMEOUT ;
+
+        int chunk = static_cast<int>(std::min<size_t>(length, 0x40000000)) ;
+        long sent = sendSocket(socketFd, data, static_cast<size_t>(chunk)) ;
+#ifndef _WIN32
+        if((sent < 0) && (errno == EINTR))
+            continue ;
+#endif
+        if(sent <= 0)
+            return TOOLBOX_FASTBOOT_ERROR_WRITE ;
+
+        data += sent ;
+        length -= static_cast<size_t>(sent) ;
+    }
+
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief TcpTransport::receiveAll : Read exactly the requested number of bytes from the socket.
+ * @param data: Output buffer.
+ * @param length: Number of bytes.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int TcpTransport::receiveAll(uint8_t* data, size_t length)
+{
+    while(length > 0)
+    {
+        if(waitSocket(POLLIN) != TOOLBOX_FASTBOOT_NO_ERROR)
+            return TOOLBOX_FASTBOOT_ERROR_TIMEOUT ;
+
+        int chunk = static_cast<int>(std::min<size_t>(length, 0x40000000)) ;
+#ifdef _WIN32
+        int received = recv(static_cast<SOCKET>(socketFd), reinterpret_cast<char*>(data), chunk, 0) ;
+#else
+        ssize_t received = recv(static_cast<int>(socketFd), data, chunk, 0) ;
+        if((received < 0) && (errno == EINTR))
+            continue ;
+#endif
+        if(received <= 0)
+            return TOOLBOX_FASTBOOT_ERROR_READ ;
+
+        data += received ;
+        length -= static_cast<size_t>(received) ;
+    }
+
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief TcpTransport::open : Connect to the device and perform the fastboot TCP handshake.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int TcpTransport::open()
+{
+    if(socketFd >= 0)
+        return TOOLBOX_FASTBOOT_NO_ERROR ;
+
+#ifdef _WIN32
+    /* Undone by close(), also when the connection fails */
+    if(wsaStarted == false)
+    {
+        WSADATA wsaData ;
+        if(WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+            return TOOLBOX_FASTBOOT_ERROR_INTERFACE_NOT_SUPPORTED ;
+        wsaStarted = true ;
+    }
+#endif
+
+    struct sockaddr_storage address ;
+    size_t addressLength = 0 ;
+    if(parseAddress(hostName, port, address, addressLength) == false)
+    {
+        displayManager.print(MSG_WARNING, L"Invalid device address %s, use its IPv4 or IPv6 address", hostName.c_str()) ;
+        return TOOLBOX_FASTBOOT_ERROR_NO_DEVICE ;
+    }
+
+    int ret = TOOLBOX_FASTBOOT_ERROR_CONNECTION ;
+    socketFd = createSocket(address.ss_family, SOCK_STREAM, IPPROTO_TCP) ;
+    if(socketFd >= 0)
+    {
+        ret = connectSocket(reinterpret_cast<const struct sockaddr*>(&address), addressLength) ;
+        if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        {
+            closeSocket(socketFd) ;
+            socketFd = -1 ;
+        }
+    }
+
+    if(socketFd < 0)
+    {
+        if(ret == TOOLBOX_FASTBOOT_ERROR_TIMEOUT)
+        {
+            displayManager.print(MSG_WARNING, L"No answer from %s:%u within %.1fs", hostName.c_str(), port, timeoutMs / 1000.0) ;
+            return TOOLBOX_FASTBOOT_ERROR_TIMEOUT ;
+        }
+        displayManager.print(MSG_WARNING, L"Cannot connect to %s:%u", hostName.c_str(), port) ;
+        return TOOLBOX_FASTBOOT_ERROR_NO_DEVICE ;
+    }
+
+    /* Commands are small request/response packets: do not let Nagle delay them */
+    int option = 1 ;
+    setsockopt(socketFd, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&option), sizeof(option)) ;
+    option = FB_TCP_SOCKET_BUFFER_SZ ;
+    setsockopt(socketFd, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&option), sizeof(option)) ;
+
+    char handshake[FB_TCP_HANDSHAKE_SZ + 1] ;
+    snprintf(handshake, sizeof(handshake), "FB%02d", FB_TCP_PROTOCOL_VERSION) ;
+    uint8_t answer[FB_TCP_HANDSHAKE_SZ + 1] = {0} ;
+    if((sendAll(reinterpret_cast<uint8_t*>(handshake), FB_TCP_HANDSHAKE_SZ) != TOOLBOX_FASTBOOT_NO_ERROR) ||
+       (receiveAll(answer, FB_TCP_HANDSHAKE_SZ) != TOOLBOX_FASTBOOT_NO_ERROR) ||
+       (memcmp(answer, "FB", 2) != 0) || (atoi(reinterpret_cast<char*>(answer) + 2) < FB_TCP_PROTOCOL_VERSION))
+    {
+        displayManager.print(MSG_WARNING, L"Fastboot TCP handshake failed with %s:%u", hostName.c_str(), port) ;
+        close() ;
+        return TOOLBOX_FASTBOOT_ERROR_CONNECTION ;
+    }
+
+    packetRemaining = 0 ;
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief TcpTransport::close : Disconnect from the device.
+ */
+void TcpTransport::close()
+{
+    if(socketFd >= 0)
+    {
+        closeSocket(socketFd) ;
+        socketFd = -1 ;
+    }
+
+#ifdef _WIN32
+    if(wsaStarted)
+    {
+        WSACleanup() ;
+        wsaStarted = false ;
+    }
+#endif
+}
+
+/**
+ * @brief TcpTransport::read : Read the next packet, or the rest of a packet larger than the buffer.
+ * @param data: Output buffer.
+ * @param length: Output buffer size.
+ * @param transferred: Output, number of bytes received.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int TcpTransport::read(uint8_t* data, size_t length, size_t* transferred)
+{
+    if(socketFd < 0)
+        return TOOLBOX_FASTBOOT_ERROR_NOT_CONNECTED ;
+
+    if(packetRemaining == 0)
+    {
+        uint8_t header[FB_TCP_HEADER_SZ] ;
+        int ret = receiveAll(header, FB_TCP_HEADER_SZ) ;
+        if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+            return ret ;
+
+        for(size_t i = 0; i < FB_TCP_HEADER_SZ; i++)
+            packetRemaining = (packetRemaining << 8) | header[i] ;
+    }
+
+    size_t chunk = static_cast<size_t>(std::min<uint64_t>(packetRemaining, length)) ;
+    int ret = receiveAll(data, chunk) ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        return ret ;
+
+    packetRemaining -= chunk ;
+    *transferred = chunk ;
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+/**
+ * @brief TcpTransport::write : Send a buffer as one fastboot TCP packet.
+ * @param data: The bytes to send.
+ * @param length: Number of bytes.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int TcpTransport::write(const uint8_t* data, size_t length)
+{
+    if(socketFd < 0)
+        return TOOLBOX_FASTBOOT_ERROR_NOT_CONNECTED ;
+
+    uint8_t header[FB_TCP_HEADER_SZ] ;
+    uint64_t packetLength = length ;
+    for(int i = FB_TCP_HEADER_SZ - 1; i >= 0; i--)
+    {
+        header[i] = static_cast<uint8_t>(packetLength & 0xFF) ;
+        packetLength >>= 8 ;
+    }
+
+    int ret = sendAll(header, FB_TCP_HEADER_SZ) ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        return ret ;
+
+    return sendAll(data, length) ;
+}
+
+/**
+ * @brief TcpTransport::getName : Describe the link for the console output.
+ * @return The transport description.
+ */
+std::string TcpTransport::getName()
+{
+    return "tcp:" + hostName + ":" + std::to_string(port) ;
+}
@@ -0,0 +1,168 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TraceRecorder.h"
+#include "FileManager.h"
+#include <fstream>
+#include <cstdio>
+
+/* Origin of the trace timestamps */
+static const traceTime programStart = std::chrono::steady_clock::now() ;
+
+/* Track of the operations of the current thread, "main" if not named */
+static thread_local std::string currentTrack ;
+
+TraceRecorder::TraceRecorder()
+{
+}
+
+TraceRecorder& TraceRecorder::getInstance()
+{
+    static TraceRecorder instance ;
+    return instance ;
+}
+
+/**
+ * @brief TraceRecorder::enable : Start recording the traced operations.
+ */
+void TraceRecorder::enable()
+{
+    enabled = true ;
+}
+
+/**
+ * @brief TraceRecorder::setTrack : Draw the next operations of the calling thread on a named track.
+ * @param trackName: The track, e.g. a device serial number, empty for "main".
+ */
+void TraceRecorder::setTrack(const std::string &trackName)
+{
+    currentTrack = trackName ;
+}
+
+/**
+ * @brief TraceRecorder::getTrack : Get the track of the calling thread.
+ * @return The track name, empty for "main".
+ */
+std::string TraceRecorder::getTrack()
+{
+    return currentTrack ;
+}
+
+/**
+ * @brief TraceRecorder::addEvent : Record a completed operation on the track of the calling thread.
+ * @param name: The operation, as displayed on its slice.
+ * @param category: The layer of the operation.
+ * @param start: The operation start.
+ * @param end: The operation end.
+ */
+void TraceRecorder::addEvent(const std::string &name, const char *category, traceTime start, traceTime end)
+{
+    if(enabled == false)
+        return ;
+
+    traceEvent event ;
+    event.name = name ;
+    event.category = category ;
+    event.startUs = std::chrono::duration_cast<std::chrono::microseconds>(start - programStart).count() ;
+    event.durationUs = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() ;
+
+    std::lock_guard<std::mutex> lock(eventsMutex) ;
+    event.trackId = getTrackId(currentTrack.empty() ? "main" : currentTrack) ;
+    eventsList.push_back(event) ;
+}
+
+/**
+ * @brief TraceRecorder::getTrackId : Get the thread identifier of a track in the trace, events mutex held.
+ * @param trackName: The track name.
+ * @return The identifier, tracks are numbered in their order of appearance.
+ */
+uint32_t TraceRecorder::getTrackId(const std::string &trackName)
+{
+    auto track = tracksList.find(trackName) ;
+    if(track != tracksList.end())
+        return track->second ;
+
+    uint32_t trackId = static_cast<uint32_t>(tracksList.size()) + 1 ;
+    tracksList[trackName] = trackId ;
+    return trackId ;
+}
+
+/**
+ * @brief TraceRecorder::write : Write the recorded operations as a Chrome trace JSON file.
+ * @param tracePath: The trace file path.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int TraceRecorder::write(const std::string &tracePath)
+{
+    std::lock_guard<std::mutex> lock(eventsMutex) ;
+
+    std::ofstream traceFile(tracePath, std::ios::trunc) ;
+    traceFile << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" ;
+    traceFile << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"PRG-TOOLBOX-FB\"}}" ;
+    for(const auto &track : tracksList)
+    {
+        traceFile << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << track.second << ",\"args\":{\"name\":\"" << FileManager::escapeJson(track.first) << "\"}}" ;
+        traceFile << ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":" << track.second << ",\"args\":{\"sort_index\":" << track.second << "}}" ;
+    }
+    for(const auto &event : eventsList)
+    {
+        traceFile << ",\n{\"name\":\"" << FileManager::escapeJson(event.name) << "\",\"cat\":\"" << event.category << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.trackId
+                  << ",\"ts\":" << event.startUs << ",\"dur\":" << event.durationUs << "}" ;
+    }
+    traceFile << "\n]}\n" ;
+    traceFile.close() ;
+
+    if(traceFile.fail())
+    {
+        DisplayManager::getInstance().print(MSG_ERROR, L"Cannot write the trace file %s", tracePath.c_str()) ;
+        return TOOLBOX_FASTBOOT_ERROR_WRITE ;
+    }
+
+    DisplayManager::getInstance().print(MSG_NORMAL, L"Trace written : %s (%lu events, %lu tracks)", tracePath.c_str(), eventsList.size(), tracksList.size()) ;
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+}
+
+TraceScope::TraceScope(const std::string &name, const char *category)
+{
+    this->category = category ;
+    active = TraceRecorder::getInstance().isEnabled() ;
+    if(active == false)
+        return ;
+
+    this->name = name ;
+    start = std::chrono::steady_clock::now() ;
+}
+
+TraceScope::~TraceScope()
+{
+    if(active)
+        TraceRecorder::getInstance().addEvent(name, category, start, std::chrono::steady_clock::now()) ;
+}
+
+TraceFile::TraceFile(const std::string &tracePath)
+{
+    this->tracePath = tracePath ;
+    if(tracePath.empty() == false)
+        TraceRecorder::getInstance().enable() ;
+}
+
+TraceFile::~TraceFile()
+{
+    if(tracePath.empty() == false)
+        TraceRecorder::getInstance().write(tracePath) ;
+}
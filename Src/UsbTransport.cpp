@@ -0,0 +1,352 @@
+/*
+ * Copyright 2024 STMicroelectronics
+ *
+ * Based on fastboot v34.0.5
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "UsbTransport.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+#ifdef __linux__
+#include <fstream>
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/usbdevice_fs.h>
+
+static const char *SYSFS_USB_DEVICES = "/sys/bus/usb/devices/" ;
+
+/**
+ * @brief readSysfsAttribute : Read a sysfs attribute file without its trailing new line.
+ * @param path: The attribute path.
+ * @return The attribute value, empty if it cannot be read.
+ */
+static std::string readSysfsAttribute(const std::string &path)
+{
+    std::ifstream attribute(path);
+    std::string value = "" ;
+    if(attribute.is_open())
+        std::getline(attribute, value) ;
+    return value ;
+}
+
+/**
+ * @brief readSysfsHex : Read a sysfs attribute written in hexadecimal.
+ * @param path: The attribute path.
+ * @return The attribute value, -1 if it cannot be read.
+ */
+static long readSysfsHex(const std::string &path)
+{
+    std::string value = readSysfsAttribute(path) ;
+    if(value.empty())
+        return -1 ;
+    return strtol(value.c_str(), nullptr, 16) ;
+}
+
+/**
+ * @brief findFastbootInterface : Search the fastboot interface and its bulk endpoints in a USB device.
+ * @param deviceName: The sysfs device name, e.g. "1-2".
+ * @param device: Output, filled with the interface and endpoints.
+ * @return True if the device exposes a fastboot interface.
+ */
+static bool findFastbootInterface(const std::string &deviceName, usbFastbootDevice &device)
+{
+    DIR *usbDir = opendir(SYSFS_USB_DEVICES) ;
+    if(usbDir == nullptr)
+        return false ;
+
+    bool found = false ;
+    struct dirent *entry ;
+    while((found == false) && ((entry = readdir(usbDir)) != nullptr))
+    {
+        std::string interfaceName = entry->d_name ;
+        if(interfaceName.compare(0, deviceName.size() + 1, deviceName + ":") != 0)
+            continue ;
+
+        std::string interfacePath = SYSFS_USB_DEVICES + interfaceName + "/" ;
+        if((readSysfsHex(interfacePath + "bInterfaceClass") != FB_USB_CLASS) ||
+           (readSysfsHex(interfacePath + "bInterfaceSubClass") != FB_USB_SUBCLASS) ||
+           (readSysfsHex(interfacePath + "bInterfaceProtocol") != FB_USB_PROTOCOL))
+            continue ;
+
+        device.interfaceNumber = static_cast<uint8_t>(readSysfsHex(interfacePath + "bInterfaceNumber")) ;
+        device.endpointIn = 0 ;
+        device.endpointOut = 0 ;
+
+        DIR *interfaceDir = opendir(interfacePath.c_str()) ;
+        if(interfaceDir == nullptr)
+            continue ;
+
+        struct dirent *endpoint ;
+        while((endpoint = readdir(interfaceDir)) != nullptr)
+        {
+            std::string endpointPath = interfacePath + endpoint->d_name + "/" ;
+            if((strncmp(endpoint->d_name, "ep_", 3) != 0) || (readSysfsAttribute(endpointPath + "type") != "Bulk"))
+                continue ;
+
+            uint8_t address = static_cast<uint8_t>(readSysfsHex(endpointPath + "bEndpointAddress")) ;
+            if(address & 0x80)
+                device.endpointIn = address ;
+            else
+                device.endpointOut = address ;
+        }
+        closedir(interfaceDir) ;
+
+        found = (device.endpointIn != 0) && (device.endpointOut != 0) ;
+    }
+
+    closedir(usbDir) ;
+    return found ;
+}
+#endif
+
+UsbTransport::UsbTransport(const std::string &serialNumber)
+{
+    this->serialNumber = serialNumber ;
+}
+
+UsbTransport::~UsbTransport()
+{
+    close() ;
+}
+
+/**
+ * @brief UsbTransport::isSupported : Check if the native USB transport is available on this platform.
+ * @return True on Linux, otherwise the bundled fastboot tool must be used.
+ */
+bool UsbTransport::isSupported()
+{
+#ifdef __linux__
+    return true ;
+#else
+    return false ;
+#endif
+}
+
+/**
+ * @brief UsbTransport::listDevices : Enumerate the USB devices exposing a fastboot interface.
+ * @param devicesList: Output, the fastboot devices found.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int UsbTransport::listDevices(std::vector<usbFastbootDevice> &devicesList)
+{
+    devicesList.clear() ;
+#ifdef __linux__
+    DIR *usbDir = opendir(SYSFS_USB_DEVICES) ;
+    if(usbDir == nullptr)
+        return TOOLBOX_FASTBOOT_ERROR_INTERFACE_NOT_SUPPORTED ;
+
+    struct dirent *entry ;
+    while((entry = readdir(usbDir)) != nullptr)
+    {
+        std::string deviceName = entry->d_name ;
+        if((deviceName[0] == '.') || (deviceName.find(':') != std::string::npos))
+            continue ; /* Keep devices only, interfaces are named <device>:<config>.<interface> */
+
+        std::string devicePath = SYSFS_USB_DEVICES + deviceName + "/" ;
+        std::string busNumber = readSysfsAttribute(devicePath + "busnum") ;
+        std::string deviceNumber = readSysfsAttribute(devicePath + "devnum") ;
+        if(busNumber.empty() || deviceNumber.empty())
+            continue ;
+
+        usbFastbootDevice device ;
+        if(findFastbootInterface(deviceName, device) == false)
+            continue ;
+
+        char nodePath[64] ;
+        snprintf(nodePath, sizeof(nodePath), "/dev/bus/usb/%03d/%03d", atoi(busNumber.c_str()), atoi(deviceNumber.c_str())) ;
+        device.devicePath = nodePath ;
+        device.serialNumber = readSysfsAttribute(devicePath + "serial") ;
+        std::transform(device.serialNumber.begin(), device.serialNumber.end(), device.serialNumber.begin(), ::toupper);
+        devicesList.push_back(device) ;
+    }
+
+    closedir(usbDir) ;
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+#else
+    return TOOLBOX_FASTBOOT_ERROR_INTERFACE_NOT_SUPPORTED ;
+#endif
+}
+
+/**
+ * @brief UsbTransport::open : Find the fastboot device (by serial number if any) and claim its interface.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int UsbTransport::open()
+{
+#ifdef __linux__
+    if(deviceFd >= 0)
+        return TOOLBOX_FASTBOOT_NO_ERROR ;
+
+    std::vector<usbFastbootDevice> devicesList ;
+    int ret = listDevices(devicesList) ;
+    if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+        return ret ;
+
+    auto it = devicesList.begin() ;
+    if(serialNumber != "")
+    {
+        for( ; it != devicesList.end(); it++)
+        {
+            if(it->serialNumber == serialNumber)
+                break ;
+        }
+    }
+
+    if(it == devicesList.end())
+        return TOOLBOX_FASTBOOT_ERROR_NO_DEVICE ;
+
+    if((serialNumber == "") && (devicesList.size() > 1))
+        displayManager.print(MSG_WARNING, L"Several Fastboot devices found, using [%s]", it->serialNumber.c_str()) ;
+
+    device = *it ;
+    deviceFd = ::open(device.devicePath.c_str(), O_RDWR | O_CLOEXEC) ;
+    if(deviceFd < 0)
+    {
+        displayManager.print(MSG_WARNING, L"Cannot open %s : %s", device.devicePath.c_str(), strerror(errno)) ;
+        return TOOLBOX_FASTBOOT_ERROR_CONNECTION ;
+    }
+
+    unsigned int interfaceNumber = device.interfaceNumber ;
+    if(ioctl(deviceFd, USBDEVFS_CLAIMINTERFACE, &interfaceNumber) != 0)
+    {
+        displayManager.print(MSG_WARNING, L"Cannot claim the fastboot interface of %s : %s", device.devicePath.c_str(), strerror(errno)) ;
+        ::close(deviceFd) ;
+        deviceFd = -1 ;
+        return TOOLBOX_FASTBOOT_ERROR_CONNECTION ;
+    }
+
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+#else
+    return TOOLBOX_FASTBOOT_ERROR_INTERFACE_NOT_SUPPORTED ;
+#endif
+}
+
+/**
+ * @brief UsbTransport::close : Release the fastboot interface, the device stays in fastboot mode.
+ */
+void UsbTransport::close()
+{
+#ifdef __linux__
+    if(deviceFd < 0)
+        return ;
+
+    unsigned int interfaceNumber = device.interfaceNumber ;
+    ioctl(deviceFd, USBDEVFS_RELEASEINTERFACE, &interfaceNumber) ;
+    ::close(deviceFd) ;
+    deviceFd = -1 ;
+#endif
+}
+
+/**
+ * @brief UsbTransport::read : Read one response packet from the bulk IN endpoint.
+ * @param data: Output buffer.
+ * @param length: Output buffer size.
+ * @param transferred: Output, number of bytes received.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int UsbTransport::read(uint8_t* data, size_t length, size_t* transferred)
+{
+#ifdef __linux__
+    if(deviceFd < 0)
+        return TOOLBOX_FASTBOOT_ERROR_NOT_CONNECTED ;
+
+    struct usbdevfs_bulktransfer bulk ;
+    bulk.ep = device.endpointIn ;
+    bulk.len = static_cast<unsigned int>(std::min(length, MAX_USBFS_BULK_READ_SIZE)) ;
+    bulk.timeout = timeoutMs ;
+    bulk.data = data ;
+
+    int ret ;
+    do
+    {
+        ret = ioctl(deviceFd, USBDEVFS_BULK, &bulk) ;
+    } while((ret < 0) && (errno == EINTR)) ;
+
+    if((ret < 0) && (errno == ETIMEDOUT))
+        return TOOLBOX_FASTBOOT_ERROR_TIMEOUT ;
+    if(ret < 0)
+        return TOOLBOX_FASTBOOT_ERROR_READ ;
+
+    *transferred = static_cast<size_t>(ret) ;
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+#else
+    (void)data ;
+    (void)length ;
+    (void)transferred ;
+    return TOOLBOX_FASTBOOT_ERROR_INTERFACE_NOT_SUPPORTED ;
+#endif
+}
+
+/**
+ * @brief UsbTransport::write : Write a buffer to the bulk OUT endpoint.
+ * @param data: The bytes to send.
+ * @param length: Number of bytes.
+ * @return 0 if the operation is performed successfully, otherwise an error occurred.
+ */
+int UsbTransport::write(const uint8_t* data, size_t length)
+{
+#ifdef __linux__
+    if(deviceFd < 0)
+        return TOOLBOX_FASTBOOT_ERROR_NOT_CONNECTED ;
+
+    size_t offset = 0 ;
+    while(offset < length)
+    {
+        struct usbdevfs_bulktransfer bulk ;
+        bulk.ep = device.endpointOut ;
+        bulk.len = static_cast<unsigned int>(std::min(length - offset, writeChunkSize)) ;
+        bulk.timeout = timeoutMs ;
+        bulk.data = const_cast<uint8_t*>(data + offset) ;
+
+        int ret = ioctl(deviceFd, USBDEVFS_BULK, &bulk) ;
+        if((ret < 0) && (errno == ENOMEM) && (writeChunkSize > MAX_USBFS_BULK_READ_SIZE))
+        {
+            /* Older kernels limit usbfs transfers to 16KB */
+            writeChunkSize = MAX_USBFS_BULK_READ_SIZE ;
+            continue ;
+        }
+        if((ret < 0) && (errno == EINTR))
+            continue ;
+        if((ret < 0) && (errno == ETIMEDOUT))
+            return TOOLBOX_FASTBOOT_ERROR_TIMEOUT ;
+        if(ret < 0)
+            return TOOLBOX_FASTBOOT_ERROR_WRITE ;
+
+        offset += static_cast<size_t>(ret) ;
+    }
+
+    return TOOLBOX_FASTBOOT_NO_ERROR ;
+#else
+    (void)data ;
+    (void)length ;
+    return TOOLBOX_FASTBOOT_ERROR_INTERFACE_NOT_SUPPORTED ;
+#endif
+}
+
+/**
+ * @brief UsbTransport::getName : Describe the link for the console output.
+ * @return The transport description.
+ */
+std::string UsbTransport::getName()
+{
+    if(device.serialNumber != "")
+        return "usb:" + device.serialNumber ;
+    return TRANSPORT_USB ;
+}
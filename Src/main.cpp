@@ -18,6 +18,7 @@
 
 #include "main.h"
 #include "ProgramManager.h"
+#include "FastbootEmulator.h"
 #include <experimental/filesystem>
 namespace fs = std::experimental::filesystem;
 
@@ -26,7 +27,16 @@ std::string toolboxRootPath = "" ;
 
 int main(int argc, char* argv[])
 {
+    traceTime argumentsStart = std::chrono::steady_clock::now() ;
     std::string fastbootSerialNumber = "";
+    std::vector<std::string> fastbootSerialNumbers ;
+    std::string transportSpec = "";
+    bool stationMode = false ;
+    bool dryRun = false ;
+    std::string tracePath = "";
+    uint32_t stationBoardsNbr = 0 ;
+    flashingOptions options ;
+    options.toolboxVersion = PRG_TOOLBOX_FASTBOOT_VERSION ;
 
     displayManager.print(MSG_NORMAL, L"      -------------------------------------------------------------------") ;
     displayManager.print(MSG_NORMAL, L"                      PRG-TOOLBOX-FB v%s                      ", PRG_TOOLBOX_FASTBOOT_VERSION.c_str()) ;
@@ -55,22 +65,224 @@ int main(int argc, char* argv[])
     {
         if(compareStrings(argumentsList[cmdIdx].cmd , "-sn", true) || compareStrings(argumentsList[cmdIdx].cmd , "--serial", true))
         {
-            if((argumentsList[cmdIdx].nParams != 1))
+            if((argumentsList[cmdIdx].nParams < 1))
             {
                 displayManager.print(MSG_ERROR, L"Wrong parameters for -sn/--serial command") ;
                 showHelp();
                 return EXIT_FAILURE;
             }
 
-            fastbootSerialNumber = argumentsList[cmdIdx].Params[0];
-            std::transform(fastbootSerialNumber.begin(), fastbootSerialNumber.end(), fastbootSerialNumber.begin(), ::toupper);
-            displayManager.print(MSG_NORMAL, L"Selected device serial number : %s", fastbootSerialNumber.data()) ;
+            /* Several devices can be given as separate parameters or as a comma separated list */
+            for(uint8_t paramIdx = 0; paramIdx < argumentsList[cmdIdx].nParams; paramIdx++)
+            {
+                std::string serialList = argumentsList[cmdIdx].Params[paramIdx] + "," ;
+                size_t begin = 0, end = 0 ;
+                while((end = serialList.find(',', begin)) != std::string::npos)
+                {
+                    std::string serialNumber = serialList.substr(begin, end - begin) ;
+                    std::transform(serialNumber.begin(), serialNumber.end(), serialNumber.begin(), ::toupper);
+                    if(serialNumber.empty() == false)
+                        fastbootSerialNumbers.push_back(serialNumber) ;
+                    begin = end + 1 ;
+                }
+            }
+
+            if(fastbootSerialNumbers.empty() || ((fastbootSerialNumbers.size() > 1) &&
+               (std::find(fastbootSerialNumbers.begin(), fastbootSerialNumbers.end(), GANG_ALL_DEVICES) != fastbootSerialNumbers.end())))
+            {
+                displayManager.print(MSG_ERROR, L"Wrong parameters for -sn/--serial command") ;
+                showHelp();
+                return EXIT_FAILURE;
+            }
+
+            if((fastbootSerialNumbers.size() == 1) && (fastbootSerialNumbers[0] != GANG_ALL_DEVICES))
+            {
+                fastbootSerialNumber = fastbootSerialNumbers[0];
+                displayManager.print(MSG_NORMAL, L"Selected device serial number : %s", fastbootSerialNumber.data()) ;
+            }
+            else
+            {
+                displayManager.print(MSG_NORMAL, L"Selected devices : %s", (fastbootSerialNumbers[0] == GANG_ALL_DEVICES) ? "all" : std::to_string(fastbootSerialNumbers.size()).c_str()) ;
+            }
+        }
+        else if(compareStrings(argumentsList[cmdIdx].cmd , "-t", true) || compareStrings(argumentsList[cmdIdx].cmd , "--transport", true))
+        {
+            if((argumentsList[cmdIdx].nParams != 1) || (FastbootTransport::isValidSpec(argumentsList[cmdIdx].Params[0]) == false))
+            {
+                displayManager.print(MSG_ERROR, L"Wrong parameters for -t/--transport command") ;
+                showHelp();
+                return EXIT_FAILURE;
+            }
+
+            transportSpec = argumentsList[cmdIdx].Params[0];
+            displayManager.print(MSG_NORMAL, L"Selected transport : %s", transportSpec.data()) ;
+        }
+        else if(compareStrings(argumentsList[cmdIdx].cmd , "--station", true))
+        {
+            char *end = nullptr ;
+            if(argumentsList[cmdIdx].nParams == 1)
+                stationBoardsNbr = static_cast<uint32_t>(strtoul(argumentsList[cmdIdx].Params[0].c_str(), &end, 10)) ;
+
+            if((argumentsList[cmdIdx].nParams > 1) || ((end != nullptr) && (*end != '\0')))
+            {
+                displayManager.print(MSG_ERROR, L"Wrong parameters for --station command") ;
+                showHelp();
+                return EXIT_FAILURE;
+            }
+
+            stationMode = true ;
+        }
+        else if(compareStrings(argumentsList[cmdIdx].cmd , "--sparse", true))
+        {
+            if((argumentsList[cmdIdx].nParams > 1) || ((argumentsList[cmdIdx].nParams == 1) && (compareStrings(argumentsList[cmdIdx].Params[0], "skip-zero", true) == false)))
+            {
+                displayManager.print(MSG_ERROR, L"Wrong parameters for --sparse command") ;
+                showHelp();
+                return EXIT_FAILURE;
+            }
+
+            options.sparse = (argumentsList[cmdIdx].nParams == 1) ? SPARSE_SKIP_ZERO : SPARSE_FILL ;
+        }
+        else if(compareStrings(argumentsList[cmdIdx].cmd , "--incremental", true))
+        {
+            if(argumentsList[cmdIdx].nParams > 1)
+            {
+                displayManager.print(MSG_ERROR, L"Wrong parameters for --incremental command") ;
+                showHelp();
+                return EXIT_FAILURE;
+            }
+
+            options.incremental = true ;
+            options.manifestPath = (argumentsList[cmdIdx].nParams == 1) ? argumentsList[cmdIdx].Params[0] : "" ;
+        }
+        else if(compareStrings(argumentsList[cmdIdx].cmd , "--force-format", true))
+        {
+            options.forceFormat = true ;
+        }
+        else if(compareStrings(argumentsList[cmdIdx].cmd , "--timeout", true))
+        {
+            if((argumentsList[cmdIdx].nParams != 1) || (FastbootProtocol::parseTimeouts(argumentsList[cmdIdx].Params[0], options.timeouts) == false))
+            {
+                displayManager.print(MSG_ERROR, L"Wrong parameters for --timeout command") ;
+                showHelp();
+                return EXIT_FAILURE;
+            }
+        }
+        else if(compareStrings(argumentsList[cmdIdx].cmd , "--log-level", true))
+        {
+            std::string level = (argumentsList[cmdIdx].nParams == 1) ? argumentsList[cmdIdx].Params[0] : "" ;
+            if(compareStrings(level, "info", true))
+                DisplayManager::setLevel(MSG_NORMAL) ;
+            else if(compareStrings(level, "warning", true))
+                DisplayManager::setLevel(MSG_WARNING) ;
+            else if(compareStrings(level, "error", true))
+                DisplayManager::setLevel(MSG_ERROR) ;
+            else
+            {
+                displayManager.print(MSG_ERROR, L"Wrong parameters for --log-level command") ;
+                showHelp();
+                return EXIT_FAILURE;
+            }
+        }
+        else if(compareStrings(argumentsList[cmdIdx].cmd , "--log-json", true))
+        {
+            if(argumentsList[cmdIdx].nParams != 1)
+            {
+                displayManager.print(MSG_ERROR, L"Wrong parameters for --log-json command") ;
+                showHelp();
+                return EXIT_FAILURE;
+            }
+
+            if(DisplayManager::setJsonLog(argumentsList[cmdIdx].Params[0]) != TOOLBOX_FASTBOOT_NO_ERROR)
+            {
+                displayManager.print(MSG_ERROR, L"Unable to open the JSON log file %s", argumentsList[cmdIdx].Params[0].data()) ;
+                return EXIT_FAILURE;
+            }
+        }
+        else if(compareStrings(argumentsList[cmdIdx].cmd , "--resume", true))
+        {
+            if(argumentsList[cmdIdx].nParams > 1)
+            {
+                displayManager.print(MSG_ERROR, L"Wrong parameters for --resume command") ;
+                showHelp();
+                return EXIT_FAILURE;
+            }
+
+            options.resume = true ;
+            options.journalFolder = (argumentsList[cmdIdx].nParams == 1) ? argumentsList[cmdIdx].Params[0] : "" ;
+        }
+        else if(compareStrings(argumentsList[cmdIdx].cmd , "--pipeline-memory", true))
+        {
+            char *end = nullptr ;
+            unsigned long memoryMB = 0 ;
+            if(argumentsList[cmdIdx].nParams == 1)
+                memoryMB = strtoul(argumentsList[cmdIdx].Params[0].c_str(), &end, 10) ;
+
+            if((argumentsList[cmdIdx].nParams != 1) || (*end != '\0') || (memoryMB > 0xFFFFFFFFul))
+            {
+                displayManager.print(MSG_ERROR, L"Wrong parameters for --pipeline-memory command") ;
+                showHelp();
+                return EXIT_FAILURE;
+            }
+
+            options.pipelineMemoryMB = static_cast<uint32_t>(memoryMB) ;
+        }
+        else if(compareStrings(argumentsList[cmdIdx].cmd , "--report", true))
+        {
+            if(argumentsList[cmdIdx].nParams != 1)
+            {
+                displayManager.print(MSG_ERROR, L"Wrong parameters for --report command") ;
+                showHelp();
+                return EXIT_FAILURE;
+            }
+
+            options.reportPath = argumentsList[cmdIdx].Params[0] ;
+        }
+        else if(compareStrings(argumentsList[cmdIdx].cmd , "--metrics", true))
+        {
+            if(argumentsList[cmdIdx].nParams != 1)
+            {
+                displayManager.print(MSG_ERROR, L"Wrong parameters for --metrics command") ;
+                showHelp();
+                return EXIT_FAILURE;
+            }
+
+            options.metricsPath = argumentsList[cmdIdx].Params[0] ;
+        }
+        else if(compareStrings(argumentsList[cmdIdx].cmd , "--dry-run", true))
+        {
+            if(argumentsList[cmdIdx].nParams > 1)
+            {
+                displayManager.print(MSG_ERROR, L"Wrong parameters for --dry-run command") ;
+                showHelp();
+                return EXIT_FAILURE;
+            }
+
+            dryRun = true ;
+            options.costModelPath = (argumentsList[cmdIdx].nParams == 1) ? argumentsList[cmdIdx].Params[0] : "" ;
+        }
+        else if(compareStrings(argumentsList[cmdIdx].cmd , "--trace", true))
+        {
+            if(argumentsList[cmdIdx].nParams != 1)
+            {
+                displayManager.print(MSG_ERROR, L"Wrong parameters for --trace command") ;
+                showHelp();
+                return EXIT_FAILURE;
+            }
+
+            tracePath = argumentsList[cmdIdx].Params[0] ;
         }
     }
 
+    /* The trace is written whichever way the program returns */
+    TraceFile traceFile(tracePath) ;
+    TraceRecorder::getInstance().addEvent("Argument parsing", "main", argumentsStart, std::chrono::steady_clock::now()) ;
+
     /* Search and execute commands */
     for (int cmdIdx=0; cmdIdx < nCommands; cmdIdx++)
     {
+        TraceScope commandTrace("Command " + argumentsList[cmdIdx].cmd, "main") ;
+
         if (compareStrings(argumentsList[cmdIdx].cmd , "-?", true) || compareStrings(argumentsList[cmdIdx].cmd , "-h", true) || compareStrings(argumentsList[cmdIdx].cmd , "--help", true))
         {
             showHelp();
@@ -83,17 +295,227 @@ int main(int argc, char* argv[])
         {
             Fastboot *fastbootInterface = new Fastboot() ;
             fastbootInterface->toolboxFolder = toolboxRootPath ;
+            fastbootInterface->transportSpec = transportSpec ;
             int ret = fastbootInterface->displayDevicesList();
 
             delete fastbootInterface;
             if(ret)
                 return EXIT_FAILURE;
         }
-        else if(compareStrings(argumentsList[cmdIdx].cmd , "-sn", true) || compareStrings(argumentsList[cmdIdx].cmd , "--serial", true))
+        else if(compareStrings(argumentsList[cmdIdx].cmd , "-sn", true) || compareStrings(argumentsList[cmdIdx].cmd , "--serial", true) ||
+                compareStrings(argumentsList[cmdIdx].cmd , "-t", true) || compareStrings(argumentsList[cmdIdx].cmd , "--transport", true) ||
+                compareStrings(argumentsList[cmdIdx].cmd , "--station", true) || compareStrings(argumentsList[cmdIdx].cmd , "--sparse", true) ||
+                compareStrings(argumentsList[cmdIdx].cmd , "--incremental", true) || compareStrings(argumentsList[cmdIdx].cmd , "--pipeline-memory", true) ||
+                compareStrings(argumentsList[cmdIdx].cmd , "--dry-run", true) || compareStrings(argumentsList[cmdIdx].cmd , "--report", true) ||
+                compareStrings(argumentsList[cmdIdx].cmd , "--trace", true) || compareStrings(argumentsList[cmdIdx].cmd , "--metrics", true) ||
+                compareStrings(argumentsList[cmdIdx].cmd , "--resume", true) || compareStrings(argumentsList[cmdIdx].cmd , "--force-format", true) ||
+                compareStrings(argumentsList[cmdIdx].cmd , "--log-level", true) || compareStrings(argumentsList[cmdIdx].cmd , "--log-json", true) ||
+                compareStrings(argumentsList[cmdIdx].cmd , "--timeout", true))
         {
             /* It has already been treated previously */
             continue ;
         }
+        else if(compareStrings(argumentsList[cmdIdx].cmd , "-e", true) || compareStrings(argumentsList[cmdIdx].cmd , "--emulate", true))
+        {
+            if((argumentsList[cmdIdx].nParams < 1) || (argumentsList[cmdIdx].nParams > 3))
+            {
+                displayManager.print(MSG_ERROR, L"Wrong parameters for -e/--emulate command") ;
+                showHelp();
+                return EXIT_FAILURE;
+            }
+
+            unsigned long port = strtoul(argumentsList[cmdIdx].Params[0].c_str(), nullptr, 10) ;
+            unsigned long sessionsNbr = (argumentsList[cmdIdx].nParams > 2) ? strtoul(argumentsList[cmdIdx].Params[2].c_str(), nullptr, 10) : 0 ;
+            if((port == 0) || (port > 0xFFFF))
+            {
+                displayManager.print(MSG_ERROR, L"Emulate command : wrong TCP port %s", argumentsList[cmdIdx].Params[0].c_str()) ;
+                return EXIT_FAILURE;
+            }
+
+            FastbootEmulator emulator ;
+            if((argumentsList[cmdIdx].nParams > 1) && (emulator.loadConfig(argumentsList[cmdIdx].Params[1]) != TOOLBOX_FASTBOOT_NO_ERROR))
+                return EXIT_FAILURE;
+
+            if(emulator.serveTcp(static_cast<uint16_t>(port), static_cast<uint32_t>(sessionsNbr)))
+                return EXIT_FAILURE;
+        }
+        else if(compareStrings(argumentsList[cmdIdx].cmd , "--sparse-bench", true))
+        {
+            if(argumentsList[cmdIdx].nParams != 1)
+            {
+                displayManager.print(MSG_ERROR, L"Wrong parameters for --sparse-bench command") ;
+                showHelp();
+                return EXIT_FAILURE;
+            }
+
+            /* First pass to load the image in the file cache, the scanners are then compared on memory throughput */
+            SparseImage image(argumentsList[cmdIdx].Params[0]) ;
+            if(image.scan(SPARSE_FILL) != TOOLBOX_FASTBOOT_NO_ERROR)
+            {
+                displayManager.print(MSG_ERROR, L"Cannot read the image %s", argumentsList[cmdIdx].Params[0].c_str()) ;
+                return EXIT_FAILURE;
+            }
+
+            displayManager.print(MSG_GREEN, L"Sparse conversion benchmark : %s (%llu KB)", argumentsList[cmdIdx].Params[0].c_str(), static_cast<unsigned long long>(image.getRawSize() / 1024)) ;
+            for(const auto &scannerInfo : SparseImage::getAvailableScanners())
+            {
+                image.scan(SPARSE_FILL, scannerInfo.scanner) ;
+                double speed = (image.getScanSeconds() > 0) ? image.getRawSize() / (image.getScanSeconds() * 1024 * 1024) : 0 ;
+                displayManager.print(MSG_NORMAL, L"  %-8s scan : %9.1f MB/s", scannerInfo.name.c_str(), speed) ;
+            }
+
+            for(sparseMode mode : {SPARSE_FILL, SPARSE_SKIP_ZERO})
+            {
+                image.scan(mode) ;
+                displayManager.print(MSG_NORMAL, L"  %-9s : %llu KB sent, %llu KB skipped (%.1f %%), %lu chunks", (mode == SPARSE_FILL) ? "fill" : "skip-zero",
+                                     static_cast<unsigned long long>(image.getSparseSize() / 1024), static_cast<unsigned long long>(image.getSkippedBytes() / 1024),
+                                     (image.getRawSize() > 0) ? 100.0 * image.getSkippedBytes() / image.getRawSize() : 0.0, image.getChunks().size()) ;
+            }
+        }
+        else if(compareStrings(argumentsList[cmdIdx].cmd , "--hash", true))
+        {
+            if(argumentsList[cmdIdx].nParams != 1)
+            {
+                displayManager.print(MSG_ERROR, L"Wrong parameters for --hash command") ;
+                showHelp();
+                return EXIT_FAILURE;
+            }
+
+            ProgramManager programManager(toolboxRootPath) ;
+            if(programManager.generateIntegrityManifest(argumentsList[cmdIdx].Params[0]))
+                return EXIT_FAILURE;
+        }
+        else if(compareStrings(argumentsList[cmdIdx].cmd , "--plan", true))
+        {
+            if(argumentsList[cmdIdx].nParams != 1)
+            {
+                displayManager.print(MSG_ERROR, L"Wrong parameters for --plan command") ;
+                showHelp();
+                return EXIT_FAILURE;
+            }
+
+            ProgramManager programManager(toolboxRootPath) ;
+            if(programManager.printFlashPlan(argumentsList[cmdIdx].Params[0]))
+                return EXIT_FAILURE;
+        }
+        else if(compareStrings(argumentsList[cmdIdx].cmd , "--hash-bench", true))
+        {
+            char *end = nullptr ;
+            unsigned long sizeMB = HASH_BENCH_DEFAULT_SIZE_MB ;
+            if(argumentsList[cmdIdx].nParams == 1)
+                sizeMB = strtoul(argumentsList[cmdIdx].Params[0].c_str(), &end, 10) ;
+
+            if((argumentsList[cmdIdx].nParams > 1) || ((end != nullptr) && (*end != '\0')) || (sizeMB == 0))
+            {
+                displayManager.print(MSG_ERROR, L"Wrong parameters for --hash-bench command") ;
+                showHelp();
+                return EXIT_FAILURE;
+            }
+
+            /* Pseudo-random data in memory: the engines are compared on CPU throughput, not on disk reads */
+            std::vector<uint8_t> buffer(sizeMB * 1024 * 1024) ;
+            uint32_t seed = 0x12345678 ;
+            for(auto &byte : buffer)
+            {
+                seed = seed * 1103515245 + 12345 ;
+                byte = static_cast<uint8_t>(seed >> 16) ;
+            }
+
+            displayManager.print(MSG_GREEN, L"Hash benchmark : %lu MB in memory, %u CPU cores", sizeMB, std::thread::hardware_concurrency()) ;
+            auto printSpeed = [&](const char *algorithm, const std::string &engine, std::chrono::steady_clock::time_point start, const std::string &result)
+            {
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() ;
+                displayManager.print(MSG_NORMAL, L"  %-7s %-7s : %9.1f MB/s  %s", algorithm, engine.c_str(), (seconds > 0) ? sizeMB / seconds : 0.0, result.c_str()) ;
+            } ;
+
+            for(const auto &engine : ImageHash::getSha256Engines())
+            {
+                auto start = std::chrono::steady_clock::now() ;
+                Sha256 hash(engine.process) ;
+                hash.update(buffer.data(), buffer.size()) ;
+                printSpeed("SHA-256", engine.name, start, hash.finish()) ;
+            }
+            for(const auto &engine : ImageHash::getCrc32cEngines())
+            {
+                auto start = std::chrono::steady_clock::now() ;
+                char crcText[16] ;
+                snprintf(crcText, sizeof(crcText), "%08x", engine.update(0, buffer.data(), buffer.size())) ;
+                printSpeed("CRC32C", engine.name, start, crcText) ;
+            }
+            for(const auto &engine : ImageHash::getCrc32Engines())
+            {
+                auto start = std::chrono::steady_clock::now() ;
+                char crcText[16] ;
+                snprintf(crcText, sizeof(crcText), "%08x", engine.update(0, buffer.data(), buffer.size())) ;
+                printSpeed("CRC32", engine.name, start, crcText) ;
+            }
+        }
+        else if(compareStrings(argumentsList[cmdIdx].cmd , "--tsv-bench", true))
+        {
+            char *end = nullptr ;
+            unsigned long linesNbr = TSV_BENCH_DEFAULT_LINES ;
+            if(argumentsList[cmdIdx].nParams == 1)
+                linesNbr = strtoul(argumentsList[cmdIdx].Params[0].c_str(), &end, 10) ;
+
+            if((argumentsList[cmdIdx].nParams > 1) || ((end != nullptr) && (*end != '\0')) || (linesNbr == 0))
+            {
+                displayManager.print(MSG_ERROR, L"Wrong parameters for --tsv-bench command") ;
+                showHelp();
+                return EXIT_FAILURE;
+            }
+
+            /* Generated layout: one line in 8 erases a partition, the others share a few small binaries */
+            fs::path benchFolder ;
+            std::string tsvPath ;
+            try
+            {
+                benchFolder = fs::temp_directory_path() / ("prg-toolbox-fb-tsv-bench-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count())) ;
+                fs::create_directories(benchFolder) ;
+                for(unsigned long i = 0; i < TSV_BENCH_BINARIES_NBR; i++)
+                    std::ofstream((benchFolder / ("image" + std::to_string(i) + ".bin")).string(), std::ios::binary) << std::string(4096, static_cast<char>(i)) ;
+
+                tsvPath = (benchFolder / "layout.tsv").string() ;
+                std::ofstream tsvFile(tsvPath) ;
+                tsvFile << "#Opt\tId\tName\tType\tIP\tOffset\tBinary\n" ;
+                for(unsigned long i = 0; i < linesNbr; i++)
+                {
+                    char line[128] ;
+                    if(i % 8 == 7)
+                        snprintf(line, sizeof(line), "PED\t0x%02lx\tpart%lu\tBinary\tmmc1\t0x%08lx\tnone\n", i % 256, i, i * 0x1000) ;
+                    else
+                        snprintf(line, sizeof(line), "P\t0x%02lx\tpart%lu\tFileSystem\tmmc1\t0x%08lx\timage%lu.bin\n", i % 256, i, i * 0x1000, i % TSV_BENCH_BINARIES_NBR) ;
+                    tsvFile << line ;
+                }
+            }
+            catch(...)
+            {
+                displayManager.print(MSG_ERROR, L"Cannot generate the benchmark layout") ;
+                return EXIT_FAILURE;
+            }
+
+            /* Best of 3 runs, the first one also loads the files in the system cache */
+            double bestSeconds = 0 ;
+            int ret = TOOLBOX_FASTBOOT_NO_ERROR ;
+            for(int run = 0; (run < 3) && (ret == TOOLBOX_FASTBOOT_NO_ERROR); run++)
+            {
+                fileTSV *parsedTsvFile = nullptr ;
+                auto start = std::chrono::steady_clock::now() ;
+                ret = FileManager::getInstance().openTsvFile(tsvPath, &parsedTsvFile) ;
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() ;
+                if((run == 0) || (seconds < bestSeconds))
+                    bestSeconds = seconds ;
+                delete parsedTsvFile ;
+            }
+
+            uint64_t tsvSize = fs::file_size(tsvPath) ;
+            fs::remove_all(benchFolder) ;
+            if(ret != TOOLBOX_FASTBOOT_NO_ERROR)
+                return EXIT_FAILURE;
+
+            displayManager.print(MSG_GREEN, L"TSV parsing benchmark : %lu lines, %llu KB, %lu binaries", linesNbr, static_cast<unsigned long long>(tsvSize / 1024), TSV_BENCH_BINARIES_NBR) ;
+            displayManager.print(MSG_NORMAL, L"  Parse and check : %9.3f ms, %9.0f lines/s, %7.1f MB/s", bestSeconds * 1000, (bestSeconds > 0) ? linesNbr / bestSeconds : 0.0,
+                                 (bestSeconds > 0) ? tsvSize / (bestSeconds * 1024 * 1024) : 0.0) ;
+        }
         else if(compareStrings(argumentsList[cmdIdx].cmd , "-d", true) || compareStrings(argumentsList[cmdIdx].cmd , "--download", true))
         {
             if(argumentsList[cmdIdx].nParams > 1 )
@@ -110,8 +532,17 @@ int main(int argc, char* argv[])
                 return EXIT_FAILURE;
             }
 
-            ProgramManager *programMng = new ProgramManager(toolboxRootPath, fastbootSerialNumber);
-            int ret = programMng->startFlashingService(std::move(tsvFilePath) );
+            ProgramManager *programMng = new ProgramManager(toolboxRootPath, fastbootSerialNumber, transportSpec);
+            programMng->options = options ;
+            int ret = TOOLBOX_FASTBOOT_NO_ERROR ;
+            if(dryRun)
+                ret = programMng->estimateFlashingService(std::move(tsvFilePath)) ;
+            else if(stationMode)
+                ret = programMng->startStationService(std::move(tsvFilePath), stationBoardsNbr);
+            else if(fastbootSerialNumber.empty() && (fastbootSerialNumbers.empty() == false))
+                ret = programMng->startGangFlashingService(std::move(tsvFilePath), fastbootSerialNumbers);
+            else
+                ret = programMng->startFlashingService(std::move(tsvFilePath) );
             delete programMng;
 
             if(ret)
@@ -239,8 +670,54 @@ void showHelp()
     displayManager.print(MSG_NORMAL, L"--version          -v       : Display the program version.") ;
     displayManager.print(MSG_NORMAL, L"--list             -l       : Display the list of available Fastboot devices.") ;
     displayManager.print(MSG_NORMAL, L"--serial           -sn      : Select the USB device by serial number.") ;
+    displayManager.print(MSG_NORMAL, L"       <serialNumber>       : One device") ;
+    displayManager.print(MSG_NORMAL, L"       <sn1,sn2,...|all>    : Several devices, or all the connected ones, flashed in parallel") ;
+    displayManager.print(MSG_NORMAL, L"--transport        -t       : Select the link to the device (default: native USB when available, else the fastboot tool).") ;
+    displayManager.print(MSG_NORMAL, L"       <usb|exec>           : native USB or bundled fastboot tool") ;
+    displayManager.print(MSG_NORMAL, L"       <loopback[:config]>  : in-process emulated device, optional emulator configuration file") ;
+    displayManager.print(MSG_NORMAL, L"       <tcp:address[:port]> : fastboot over TCP, IPv4 or IPv6 address (default port 5554)") ;
     displayManager.print(MSG_NORMAL, L"--download         -d       : Prepare the device, flash/update the memory partitions over fastboot mode.") ;
     displayManager.print(MSG_NORMAL, L"       <filePath.tsv>       : TSV file path") ;
+    displayManager.print(MSG_NORMAL, L"--station                   : With -d, keep running and flash every Fastboot device as soon as it is plugged.") ;
+    displayManager.print(MSG_NORMAL, L"       [boardsNbr]          : Number of boards to flash before exiting, default: run until interrupted") ;
+    displayManager.print(MSG_NORMAL, L"--sparse                    : Send raw images as Android sparse images, uniform blocks are not transferred.") ;
+    displayManager.print(MSG_NORMAL, L"       [skip-zero]          : Do not write the zero blocks at all (their previous content is kept)") ;
+    displayManager.print(MSG_NORMAL, L"--incremental               : With -d, skip the partitions whose image is unchanged since their last successful flash.") ;
+    displayManager.print(MSG_NORMAL, L"       [manifestPath]       : Flash manifest file, default: ~/" TOOLBOX_DATA_FOLDER "/" FLASH_MANIFEST_DEFAULT_FILE) ;
+    displayManager.print(MSG_NORMAL, L"--force-format              : With -d, run \"oem format\" even if the device partitions already match the TSV layout.") ;
+    displayManager.print(MSG_NORMAL, L"--resume                    : With -d, journal the completed steps of each device and continue an interrupted flashing") ;
+    displayManager.print(MSG_NORMAL, L"                              from its first unfinished step, without formatting again if the layout is unchanged.") ;
+    displayManager.print(MSG_NORMAL, L"       [journalFolder]      : Folder of the per-device journals, default: ~/" TOOLBOX_DATA_FOLDER "/" FLASH_JOURNAL_DEFAULT_FOLDER) ;
+    displayManager.print(MSG_NORMAL, L"--timeout                   : With -d, stop waiting for a device silent for longer than its command may take.") ;
+    displayManager.print(MSG_NORMAL, L"       <name=seconds,...>   : command (5), transfer (10), flash (10), flash-per-mb (0.5), erase (60), format (30), 0 to wait forever") ;
+    displayManager.print(MSG_NORMAL, L"--report                    : With -d, append the size, transfer and write time of every step to a report file.") ;
+    displayManager.print(MSG_NORMAL, L"       <reportFile>         : JSON Lines file if it ends with " REPORT_JSON_EXTENSION ", CSV file otherwise") ;
+    displayManager.print(MSG_NORMAL, L"--metrics                   : With -d, add the boards, failures, bytes and durations to Prometheus metrics after every board.") ;
+    displayManager.print(MSG_NORMAL, L"       <metricsFile.prom>   : Text file of the node exporter textfile collector, updated in place (also in --station mode)") ;
+    displayManager.print(MSG_NORMAL, L"--trace                     : Record the timeline of the run, one track per device and per preparation thread.") ;
+    displayManager.print(MSG_NORMAL, L"       <traceFile.json>     : Chrome trace event file, opened with Perfetto or chrome://tracing") ;
+    displayManager.print(MSG_NORMAL, L"--log-level                 : Hide the console messages less severe than a level.") ;
+    displayManager.print(MSG_NORMAL, L"       <info|warning|error> : Default: info, every message is printed") ;
+    displayManager.print(MSG_NORMAL, L"--log-json                  : Also append every message to a log file, with its time, level and device.") ;
+    displayManager.print(MSG_NORMAL, L"       <logFile.jsonl>      : JSON Lines file, written whatever the --log-level") ;
+    displayManager.print(MSG_NORMAL, L"--dry-run                   : With -d, predict the duration of each partition and of the whole flashing, nothing is sent.") ;
+    displayManager.print(MSG_NORMAL, L"       [costModelFile]      : Link and memory figures, default: measured by the last flashing in ~/" TOOLBOX_DATA_FOLDER "/" COST_MODEL_DEFAULT_FILE) ;
+    displayManager.print(MSG_NORMAL, L"--pipeline-memory           : Memory used to read the next images while the current one is transferred, per device.") ;
+    displayManager.print(MSG_NORMAL, L"       <sizeMB>             : Default: 256, 0 to only prepare the sparse conversion ahead and read the images during the transfer") ;
+    displayManager.print(MSG_NORMAL, L"--plan                      : Display the device commands compiled from a TSV file, without flashing.") ;
+    displayManager.print(MSG_NORMAL, L"       <filePath.tsv>       : TSV file path") ;
+    displayManager.print(MSG_NORMAL, L"--hash                      : Hash the images of a TSV file and write its integrity manifest (<filePath.tsv>" INTEGRITY_MANIFEST_EXTENSION ").") ;
+    displayManager.print(MSG_NORMAL, L"       <filePath.tsv>       : TSV file path, -d then checks the images against the manifest before flashing") ;
+    displayManager.print(MSG_NORMAL, L"--hash-bench                : Measure the throughput of every available SHA-256, CRC32C and CRC32 implementation.") ;
+    displayManager.print(MSG_NORMAL, L"       [sizeMB]             : Size of the hashed buffer, default: 256") ;
+    displayManager.print(MSG_NORMAL, L"--tsv-bench                 : Measure the parsing of a generated TSV layout, binaries check included.") ;
+    displayManager.print(MSG_NORMAL, L"       [linesNbr]           : Number of partition lines, default: 100000") ;
+    displayManager.print(MSG_NORMAL, L"--sparse-bench              : Measure the sparse conversion of an image with every available block scanner.") ;
+    displayManager.print(MSG_NORMAL, L"       <imagePath>          : Raw image path") ;
+    displayManager.print(MSG_NORMAL, L"--emulate          -e       : Run an emulated fastboot device reachable with -t tcp:host:port.") ;
+    displayManager.print(MSG_NORMAL, L"       <port>               : TCP port to listen on") ;
+    displayManager.print(MSG_NORMAL, L"       [configFile]         : Emulator configuration file (partitions, variables, speeds)") ;
+    displayManager.print(MSG_NORMAL, L"       [sessionsNbr]        : Number of host sessions to serve, default: unlimited") ;
 
     displayManager.print(MSG_NORMAL, L"") ;
 }